@@ -0,0 +1,307 @@
+﻿#include "BenchScene.h"
+
+#include <array>
+#include <fstream>
+#include <random>
+
+#include <glm/gtc/constants.hpp>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/graphics/BindingLayout.h>
+#include <PaperEngine/graphics/BindlessMaterialTable.h>
+#include <PaperEngine/components/MeshComponent.h>
+#include <PaperEngine/components/MeshRendererComponent.h>
+#include <PaperEngine/components/TransformComponent.h>
+#include <PaperEngine/components/LightComponent.h>
+
+namespace PaperBench {
+
+	namespace {
+
+		std::vector<uint8_t> ReadFile(const std::string& filepath)
+		{
+			std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+			if (!file.is_open()) {
+				PE_CORE_ERROR("[PaperBench] Failed to open {}", filepath);
+				return {};
+			}
+
+			const size_t fileSize = file.tellg();
+			std::vector<uint8_t> data(fileSize);
+			file.seekg(0, std::ios::beg);
+			file.read(reinterpret_cast<char*>(data.data()), fileSize);
+			return data;
+		}
+
+		nvrhi::ShaderHandle LoadShader(const std::string& filepath, const char* entryName, nvrhi::ShaderType type)
+		{
+			auto data = ReadFile(filepath);
+			if (data.empty())
+				return nullptr;
+
+			nvrhi::ShaderDesc shaderDesc;
+			shaderDesc.debugName = filepath;
+			shaderDesc.entryName = entryName;
+			shaderDesc.shaderType = type;
+			return PaperEngine::Application::GetNVRHIDevice()->createShader(shaderDesc, data.data(), data.size());
+		}
+
+		/// <summary>
+		/// 跟Sandbox一樣的test shader (set 2: texture0, sampler0)
+		/// bindless的話用assets/shaders/bindless，set 2, 3為BindlessMaterialTable的layout
+		/// </summary>
+		PaperEngine::Ref<PaperEngine::GraphicsPipeline> CreateBenchPipeline(bool bindless)
+		{
+			auto device = PaperEngine::Application::GetNVRHIDevice();
+
+			// BindlessMaterialTable需要descriptor indexing，不支援的話退回test shader
+			if (bindless && !PaperEngine::Application::Get()->getGraphicsContext()->supportsBindless()) {
+				PE_CORE_ERROR("[PaperBench] The device does not support bindless descriptors, falling back to the test shader.");
+				bindless = false;
+			}
+
+			nvrhi::GraphicsPipelineDesc graphicsPipelineDesc;
+			graphicsPipelineDesc.setPrimType(nvrhi::PrimitiveType::TriangleList);
+			graphicsPipelineDesc.renderState.rasterState.cullMode = nvrhi::RasterCullMode::Back;
+
+			graphicsPipelineDesc.bindingLayouts.resize(bindless ? 4 : 3);
+			graphicsPipelineDesc.bindingLayouts[0] = PaperEngine::Application::GetResourceManager()
+				->load<PaperEngine::BindingLayout>("SceneRenderer_globalLayout")->handle;
+			graphicsPipelineDesc.bindingLayouts[1] = PaperEngine::Application::GetResourceManager()
+				->load<PaperEngine::BindingLayout>("MeshRenderer_instanceBufLayout")->handle;
+
+			const std::string shaderDirectory = bindless ? "assets/shaders/bindless/" : "assets/shaders/test/";
+			graphicsPipelineDesc.VS = LoadShader(shaderDirectory + "shader.vert.spv", "main_vs", nvrhi::ShaderType::Vertex);
+			graphicsPipelineDesc.PS = LoadShader(shaderDirectory + "shader.frag.spv", "main_ps", nvrhi::ShaderType::Pixel);
+
+			nvrhi::VertexAttributeDesc attributes[] = {
+				nvrhi::VertexAttributeDesc()
+				.setName("POSITION")
+				.setFormat(nvrhi::Format::RGB32_FLOAT)
+				.setOffset(offsetof(PaperEngine::StaticVertex, position))
+				.setBufferIndex(0)
+				.setElementStride(sizeof(PaperEngine::StaticVertex)),
+				nvrhi::VertexAttributeDesc()
+				.setName("NORMAL")
+				.setFormat(nvrhi::Format::RGB32_FLOAT)
+				.setOffset(offsetof(PaperEngine::StaticVertex, normal))
+				.setBufferIndex(0)
+				.setElementStride(sizeof(PaperEngine::StaticVertex)),
+				nvrhi::VertexAttributeDesc()
+				.setName("TEXCOORD0")
+				.setFormat(nvrhi::Format::RG32_FLOAT)
+				.setOffset(offsetof(PaperEngine::StaticVertex, texcoord))
+				.setBufferIndex(0)
+				.setElementStride(sizeof(PaperEngine::StaticVertex))
+			};
+
+			graphicsPipelineDesc.inputLayout = device->createInputLayout(
+				attributes,
+				uint32_t(std::size(attributes)),
+				graphicsPipelineDesc.VS);
+
+			if (bindless) {
+				auto bindlessTable = PaperEngine::BindlessMaterialTable::Get();
+				graphicsPipelineDesc.bindingLayouts[2] = bindlessTable->getParameterLayout();
+				graphicsPipelineDesc.bindingLayouts[3] = bindlessTable->getBindlessLayout();
+
+				// MaterialParams: texture0 (uint)、sampler0 (uint)
+				return PaperEngine::CreateRef<PaperEngine::GraphicsPipeline>(graphicsPipelineDesc, nullptr, sizeof(uint32_t) * 2, true);
+			}
+
+			nvrhi::BindingLayoutDesc bindingLayoutDesc;
+			bindingLayoutDesc
+				.setRegisterSpace(2)			// set = 2
+				.setRegisterSpaceIsDescriptorSet(true)
+				.setVisibility(nvrhi::ShaderType::All)
+				.addItem(nvrhi::BindingLayoutItem::Texture_SRV(0))
+				.addItem(nvrhi::BindingLayoutItem::Sampler(0));
+			nvrhi::BindingLayoutHandle bindingLayout = device->createBindingLayout(bindingLayoutDesc);
+			graphicsPipelineDesc.bindingLayouts[2] = bindingLayout;
+
+			return PaperEngine::CreateRef<PaperEngine::GraphicsPipeline>(graphicsPipelineDesc, bindingLayout, 0);
+		}
+
+		/// <summary>
+		/// 中心在原點的box，每個面4個vertex
+		/// </summary>
+		void GenerateBox(const glm::vec3& halfExtent, std::vector<PaperEngine::StaticVertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			const std::array<glm::vec3, 6> normals = {
+				glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0),
+				glm::vec3(0, 1, 0), glm::vec3(0, -1, 0),
+				glm::vec3(0, 0, 1), glm::vec3(0, 0, -1),
+			};
+
+			for (const auto& normal : normals) {
+				// 面上的兩個軸
+				const glm::vec3 up = std::abs(normal.y) > 0.5f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+				const glm::vec3 right = glm::cross(up, normal);
+
+				const uint32_t base = static_cast<uint32_t>(vertices.size());
+				const glm::vec2 corners[4] = { {-1, -1}, {1, -1}, {1, 1}, {-1, 1} };
+				for (const auto& corner : corners) {
+					const glm::vec3 position = (normal + right * corner.x + up * corner.y) * halfExtent;
+					vertices.push_back({ position, normal, corner * 0.5f + 0.5f });
+				}
+
+				indices.insert(indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+			}
+		}
+
+	}
+
+	const std::vector<ScenePreset>& GetScenePresets()
+	{
+		static const std::vector<ScenePreset> presets = {
+			{ "small",		1000,	4,	4,		256,	1 },
+			{ "default",	20000,	16,	32,		4096,	1 },
+			{ "heavy",		100000,	64,	128,	10000,	1 },
+			{ "lights",		5000,	4,	4,		10000,	1, 500.0f },
+			{ "bindless",	20000,	16,	1024,	4096,	1, 1000.0f, true },
+			{ "shadows",	5000,	16,	32,		1024,	1, 500.0f, true, true },
+		};
+		return presets;
+	}
+
+	const ScenePreset* FindScenePreset(const std::string& name)
+	{
+		for (const auto& preset : GetScenePresets()) {
+			if (preset.name == name)
+				return &preset;
+		}
+		return nullptr;
+	}
+
+	PaperEngine::Ref<BenchScene> BuildBenchScene(const ScenePreset& preset)
+	{
+		auto device = PaperEngine::Application::GetNVRHIDevice();
+		auto result = PaperEngine::CreateRef<BenchScene>();
+
+		// 固定seed，每次都產生一樣的場景
+		std::mt19937 gen(preset.seed);
+		std::uniform_real_distribution<float> positionDist(-preset.worldExtent, preset.worldExtent);
+		std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+		std::uniform_real_distribution<float> extentDist(1.0f, 10.0f);
+
+		result->scene = PaperEngine::CreateRef<PaperEngine::Scene>();
+		result->graphicsPipeline = CreateBenchPipeline(preset.bindless);
+
+		auto cmd = device->createCommandList();
+		cmd->open();
+
+#pragma region Meshes
+		for (uint32_t i = 0; i < preset.meshCount; i++) {
+			std::vector<PaperEngine::StaticVertex> vertices;
+			std::vector<uint32_t> indices;
+			GenerateBox(glm::vec3(extentDist(gen), extentDist(gen), extentDist(gen)), vertices, indices);
+
+			auto mesh = PaperEngine::CreateRef<PaperEngine::Mesh>();
+			mesh->loadStaticMesh(cmd, vertices);
+			mesh->loadIndexBuffer(cmd, indices.data(), indices.size());
+			mesh->getSubMeshes().push_back({ 0, static_cast<uint32_t>(indices.size()), 0 });
+			result->meshes.push_back(mesh);
+		}
+#pragma endregion
+
+#pragma region Materials
+		result->sampler = device->createSampler(nvrhi::SamplerDesc());
+		for (uint32_t i = 0; i < preset.materialCount; i++) {
+			constexpr uint32_t TextureSize = 4;
+
+			nvrhi::TextureDesc textureDesc;
+			textureDesc
+				.setWidth(TextureSize)
+				.setHeight(TextureSize)
+				.setFormat(nvrhi::Format::RGBA8_UNORM)
+				.setDebugName("PaperBench_materialTexture")
+				.setInitialState(nvrhi::ResourceStates::ShaderResource)
+				.setKeepInitialState(true);
+			auto texture = device->createTexture(textureDesc);
+
+			const uint32_t color =
+				(static_cast<uint32_t>(unitDist(gen) * 255.0f)) |
+				(static_cast<uint32_t>(unitDist(gen) * 255.0f) << 8) |
+				(static_cast<uint32_t>(unitDist(gen) * 255.0f) << 16) |
+				0xFF000000u;
+			std::vector<uint32_t> pixels(TextureSize * TextureSize, color);
+			cmd->writeTexture(texture, 0, 0, pixels.data(), TextureSize * sizeof(uint32_t));
+
+			auto material = PaperEngine::CreateRef<PaperEngine::Material>(result->graphicsPipeline);
+			if (result->graphicsPipeline->isBindless()) {
+				// bindless shader從material參數讀index，位置跟shader.hlsl的MaterialParams一樣
+				material->setOffset("texture0", 0);
+				material->setOffset("sampler0", sizeof(uint32_t));
+			}
+			material->setSampler("sampler0", result->sampler);
+			material->setTexture("texture0", texture);
+			material->update();
+
+			result->textures.push_back(texture);
+			result->materials.push_back(material);
+		}
+#pragma endregion
+
+		cmd->close();
+		device->executeCommandList(cmd);
+
+#pragma region Entities
+		for (uint32_t i = 0; i < preset.entityCount; i++) {
+			auto entity = result->scene->createEntity("Bench Entity");
+			const auto& mesh = result->meshes[i % result->meshes.size()];
+
+			auto& meshCom = entity.addComponent<PaperEngine::MeshComponent>();
+			meshCom.mesh = mesh;
+
+			auto& meshRendererCom = entity.addComponent<PaperEngine::MeshRendererComponent>();
+			meshRendererCom.materials.resize(1);
+			meshRendererCom.materials[0] = result->materials[(i / static_cast<uint32_t>(result->meshes.size())) % result->materials.size()];
+
+			auto& transCom = entity.getComponent<PaperEngine::TransformComponent>();
+			transCom.transform.setPosition(glm::vec3(positionDist(gen), positionDist(gen), positionDist(gen)));
+
+			// uniform random rotation
+			const float u1 = unitDist(gen);
+			const float u2 = unitDist(gen);
+			const float u3 = unitDist(gen);
+			const float theta1 = 2.0f * glm::pi<float>() * u2;
+			const float theta2 = 2.0f * glm::pi<float>() * u3;
+			transCom.transform.setRotation(glm::quat(
+				std::sqrt(1.0f - u1) * std::sin(theta1),
+				std::sqrt(1.0f - u1) * std::cos(theta1),
+				std::sqrt(u1) * std::sin(theta2),
+				std::sqrt(u1) * std::cos(theta2)));
+
+			meshCom.worldAABB = mesh->getAABB().transformed(transCom.transform);
+		}
+#pragma endregion
+
+#pragma region Lights
+		for (uint32_t i = 0; i < preset.pointLightCount; i++) {
+			auto lightEntity = result->scene->createEntity("Bench PointLight");
+			auto& transCom = lightEntity.getComponent<PaperEngine::TransformComponent>();
+			transCom.transform.setPosition(glm::vec3(positionDist(gen), positionDist(gen), positionDist(gen)));
+
+			auto& lightCom = lightEntity.addComponent<PaperEngine::LightComponent>();
+			lightCom.type = PaperEngine::LightType::Point;
+			lightCom.castShadow = preset.shadows;
+			lightCom.light.pointLight.color = glm::vec3(unitDist(gen), unitDist(gen), unitDist(gen)) * 2.0f;
+			lightCom.light.pointLight.radius = 10.0f + unitDist(gen) * 90.0f;
+		}
+
+		auto dirLightEntity = result->scene->createEntity("Bench DirectionalLight");
+		auto& dirLightCom = dirLightEntity.addComponent<PaperEngine::LightComponent>();
+		dirLightCom.type = PaperEngine::LightType::Directional;
+		dirLightCom.castShadow = preset.shadows;
+		dirLightCom.light.directionalLight.direction = glm::vec3(0, -1, 0);
+		dirLightCom.light.directionalLight.color = glm::vec3(0.2f);
+#pragma endregion
+
+		PE_CORE_INFO("[PaperBench] Scene '{}' built: {} entities, {} meshes, {} {}materials, {} point lights{} (seed {})",
+			preset.name, preset.entityCount, preset.meshCount, preset.materialCount, preset.bindless ? "bindless " : "", preset.pointLightCount,
+			preset.shadows ? ", shadows" : "", preset.seed);
+
+		return result;
+	}
+
+}
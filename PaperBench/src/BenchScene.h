@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/scene/Scene.h>
+#include <PaperEngine/graphics/GraphicsPipeline.h>
+#include <PaperEngine/graphics/Material.h>
+#include <PaperEngine/graphics/Mesh.h>
+
+namespace PaperBench {
+
+	/// <summary>
+	/// benchmark場景的參數
+	/// 同一個preset + seed每次產生的場景都一樣
+	/// </summary>
+	struct ScenePreset {
+		std::string name;
+		uint32_t entityCount = 0;		// mesh entity數量
+		uint32_t meshCount = 0;			// 不同的mesh
+		uint32_t materialCount = 0;		// 不同的material
+		uint32_t pointLightCount = 0;
+		uint32_t seed = 0;
+
+		/// <summary>
+		/// entity跟light分布的範圍 (-worldExtent ~ worldExtent)
+		/// </summary>
+		float worldExtent = 1000.0f;
+
+		/// <summary>
+		/// material使用assets/shaders/bindless (BindlessMaterialTable)
+		/// 所有material的draw共用同一個binding set，走MDI的bindless路徑
+		/// </summary>
+		bool bindless = false;
+
+		/// <summary>
+		/// directional light產生cascaded shadow，point light使用shadow atlas
+		/// 只有會取樣shadow map的shader (bindless) 才會畫shadow pass
+		/// </summary>
+		bool shadows = false;
+	};
+
+	/// <summary>
+	/// 內建的preset: small, default, heavy, lights, bindless, shadows
+	/// </summary>
+	const std::vector<ScenePreset>& GetScenePresets();
+
+	/// <summary>
+	/// 找不到回傳nullptr
+	/// </summary>
+	const ScenePreset* FindScenePreset(const std::string& name);
+
+	/// <summary>
+	/// 依照preset建立的場景跟它用到的GPU資源
+	/// </summary>
+	struct BenchScene {
+		PaperEngine::Ref<PaperEngine::Scene> scene;
+		PaperEngine::Ref<PaperEngine::GraphicsPipeline> graphicsPipeline;
+		std::vector<PaperEngine::Ref<PaperEngine::Mesh>> meshes;
+		std::vector<PaperEngine::Ref<PaperEngine::Material>> materials;
+		std::vector<nvrhi::TextureHandle> textures;
+		nvrhi::SamplerHandle sampler;
+	};
+
+	/// <summary>
+	/// 建立場景，mesh是程式產生的box，不需要讀model
+	/// shader使用assets/shaders/test，bindless的preset使用assets/shaders/bindless
+	/// </summary>
+	PaperEngine::Ref<BenchScene> BuildBenchScene(const ScenePreset& preset);
+
+}
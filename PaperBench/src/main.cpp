@@ -0,0 +1,283 @@
+﻿
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <PaperEngine/PaperEngine.h>
+#include <PaperEngine/graphics/SceneRenderer.h>
+#include <PaperEngine/graphics/SceneSnapshot.h>
+#include <PaperEngine/core/SnapshotBuffer.h>
+#include <PaperEngine/events/ApplicationEvent.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+#include "BenchScene.h"
+
+/// <summary>
+/// PaperBench的命令列參數
+/// </summary>
+struct BenchOptions {
+	std::string preset = "default";
+	uint32_t frames = 200;				// 記錄的frame數
+	uint32_t warmupFrames = 30;			// 不記錄的frame數 (pipeline/cache建立)
+	int64_t seed = -1;					// < 0使用preset的seed
+	std::string output = "PaperBench.json";
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	bool windowed = false;
+	bool threaded = false;				// update跟render在不同thread
+	uint32_t framesAhead = 1;
+	uint32_t recordLists = 0;			// mesh平行錄製的command list上限，0為worker數 + 1
+	uint32_t framesInFlight = 3;
+	PaperEngine::PresentMode presentMode = PaperEngine::PresentMode::Mailbox;	// --windowed時才有用
+	std::string capture;				// 最後一個記錄的frame存成PPM，空的話不存
+	std::string gpu;					// GPU名稱包含這個字串的優先 (例如 llvmpipe)
+};
+
+/// <summary>
+/// 只支援8 bit RGBA/BGRA，alpha會被丟掉
+/// </summary>
+static bool WritePPM(const std::string& filepath, const PaperEngine::FrameReadback& readback)
+{
+	const bool rgba = readback.format == nvrhi::Format::RGBA8_UNORM || readback.format == nvrhi::Format::SRGBA8_UNORM;
+	const bool bgra = readback.format == nvrhi::Format::BGRA8_UNORM || readback.format == nvrhi::Format::SBGRA8_UNORM;
+	if (!rgba && !bgra) {
+		PE_CORE_ERROR("[PaperBench] Capture format {} is not supported.", static_cast<uint32_t>(readback.format));
+		return false;
+	}
+
+	std::ofstream out(filepath, std::ios::binary);
+	if (!out.is_open())
+		return false;
+
+	out << "P6\n" << readback.width << " " << readback.height << "\n255\n";
+	std::vector<uint8_t> row(static_cast<size_t>(readback.width) * 3);
+	for (uint32_t y = 0; y < readback.height; y++) {
+		const uint8_t* src = readback.pixels.data() + static_cast<size_t>(y) * readback.width * 4;
+		for (uint32_t x = 0; x < readback.width; x++) {
+			row[x * 3 + 0] = src[x * 4 + (rgba ? 0 : 2)];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + (rgba ? 2 : 0)];
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+	return static_cast<bool>(out);
+}
+
+class BenchLayer : public PaperEngine::Layer {
+public:
+	BenchLayer(const BenchOptions& options, const PaperBench::ScenePreset& preset)
+		: Layer(), m_options(options), m_preset(preset)
+	{
+	}
+
+	void onAttach() override {
+		camera.setWidth(static_cast<float>(m_options.width));
+		camera.setHeight(static_cast<float>(m_options.height));
+		camera.setFarPlane(m_preset.worldExtent * 2.0f);
+
+		m_sceneRenderer = PaperEngine::CreateRef<PaperEngine::SceneRenderer>();
+		m_sceneRenderer->getMeshRenderer()->setMaxRecordCommandLists(m_options.recordLists);
+		m_benchScene = PaperBench::BuildBenchScene(m_preset);
+
+		PE_CORE_INFO("[PaperBench] Warmup {} frames, record {} frames.", m_options.warmupFrames, m_options.frames);
+	}
+
+	void onDetach() override {
+		m_benchScene = nullptr;
+		m_sceneRenderer = nullptr;
+	}
+
+	void onEvent(PaperEngine::Event& e) override {
+		PaperEngine::EventDispatcher dispatcher(e);
+		dispatcher.dispatch<PaperEngine::WindowCloseEvent>([](PaperEngine::WindowCloseEvent& e) {
+			PaperEngine::Application::Shutdown();
+			return false;
+			});
+	}
+
+	void onUpdate(PaperEngine::Timestep dt) override {
+		// warmup結束，之後的frame才算進結果
+		if (m_frameIndex == m_options.warmupFrames)
+			PaperEngine::FrameStats::Get().reset();
+
+		if (m_frameIndex == m_options.warmupFrames + m_options.frames) {
+			writeResult();
+			PaperEngine::Application::Shutdown();
+		}
+
+		// camera以frame index轉動，不依賴dt，每次跑的畫面都一樣
+		const float yaw = static_cast<float>(m_frameIndex) * 360.0f / static_cast<float>(m_options.warmupFrames + m_options.frames);
+		cameraTransform.setRotation(glm::angleAxis(glm::radians(yaw), glm::vec3(0, 1, 0)));
+		m_frameIndex++;
+	}
+
+	void onExtract() override {
+		if (!m_options.threaded)
+			return;
+		std::vector<PaperEngine::Ref<PaperEngine::Scene>> scenes;
+		scenes.push_back(m_benchScene->scene);
+		m_snapshots.write(PaperEngine::Application::GetFrameNumber(), PaperEngine::SceneSnapshot::Extract(scenes, camera, cameraTransform));
+	}
+
+	void onFinalRender(nvrhi::IFramebuffer* framebuffer) override {
+		// 最後一個記錄的frame，GPU完成後 (最晚在cleanUp) 寫檔
+		if (!m_options.capture.empty() && PaperEngine::Application::GetFrameNumber() + 1 == m_options.warmupFrames + m_options.frames) {
+			PaperEngine::Application::Get()->getGraphicsContext()->requestFrameReadback([path = m_options.capture](const PaperEngine::FrameReadback& readback) {
+				if (WritePPM(path, readback))
+					PE_CORE_INFO("[PaperBench] Frame captured to '{}'.", path);
+				else
+					PE_CORE_ERROR("[PaperBench] Could not write capture '{}'.", path);
+				});
+		}
+
+		if (m_options.threaded) {
+			if (auto snapshot = m_snapshots.read(PaperEngine::Application::GetFrameNumber()))
+				m_sceneRenderer->renderSnapshot(*snapshot, framebuffer);
+			return;
+		}
+
+		std::vector<PaperEngine::Ref<PaperEngine::Scene>> scenes;
+		scenes.push_back(m_benchScene->scene);
+		m_sceneRenderer->renderScene(scenes, &camera, &cameraTransform, framebuffer);
+	}
+
+private:
+	void writeResult() {
+		std::ofstream out(m_options.output);
+		if (!out.is_open()) {
+			PE_CORE_ERROR("[PaperBench] Could not open '{}'.", m_options.output);
+			return;
+		}
+
+		// FrameStats只保留最近HistoryLength個frame，frames比較大時只有最後的部分
+		out << "{\"preset\":\"" << m_preset.name << "\",";
+		out << "\"seed\":" << m_preset.seed << ",";
+		out << "\"entities\":" << m_preset.entityCount << ",";
+		out << "\"pointLights\":" << m_preset.pointLightCount << ",";
+		out << "\"width\":" << m_options.width << ",";
+		out << "\"height\":" << m_options.height << ",";
+		out << "\"headless\":" << (m_options.windowed ? "false" : "true") << ",";
+		out << "\"threaded\":" << (m_options.threaded ? "true" : "false") << ",";
+		out << "\"framesAhead\":" << m_options.framesAhead << ",";
+		out << "\"recordLists\":" << m_options.recordLists << ",";
+		out << "\"framesInFlight\":" << PaperEngine::Application::Get()->getGraphicsContext()->getMaxFrameInFlight() << ",";
+		out << "\"presentMode\":\"" << PaperEngine::PresentModeToString(PaperEngine::Application::Get()->getGraphicsContext()->getPresentMode()) << "\",";
+		out << "\"jobWorkers\":" << PaperEngine::Application::GetJobSystem()->getWorkerCount() << ",";
+		out << "\"warmupFrames\":" << m_options.warmupFrames << ",";
+		out << "\"frames\":" << m_options.frames << ",";
+		out << "\"frameStats\":";
+		PaperEngine::FrameStats::Get().writeJSON(out);
+		out << "}\n";
+
+		PE_CORE_INFO("[PaperBench] Result written to '{}'.", m_options.output);
+	}
+
+private:
+	BenchOptions m_options;
+	PaperBench::ScenePreset m_preset;
+
+	uint32_t m_frameIndex = 0;
+
+	PaperEngine::Ref<PaperEngine::SceneRenderer> m_sceneRenderer;
+	PaperEngine::Ref<PaperBench::BenchScene> m_benchScene;
+	PaperEngine::SnapshotBuffer<PaperEngine::SceneSnapshot> m_snapshots;
+
+	PaperEngine::Camera camera;
+	PaperEngine::Transform cameraTransform;
+};
+
+class PaperBenchApp : public PaperEngine::Application {
+public:
+	PaperBenchApp(const PaperEngine::ApplicationProps& spec, const BenchOptions& options, const PaperBench::ScenePreset& preset)
+		: Application(spec), m_benchLayer(options, preset)
+	{
+	}
+
+	void onInit() override {
+		pushLayer(&m_benchLayer);
+	}
+
+private:
+	BenchLayer m_benchLayer;
+};
+
+static void PrintUsage()
+{
+	PE_CORE_INFO("Usage: PaperBench [--preset <name>] [--frames <n>] [--warmup <n>] [--seed <n>] [--output <file>] [--width <n>] [--height <n>] [--windowed] [--threaded] [--frames-ahead <n>] [--record-lists <n>] [--frames-in-flight <n>] [--present-mode fifo|mailbox|immediate] [--capture <file.ppm>] [--gpu <name>]");
+	for (const auto& preset : PaperBench::GetScenePresets()) {
+		PE_CORE_INFO("    preset '{}': {} entities, {} meshes, {} {}materials, {} point lights{}",
+			preset.name, preset.entityCount, preset.meshCount, preset.materialCount, preset.bindless ? "bindless " : "", preset.pointLightCount,
+			preset.shadows ? ", shadows" : "");
+	}
+}
+
+PaperEngine::Application* PaperEngine::CreateApplication(int argc, const char** argv) {
+	BenchOptions options;
+	for (int i = 1; i < argc; i++) {
+		const bool hasValue = i + 1 < argc;
+		if (std::strcmp(argv[i], "--preset") == 0 && hasValue)
+			options.preset = argv[++i];
+		else if (std::strcmp(argv[i], "--frames") == 0 && hasValue)
+			options.frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue)
+			options.warmupFrames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--seed") == 0 && hasValue)
+			options.seed = std::strtoll(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--output") == 0 && hasValue)
+			options.output = argv[++i];
+		else if (std::strcmp(argv[i], "--width") == 0 && hasValue)
+			options.width = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--height") == 0 && hasValue)
+			options.height = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--windowed") == 0)
+			options.windowed = true;
+		else if (std::strcmp(argv[i], "--threaded") == 0)
+			options.threaded = true;
+		else if (std::strcmp(argv[i], "--frames-ahead") == 0 && hasValue)
+			options.framesAhead = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--record-lists") == 0 && hasValue)
+			options.recordLists = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+			options.framesInFlight = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--present-mode") == 0 && hasValue) {
+			const char* mode = argv[++i];
+			if (std::strcmp(mode, "fifo") == 0)
+				options.presentMode = PaperEngine::PresentMode::Fifo;
+			else if (std::strcmp(mode, "mailbox") == 0)
+				options.presentMode = PaperEngine::PresentMode::Mailbox;
+			else if (std::strcmp(mode, "immediate") == 0)
+				options.presentMode = PaperEngine::PresentMode::Immediate;
+			else
+				PE_CORE_WARN("[PaperBench] Unknown present mode '{}'.", mode);
+		}
+		else if (std::strcmp(argv[i], "--capture") == 0 && hasValue)
+			options.capture = argv[++i];
+		else if (std::strcmp(argv[i], "--gpu") == 0 && hasValue)
+			options.gpu = argv[++i];
+		else
+			PE_CORE_WARN("[PaperBench] Unknown argument '{}'.", argv[i]);
+	}
+
+	const PaperBench::ScenePreset* found = PaperBench::FindScenePreset(options.preset);
+	if (!found) {
+		PE_CORE_ERROR("[PaperBench] Unknown preset '{}'.", options.preset);
+		PrintUsage();
+		found = PaperBench::FindScenePreset("default");
+	}
+
+	PaperBench::ScenePreset preset = *found;
+	if (options.seed >= 0)
+		preset.seed = static_cast<uint32_t>(options.seed);
+
+	PaperEngine::ApplicationProps spec;
+	spec.name = "PaperBench";
+	spec.width = options.width;
+	spec.height = options.height;
+	spec.headless = !options.windowed;
+	spec.threadedRendering = options.threaded;
+	spec.maxFramesAhead = options.framesAhead;
+	spec.framesInFlight = options.framesInFlight;
+	spec.presentMode = options.presentMode;
+	spec.gpuName = options.gpu;
+	return new PaperBenchApp(spec, options, preset);
+}
@@ -12,6 +12,11 @@ namespace PaperEngine {
 	struct MeshRendererComponent {
 		bool visible = true;
 		bool renderStatic = true;
+		bool castShadow = true;
+		/// <summary>
+		/// 不會移動的mesh，遠的shadow cascade只畫static的mesh並快取結果
+		/// </summary>
+		bool isStatic = false;
 		std::vector<Ref<Material>> materials;
 	};
 
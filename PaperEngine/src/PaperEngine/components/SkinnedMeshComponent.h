@@ -0,0 +1,19 @@
+﻿#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 要做GPU skinning的skeletal mesh，一定要有Mesh component (MeshType::Skeletal)
+	/// bonePalette[BoneData::id] = joint的global transformation * BoneData::offsetMatrix (mesh space)
+	/// 動畫每個frame更新bonePalette，SkinningPass把它skin到共用的output vertex buffer
+	/// 空的話照bind pose畫
+	/// </summary>
+	struct SkinnedMeshComponent {
+		std::vector<glm::mat4> bonePalette;
+	};
+
+}
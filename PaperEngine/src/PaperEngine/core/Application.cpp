@@ -3,32 +3,52 @@
 #include <nvrhi/nvrhi.h>
 #include "Application.h"
 
+#include <algorithm>
+
 #include <PaperEngine/core/Assert.h>
 #include <PaperEngine/core/Logger.h>
+#include <PaperEngine/core/SnapshotBuffer.h>
 #include <PaperEngine/events/ApplicationEvent.h>
+#include <PaperEngine/events/KeyEvent.h>
 #include <PaperEngine/utils/Clock.h>
 
 #include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+#include <PaperEngine/debug/FrameStats.h>
 
 namespace PaperEngine {
 
 	Application* Application::s_instance = nullptr;
 
+	static_assert(SnapshotBuffer<int>::SlotCount >= Application::MaxFramesAhead + 1, "SnapshotBuffer slots would be overwritten while rendering.");
+
+	// update thread跟render thread各自的frame number
+	static thread_local uint64_t s_frameNumber = 0;
+
 	Application::Application(const ApplicationProps& props) :
-		m_renderAPI(props.renderAPI)
+		m_renderAPI(props.renderAPI),
+		m_pipelineCacheDirectory(props.pipelineCacheDirectory),
+		m_framesInFlight(std::clamp(props.framesInFlight, 1u, GraphicsContext::MaxFramesInFlight)),
+		m_presentMode(props.presentMode),
+		m_gpuName(props.gpuName),
+		m_frameUploadSize(props.frameUploadSize),
+		m_textureStreamingBudget(props.textureStreamingBudget),
+		m_threadedRendering(props.threadedRendering),
+		m_maxFramesAhead(std::clamp(props.maxFramesAhead, 1u, MaxFramesAhead))
 	{
 		PE_CORE_ASSERT(!s_instance, "Application already created.");
 		s_instance = this;
 
-		initThreadPool();
+		initThreadPool(props);
 
-		m_window = Window::Create(WindowProps(props.name, props.width, props.height));
+		m_window = Window::Create(WindowProps(props.name, props.width, props.height, props.headless));
 		m_window->init();
 		m_window->setEventCallback(PE_BIND_EVENT_FN(Application::onEvent));
 	}
 
 	Application::~Application()
 	{
+		m_jobSystem.reset();
 	}
 
 	PE_API void Application::run()
@@ -40,11 +60,25 @@ namespace PaperEngine {
 		m_graphicsContext->setOnBackBufferResizingCallback(PE_BIND_EVENT_FN(Application::onBackBufferResizing));
 		m_graphicsContext->init();
 
+		m_gpuMemoryAllocator = CreateScope<GPUMemoryAllocator>(m_graphicsContext->getMaxFrameInFlight());
+		m_frameUploadAllocator = CreateScope<FrameUploadAllocator>(m_frameUploadSize, m_graphicsContext->getMaxFrameInFlight());
+		m_textureStreamer = CreateScope<TextureStreamer>(m_textureStreamingBudget, m_graphicsContext->getMaxFrameInFlight());
+
+#ifdef PE_PROFILE
+		GPUProfiler::Get().init(m_graphicsContext->getNVRhiDevice(), m_graphicsContext->getMaxFrameInFlight());
+#endif // PE_PROFILE
+
 		m_resourceManager = CreateScope<ResourceManager>();
 
 #ifdef PE_ENABLE_IMGUI
-		m_imguiLayer = ImGuiLayer::Create();
-		m_layerManager.pushOverlay(m_imguiLayer.get());
+		// headless沒有native window給ImGui的platform backend
+		// threaded rendering時ImGui的input (update thread) 跟NewFrame (render thread) 會在不同thread，先不支援
+		if (m_threadedRendering)
+			PE_CORE_WARN("Threaded rendering enabled, ImGui overlay is disabled.");
+		else if (!m_window->isHeadless()) {
+			m_imguiLayer = ImGuiLayer::Create();
+			m_layerManager.pushOverlay(m_imguiLayer.get());
+		}
 #endif // PE_ENABLE_IMGUI
 
 
@@ -55,98 +89,216 @@ namespace PaperEngine {
 		auto cmd = m_graphicsContext->getNVRhiDevice()->createCommandList();
 		Clock clock;
 
-		Timestep FPSCounter(std::chrono::seconds(0));
+		if (m_threadedRendering)
+			runThreaded(clock);
+		else
+			runSingleThreaded(clock);
+
+		cmd = nullptr;
+
+		m_layerManager.cleanUp();
+
+		m_resourceManager.reset();
+
+#ifdef PE_PROFILE
+		GPUProfiler::Get().shutdown();
+#endif // PE_PROFILE
 
+		m_textureStreamer.reset();
+		m_frameUploadAllocator.reset();
+		m_gpuMemoryAllocator.reset();
+
+		m_graphicsContext->cleanUp();
+
+		m_window->cleanUp();
+	}
+
+	void Application::runSingleThreaded(Clock& clock)
+	{
 		while (m_running) {
+			PE_PROFILE_FRAME_MARK();
 			PE_PROFILE_SCOPE("RunLoop");
 
-			auto deltaTime = clock.resetClock();
-			FPSCounter += deltaTime;
+			updateFrame(clock.resetClock());
+			renderFrame();
 
-			if (FPSCounter.toSeconds() >= 1.0f) {
-				// 每秒更新一次FPS
-				m_window->setTitle(fmt::format("Sandbox - FPS: {}", m_framePerSecond));
-				FPSCounter = Timestep(std::chrono::seconds(0));
-				m_framePerSecond = 0;
+			FrameStats::Get().endFrame();
+			s_frameNumber++;
+		}
+	}
+
+	void Application::runThreaded(Clock& clock)
+	{
+		m_renderThread = std::thread([this]() { renderThreadLoop(); });
+
+		while (m_running) {
+			PE_PROFILE_FRAME_MARK();
+			PE_PROFILE_SCOPE("UpdateLoop");
+
+			// update最多領先render m_maxFramesAhead個frame
+			{
+				PE_PROFILE_SCOPE("Wait for render thread");
+				std::unique_lock<std::mutex> lock(m_frameMutex);
+				m_frameCondition.wait(lock, [this]() {
+					return s_frameNumber <= m_renderedFrameCount + m_maxFramesAhead;
+					});
 			}
-			// update
 
+			updateFrame(clock.resetClock());
+
+			// 這個frame的snapshot都寫好了，交給render thread
 			{
-				m_window->onUpdate();
-				// Update logic, input handling, etc.
-				{
-					PE_PROFILE_SCOPE("Layers Update");
-					for (auto layer : m_layerManager) {
-						layer->onUpdate(deltaTime);
-					}
-				}
+				std::lock_guard<std::mutex> lock(m_frameMutex);
+				m_readyFrameCount = s_frameNumber + 1;
 			}
+			m_frameCondition.notify_all();
+
+			// render的數值會記在當時還沒結束的update frame
+			FrameStats::Get().endFrame();
+			s_frameNumber++;
+		}
 
-			// Render
+		{
+			std::lock_guard<std::mutex> lock(m_frameMutex);
+			m_stopRenderThread = true;
+		}
+		m_frameCondition.notify_all();
+		m_renderThread.join();
+	}
+
+	void Application::renderThreadLoop()
+	{
+		s_frameNumber = 0;
+		while (true) {
 			{
-				if (m_window->getWidth() != 0 && m_window->getHeight() != 0) {
-					if (m_graphicsContext->beginFrame()) {
-						// Render
-
-						// TODO commit無關swapchain image的繪製
-						for (auto layer : m_layerManager) {
-							layer->onPreRender();
-						}
-
-						// TODO commit繪製swpachain image的命令
-						auto main_cmd = m_graphicsContext->getMainCommandList();
-						main_cmd->open();
-						auto fb = m_graphicsContext->getCurrentFramebuffer();
-						auto swapchain_texture = fb->getDesc().colorAttachments[0].texture;
-						auto depth_texture = fb->getDesc().depthAttachment.texture;
-
-						// NVRHI有問題，他無法使用track一個一開始undefined layout導致Vulkan validation一直報錯
-						//main_cmd->beginTrackingTextureState(swapchain_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Unknown);
-						//main_cmd->beginTrackingTextureState(depth_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Unknown);
-
-						for (auto layer : m_layerManager) {
+				std::unique_lock<std::mutex> lock(m_frameMutex);
+				m_frameCondition.wait(lock, [this]() {
+					return m_readyFrameCount > s_frameNumber || m_stopRenderThread;
+					});
+				// 停止時還沒畫的frame就不畫了
+				if (m_stopRenderThread)
+					break;
+			}
+
+			{
+				PE_PROFILE_SCOPE("RenderLoop");
+				renderFrame();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_frameMutex);
+				m_renderedFrameCount = s_frameNumber + 1;
+			}
+			m_frameCondition.notify_all();
+			s_frameNumber++;
+		}
+	}
+
+	void Application::updateFrame(Timestep deltaTime)
+	{
+		m_fpsCounter += deltaTime;
+		PE_FRAME_STAT_TIME("Frame Time", deltaTime.toSeconds() * 1000.0f);
+
+		if (m_fpsCounter.toSeconds() >= 1.0f) {
+			// 每秒更新一次FPS
+			m_window->setTitle(fmt::format("Sandbox - FPS: {}", m_framePerSecond.exchange(0, std::memory_order_relaxed)));
+			m_fpsCounter = Timestep(std::chrono::seconds(0));
+		}
+
+		m_window->onUpdate();
+		// window event處理完，這個frame的input已經確定了
+		m_frameInputTimes[s_frameNumber % m_frameInputTimes.size()] = m_pendingInputTime;
+		m_pendingInputTime = {};
+
+		// Update logic, input handling, etc.
+		{
+			PE_PROFILE_SCOPE("Layers Update");
+			for (auto layer : m_layerManager) {
+				layer->onUpdate(deltaTime);
+			}
+		}
+
+		{
+			PE_PROFILE_SCOPE("Layers Extract");
+			for (auto layer : m_layerManager) {
+				layer->onExtract();
+			}
+		}
+	}
+
+	void Application::renderFrame()
+	{
+		if (m_window->getWidth() != 0 && m_window->getHeight() != 0) {
+			if (m_graphicsContext->beginFrame()) {
+#ifdef PE_PROFILE
+				GPUProfiler::Get().beginFrame(m_graphicsContext->getCurrentFrameIndex());
+#endif // PE_PROFILE
+				m_gpuMemoryAllocator->beginFrame();
+				m_frameUploadAllocator->beginFrame(m_graphicsContext->getCurrentFrameIndex());
+				// Render
+
+				// TODO commit無關swapchain image的繪製
+				for (auto layer : m_layerManager) {
+					layer->onPreRender();
+				}
+
+				// TODO commit繪製swpachain image的命令
+				auto main_cmd = m_graphicsContext->getMainCommandList();
+				main_cmd->open();
+				// 上傳完的streaming texture在這裡換上去，之後的繪製才會用到
+				m_textureStreamer->update(main_cmd);
+				auto fb = m_graphicsContext->getCurrentFramebuffer();
+				auto swapchain_texture = fb->getDesc().colorAttachments[0].texture;
+				auto depth_texture = fb->getDesc().depthAttachment.texture;
+
+				// NVRHI有問題，他無法使用track一個一開始undefined layout導致Vulkan validation一直報錯
+				//main_cmd->beginTrackingTextureState(swapchain_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Unknown);
+				//main_cmd->beginTrackingTextureState(depth_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Unknown);
+
+				for (auto layer : m_layerManager) {
 #ifdef PE_ENABLE_IMGUI
-							// Imgui 在preRender begin，然後他又是最後render的
-							// 所以他能夠處理
-							layer->onImGuiRender();
+					// Imgui 在preRender begin，然後他又是最後render的
+					// 所以他能夠處理
+					if (m_imguiLayer)
+						layer->onImGuiRender();
 #endif // PE_ENABLE_IMGUI
 
-							layer->onFinalRender(m_graphicsContext->getCurrentFramebuffer());
+					layer->onFinalRender(m_graphicsContext->getCurrentFramebuffer());
 
-						}
-						main_cmd->close();
+				}
+				main_cmd->close();
 
 #pragma region Present this frame
-						//cmd->open();
+				//cmd->open();
 
-						//cmd->setTextureState(m_graphicsContext->getCurrentSwapchainTexture(),
-						//	nvrhi::AllSubresources,
-						//	nvrhi::ResourceStates::Present);
+				//cmd->setTextureState(m_graphicsContext->getCurrentSwapchainTexture(),
+				//	nvrhi::AllSubresources,
+				//	nvrhi::ResourceStates::Present);
 
-						//cmd->close();
-						//m_graphicsContext->getNVRhiDevice()->executeCommandList(cmd);
+				//cmd->close();
+				//m_graphicsContext->getNVRhiDevice()->executeCommandList(cmd);
 
-						if (m_graphicsContext->present()) {
-							m_framePerSecond++;
-						}
-#pragma endregion
+				if (m_graphicsContext->present()) {
+					m_framePerSecond.fetch_add(1, std::memory_order_relaxed);
 
+					// 到present送出為止，不含compositor/scanout
+					const auto inputTime = m_frameInputTimes[s_frameNumber % m_frameInputTimes.size()];
+					if (inputTime != std::chrono::steady_clock::time_point{}) {
+						const std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - inputTime;
+						PE_FRAME_STAT_TIME("Input To Present Latency", latency.count());
 					}
 				}
-			}
+#pragma endregion
 
-			m_graphicsContext->getNVRhiDevice()->runGarbageCollection();
+			}
 		}
 
-		cmd = nullptr;
-
-		m_layerManager.cleanUp();
-
-		m_resourceManager.reset();
-
-		m_graphicsContext->cleanUp();
+		m_graphicsContext->getNVRhiDevice()->runGarbageCollection();
+	}
 
-		m_window->cleanUp();
+	uint64_t Application::GetFrameNumber()
+	{
+		return s_frameNumber;
 	}
 
 	nvrhi::IDevice* Application::GetNVRHIDevice() {
@@ -160,6 +312,30 @@ namespace PaperEngine {
 		return s_instance->m_thread_pool;
 	}
 
+	PE_API JobSystem* Application::GetJobSystem()
+	{
+		PE_CORE_ASSERT(s_instance && s_instance->m_jobSystem, "JobSystem is not created.");
+		return s_instance->m_jobSystem.get();
+	}
+
+	PE_API FrameUploadAllocator* Application::GetFrameUploadAllocator()
+	{
+		PE_CORE_ASSERT(s_instance && s_instance->m_frameUploadAllocator, "FrameUploadAllocator is not created. Application not run?");
+		return s_instance->m_frameUploadAllocator.get();
+	}
+
+	PE_API GPUMemoryAllocator* Application::GetGPUMemoryAllocator()
+	{
+		PE_CORE_ASSERT(s_instance && s_instance->m_gpuMemoryAllocator, "GPUMemoryAllocator is not created. Application not run?");
+		return s_instance->m_gpuMemoryAllocator.get();
+	}
+
+	PE_API TextureStreamer* Application::GetTextureStreamer()
+	{
+		PE_CORE_ASSERT(s_instance && s_instance->m_textureStreamer, "TextureStreamer is not created. Application not run?");
+		return s_instance->m_textureStreamer.get();
+	}
+
 	void Application::Shutdown()
 	{
 		PE_CORE_ASSERT(s_instance, "Application instance is null, cannot shutdown.");
@@ -178,6 +354,19 @@ namespace PaperEngine {
 
 	void Application::onEvent(Event& e)
 	{
+		if (e.isInCategory(EventCategoryInput) && m_pendingInputTime == std::chrono::steady_clock::time_point{})
+			m_pendingInputTime = std::chrono::steady_clock::now();
+
+#ifdef PE_PROFILE
+		// F11: capture profile
+		EventDispatcher dispatcher(e);
+		dispatcher.dispatch<KeyPressedEvent>([](KeyPressedEvent& e) {
+			if (e.get_key_code() == Key::F11 && !e.IsRepeat())
+				PE_PROFILE_CAPTURE_FRAMES(Instrumentor::CaptureHotkeyFrameCount);
+			return false;
+		});
+#endif // PE_PROFILE
+
 		for (auto it = m_layerManager.rbegin(); it != m_layerManager.rend(); ++it)
 		{
 			Layer* layer = *it;
@@ -202,7 +391,7 @@ namespace PaperEngine {
 		}
 	}
 
-	void Application::initThreadPool()
+	void Application::initThreadPool(const ApplicationProps& props)
 	{
 		uint32_t core_count = std::thread::hardware_concurrency();
 		std::vector<bool> affinity(std::thread::hardware_concurrency(), false);
@@ -270,9 +459,39 @@ namespace PaperEngine {
 
 			BS::this_thread::set_os_thread_affinity(affinity);
 			});
+
+		// 呼叫的thread (main thread) 也會執行job，所以少開一個worker
+		m_jobSystem = CreateScope<JobSystem>();
+		m_jobSystem->init(core_count > 1 ? core_count - 1 : 1, [affinity](uint32_t workerIndex) {
+			BS::this_thread::set_os_thread_affinity(affinity);
+			});
 #elifdef PE_PLATFORM_LINUX
-		
-		m_thread_pool = std::make_shared<BS::thread_pool<>>(core_count);
+		const CpuTopology topology = CpuTopology::Detect();
+		const ThreadPlacement placement = topology.selectPlacement(props.threadAffinityPolicy, props.reserveMainThreadCore);
+
+		PE_CORE_INFO("CPU topology: {}", topology.toString());
+		PE_CORE_INFO("Thread policy: {}, {} workers{}{}",
+			ThreadAffinityPolicyToString(placement.policy),
+			placement.workerCount,
+			placement.workerCpus.empty() ? std::string(" unpinned") : fmt::format(" on CPU {}", CpuTopology::FormatCpuList(placement.workerCpus)),
+			placement.mainThreadCpu == ThreadPlacement::InvalidCpu ? std::string() : fmt::format(", main thread on CPU {}", placement.mainThreadCpu));
+
+		if (placement.mainThreadCpu != ThreadPlacement::InvalidCpu)
+			CpuTopology::PinCurrentThread({ placement.mainThreadCpu });
+
+		// thread pool是長時間的非同步工作，允許在所有worker CPU之間移動
+		m_thread_pool = std::make_shared<BS::thread_pool<>>(placement.workerCount, [cpus = placement.workerCpus](std::size_t idx) {
+			CpuTopology::PinCurrentThread(cpus);
+			});
+
+		// 沒有保留core時main thread也會執行job，第一個CPU留給他
+		const uint32_t skipped = placement.mainThreadCpu == ThreadPlacement::InvalidCpu ? 1 : 0;
+		const uint32_t worker_count = placement.workerCount > skipped ? placement.workerCount - skipped : 1;
+		m_jobSystem = CreateScope<JobSystem>();
+		m_jobSystem->init(worker_count, [cpus = placement.workerCpus, skipped](uint32_t workerIndex) {
+			if (!cpus.empty())
+				CpuTopology::PinCurrentThread({ cpus[(workerIndex + skipped) % cpus.size()] });
+			});
 #endif // PE_PLATFORM_WINDOWS
 
 	}
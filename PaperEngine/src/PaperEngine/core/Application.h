@@ -1,12 +1,24 @@
 ﻿#pragma once
 
 #include <string>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <PaperEngine/core/Base.h>
 #include <PaperEngine/core/Window.h>
 #include <PaperEngine/graphics/GraphicsContext.h>
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+#include <PaperEngine/graphics/TextureStreamer.h>
 #include <PaperEngine/core/LayerManager.h>
+#include <PaperEngine/core/JobSystem.h>
+#include <PaperEngine/core/CpuTopology.h>
 #include <PaperEngine/resourceManager/ResourceManager.h>
+#include <PaperEngine/utils/Clock.h>
 
 #define BS_THREAD_POOL_NATIVE_EXTENSIONS
 #include <BS_thread_pool.hpp>
@@ -30,6 +42,50 @@ namespace PaperEngine {
 		uint32_t width = 2560;
 		uint32_t height = 1440;
 		// bool disableMinimizeBox = false;
+		/// <summary>
+		/// 不開視窗也不建立swapchain (benchmark/CI)
+		/// </summary>
+		bool headless = false;
+		/// <summary>
+		/// Linux上worker thread的affinity (Windows使用P-core affinity)
+		/// </summary>
+		ThreadAffinityPolicy threadAffinityPolicy = ThreadAffinityPolicy::PerformanceCores;
+		/// <summary>
+		/// 保留一個core給main (render) thread，worker不會排在上面
+		/// </summary>
+		bool reserveMainThreadCore = false;
+		/// <summary>
+		/// update (含window event) 在main thread，render在另一個thread
+		/// Layer要在onExtract建立snapshot，onFinalRender只能讀snapshot (見SnapshotBuffer)
+		/// </summary>
+		bool threadedRendering = false;
+		/// <summary>
+		/// threaded rendering時update最多領先render幾個frame (1 ~ Application::MaxFramesAhead)
+		/// 越大吞吐量越好但input latency越高
+		/// </summary>
+		uint32_t maxFramesAhead = 1;
+		/// <summary>
+		/// 存放pipeline cache的資料夾 (相對於working directory)，空的話不讀也不存
+		/// </summary>
+		std::string pipelineCacheDirectory = "cache";
+		/// <summary>
+		/// CPU最多領先GPU幾個frame (1 ~ GraphicsContext::MaxFramesInFlight)
+		/// 越少latency越低，但CPU會比較常等GPU
+		/// </summary>
+		uint32_t framesInFlight = 3;
+		PresentMode presentMode = PresentMode::Mailbox;
+		/// <summary>
+		/// 名稱包含這個字串的GPU優先 (例如 "llvmpipe" 使用software ICD)，空的話自動選擇
+		/// </summary>
+		std::string gpuName;
+		/// <summary>
+		/// FrameUploadAllocator的ring buffer大小 (bytes)，要放得下framesInFlight個frame的上傳量
+		/// </summary>
+		uint64_t frameUploadSize = 64ull * 1024 * 1024;
+		/// <summary>
+		/// TextureStreamer載入的texture可以使用的記憶體 (bytes)，超過時evict最久沒用到的mip
+		/// </summary>
+		uint64_t textureStreamingBudget = 512ull * 1024 * 1024;
 		RenderAPI renderAPI = RenderAPI::Vulkan;
 	};
 
@@ -60,6 +116,17 @@ namespace PaperEngine {
 
 		inline PE_API RenderAPI getRenderAPI() const { return m_renderAPI; }
 
+		inline PE_API const std::string& getPipelineCacheDirectory() const { return m_pipelineCacheDirectory; }
+
+		/// <summary>
+		/// ApplicationProps要求的值 (已clamp)，GraphicsContext建立時使用
+		/// </summary>
+		inline PE_API uint32_t getFramesInFlight() const { return m_framesInFlight; }
+
+		inline PE_API PresentMode getPresentMode() const { return m_presentMode; }
+
+		inline PE_API const std::string& getGPUName() const { return m_gpuName; }
+
 	public:
 		/// <summary>
 		/// 全域Application實例。
@@ -72,8 +139,38 @@ namespace PaperEngine {
 
 		PE_API static Ref<BS::thread_pool<>> GetThreadPool();
 
+		/// <summary>
+		/// 每個frame的細粒度工作 (scene處理等) 用JobSystem
+		/// 長時間的非同步工作 (pipeline prewarm等) 繼續用thread pool
+		/// </summary>
+		PE_API static JobSystem* GetJobSystem();
+
+		/// <summary>
+		/// 每個frame CPU上傳到GPU的資料都從這裡allocate，只在這個frame有效
+		/// </summary>
+		PE_API static FrameUploadAllocator* GetFrameUploadAllocator();
+
+		/// <summary>
+		/// GPU-only的buffer/texture從這裡建立 (放在共用的memory block)
+		/// </summary>
+		PE_API static GPUMemoryAllocator* GetGPUMemoryAllocator();
+
+		/// <summary>
+		/// 載入.ptex (只有需要的mip會resident)
+		/// </summary>
+		PE_API static TextureStreamer* GetTextureStreamer();
+
 		PE_API static void Shutdown();
 
+		/// <summary>
+		/// 呼叫的thread目前處理的frame number
+		/// update thread是正在update的frame，render thread是正在render的frame
+		/// 沒有threaded rendering時兩者相同
+		/// </summary>
+		PE_API static uint64_t GetFrameNumber();
+
+		static constexpr uint32_t MaxFramesAhead = 3;
+
 		PE_API static ResourceManager* GetResourceManager();
 
 	protected:
@@ -83,23 +180,74 @@ namespace PaperEngine {
 
 		void onBackBufferResized();
 
-		void initThreadPool();
+		void initThreadPool(const ApplicationProps& props);
+
+		void runSingleThreaded(Clock& clock);
+
+		/// <summary>
+		/// main thread做update，render thread畫前面的frame
+		/// </summary>
+		void runThreaded(Clock& clock);
+
+		void renderThreadLoop();
+
+		/// <summary>
+		/// window event、layer的onUpdate跟onExtract
+		/// </summary>
+		void updateFrame(Timestep deltaTime);
+
+		/// <summary>
+		/// beginFrame到present
+		/// </summary>
+		void renderFrame();
 
 	private:
-		bool m_running = false;
+		std::atomic<bool> m_running{ false };
 
 		Scope<Window> m_window;
 		Ref<GraphicsContext> m_graphicsContext;
 
 		Ref<BS::thread_pool<>> m_thread_pool;
 
+		Scope<JobSystem> m_jobSystem;
+
 		Scope<ResourceManager> m_resourceManager;
 
+		Scope<GPUMemoryAllocator> m_gpuMemoryAllocator;
+		Scope<FrameUploadAllocator> m_frameUploadAllocator;
+		Scope<TextureStreamer> m_textureStreamer;
+
 		RenderAPI m_renderAPI = RenderAPI::Vulkan;
+		std::string m_pipelineCacheDirectory;
+		uint32_t m_framesInFlight = 3;
+		PresentMode m_presentMode = PresentMode::Mailbox;
+		std::string m_gpuName;
+		uint64_t m_frameUploadSize;
+		uint64_t m_textureStreamingBudget;
 
 		LayerManager m_layerManager;
 
-		uint32_t m_framePerSecond = 0;
+		std::atomic<uint32_t> m_framePerSecond{ 0 };
+		Timestep m_fpsCounter{ std::chrono::seconds(0) };
+
+		bool m_threadedRendering = false;
+		uint32_t m_maxFramesAhead = 1;
+		std::thread m_renderThread;
+		std::mutex m_frameMutex;
+		std::condition_variable m_frameCondition;
+		uint64_t m_readyFrameCount = 0;			// update完成的frame數
+		uint64_t m_renderedFrameCount = 0;		// render完成的frame數
+		bool m_stopRenderThread = false;
+
+		/// <summary>
+		/// 這個frame第一個input event的時間，update thread使用
+		/// </summary>
+		std::chrono::steady_clock::time_point m_pendingInputTime{};
+		/// <summary>
+		/// 每個frame的第一個input時間，present後計算input到present的latency
+		/// update最多領先render MaxFramesAhead個frame，所以MaxFramesAhead + 1個就夠
+		/// </summary>
+		std::array<std::chrono::steady_clock::time_point, MaxFramesAhead + 1> m_frameInputTimes{};
 
 #ifdef PE_ENABLE_IMGUI
 		Ref<ImGuiLayer> m_imguiLayer;
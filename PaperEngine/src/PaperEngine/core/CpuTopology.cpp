@@ -0,0 +1,291 @@
+﻿#include "CpuTopology.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <PaperEngine/core/Logger.h>
+
+#ifdef PE_PLATFORM_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif // PE_PLATFORM_LINUX
+
+namespace PaperEngine {
+
+	const char* ThreadAffinityPolicyToString(ThreadAffinityPolicy policy)
+	{
+		switch (policy)
+		{
+		case ThreadAffinityPolicy::Unpinned:			return "Unpinned";
+		case ThreadAffinityPolicy::LogicalCores:		return "LogicalCores";
+		case ThreadAffinityPolicy::PhysicalCores:		return "PhysicalCores";
+		case ThreadAffinityPolicy::PerformanceCores:	return "PerformanceCores";
+		}
+		return "Unknown";
+	}
+
+#ifdef PE_PLATFORM_LINUX
+	namespace {
+
+		const std::string SysCpuPath = "/sys/devices/system/cpu/";
+
+		bool ReadFileLine(const std::string& path, std::string& line)
+		{
+			std::ifstream file(path);
+			if (!file.is_open())
+				return false;
+			return static_cast<bool>(std::getline(file, line));
+		}
+
+		bool ReadFileUInt(const std::string& path, uint32_t& value)
+		{
+			std::string line;
+			if (!ReadFileLine(path, line))
+				return false;
+			try {
+				value = static_cast<uint32_t>(std::stoul(line));
+			}
+			catch (const std::exception&) {
+				return false;
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// 解析sysfs的cpulist，例如 "0-3,8,10-11"
+		/// </summary>
+		std::vector<uint32_t> ParseCpuList(const std::string& list)
+		{
+			std::vector<uint32_t> cpus;
+			std::stringstream ss(list);
+			std::string range;
+			while (std::getline(ss, range, ',')) {
+				if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0])))
+					continue;
+				const size_t dash = range.find('-');
+				const uint32_t first = static_cast<uint32_t>(std::stoul(range.substr(0, dash)));
+				const uint32_t last = dash == std::string::npos ? first : static_cast<uint32_t>(std::stoul(range.substr(dash + 1)));
+				for (uint32_t cpu = first; cpu <= last; cpu++)
+					cpus.push_back(cpu);
+			}
+			return cpus;
+		}
+
+		std::vector<uint32_t> ReadCpuList(const std::string& path)
+		{
+			std::string line;
+			if (!ReadFileLine(path, line))
+				return {};
+			return ParseCpuList(line);
+		}
+
+		/// <summary>
+		/// 找出共用L3的CPU，沒有L3的話回傳空的
+		/// </summary>
+		std::vector<uint32_t> ReadL3SharedCpus(uint32_t cpu)
+		{
+			const std::string cachePath = SysCpuPath + "cpu" + std::to_string(cpu) + "/cache/";
+			for (uint32_t index = 0; index < 8; index++) {
+				const std::string indexPath = cachePath + "index" + std::to_string(index) + "/";
+				uint32_t level = 0;
+				if (!ReadFileUInt(indexPath + "level", level))
+					break;
+				if (level == 3)
+					return ReadCpuList(indexPath + "shared_cpu_list");
+			}
+			return {};
+		}
+
+	}
+#endif // PE_PLATFORM_LINUX
+
+	CpuTopology CpuTopology::Detect()
+	{
+		CpuTopology topology;
+
+#ifdef PE_PLATFORM_LINUX
+		std::vector<uint32_t> online = ReadCpuList(SysCpuPath + "online");
+
+		// Intel hybrid：kernel把P-core跟E-core分成cpu_core/cpu_atom兩個PMU
+		const std::vector<uint32_t> atomCpus = ReadCpuList("/sys/devices/cpu_atom/cpus");
+		const std::set<uint32_t> atomSet(atomCpus.begin(), atomCpus.end());
+
+		std::map<std::pair<uint32_t, uint32_t>, uint32_t> coreIndices;		// (package, first sibling) -> coreIndex
+		std::map<uint32_t, uint32_t> cacheDomains;							// first CPU sharing the L3 -> domain
+		uint32_t maxCapacity = 0;
+
+		for (uint32_t id : online) {
+			const std::string cpuPath = SysCpuPath + "cpu" + std::to_string(id) + "/";
+
+			LogicalCpu cpu;
+			cpu.id = id;
+			ReadFileUInt(cpuPath + "topology/physical_package_id", cpu.packageId);
+
+			std::vector<uint32_t> siblings = ReadCpuList(cpuPath + "topology/thread_siblings_list");
+			const uint32_t firstSibling = siblings.empty() ? id : *std::min_element(siblings.begin(), siblings.end());
+			cpu.primaryThread = firstSibling == id;
+			cpu.coreIndex = coreIndices.try_emplace({ cpu.packageId, firstSibling }, static_cast<uint32_t>(coreIndices.size())).first->second;
+
+			// 沒有L3的話以package當domain
+			const std::vector<uint32_t> l3Cpus = ReadL3SharedCpus(id);
+			const uint32_t domainKey = l3Cpus.empty() ? (1u << 31) | cpu.packageId : *std::min_element(l3Cpus.begin(), l3Cpus.end());
+			cpu.cacheDomain = cacheDomains.try_emplace(domainKey, static_cast<uint32_t>(cacheDomains.size())).first->second;
+
+			// ARM big.LITTLE跟比較新的kernel上的Intel hybrid會有cpu_capacity
+			cpu.capacity = 0;
+			ReadFileUInt(cpuPath + "cpu_capacity", cpu.capacity);
+			maxCapacity = std::max(maxCapacity, cpu.capacity);
+
+			cpu.efficiencyCore = atomSet.contains(id);
+			topology.m_cpus.push_back(cpu);
+		}
+
+		for (auto& cpu : topology.m_cpus) {
+			if (maxCapacity == 0)
+				cpu.capacity = 1024;
+			else if (atomSet.empty() && cpu.capacity < maxCapacity)
+				cpu.efficiencyCore = true;
+			topology.m_hybrid |= cpu.efficiencyCore;
+		}
+
+		topology.m_physicalCoreCount = static_cast<uint32_t>(coreIndices.size());
+		topology.m_cacheDomainCount = static_cast<uint32_t>(cacheDomains.size());
+#endif // PE_PLATFORM_LINUX
+
+		// 讀不到sysfs (或其他平台) 的話每個logical CPU當作一個core
+		if (topology.m_cpus.empty()) {
+			const uint32_t count = std::max(1u, std::thread::hardware_concurrency());
+			for (uint32_t id = 0; id < count; id++) {
+				LogicalCpu cpu;
+				cpu.id = id;
+				cpu.coreIndex = id;
+				topology.m_cpus.push_back(cpu);
+			}
+			topology.m_physicalCoreCount = count;
+			topology.m_cacheDomainCount = 1;
+		}
+
+		return topology;
+	}
+
+	ThreadPlacement CpuTopology::selectPlacement(ThreadAffinityPolicy policy, bool reserveMainThreadCore) const
+	{
+		ThreadPlacement placement;
+		placement.policy = policy;
+
+		std::vector<LogicalCpu> candidates;
+		for (const auto& cpu : m_cpus) {
+			if (policy == ThreadAffinityPolicy::PhysicalCores || policy == ThreadAffinityPolicy::PerformanceCores) {
+				if (!cpu.primaryThread)
+					continue;
+			}
+			if (policy == ThreadAffinityPolicy::PerformanceCores && cpu.efficiencyCore)
+				continue;
+			candidates.push_back(cpu);
+		}
+		if (candidates.empty())
+			candidates = m_cpus;
+
+		// 同一個L3的worker排在一起，steal時比較容易偷到鄰近的
+		std::stable_sort(candidates.begin(), candidates.end(), [](const LogicalCpu& a, const LogicalCpu& b) {
+			if (a.efficiencyCore != b.efficiencyCore)
+				return !a.efficiencyCore;
+			if (a.cacheDomain != b.cacheDomain)
+				return a.cacheDomain < b.cacheDomain;
+			if (a.coreIndex != b.coreIndex)
+				return a.coreIndex < b.coreIndex;
+			return a.id < b.id;
+			});
+
+		// 第一個core (含SMT sibling) 留給main thread
+		if (reserveMainThreadCore && candidates.size() > 1) {
+			const uint32_t mainCore = candidates.front().coreIndex;
+			placement.mainThreadCpu = candidates.front().id;
+			std::erase_if(candidates, [mainCore](const LogicalCpu& cpu) { return cpu.coreIndex == mainCore; });
+			if (candidates.empty()) {
+				// 只有一個core，沒有東西可以留
+				placement.mainThreadCpu = ThreadPlacement::InvalidCpu;
+				candidates = m_cpus;
+			}
+		}
+
+		placement.workerCount = static_cast<uint32_t>(candidates.size());
+		if (policy != ThreadAffinityPolicy::Unpinned) {
+			for (const auto& cpu : candidates)
+				placement.workerCpus.push_back(cpu.id);
+		}
+
+		return placement;
+	}
+
+	std::string CpuTopology::toString() const
+	{
+		std::stringstream ss;
+		ss << m_cpus.size() << " logical, " << m_physicalCoreCount << " physical, "
+			<< m_cacheDomainCount << " L3 domain" << (m_cacheDomainCount == 1 ? "" : "s");
+
+		if (m_hybrid) {
+			std::vector<uint32_t> performance, efficiency;
+			for (const auto& cpu : m_cpus)
+				(cpu.efficiencyCore ? efficiency : performance).push_back(cpu.id);
+			ss << ", hybrid (P: " << FormatCpuList(performance) << ", E: " << FormatCpuList(efficiency) << ")";
+		}
+		if (m_physicalCoreCount < m_cpus.size())
+			ss << ", SMT";
+		return ss.str();
+	}
+
+	bool CpuTopology::PinCurrentThread(const std::vector<uint32_t>& cpus)
+	{
+		if (cpus.empty())
+			return false;
+
+#ifdef PE_PLATFORM_LINUX
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (uint32_t cpu : cpus) {
+			if (cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+		}
+		const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (result != 0) {
+			PE_CORE_WARN("[CpuTopology] pthread_setaffinity_np failed ({}).", result);
+			return false;
+		}
+		return true;
+#elifdef PE_PLATFORM_WINDOWS
+		DWORD_PTR mask = 0;
+		for (uint32_t cpu : cpus) {
+			if (cpu < sizeof(DWORD_PTR) * 8)
+				mask |= static_cast<DWORD_PTR>(1) << cpu;
+		}
+		return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+		return false;
+#endif // PE_PLATFORM_LINUX
+	}
+
+	std::string CpuTopology::FormatCpuList(std::vector<uint32_t> cpus)
+	{
+		std::sort(cpus.begin(), cpus.end());
+		std::string result;
+		for (size_t i = 0; i < cpus.size(); ) {
+			size_t j = i;
+			while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+				j++;
+			if (!result.empty())
+				result += ",";
+			result += std::to_string(cpus[i]);
+			if (j > i)
+				result += "-" + std::to_string(cpus[j]);
+			i = j + 1;
+		}
+		return result;
+	}
+
+}
@@ -0,0 +1,124 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+#include <PaperEngine/core/Base.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// Worker thread要放在哪些CPU上
+	/// </summary>
+	enum class ThreadAffinityPolicy {
+		/// <summary>
+		/// 不pin，hardware_concurrency個thread交給OS排程 (舊的行為)
+		/// </summary>
+		Unpinned,
+		/// <summary>
+		/// 每個logical CPU (包含SMT sibling) 一個worker
+		/// </summary>
+		LogicalCores,
+		/// <summary>
+		/// 每個physical core一個worker，不使用SMT sibling
+		/// </summary>
+		PhysicalCores,
+		/// <summary>
+		/// 每個P-core一個worker，不使用E-core跟SMT sibling
+		/// 不是hybrid CPU的話跟PhysicalCores一樣
+		/// </summary>
+		PerformanceCores,
+	};
+
+	PE_API const char* ThreadAffinityPolicyToString(ThreadAffinityPolicy policy);
+
+	struct LogicalCpu {
+		uint32_t id = 0;
+		/// <summary>
+		/// 同一個physical core的SMT sibling有相同的coreIndex (整台機器唯一)
+		/// </summary>
+		uint32_t coreIndex = 0;
+		uint32_t packageId = 0;
+		/// <summary>
+		/// 共用同一個L3 cache的CPU有相同的cacheDomain
+		/// </summary>
+		uint32_t cacheDomain = 0;
+		/// <summary>
+		/// 相對效能，最快的core是1024
+		/// </summary>
+		uint32_t capacity = 1024;
+		bool efficiencyCore = false;
+		/// <summary>
+		/// physical core中id最小的logical CPU
+		/// </summary>
+		bool primaryThread = true;
+	};
+
+	/// <summary>
+	/// 依照policy選出來的CPU
+	/// </summary>
+	struct ThreadPlacement {
+		ThreadAffinityPolicy policy = ThreadAffinityPolicy::Unpinned;
+		/// <summary>
+		/// 每個worker pin在一個CPU上，空的話不pin
+		/// </summary>
+		std::vector<uint32_t> workerCpus;
+		/// <summary>
+		/// main (render) thread保留的CPU，沒有保留的話是InvalidCpu
+		/// </summary>
+		uint32_t mainThreadCpu = ~0u;
+		/// <summary>
+		/// worker數量 (Unpinned時不等於workerCpus.size())
+		/// </summary>
+		uint32_t workerCount = 0;
+
+		static constexpr uint32_t InvalidCpu = ~0u;
+	};
+
+	/// <summary>
+	/// CPU的topology：physical core、SMT sibling、P/E core跟L3 domain
+	/// Linux從 /sys/devices/system/cpu 讀取，其他平台只知道logical CPU數量
+	/// </summary>
+	class CpuTopology {
+	public:
+		PE_API static CpuTopology Detect();
+
+		const std::vector<LogicalCpu>& getCpus() const { return m_cpus; }
+
+		uint32_t getLogicalCpuCount() const { return static_cast<uint32_t>(m_cpus.size()); }
+
+		uint32_t getPhysicalCoreCount() const { return m_physicalCoreCount; }
+
+		uint32_t getCacheDomainCount() const { return m_cacheDomainCount; }
+
+		bool isHybrid() const { return m_hybrid; }
+
+		/// <summary>
+		/// 依照policy選出worker的CPU
+		/// reserveMainThreadCore時第一個core (含SMT sibling) 留給main thread，不放worker
+		/// </summary>
+		PE_API ThreadPlacement selectPlacement(ThreadAffinityPolicy policy, bool reserveMainThreadCore) const;
+
+		/// <summary>
+		/// 例如 "16 logical, 8 physical, 1 L3 domain, hybrid (P: 0-7, E: 8-15)"
+		/// </summary>
+		PE_API std::string toString() const;
+
+		/// <summary>
+		/// 把呼叫的thread pin到cpus上，失敗的話回傳false
+		/// </summary>
+		PE_API static bool PinCurrentThread(const std::vector<uint32_t>& cpus);
+
+		/// <summary>
+		/// 轉成 "0-3,8,10-11" 的格式 (跟sysfs的cpulist一樣)
+		/// </summary>
+		PE_API static std::string FormatCpuList(std::vector<uint32_t> cpus);
+
+	private:
+		std::vector<LogicalCpu> m_cpus;
+		uint32_t m_physicalCoreCount = 0;
+		uint32_t m_cacheDomainCount = 0;
+		bool m_hybrid = false;
+	};
+
+}
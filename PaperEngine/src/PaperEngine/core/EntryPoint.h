@@ -15,11 +15,19 @@ namespace PaperEngine {
 		Logger::Init();
 
 		Application* app = CreateApplication(argc, argv); // This function Write in application
+#ifdef PE_DIST
+		// Release只在按hotkey時capture
+		PE_PROFILE_BEGIN_SESSION_IDLE("Runtime", "PaperProfile-Runtime.json");
+#else
 		PE_PROFILE_BEGIN_SESSION("Runtime", "PaperProfile-Runtime.json");
+#endif // PE_DIST
 		app->run();
 		PE_PROFILE_END_SESSION();
 		delete app;
 
+		// 寫完async queue中剩下的log
+		Logger::Shutdown();
+
 		// PaperEngine::CleanUp();
 
 		return 0;
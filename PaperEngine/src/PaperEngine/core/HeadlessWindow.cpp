@@ -0,0 +1,10 @@
+﻿#include "HeadlessWindow.h"
+
+namespace PaperEngine {
+
+	HeadlessWindow::HeadlessWindow(const WindowProps& props)
+		: m_title(props.Title), m_width(props.Width), m_height(props.Height)
+	{
+	}
+
+}
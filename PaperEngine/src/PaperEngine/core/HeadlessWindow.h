@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include <PaperEngine/core/Window.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 沒有視窗的Window (benchmark/CI用)
+	/// 沒有native window也沒有surface，GraphicsContext會改用offscreen framebuffer
+	/// </summary>
+	class HeadlessWindow : public Window {
+	public:
+		HeadlessWindow(const WindowProps& props);
+
+		void init() override {}
+
+		void cleanUp() override {}
+
+		bool shouldClose() const override { return false; }
+
+		void onUpdate() override {}
+
+		void setTitle(const std::string& title) override { m_title = title; }
+
+		glm::vec2 getCursorDeltaPosition() const override { return glm::vec2(0.0f); }
+
+		void setEventCallback(const EventCallbackFn& callback) override { m_eventCallback = callback; }
+
+		void* getNativeWindow() override { return nullptr; }
+
+		bool createSurface(void* instance_ptr, void* surface_ptr) override { return false; }
+
+		uint32_t getWidth() const override { return m_width; }
+
+		uint32_t getHeight() const override { return m_height; }
+
+		bool isHeadless() const override { return true; }
+
+	private:
+		std::string m_title;
+		uint32_t m_width;
+		uint32_t m_height;
+		EventCallbackFn m_eventCallback;
+	};
+
+}
@@ -0,0 +1,238 @@
+﻿#include "JobSystem.h"
+
+#include <PaperEngine/core/Assert.h>
+#include <PaperEngine/core/Logger.h>
+#include <PaperEngine/debug/Instrumentor.h>
+
+namespace PaperEngine {
+
+	static thread_local uint32_t s_workerIndex = JobSystem::InvalidWorker;
+
+	JobSystem::~JobSystem()
+	{
+		shutdown();
+	}
+
+	void JobSystem::init(uint32_t workerCount, const WorkerInitFunction& initFunction)
+	{
+		PE_CORE_ASSERT(!m_running, "JobSystem already initialized.");
+
+		m_queues.clear();
+		for (uint32_t i = 0; i < workerCount + 1; i++)
+			m_queues.push_back(CreateScope<WorkQueue>());
+
+		m_running = true;
+		for (uint32_t i = 0; i < workerCount; i++)
+			m_workers.emplace_back(&JobSystem::workerLoop, this, i, initFunction);
+
+		PE_CORE_INFO("[JobSystem] Started {} workers.", workerCount);
+	}
+
+	void JobSystem::shutdown()
+	{
+		if (!m_running)
+			return;
+
+		// 先把剩下的job做完
+		Job job;
+		while (m_pendingJobCount.load(std::memory_order_acquire) > 0)
+		{
+			if (tryPop(job))
+				execute(job);
+			else
+				std::this_thread::yield();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_running = false;
+		}
+		m_sleepCondition.notify_all();
+
+		for (auto& worker : m_workers)
+			worker.join();
+		m_workers.clear();
+		m_queues.clear();
+	}
+
+	void JobSystem::run(JobFunction job, JobCounter* counter)
+	{
+		if (counter)
+			counter->m_count.fetch_add(1, std::memory_order_relaxed);
+
+		// 沒有worker的話直接執行
+		if (m_workers.empty())
+		{
+			Job inlineJob{ std::move(job), counter };
+			execute(inlineJob);
+			return;
+		}
+
+		push({ std::move(job), counter });
+	}
+
+	void JobSystem::runAfter(JobCounter& dependency, JobFunction job, JobCounter* counter)
+	{
+		if (counter)
+			counter->m_count.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lock(dependency.m_continuationMutex);
+			if (!dependency.isDone())
+			{
+				dependency.m_continuations.emplace_back(std::move(job), counter);
+				return;
+			}
+		}
+
+		// 已經完成，直接排入 (counter已經+1過了)
+		if (m_workers.empty())
+		{
+			Job inlineJob{ std::move(job), counter };
+			execute(inlineJob);
+			return;
+		}
+		push({ std::move(job), counter });
+	}
+
+	void JobSystem::wait(JobCounter& counter)
+	{
+		PE_PROFILE_FUNCTION();
+
+		Job job;
+		while (!counter.isDone())
+		{
+			if (tryPop(job))
+				execute(job);
+			else
+				std::this_thread::yield();
+		}
+
+		// 歸零的thread可能還在finish中拿著lock，等他放開後counter才能被銷毀
+		std::lock_guard<std::mutex> lock(counter.m_continuationMutex);
+	}
+
+	uint32_t JobSystem::GetCurrentWorkerIndex()
+	{
+		return s_workerIndex;
+	}
+
+	void JobSystem::workerLoop(uint32_t workerIndex, WorkerInitFunction initFunction)
+	{
+		s_workerIndex = workerIndex;
+		if (initFunction)
+			initFunction(workerIndex);
+
+		Job job;
+		while (true)
+		{
+			if (tryPop(job))
+			{
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_sleepCondition.wait(lock, [this]() {
+				return !m_running || m_pendingJobCount.load(std::memory_order_acquire) > 0;
+				});
+			if (!m_running)
+				break;
+		}
+
+		s_workerIndex = InvalidWorker;
+	}
+
+	void JobSystem::push(Job&& job)
+	{
+		// worker放自己的queue，其他thread放共用的queue
+		const uint32_t queueIndex = s_workerIndex < m_workers.size() ? s_workerIndex : static_cast<uint32_t>(m_workers.size());
+		WorkQueue& queue = *m_queues[queueIndex];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+
+		{
+			// 在sleepMutex中+1，避免worker檢查完條件但還沒sleep時漏掉notify
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_pendingJobCount.fetch_add(1, std::memory_order_release);
+		}
+		m_sleepCondition.notify_one();
+	}
+
+	bool JobSystem::tryPop(Job& job)
+	{
+		if (m_pendingJobCount.load(std::memory_order_acquire) == 0)
+			return false;
+
+		const uint32_t queueCount = static_cast<uint32_t>(m_queues.size());
+		const uint32_t ownIndex = s_workerIndex < m_workers.size() ? s_workerIndex : queueCount - 1;
+
+		// 自己的queue從後面拿
+		{
+			WorkQueue& queue = *m_queues[ownIndex];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty())
+			{
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+				m_pendingJobCount.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		// 從下一個開始偷，避免所有thread都搶同一個queue
+		for (uint32_t offset = 1; offset < queueCount; offset++)
+		{
+			WorkQueue& queue = *m_queues[(ownIndex + offset) % queueCount];
+			std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+			if (!lock.owns_lock() || queue.jobs.empty())
+				continue;
+
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			m_pendingJobCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		return false;
+	}
+
+	void JobSystem::execute(Job& job)
+	{
+		job.function();
+		job.function = nullptr;
+		finish(job.counter);
+	}
+
+	void JobSystem::finish(JobCounter* counter)
+	{
+		if (!counter)
+			return;
+
+		std::vector<std::pair<JobFunction, JobCounter*>> continuations;
+		{
+			// 跟runAfter用同一個lock，歸零跟加入continuation不會錯過
+			std::lock_guard<std::mutex> lock(counter->m_continuationMutex);
+			if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+			continuations.swap(counter->m_continuations);
+		}
+
+		// 放開lock後wait就會返回，counter可能被銷毀，之後不能再碰counter
+		for (auto& [function, continuationCounter] : continuations)
+		{
+			if (m_workers.empty())
+			{
+				Job inlineJob{ std::move(function), continuationCounter };
+				execute(inlineJob);
+			}
+			else
+			{
+				push({ std::move(function), continuationCounter });
+			}
+		}
+	}
+
+}
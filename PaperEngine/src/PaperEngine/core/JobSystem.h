@@ -0,0 +1,191 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <PaperEngine/core/Base.h>
+
+namespace PaperEngine {
+
+	typedef std::function<void()> JobFunction;
+
+	/// <summary>
+	/// 追蹤一組job是否完成
+	/// run時+1，job執行完-1，歸零代表這組job都完成了
+	/// 可以用JobSystem::runAfter在歸零時接著執行其他job (job graph)
+	/// 要等JobSystem::wait返回後才能銷毀
+	/// </summary>
+	class JobCounter {
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		bool isDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> m_count{ 0 };
+
+		/// <summary>
+		/// 歸零時要排入的job
+		/// </summary>
+		std::mutex m_continuationMutex;
+		std::vector<std::pair<JobFunction, JobCounter*>> m_continuations;
+	};
+
+	/// <summary>
+	/// Engine的job system
+	///
+	/// 每個worker有自己的deque：自己從後面拿（LIFO，cache比較熱），其他thread從前面偷
+	/// 不是worker的thread (main thread) submit的job放在共用的queue，由worker偷
+	/// wait時呼叫的thread也會幫忙執行job，不會閒置
+	/// </summary>
+	class JobSystem {
+	public:
+		typedef std::function<void(uint32_t workerIndex)> WorkerInitFunction;
+
+	public:
+		JobSystem() = default;
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+		PE_API ~JobSystem();
+
+		/// <summary>
+		/// 建立workerCount個worker thread
+		/// initFunction在每個worker開始時呼叫 (設定affinity之類的)
+		/// </summary>
+		PE_API void init(uint32_t workerCount, const WorkerInitFunction& initFunction = nullptr);
+
+		/// <summary>
+		/// 執行完剩下的job後停止所有worker
+		/// </summary>
+		PE_API void shutdown();
+
+		/// <summary>
+		/// 排入一個job，counter不是nullptr的話會+1，job執行完-1
+		/// </summary>
+		PE_API void run(JobFunction job, JobCounter* counter = nullptr);
+
+		/// <summary>
+		/// dependency歸零後才排入job
+		/// dependency已經是0的話直接排入
+		/// </summary>
+		PE_API void runAfter(JobCounter& dependency, JobFunction job, JobCounter* counter = nullptr);
+
+		/// <summary>
+		/// 等到counter歸零，等待中會執行其他job
+		/// </summary>
+		PE_API void wait(JobCounter& counter);
+
+		/// <summary>
+		/// 把 [0, count) 切成grainSize大小的區段平行執行 func(begin, end)
+		/// 第一段在呼叫的thread執行，回傳時全部都完成了
+		/// </summary>
+		template<typename Func>
+		void parallelFor(uint32_t count, uint32_t grainSize, Func&& func)
+		{
+			if (count == 0)
+				return;
+			grainSize = std::max(1u, grainSize);
+
+			JobCounter counter;
+			for (uint32_t begin = grainSize; begin < count; begin += grainSize)
+			{
+				const uint32_t end = std::min(count, begin + grainSize);
+				run([&func, begin, end]() { func(begin, end); }, &counter);
+			}
+			func(0u, std::min(count, grainSize));
+			wait(counter);
+		}
+
+		/// <summary>
+		/// 對EnTT group (或單一component的view) 中每個entity平行執行 func(entity)
+		/// range需要有size()跟random access iterator
+		/// </summary>
+		template<typename Range, typename Func>
+		void parallelForEach(const Range& range, uint32_t grainSize, Func&& func)
+		{
+			const auto first = range.begin();
+			parallelFor(static_cast<uint32_t>(range.size()), grainSize, [&first, &func](uint32_t begin, uint32_t end)
+				{
+					auto it = std::next(first, begin);
+					for (uint32_t i = begin; i < end; i++, ++it)
+						func(*it);
+				});
+		}
+
+		/// <summary>
+		/// 依照worker數量決定grain size，讓每個thread大約分到chunksPerThread段
+		/// </summary>
+		uint32_t getGrainSize(uint32_t count, uint32_t chunksPerThread = 4) const
+		{
+			const uint32_t chunkCount = (getWorkerCount() + 1) * chunksPerThread;
+			return std::max(1u, (count + chunkCount - 1) / chunkCount);
+		}
+
+		uint32_t getWorkerCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
+		/// <summary>
+		/// 目前thread的worker index，不是worker的話回傳InvalidWorker
+		/// </summary>
+		PE_API static uint32_t GetCurrentWorkerIndex();
+
+		static constexpr uint32_t InvalidWorker = ~0u;
+
+	private:
+		struct Job {
+			JobFunction function;
+			JobCounter* counter = nullptr;
+		};
+
+		/// <summary>
+		/// 一個worker的deque
+		/// 擁有者從後面push/pop，其他thread從前面steal
+		/// </summary>
+		struct WorkQueue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+	private:
+		void workerLoop(uint32_t workerIndex, WorkerInitFunction initFunction);
+
+		void push(Job&& job);
+
+		/// <summary>
+		/// 從自己的queue拿，沒有的話去偷別人的
+		/// </summary>
+		bool tryPop(Job& job);
+
+		void execute(Job& job);
+
+		/// <summary>
+		/// counter -1，歸零的話排入continuation
+		/// </summary>
+		void finish(JobCounter* counter);
+
+	private:
+		std::vector<std::thread> m_workers;
+
+		/// <summary>
+		/// [0, workerCount) 是worker的queue，最後一個是外部thread共用的
+		/// </summary>
+		std::vector<Scope<WorkQueue>> m_queues;
+
+		std::atomic<uint32_t> m_pendingJobCount{ 0 };
+
+		std::mutex m_sleepMutex;
+		std::condition_variable m_sleepCondition;
+		std::atomic<bool> m_running{ false };
+	};
+
+}
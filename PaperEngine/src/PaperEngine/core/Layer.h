@@ -22,6 +22,12 @@ namespace PaperEngine {
 		/// <param name="deltaTime"></param>
 		virtual void onUpdate(Timestep) {}
 
+		/// <summary>
+		/// onUpdate之後在update thread呼叫
+		/// threaded rendering時把render需要的資料複製成snapshot，onFinalRender只讀snapshot
+		/// </summary>
+		virtual void onExtract() {}
+
 		/// <summary>
 		/// 用於可以直接在該frame渲染的東西
 		/// swapchainIndex已經更新了
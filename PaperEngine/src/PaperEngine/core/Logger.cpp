@@ -8,6 +8,7 @@
 #pragma warning(disable : 26495)
 #pragma warning(disable : 26498)
 #endif
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #ifdef _MSC_VER
@@ -19,19 +20,97 @@ namespace PaperEngine {
 
 	Ref<spdlog::logger> Logger::s_coreLogger;
 
-	void Logger::Init()
+	/// <summary>
+	/// async logger用的queue跟background thread
+	/// </summary>
+	static Ref<spdlog::details::thread_pool> s_threadPool;
+
+	static spdlog::async_overflow_policy ToSpdlogPolicy(LogOverflowPolicy policy)
+	{
+		switch (policy)
+		{
+		case LogOverflowPolicy::DropOldest:
+			return spdlog::async_overflow_policy::overrun_oldest;
+		case LogOverflowPolicy::DropNewest:
+#if SPDLOG_VERSION >= 11200
+			return spdlog::async_overflow_policy::discard_new;
+#else
+			// 舊版spdlog沒有discard_new
+			return spdlog::async_overflow_policy::overrun_oldest;
+#endif
+		case LogOverflowPolicy::Block:
+		default:
+			return spdlog::async_overflow_policy::block;
+		}
+	}
+
+	void Logger::Init(const LoggerProps& props)
 	{
 		std::vector<spdlog::sink_ptr> logSinks;
 		logSinks.emplace_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
-		logSinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>("PaperEngine.log", true));
+		logSinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(props.filepath, true));
 
 		logSinks[0]->set_pattern("%^[%T] %n: %v%$");
 		logSinks[1]->set_pattern("[%T] [%l] %n: %v");
 
-		s_coreLogger = CreateRef<spdlog::logger>("PaperEngine", begin(logSinks), end(logSinks));
+		if (props.async)
+		{
+			// 只有一個thread寫sink，log的順序不會亂
+			s_threadPool = CreateRef<spdlog::details::thread_pool>(props.queueSize, 1);
+			s_coreLogger = CreateRef<spdlog::async_logger>(
+				"PaperEngine",
+				begin(logSinks),
+				end(logSinks),
+				s_threadPool,
+				ToSpdlogPolicy(props.overflowPolicy));
+		}
+		else
+		{
+			s_coreLogger = CreateRef<spdlog::logger>("PaperEngine", begin(logSinks), end(logSinks));
+		}
 		spdlog::register_logger(s_coreLogger);
 		s_coreLogger->set_level(spdlog::level::trace);
+		s_coreLogger->flush_on(props.async ? props.flushLevel : spdlog::level::trace);
+
+		if (props.async && props.flushInterval.count() > 0)
+			spdlog::flush_every(props.flushInterval);
+	}
+
+	void Logger::Shutdown()
+	{
+		if (!s_coreLogger)
+			return;
+
+		s_coreLogger->flush();
+		if (!s_threadPool)
+			return;
+
+		// 保留sink，換成同步的logger，static destructor中的log還是寫得出去
+		auto sinks = s_coreLogger->sinks();
+		const auto level = s_coreLogger->level();
+		spdlog::shutdown();
+		s_threadPool = nullptr;
+
+		s_coreLogger = CreateRef<spdlog::logger>("PaperEngine", begin(sinks), end(sinks));
+		s_coreLogger->set_level(level);
 		s_coreLogger->flush_on(spdlog::level::trace);
 	}
 
+	void Logger::Flush()
+	{
+		if (s_coreLogger)
+			s_coreLogger->flush();
+	}
+
+	size_t Logger::GetDroppedMessageCount()
+	{
+		if (!s_threadPool)
+			return 0;
+#if SPDLOG_VERSION >= 11200
+		return s_threadPool->overrun_counter() + s_threadPool->discard_counter();
+#else
+		return s_threadPool->overrun_counter();
+#endif
+	}
+
 }
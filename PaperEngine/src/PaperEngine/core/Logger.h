@@ -2,6 +2,9 @@
 
 #include "Base.h"
 
+#include <chrono>
+#include <string>
+
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable : 6294)
@@ -14,9 +17,59 @@
 #endif
 namespace PaperEngine {
 
+	/// <summary>
+	/// async模式queue滿的時候要怎麼處理
+	/// </summary>
+	enum class LogOverflowPolicy {
+		/// <summary>
+		/// 等到queue有空位，不會掉log
+		/// </summary>
+		Block,
+		/// <summary>
+		/// 丟掉queue中最舊的log
+		/// </summary>
+		DropOldest,
+		/// <summary>
+		/// 丟掉新的log
+		/// </summary>
+		DropNewest,
+	};
+
+	struct LoggerProps {
+		/// <summary>
+		/// true: log先放進queue，由background thread寫到sink
+		/// false: 在呼叫的thread直接寫 (每行都flush，crash時不會掉log)
+		/// </summary>
+		bool async = true;
+		/// <summary>
+		/// async queue可以放幾條log
+		/// </summary>
+		size_t queueSize = 8192;
+		LogOverflowPolicy overflowPolicy = LogOverflowPolicy::Block;
+		/// <summary>
+		/// 定期flush的間隔，0不定期flush
+		/// </summary>
+		std::chrono::seconds flushInterval{ 1 };
+		/// <summary>
+		/// 這個level以上的log會馬上flush
+		/// </summary>
+		spdlog::level::level_enum flushLevel = spdlog::level::err;
+		std::string filepath = "PaperEngine.log";
+	};
+
 	class Logger {
 	public:
-		PE_API static void Init();
+		PE_API static void Init(const LoggerProps& props = LoggerProps());
+		/// <summary>
+		/// 把queue中的log寫完並停止background thread
+		/// 之後的log會改成同步寫到同樣的sink
+		/// </summary>
+		PE_API static void Shutdown();
+		PE_API static void Flush();
+		/// <summary>
+		/// async queue滿了被丟掉的log數量
+		/// </summary>
+		PE_API static size_t GetDroppedMessageCount();
 		PE_API inline static Ref<spdlog::logger>& GetCoreLogger() { return s_coreLogger; }
 	private:
 		static Ref<spdlog::logger> s_coreLogger;
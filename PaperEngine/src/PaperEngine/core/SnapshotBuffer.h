@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <array>
+
+#include <PaperEngine/core/Base.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// Layer在onExtract寫入，在onFinalRender讀取的snapshot
+	/// 依照Application::GetFrameNumber()放在不同的slot，update thread寫新的frame時
+	/// render thread還在讀的舊frame不會被覆蓋
+	/// 
+	/// 用法：
+	///		void onExtract() override { m_snapshots.write(Application::GetFrameNumber(), SceneSnapshot::Extract(...)); }
+	///		void onFinalRender(...) override { if (auto snapshot = m_snapshots.read(Application::GetFrameNumber())) ... }
+	/// </summary>
+	template<typename T>
+	class SnapshotBuffer {
+	public:
+		/// <summary>
+		/// 需要 >= Application::MaxFramesAhead + 1
+		/// </summary>
+		static constexpr uint32_t SlotCount = 4;
+
+		void write(uint64_t frameNumber, Ref<const T> snapshot)
+		{
+			Slot& slot = m_slots[frameNumber % SlotCount];
+			slot.frameNumber = frameNumber;
+			slot.snapshot = std::move(snapshot);
+		}
+
+		/// <summary>
+		/// 那個frame沒有寫入的話回傳nullptr
+		/// </summary>
+		Ref<const T> read(uint64_t frameNumber) const
+		{
+			const Slot& slot = m_slots[frameNumber % SlotCount];
+			return slot.frameNumber == frameNumber ? slot.snapshot : nullptr;
+		}
+
+	private:
+		struct Slot {
+			uint64_t frameNumber = ~0ull;
+			Ref<const T> snapshot;
+		};
+
+		std::array<Slot, SlotCount> m_slots;
+	};
+
+}
@@ -2,10 +2,13 @@
 #include <PaperEngine/core/Window.h>
 
 #include "GLFWWindow.h"
+#include "HeadlessWindow.h"
 
 namespace PaperEngine {
 	Scope<Window> Window::Create(const WindowProps& props)
 	{
+		if (props.headless)
+			return CreateScope<HeadlessWindow>(props);
 		return CreateScope<GLFWWindow>(props);
 	}
 }
@@ -20,10 +20,16 @@ namespace PaperEngine {
 
 		bool disableMinimizeBox{ false };
 
+		/// <summary>
+		/// 不開視窗，GraphicsContext畫到offscreen framebuffer
+		/// </summary>
+		bool headless{ false };
+
 		WindowProps(const std::string& title = "Paper Engine",
 			uint32_t width = 1600,
-			uint32_t height = 900)
-			: Title(title), Width(width), Height(height)
+			uint32_t height = 900,
+			bool headless = false)
+			: Title(title), Width(width), Height(height), headless(headless)
 		{
 		}
 	};
@@ -54,6 +60,8 @@ namespace PaperEngine {
 		virtual uint32_t getWidth() const = 0;
 		virtual uint32_t getHeight() const = 0;
 
+		virtual bool isHeadless() const { return false; }
+
 		static Scope<Window> Create(const WindowProps& props = WindowProps());
 
 	};
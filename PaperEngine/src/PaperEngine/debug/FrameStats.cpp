@@ -0,0 +1,232 @@
+﻿#include "FrameStats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+#include <PaperEngine/imgui/ImGuiInclude.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+
+namespace PaperEngine {
+
+	FrameStats::StatHandle FrameStats::registerStat(const std::string& name, FrameStatType type)
+	{
+		std::lock_guard<std::mutex> lock(m_registerMutex);
+
+		auto it = m_statHandles.find(name);
+		if (it != m_statHandles.end())
+			return it->second;
+
+		const uint32_t count = m_statCount.load(std::memory_order_relaxed);
+		if (count >= MaxStatCount)
+		{
+			PE_CORE_ERROR("[FrameStats] Stat count exceed {}, '{}' is ignored.", MaxStatCount, name);
+			return InvalidStat;
+		}
+
+		Stat& stat = m_stats[count];
+		stat.name = name;
+		stat.type = type;
+		m_statHandles[name] = count;
+		m_statCount.store(count + 1, std::memory_order_release);
+		return count;
+	}
+
+	void FrameStats::endFrame()
+	{
+		const uint32_t count = getStatCount();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Stat& stat = m_stats[i];
+			stat.history[m_historyHead] = static_cast<float>(stat.current.exchange(0.0, std::memory_order_relaxed));
+		}
+
+		m_historyHead = (m_historyHead + 1) % HistoryLength;
+		m_frameCount++;
+	}
+
+	void FrameStats::reset()
+	{
+		const uint32_t count = getStatCount();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			m_stats[i].current.store(0.0, std::memory_order_relaxed);
+			m_stats[i].history.fill(0.0f);
+		}
+
+		m_historyHead = 0;
+		m_frameCount = 0;
+	}
+
+	uint32_t FrameStats::copyHistory(StatHandle stat, float* out) const
+	{
+		const uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(m_frameCount, HistoryLength));
+		const uint32_t first = (m_historyHead + HistoryLength - length) % HistoryLength;
+		for (uint32_t i = 0; i < length; i++)
+			out[i] = m_stats[stat].history[(first + i) % HistoryLength];
+		return length;
+	}
+
+	FrameStats::Summary FrameStats::getSummary(StatHandle stat) const
+	{
+		Summary summary;
+		if (stat >= getStatCount())
+			return summary;
+
+		std::array<float, HistoryLength> values;
+		const uint32_t length = copyHistory(stat, values.data());
+		if (length == 0)
+			return summary;
+
+		summary.last = values[length - 1];
+
+		double total = 0.0;
+		summary.min = values[0];
+		for (uint32_t i = 0; i < length; i++)
+		{
+			summary.min = std::min<double>(summary.min, values[i]);
+			total += values[i];
+		}
+		summary.avg = total / length;
+
+		const uint32_t p99Index = std::min(length - 1, static_cast<uint32_t>(length * 0.99));
+		std::nth_element(values.begin(), values.begin() + p99Index, values.begin() + length);
+		summary.p99 = values[p99Index];
+
+		return summary;
+	}
+
+	void FrameStats::drawImGui()
+	{
+		ImGui::Begin("Frame Stats");
+
+		bool gpuTiming = GPUProfiler::Get().isEnabled();
+		if (ImGui::Checkbox("GPU timing", &gpuTiming))
+			GPUProfiler::Get().setEnabled(gpuTiming);
+		ImGui::SameLine();
+		if (ImGui::Button("Dump CSV"))
+			dumpCSV("FrameStats.csv");
+		ImGui::SameLine();
+		if (ImGui::Button("Dump JSON"))
+			dumpJSON("FrameStats.json");
+
+		if (ImGui::BeginTable("FrameStatsTable", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_SizingStretchProp))
+		{
+			ImGui::TableSetupColumn("Name");
+			ImGui::TableSetupColumn("Last");
+			ImGui::TableSetupColumn("Min");
+			ImGui::TableSetupColumn("Avg");
+			ImGui::TableSetupColumn("P99");
+			ImGui::TableSetupColumn("History");
+			ImGui::TableHeadersRow();
+
+			std::array<float, HistoryLength> values;
+			const uint32_t count = getStatCount();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const Summary summary = getSummary(i);
+				const char* format = m_stats[i].type == FrameStatType::Timer ? "%.3f ms" : "%.0f";
+
+				ImGui::PushID(static_cast<int>(i));
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(m_stats[i].name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text(format, summary.last);
+				ImGui::TableNextColumn();
+				ImGui::Text(format, summary.min);
+				ImGui::TableNextColumn();
+				ImGui::Text(format, summary.avg);
+				ImGui::TableNextColumn();
+				ImGui::Text(format, summary.p99);
+				ImGui::TableNextColumn();
+				const uint32_t length = copyHistory(i, values.data());
+				ImGui::PlotLines("##history", values.data(), static_cast<int>(length), 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(-1.0f, 20.0f));
+				ImGui::PopID();
+			}
+
+			ImGui::EndTable();
+		}
+
+		ImGui::End();
+	}
+
+	bool FrameStats::dumpCSV(const std::string& filepath) const
+	{
+		std::ofstream out(filepath);
+		if (!out.is_open())
+		{
+			PE_CORE_ERROR("[FrameStats] Could not open '{}'.", filepath);
+			return false;
+		}
+
+		std::array<float, HistoryLength> values;
+		const uint32_t count = getStatCount();
+		const uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(m_frameCount, HistoryLength));
+
+		out << std::setprecision(6);
+		out << "name,min,avg,p99";
+		for (uint32_t frame = 0; frame < length; frame++)
+			out << ",f" << frame;
+		out << "\n";
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Summary summary = getSummary(i);
+			out << '"' << m_stats[i].name << '"' << ',' << summary.min << ',' << summary.avg << ',' << summary.p99;
+			copyHistory(i, values.data());
+			for (uint32_t frame = 0; frame < length; frame++)
+				out << ',' << values[frame];
+			out << "\n";
+		}
+
+		PE_CORE_INFO("[FrameStats] Dumped {} stats to '{}'.", count, filepath);
+		return true;
+	}
+
+	bool FrameStats::dumpJSON(const std::string& filepath) const
+	{
+		std::ofstream out(filepath);
+		if (!out.is_open())
+		{
+			PE_CORE_ERROR("[FrameStats] Could not open '{}'.", filepath);
+			return false;
+		}
+
+		writeJSON(out);
+
+		PE_CORE_INFO("[FrameStats] Dumped {} stats to '{}'.", getStatCount(), filepath);
+		return true;
+	}
+
+	void FrameStats::writeJSON(std::ostream& out) const
+	{
+		std::array<float, HistoryLength> values;
+		const uint32_t count = getStatCount();
+
+		out << std::setprecision(6);
+		out << "{\"frameCount\":" << m_frameCount << ",\"stats\":[";
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Summary summary = getSummary(i);
+			const char* type = m_stats[i].type == FrameStatType::Timer ? "timer" :
+				(m_stats[i].type == FrameStatType::Bytes ? "bytes" : "counter");
+
+			if (i > 0)
+				out << ",";
+			out << "{\"name\":\"" << m_stats[i].name << "\",";
+			out << "\"type\":\"" << type << "\",";
+			out << "\"min\":" << summary.min << ",";
+			out << "\"avg\":" << summary.avg << ",";
+			out << "\"p99\":" << summary.p99 << ",";
+			out << "\"history\":[";
+			const uint32_t length = copyHistory(i, values.data());
+			for (uint32_t frame = 0; frame < length; frame++)
+				out << (frame > 0 ? "," : "") << values[frame];
+			out << "]}";
+		}
+		out << "]}";
+	}
+
+}
@@ -0,0 +1,175 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include <PaperEngine/core/Base.h>
+
+namespace PaperEngine {
+
+	enum class FrameStatType {
+		/// <summary>
+		/// 數量，同一個frame中add的值會加總
+		/// </summary>
+		Counter,
+		/// <summary>
+		/// 時間(ms)，同一個frame中add的值會加總
+		/// </summary>
+		Timer,
+		/// <summary>
+		/// bytes
+		/// </summary>
+		Bytes,
+	};
+
+	/// <summary>
+	/// 每個frame的統計數據
+	///
+	/// 各個subsystem用PE_FRAME_STAT_*把數值加到這個frame
+	/// Application在frame結束時呼叫endFrame，把數值存進HistoryLength個frame的ring
+	/// 再從ring計算min/avg/p99
+	///
+	/// add/set可以在任何thread呼叫（atomic），endFrame跟讀取只能在main thread
+	/// </summary>
+	class FrameStats {
+	public:
+		typedef uint32_t StatHandle;
+
+		static constexpr StatHandle InvalidStat = ~0u;
+
+		static constexpr uint32_t MaxStatCount = 128;
+
+		static constexpr uint32_t HistoryLength = 240;
+
+		struct Summary {
+			double last = 0.0;
+			double min = 0.0;
+			double avg = 0.0;
+			double p99 = 0.0;
+		};
+
+	public:
+		FrameStats(const FrameStats&) = delete;
+		FrameStats(FrameStats&&) = delete;
+
+		/// <summary>
+		/// 註冊一個統計，同名的會回傳同一個handle
+		/// </summary>
+		PE_API StatHandle registerStat(const std::string& name, FrameStatType type);
+
+		void add(StatHandle stat, double value)
+		{
+			if (stat < MaxStatCount)
+				m_stats[stat].current.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		void set(StatHandle stat, double value)
+		{
+			if (stat < MaxStatCount)
+				m_stats[stat].current.store(value, std::memory_order_relaxed);
+		}
+
+		/// <summary>
+		/// 由Application在每個frame最後呼叫
+		/// </summary>
+		PE_API void endFrame();
+
+		/// <summary>
+		/// 清掉所有history，統計的註冊保留 (benchmark warmup後呼叫)
+		/// </summary>
+		PE_API void reset();
+
+		PE_API Summary getSummary(StatHandle stat) const;
+
+		uint32_t getStatCount() const { return m_statCount.load(std::memory_order_acquire); }
+
+		const std::string& getName(StatHandle stat) const { return m_stats[stat].name; }
+
+		FrameStatType getType(StatHandle stat) const { return m_stats[stat].type; }
+
+		uint64_t getFrameCount() const { return m_frameCount; }
+
+		/// <summary>
+		/// 畫出"Frame Stats"的ImGui視窗
+		/// </summary>
+		PE_API void drawImGui();
+
+		/// <summary>
+		/// 輸出每個統計的min/avg/p99跟最近HistoryLength個frame的數值
+		/// </summary>
+		PE_API bool dumpCSV(const std::string& filepath) const;
+
+		PE_API bool dumpJSON(const std::string& filepath) const;
+
+		/// <summary>
+		/// dumpJSON的內容，給要加上其他資訊的工具用 (PaperBench)
+		/// </summary>
+		PE_API void writeJSON(std::ostream& out) const;
+
+		PE_API static FrameStats& Get()
+		{
+			static FrameStats instance;
+			return instance;
+		}
+
+	private:
+		FrameStats() = default;
+
+		/// <summary>
+		/// 從舊到新取出history
+		/// </summary>
+		uint32_t copyHistory(StatHandle stat, float* out) const;
+
+	private:
+		struct Stat {
+			std::string name;
+			FrameStatType type = FrameStatType::Counter;
+			std::atomic<double> current{ 0.0 };
+			std::array<float, HistoryLength> history{};
+		};
+
+		std::mutex m_registerMutex;
+		std::unordered_map<std::string, StatHandle> m_statHandles;
+
+		std::array<Stat, MaxStatCount> m_stats;
+		std::atomic<uint32_t> m_statCount{ 0 };
+
+		uint64_t m_frameCount = 0;
+		uint32_t m_historyHead = 0;
+	};
+
+	/// <summary>
+	/// 把scope的CPU時間(ms)加到timer統計
+	/// </summary>
+	class FrameStatTimer {
+	public:
+		FrameStatTimer(FrameStats::StatHandle stat)
+			: m_stat(stat), m_start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~FrameStatTimer()
+		{
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_start;
+			FrameStats::Get().add(m_stat, elapsed.count());
+		}
+
+	private:
+		FrameStats::StatHandle m_stat;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+}
+
+#define PE_FRAME_STAT_HANDLE(name, type) []() { static const ::PaperEngine::FrameStats::StatHandle s_stat = ::PaperEngine::FrameStats::Get().registerStat(name, type); return s_stat; }()
+#define PE_FRAME_STAT_COUNT(name, value) ::PaperEngine::FrameStats::Get().add(PE_FRAME_STAT_HANDLE(name, ::PaperEngine::FrameStatType::Counter), static_cast<double>(value))
+#define PE_FRAME_STAT_BYTES(name, value) ::PaperEngine::FrameStats::Get().add(PE_FRAME_STAT_HANDLE(name, ::PaperEngine::FrameStatType::Bytes), static_cast<double>(value))
+#define PE_FRAME_STAT_TIME(name, ms) ::PaperEngine::FrameStats::Get().add(PE_FRAME_STAT_HANDLE(name, ::PaperEngine::FrameStatType::Timer), static_cast<double>(ms))
+#define PE_FRAME_STAT_SCOPE_LINE2(name, line) ::PaperEngine::FrameStatTimer frameStatTimer##line(PE_FRAME_STAT_HANDLE(name, ::PaperEngine::FrameStatType::Timer))
+#define PE_FRAME_STAT_SCOPE_LINE(name, line) PE_FRAME_STAT_SCOPE_LINE2(name, line)
+#define PE_FRAME_STAT_SCOPE(name) PE_FRAME_STAT_SCOPE_LINE(name, __LINE__)
@@ -0,0 +1,163 @@
+﻿#include "GPUProfiler.h"
+
+#include <chrono>
+#include <algorithm>
+
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	// 巢狀深度跟著thread走，worker在自己的command list上記錄的scope不會被算進main thread的scope裡
+	static thread_local uint32_t s_currentDepth = 0;
+
+	void GPUProfiler::init(nvrhi::IDevice* device, uint32_t frameInFlightCount)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_device = device;
+		m_frames.clear();
+		m_frames.resize(frameInFlightCount);
+		m_currentFrame = 0;
+		s_currentDepth = 0;
+		m_frameActive = false;
+	}
+
+	void GPUProfiler::shutdown()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_frames.clear();
+		m_lastResults.clear();
+		m_device = nullptr;
+		m_frameActive = false;
+	}
+
+	void GPUProfiler::beginFrame(uint32_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_device || frameIndex >= m_frames.size())
+			return;
+
+		resolveFrame(frameIndex);
+
+		m_currentFrame = frameIndex;
+		s_currentDepth = 0;
+		m_frameActive = true;
+	}
+
+	uint32_t GPUProfiler::beginScope(nvrhi::ICommandList* cmd, const char* name)
+	{
+		if (!isActive())
+			return InvalidScope;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_frameActive)
+			return InvalidScope;
+
+		auto& frame = m_frames[m_currentFrame];
+		const uint32_t index = static_cast<uint32_t>(frame.scopes.size());
+		if (index >= MaxQueriesPerFrame)
+			return InvalidScope;
+
+		// query用到才建立，之後一直重複使用
+		if (index >= frame.queries.size())
+			frame.queries.push_back(m_device->createTimerQuery());
+
+		if (frame.scopes.empty())
+			frame.cpuStartTicks = Instrumentor::GetTicks();
+
+		frame.scopes.push_back({ name, s_currentDepth, false });
+		s_currentDepth++;
+
+		cmd->beginTimerQuery(frame.queries[index]);
+		return index;
+	}
+
+	void GPUProfiler::endScope(nvrhi::ICommandList* cmd, uint32_t scope)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_frameActive)
+			return;
+
+		auto& frame = m_frames[m_currentFrame];
+		if (scope >= frame.scopes.size())
+			return;
+
+		cmd->endTimerQuery(frame.queries[scope]);
+		frame.scopes[scope].ended = true;
+		if (s_currentDepth > 0)
+			s_currentDepth--;
+	}
+
+	bool GPUProfiler::isActive() const
+	{
+		return m_enabled || Instrumentor::Get().isCapturing();
+	}
+
+	void GPUProfiler::resolveFrame(uint32_t frameIndex)
+	{
+		auto& frame = m_frames[frameIndex];
+		if (frame.scopes.empty())
+			return;
+
+		using TickPeriod = std::chrono::steady_clock::period;
+		const double ticksPerSecond = static_cast<double>(TickPeriod::den) / TickPeriod::num;
+
+		std::vector<GPUProfileResult> results;
+		results.reserve(frame.scopes.size());
+
+		// 依照depth排列在GPU track上
+		struct Cursor {
+			int64_t start;
+			int64_t childCursor;
+		};
+		std::vector<Cursor> stack;
+		int64_t cursor = std::max(frame.cpuStartTicks, m_lastGpuEndTicks);
+
+		bool complete = true;
+		for (uint32_t i = 0; i < frame.scopes.size(); i++)
+		{
+			const auto& scope = frame.scopes[i];
+			const auto& query = frame.queries[i];
+
+			// 正常情況fence已經等過了，沒結果的話直接丟掉，不等待
+			if (!scope.ended || !m_device->pollTimerQuery(query))
+			{
+				complete = false;
+				continue;
+			}
+
+			const float seconds = m_device->getTimerQueryTime(query);
+			results.push_back({ scope.name, scope.depth, seconds * 1000.0f });
+
+			auto statIt = m_statHandles.find(scope.name);
+			if (statIt == m_statHandles.end())
+				statIt = m_statHandles.emplace(scope.name, FrameStats::Get().registerStat(std::string("GPU ") + scope.name, FrameStatType::Timer)).first;
+			FrameStats::Get().add(statIt->second, seconds * 1000.0);
+
+			while (stack.size() > scope.depth)
+				stack.pop_back();
+
+			const int64_t start = stack.empty() ? cursor : stack.back().childCursor;
+			const int64_t end = start + static_cast<int64_t>(seconds * ticksPerSecond);
+
+			if (stack.empty())
+				cursor = end;
+			else
+				stack.back().childCursor = end;
+			stack.push_back({ start, start });
+
+			Instrumentor::Get().writeGpuEvent(scope.name, start, end);
+		}
+
+		for (uint32_t i = 0; i < frame.scopes.size(); i++)
+			m_device->resetTimerQuery(frame.queries[i]);
+
+		m_lastGpuEndTicks = cursor;
+		if (complete)
+			m_lastResults = std::move(results);
+		frame.scopes.clear();
+	}
+
+}
@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+
+namespace PaperEngine {
+
+	struct GPUProfileResult {
+		const char* name;
+		uint32_t depth;
+		float milliseconds;
+	};
+
+	/// <summary>
+	/// 用nvrhi timer query量GPU時間
+	///
+	/// 每個frame in flight有自己的query pool
+	/// beginFrame(frameIndex)時GraphicsContext已經等過這個frame的fence
+	/// 所以上一輪(frameInFlight個frame前)的query一定有結果，讀取不會stall
+	///
+	/// nvrhi的timer query只有duration，沒有GPU的絕對時間
+	/// 寫到Chrome trace時以該frame第一個scope的CPU時間為起點，依照記錄順序排列（巢狀的放在parent裡）
+	///
+	/// 只在Instrumentor capture中或setEnabled(true)時才會發query
+	/// 一個scope的begin/end要在同一個thread、同一個command list上
+	/// 平行錄製時每個command list各自記錄一個scope，同名的scope時間會加總到同一個stat
+	/// </summary>
+	class GPUProfiler {
+	public:
+		static constexpr uint32_t MaxQueriesPerFrame = 256;
+
+		static constexpr uint32_t InvalidScope = ~0u;
+
+	public:
+		GPUProfiler(const GPUProfiler&) = delete;
+		GPUProfiler(GPUProfiler&&) = delete;
+
+		PE_API void init(nvrhi::IDevice* device, uint32_t frameInFlightCount);
+
+		PE_API void shutdown();
+
+		/// <summary>
+		/// GraphicsContext::beginFrame成功後呼叫
+		/// 讀取這個frame index上一輪的結果並重置query pool
+		/// </summary>
+		PE_API void beginFrame(uint32_t frameIndex);
+
+		PE_API uint32_t beginScope(nvrhi::ICommandList* cmd, const char* name);
+
+		PE_API void endScope(nvrhi::ICommandList* cmd, uint32_t scope);
+
+		/// <summary>
+		/// 不在capture中也量GPU時間（給debug UI用）
+		/// </summary>
+		void setEnabled(bool enabled) { m_enabled = enabled; }
+
+		bool isEnabled() const { return m_enabled; }
+
+		/// <summary>
+		/// 最近一個讀回來的frame的結果
+		/// </summary>
+		const std::vector<GPUProfileResult>& getLastResults() const { return m_lastResults; }
+
+		PE_API static GPUProfiler& Get()
+		{
+			static GPUProfiler instance;
+			return instance;
+		}
+
+	private:
+		GPUProfiler() = default;
+
+		bool isActive() const;
+
+		void resolveFrame(uint32_t frameIndex);
+
+	private:
+		struct ScopeRecord {
+			const char* name;
+			uint32_t depth;
+			bool ended;
+		};
+
+		struct FrameQueries {
+			std::vector<nvrhi::TimerQueryHandle> queries;
+			std::vector<ScopeRecord> scopes;
+			int64_t cpuStartTicks = 0;
+		};
+
+		std::mutex m_mutex;
+		nvrhi::DeviceHandle m_device;
+		std::vector<FrameQueries> m_frames;
+		uint32_t m_currentFrame = 0;
+		bool m_enabled = false;
+		bool m_frameActive = false;
+
+		// scope名稱 -> FrameStats的handle ("GPU <name>")
+		std::unordered_map<const char*, uint32_t> m_statHandles;
+
+		// GPU track上一個frame結束的時間，避免frame之間重疊
+		int64_t m_lastGpuEndTicks = 0;
+
+		std::vector<GPUProfileResult> m_lastResults;
+	};
+
+	class GPUProfileScope {
+	public:
+		GPUProfileScope(nvrhi::ICommandList* cmd, const char* name)
+			: m_cmd(cmd)
+		{
+			m_scope = GPUProfiler::Get().beginScope(cmd, name);
+		}
+
+		~GPUProfileScope()
+		{
+			if (m_scope != GPUProfiler::InvalidScope)
+				GPUProfiler::Get().endScope(m_cmd, m_scope);
+		}
+
+	private:
+		nvrhi::ICommandList* m_cmd;
+		uint32_t m_scope;
+	};
+
+}
+
+#ifdef PE_PROFILE
+#define PE_PROFILE_GPU_SCOPE_LINE2(cmd, name, line) ::PaperEngine::GPUProfileScope gpuScope##line(cmd, name)
+#define PE_PROFILE_GPU_SCOPE_LINE(cmd, name, line) PE_PROFILE_GPU_SCOPE_LINE2(cmd, name, line)
+#define PE_PROFILE_GPU_SCOPE(cmd, name) PE_PROFILE_GPU_SCOPE_LINE(cmd, name, __LINE__)
+#else
+#define PE_PROFILE_GPU_SCOPE(cmd, name)
+#endif
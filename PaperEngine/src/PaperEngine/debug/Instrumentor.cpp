@@ -1,11 +1,19 @@
 ﻿#include "Instrumentor.h"
 
+#include <iomanip>
+
 namespace PaperEngine {
 
-	void Instrumentor::BeginSession(const std::string& name, const std::string& filepath)
+	namespace {
+
+		constexpr double TicksToMicroseconds =
+			1000000.0 * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+
+	}
+
+	void Instrumentor::BeginSession(const std::string& name, const std::string& filepath, uint32_t captureFrameCount)
 	{
-		std::lock_guard lock(m_Mutex);
-		if (m_CurrentSession)
+		if (m_sessionActive)
 		{
 			// If there is already a current session, then close it before beginning new one.
 			// Subsequent profiling output meant for the original session will end up in the
@@ -13,25 +21,200 @@ namespace PaperEngine {
 			// profiling output.
 			if (Logger::GetCoreLogger()) // Edge case: BeginSession() might be before Log::Init()
 			{
-				PE_CORE_ERROR("Instrumentor::BeginSession('{0}') when session '{1}' already open.", name, m_CurrentSession->Name);
+				PE_CORE_ERROR("Instrumentor::BeginSession('{0}') when session '{1}' already open.", name, m_sessionName);
 			}
-			InternalEndSession();
+			EndSession();
 		}
-		m_OutputStream.open(filepath);
 
-		if (m_OutputStream.is_open())
-		{
-			m_CurrentSession = new InstrumentationSession({ name });
-			void* pCurrentSession = &m_CurrentSession; (void*)pCurrentSession;
-			WriteHeader();
-		}
-		else
+		std::lock_guard lock(m_sessionMutex);
+		m_outputStream.open(filepath);
+
+		if (!m_outputStream.is_open())
 		{
 			if (Logger::GetCoreLogger()) // Edge case: BeginSession() might be before Log::Init()
 			{
 				PE_CORE_ERROR("Instrumentor could not open results file '{0}'.", filepath);
 			}
+			return;
+		}
+
+		m_sessionName = name;
+		m_sessionActive = true;
+		m_droppedEventCount = 0;
+		m_outputStream << std::setprecision(3) << std::fixed;
+		writeHeader();
+
+		m_writerRunning = true;
+		m_writerThread = std::thread(&Instrumentor::writerThreadLoop, this);
+
+		m_remainingCaptureFrames = 0;
+		m_pendingCaptureFrames = 0;
+		if (captureFrameCount == InfiniteCapture)
+		{
+			m_remainingCaptureFrames = InfiniteCapture;
+			m_capturing = true;
+		}
+		else if (captureFrameCount > 0)
+		{
+			captureFrames(captureFrameCount);
+		}
+	}
+
+	void Instrumentor::EndSession()
+	{
+		std::lock_guard lock(m_sessionMutex);
+		if (!m_sessionActive)
+			return;
+
+		m_capturing = false;
+
+		{
+			std::lock_guard writerLock(m_writerMutex);
+			m_writerRunning = false;
+		}
+		m_writerCondition.notify_one();
+		if (m_writerThread.joinable())
+			m_writerThread.join();
+
+		// writer停了之後把剩下的event寫完
+		drainBuffers();
+
+		writeFooter();
+		m_outputStream.close();
+		m_sessionActive = false;
+
+		if (m_droppedEventCount > 0 && Logger::GetCoreLogger())
+		{
+			PE_CORE_WARN("Instrumentor session '{0}' dropped {1} events (ring buffer full).", m_sessionName, m_droppedEventCount.load());
 		}
 	}
 
+	void Instrumentor::captureFrames(uint32_t frameCount)
+	{
+		m_pendingCaptureFrames.store(frameCount, std::memory_order_relaxed);
+	}
+
+	void Instrumentor::frameMark()
+	{
+		const uint32_t pending = m_pendingCaptureFrames.exchange(0, std::memory_order_relaxed);
+		if (pending > 0 && m_sessionActive)
+		{
+			m_remainingCaptureFrames = pending;
+			m_capturing.store(true, std::memory_order_relaxed);
+		}
+
+		if (!isCapturing())
+			return;
+
+		if (m_remainingCaptureFrames != InfiniteCapture)
+		{
+			if (m_remainingCaptureFrames == 0)
+			{
+				m_capturing.store(false, std::memory_order_relaxed);
+				return;
+			}
+			m_remainingCaptureFrames--;
+		}
+
+		const int64_t now = GetTicks();
+		writeEvent({ "Frame", now, now, 0, ProfileEventType::FrameMark });
+	}
+
+	void Instrumentor::writeEvent(const ProfileEvent& e)
+	{
+		ProfileEventBuffer* buffer = getThreadBuffer();
+
+		ProfileEvent event = e;
+		event.threadIndex = buffer->getThreadIndex();
+		if (!buffer->push(event))
+			m_droppedEventCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Instrumentor::writeGpuEvent(const char* name, int64_t start, int64_t end)
+	{
+		if (!isCapturing())
+			return;
+
+		if (!getThreadBuffer()->push({ name, start, end, GpuTrackThreadId, ProfileEventType::GpuScope }))
+			m_droppedEventCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	ProfileEventBuffer* Instrumentor::getThreadBuffer()
+	{
+		thread_local ProfileEventBuffer* t_buffer = nullptr;
+		if (t_buffer)
+			return t_buffer;
+
+		// 每個thread只會進來一次
+		std::lock_guard lock(m_buffersMutex);
+		m_buffers.push_back(std::make_unique<ProfileEventBuffer>(static_cast<uint32_t>(m_buffers.size())));
+		t_buffer = m_buffers.back().get();
+		return t_buffer;
+	}
+
+	void Instrumentor::writerThreadLoop()
+	{
+		std::unique_lock lock(m_writerMutex);
+		while (m_writerRunning)
+		{
+			m_writerCondition.wait_for(lock, std::chrono::milliseconds(10), [this]() { return !m_writerRunning; });
+
+			lock.unlock();
+			drainBuffers();
+			lock.lock();
+		}
+	}
+
+	void Instrumentor::drainBuffers()
+	{
+		std::vector<ProfileEventBuffer*> buffers;
+		{
+			std::lock_guard lock(m_buffersMutex);
+			buffers.reserve(m_buffers.size());
+			for (auto& buffer : m_buffers)
+				buffers.push_back(buffer.get());
+		}
+
+		for (auto buffer : buffers)
+		{
+			buffer->drain([this](const ProfileEvent& e) {
+				const double start = static_cast<double>(e.start) * TicksToMicroseconds;
+
+				m_outputStream << ",{";
+				if (e.type == ProfileEventType::FrameMark)
+				{
+					m_outputStream << "\"cat\":\"frame\",";
+					m_outputStream << "\"name\":\"" << e.name << "\",";
+					m_outputStream << "\"ph\":\"i\",";
+					m_outputStream << "\"s\":\"g\",";
+				}
+				else
+				{
+					m_outputStream << (e.type == ProfileEventType::GpuScope ? "\"cat\":\"gpu\"," : "\"cat\":\"function\",");
+					m_outputStream << "\"dur\":" << static_cast<double>(e.end - e.start) * TicksToMicroseconds << ',';
+					m_outputStream << "\"name\":\"" << e.name << "\",";
+					m_outputStream << "\"ph\":\"X\",";
+				}
+				m_outputStream << "\"pid\":0,";
+				m_outputStream << "\"tid\":" << (e.type == ProfileEventType::GpuScope ? GpuTrackThreadId : e.threadIndex) << ",";
+				m_outputStream << "\"ts\":" << start;
+				m_outputStream << "}";
+			});
+		}
+		m_outputStream.flush();
+	}
+
+	void Instrumentor::writeHeader()
+	{
+		m_outputStream << "{\"otherData\": {},\"traceEvents\":[{}";
+		m_outputStream << ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GpuTrackThreadId << ",\"args\":{\"name\":\"GPU\"}}";
+		m_outputStream.flush();
+	}
+
+	void Instrumentor::writeFooter()
+	{
+		m_outputStream << "]}";
+		m_outputStream.flush();
+	}
+
 }
@@ -2,70 +2,167 @@
 
 #include "PaperEngine/core/Logger.h"
 
-#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
-#include <iomanip>
+#include <memory>
 #include <string>
 #include <thread>
 #include <mutex>
-#include <sstream>
+#include <vector>
 
 namespace PaperEngine {
 
-	using FloatingPointMicroseconds = std::chrono::duration<double, std::micro>;
+	enum class ProfileEventType : uint32_t {
+		Scope,
+		/// <summary>
+		/// Frame的分界，Chrome trace中以instant event顯示
+		/// </summary>
+		FrameMark,
+		/// <summary>
+		/// GPUProfiler解析出來的GPU時間，寫在獨立的"GPU" track
+		/// </summary>
+		GpuScope,
+	};
 
-	struct ProfileResult
+	/// <summary>
+	/// 寫進ring buffer的binary event
+	/// name必須是static storage的字串（PE_PROFILE_SCOPE的名稱是constexpr）
+	/// start/end是steady_clock的tick
+	/// </summary>
+	struct ProfileEvent
 	{
-		std::string Name;
-
-		FloatingPointMicroseconds Start;
-		std::chrono::microseconds ElapsedTime;
-		std::thread::id ThreadID;
+		const char* name;
+		int64_t start;
+		int64_t end;
+		uint32_t threadIndex;
+		ProfileEventType type;
 	};
 
-	struct InstrumentationSession
+	/// <summary>
+	/// 單一thread使用的single-producer single-consumer ring buffer
+	/// producer: 擁有這個buffer的thread
+	/// consumer: Instrumentor的writer thread
+	/// 滿了的話新的event直接丟掉，不會block
+	/// </summary>
+	class ProfileEventBuffer
 	{
-		std::string Name;
+	public:
+		static constexpr uint32_t Capacity = 1 << 16;
+
+		explicit ProfileEventBuffer(uint32_t threadIndex)
+			: m_threadIndex(threadIndex), m_events(Capacity)
+		{
+		}
+
+		uint32_t getThreadIndex() const { return m_threadIndex; }
+
+		bool push(const ProfileEvent& e)
+		{
+			const uint64_t head = m_head.load(std::memory_order_relaxed);
+			if (head - m_tail.load(std::memory_order_acquire) >= Capacity)
+				return false;
+
+			m_events[head & (Capacity - 1)] = e;
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// <summary>
+		/// 只能由consumer呼叫
+		/// </summary>
+		template<typename Fn>
+		void drain(Fn&& fn)
+		{
+			uint64_t tail = m_tail.load(std::memory_order_relaxed);
+			const uint64_t head = m_head.load(std::memory_order_acquire);
+			for (; tail != head; tail++)
+				fn(m_events[tail & (Capacity - 1)]);
+			m_tail.store(tail, std::memory_order_release);
+		}
+
+	private:
+		uint32_t m_threadIndex;
+		std::vector<ProfileEvent> m_events;
+
+		alignas(64) std::atomic<uint64_t> m_head{ 0 };
+		alignas(64) std::atomic<uint64_t> m_tail{ 0 };
 	};
 
+	/// <summary>
+	/// Profiler
+	///
+	/// 每個thread有自己的ProfileEventBuffer，PE_PROFILE_SCOPE只會寫進自己的buffer（不用lock）
+	/// background writer thread定期把所有buffer的event轉成Chrome trace的JSON
+	///
+	/// 只有在capture中才會記錄event，沒有capture時PE_PROFILE_SCOPE只有一次atomic load
+	/// capture可以是:
+	///		一直開著 (BeginSession的預設)
+	///		N個frame (captureFrames, 以frameMark計算)
+	///		hotkey (Application中按F11 capture CaptureHotkeyFrameCount個frame)
+	/// </summary>
 	class Instrumentor
 	{
+	public:
+		/// <summary>
+		/// BeginSession的captureFrameCount用，代表直到EndSession前都capture
+		/// </summary>
+		static constexpr uint32_t InfiniteCapture = ~0u;
+
+		/// <summary>
+		/// 按hotkey時capture的frame數
+		/// </summary>
+		static constexpr uint32_t CaptureHotkeyFrameCount = 300;
+
+		/// <summary>
+		/// Chrome trace中GPU track的tid
+		/// </summary>
+		static constexpr uint32_t GpuTrackThreadId = 10000;
+
 	public:
 		Instrumentor(const Instrumentor&) = delete;
 		Instrumentor(Instrumentor&&) = delete;
 
-		PE_API void BeginSession(const std::string& name, const std::string& filepath = "results.json");
+		/// <summary>
+		/// 開啟輸出檔案並啟動writer thread
+		/// </summary>
+		/// <param name="captureFrameCount">
+		///		一開始要capture的frame數
+		///		InfiniteCapture: 一直capture
+		///		0: 等captureFrames/hotkey才開始
+		/// </param>
+		PE_API void BeginSession(const std::string& name, const std::string& filepath = "results.json", uint32_t captureFrameCount = InfiniteCapture);
 
-		PE_API void EndSession()
-		{
-			std::lock_guard lock(m_Mutex);
-			InternalEndSession();
-		}
+		PE_API void EndSession();
+
+		/// <summary>
+		/// 從下一個frameMark開始capture frameCount個frame
+		/// </summary>
+		PE_API void captureFrames(uint32_t frameCount);
+
+		/// <summary>
+		/// 每個frame開始時由Application呼叫一次
+		/// 處理capture window的開始與結束
+		/// </summary>
+		PE_API void frameMark();
+
+		bool isCapturing() const { return m_capturing.load(std::memory_order_relaxed); }
 
-		PE_API void WriteProfile(const ProfileResult& result)
+		PE_API void writeEvent(const ProfileEvent& e);
+
+		/// <summary>
+		/// 寫入一個GPU的scope，start/end已經換算成CPU的steady_clock tick
+		/// </summary>
+		PE_API void writeGpuEvent(const char* name, int64_t start, int64_t end);
+
+		/// <summary>
+		/// 取得steady_clock的tick
+		/// </summary>
+		static int64_t GetTicks()
 		{
-			std::lock_guard lock(m_Mutex);
-			std::stringstream json;
-
-			json << std::setprecision(3) << std::fixed;
-			json << ",{";
-			json << "\"cat\":\"function\",";
-			json << "\"dur\":" << (result.ElapsedTime.count()) << ',';
-			json << "\"name\":\"" << result.Name << "\",";
-			json << "\"ph\":\"X\",";
-			json << "\"pid\":0,";
-			json << "\"tid\":" << result.ThreadID << ",";
-			json << "\"ts\":" << result.Start.count();
-			json << "}";
-
-			PE_CORE_ASSERT(m_CurrentSession, "No session!");
-
-			if (m_CurrentSession)
-			{
-				m_OutputStream << json.str();
-				m_OutputStream.flush();
-			}
+			return std::chrono::steady_clock::now().time_since_epoch().count();
 		}
 
 		PE_API static Instrumentor& Get()
@@ -74,75 +171,76 @@ namespace PaperEngine {
 			return instance;
 		}
 	private:
-		Instrumentor()
-			: m_CurrentSession(nullptr)
-		{
-		}
+		Instrumentor() = default;
 
 		~Instrumentor()
 		{
 			EndSession();
 		}
 
-		PE_API void WriteHeader()
-		{
-			m_OutputStream << "{\"otherData\": {},\"traceEvents\":[{}";
-			m_OutputStream.flush();
-		}
+		ProfileEventBuffer* getThreadBuffer();
 
-		PE_API void WriteFooter()
-		{
-			m_OutputStream << "]}";
-			m_OutputStream.flush();
-		}
+		void writerThreadLoop();
+
+		/// <summary>
+		/// 把所有buffer的event寫到檔案，只在writer thread或writer thread停止後呼叫
+		/// </summary>
+		void drainBuffers();
+
+		void writeHeader();
+
+		void writeFooter();
 
-		// Note: you must already own lock on m_Mutex before
-		// calling InternalEndSession()
-		PE_API void InternalEndSession()
-		{
-			if (m_CurrentSession)
-			{
-				WriteFooter();
-				m_OutputStream.close();
-				delete m_CurrentSession;
-				m_CurrentSession = nullptr;
-			}
-		}
 	private:
-		std::mutex m_Mutex;
-		InstrumentationSession* m_CurrentSession;
-		std::ofstream m_OutputStream;
+		// session狀態 (BeginSession/EndSession)
+		std::mutex m_sessionMutex;
+		std::string m_sessionName;
+		bool m_sessionActive = false;
+		std::ofstream m_outputStream;
+
+		std::atomic<bool> m_capturing{ false };
+		std::atomic<uint32_t> m_pendingCaptureFrames{ 0 };
+		uint32_t m_remainingCaptureFrames = 0;	// 只在frameMark的thread使用
+
+		// 所有thread的buffer，thread結束後還是保留到writer讀完
+		std::mutex m_buffersMutex;
+		std::vector<std::unique_ptr<ProfileEventBuffer>> m_buffers;
+		std::atomic<uint64_t> m_droppedEventCount{ 0 };
+
+		// writer thread
+		std::thread m_writerThread;
+		std::mutex m_writerMutex;
+		std::condition_variable m_writerCondition;
+		bool m_writerRunning = false;
 	};
 
 	class InstrumentationTimer
 	{
 	public:
 		InstrumentationTimer(const char* name)
-			: m_Name(name), m_Stopped(false)
+			: m_Name(nullptr)
 		{
-			m_StartTimepoint = std::chrono::steady_clock::now();
+			if (Instrumentor::Get().isCapturing())
+			{
+				m_Name = name;
+				m_Start = Instrumentor::GetTicks();
+			}
 		}
 
 		~InstrumentationTimer()
 		{
-			if (!m_Stopped)
+			if (m_Name)
 				Stop();
 		}
 
 		void Stop()
 		{
-			auto endTimepoint = std::chrono::steady_clock::now();
-			auto highResStart = FloatingPointMicroseconds{ m_StartTimepoint.time_since_epoch() };
-			auto elapsedTime = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch() - std::chrono::time_point_cast<std::chrono::microseconds>(m_StartTimepoint).time_since_epoch();
-
-			Instrumentor::Get().WriteProfile({ m_Name, highResStart, elapsedTime, std::this_thread::get_id() });
-
-			m_Stopped = true;
+			Instrumentor::Get().writeEvent({ m_Name, m_Start, Instrumentor::GetTicks(), 0, ProfileEventType::Scope });
+			m_Name = nullptr;
 		}
 	private:
 		const char* m_Name;
-		std::chrono::time_point<std::chrono::steady_clock> m_StartTimepoint;
-		bool m_Stopped;
+		int64_t m_Start = 0;
 	};
 
 	namespace InstrumentorUtils {
@@ -198,15 +296,23 @@ namespace PaperEngine {
 #endif
 
 #define PE_PROFILE_BEGIN_SESSION(name, filepath) ::PaperEngine::Instrumentor::Get().BeginSession(name, filepath)
+// 開啟session但不capture，等PE_PROFILE_CAPTURE_FRAMES或hotkey
+#define PE_PROFILE_BEGIN_SESSION_IDLE(name, filepath) ::PaperEngine::Instrumentor::Get().BeginSession(name, filepath, 0)
 #define PE_PROFILE_END_SESSION() ::PaperEngine::Instrumentor::Get().EndSession()
-#define PE_PROFILE_SCOPE_LINE2(name, line) constexpr auto fixedName##line = ::PaperEngine::InstrumentorUtils::CleanupOutputString(name, "__cdecl ");\
+#define PE_PROFILE_CAPTURE_FRAMES(count) ::PaperEngine::Instrumentor::Get().captureFrames(count)
+#define PE_PROFILE_FRAME_MARK() ::PaperEngine::Instrumentor::Get().frameMark()
+// static storage: ring buffer中只存name的pointer
+#define PE_PROFILE_SCOPE_LINE2(name, line) static constexpr auto fixedName##line = ::PaperEngine::InstrumentorUtils::CleanupOutputString(name, "__cdecl ");\
 											   ::PaperEngine::InstrumentationTimer timer##line(fixedName##line.Data)
 #define PE_PROFILE_SCOPE_LINE(name, line) PE_PROFILE_SCOPE_LINE2(name, line)
 #define PE_PROFILE_SCOPE(name) PE_PROFILE_SCOPE_LINE(name, __LINE__)
 #define PE_PROFILE_FUNCTION() PE_PROFILE_SCOPE(PE_FUNC_SIG)
 #else
 #define PE_PROFILE_BEGIN_SESSION(name, filepath)
+#define PE_PROFILE_BEGIN_SESSION_IDLE(name, filepath)
 #define PE_PROFILE_END_SESSION()
+#define PE_PROFILE_CAPTURE_FRAMES(count)
+#define PE_PROFILE_FRAME_MARK()
 #define PE_PROFILE_SCOPE(name)
 #define PE_PROFILE_FUNCTION()
-#endif
\ No newline at end of file
+#endif
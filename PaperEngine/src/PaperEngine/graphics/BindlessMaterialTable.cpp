@@ -0,0 +1,335 @@
+﻿#include "BindlessMaterialTable.h"
+
+#include <algorithm>
+
+#include <PaperEngine/core/Application.h>
+
+namespace PaperEngine {
+
+	BindlessMaterialTable::BindlessMaterialTable()
+	{
+		PE_CORE_ASSERT(Application::Get()->getGraphicsContext()->supportsBindless(), "BindlessMaterialTable requires descriptor indexing support.");
+		auto device = Application::GetNVRHIDevice();
+
+#pragma region Layouts
+		{
+			nvrhi::BindingLayoutDesc parameterLayoutDesc;
+			parameterLayoutDesc
+				.setRegisterSpace(2)			// set = 2
+				.setRegisterSpaceIsDescriptorSet(true)
+				.setVisibility(nvrhi::ShaderType::All)
+				.addItem(nvrhi::BindingLayoutItem::RawBuffer_SRV(0));
+			m_parameterLayout = Application::GetResourceManager()->create<BindingLayout>(
+				"BindlessMaterialTable_parameterLayout",
+				device->createBindingLayout(parameterLayoutDesc));
+
+			nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+			bindlessLayoutDesc
+				.setVisibility(nvrhi::ShaderType::All)
+				.setFirstSlot(0)
+				.setMaxCapacity(MaxDescriptorCount)
+				.addRegisterSpace(nvrhi::BindingLayoutItem::Texture_SRV(0))		// binding 0
+				.addRegisterSpace(nvrhi::BindingLayoutItem::Sampler(0));		// binding 1
+			m_bindlessLayout = Application::GetResourceManager()->create<BindingLayout>(
+				"BindlessMaterialTable_bindlessLayout",
+				device->createBindlessLayout(bindlessLayoutDesc));
+		}
+#pragma endregion
+
+#pragma region Material Parameter Buffer
+		{
+			nvrhi::BufferDesc parameterBufferDesc;
+			parameterBufferDesc
+				.setByteSize(static_cast<uint64_t>(MaxMaterialCount) * MaterialParameterStride)
+				.setDebugName("BindlessMaterialTable_parameterBuffer")
+				.setCanHaveRawViews(true)
+				.setInitialState(nvrhi::ResourceStates::ShaderResource)
+				.setKeepInitialState(true);
+			m_parameterBuffer = Application::GetGPUMemoryAllocator()->createBuffer(parameterBufferDesc, GPUMemoryCategory::Buffer, m_parameterMemory);
+
+			nvrhi::BindingSetDesc parameterSetDesc;
+			parameterSetDesc.addItem(nvrhi::BindingSetItem::RawBuffer_SRV(0, m_parameterBuffer));
+			m_parameterSet = device->createBindingSet(parameterSetDesc, m_parameterLayout->handle);
+
+			m_cpuParameters.resize(static_cast<size_t>(MaxMaterialCount) * MaterialParameterStride, 0);
+		}
+#pragma endregion
+
+		m_descriptorTable = device->createDescriptorTable(m_bindlessLayout->handle);
+		device->resizeDescriptorTable(m_descriptorTable, MaxDescriptorCount, false);
+
+		m_framesInFlight = Application::Get()->getGraphicsContext()->getMaxFrameInFlight();
+		m_materialReferences.resize(MaxMaterialCount);
+		m_materialDirty.resize(MaxMaterialCount, 0);
+
+#pragma region Fallback Descriptors
+		{
+			// 內容在第一次flush時上傳
+			nvrhi::TextureDesc fallbackDesc;
+			fallbackDesc
+				.setDebugName("BindlessMaterialTable_fallbackTexture")
+				.setWidth(1)
+				.setHeight(1)
+				.setFormat(nvrhi::Format::RGBA8_UNORM)
+				.setInitialState(nvrhi::ResourceStates::ShaderResource)
+				.setKeepInitialState(true);
+			m_fallbackTexture = Application::GetGPUMemoryAllocator()->createTexture(fallbackDesc, GPUMemoryCategory::Texture, m_fallbackMemory);
+			nvrhi::SamplerHandle fallbackSampler = device->createSampler(nvrhi::SamplerDesc());
+
+			device->writeDescriptorTable(m_descriptorTable, nvrhi::BindingSetItem::Texture_SRV(FallbackDescriptorIndex, m_fallbackTexture));
+			device->writeDescriptorTable(m_descriptorTable, nvrhi::BindingSetItem::Sampler(FallbackDescriptorIndex, fallbackSampler));
+
+			// fallback的slot不會被釋放
+			m_textures.slots.push_back({ m_fallbackTexture, 1 });
+			m_samplers.slots.push_back({ fallbackSampler, 1 });
+
+			// fallback material的參數 (全部為0) 跟第一次flush一起上傳
+			markDirty(FallbackMaterialIndex);
+		}
+#pragma endregion
+	}
+
+	BindlessMaterialTable::~BindlessMaterialTable()
+	{
+		Application::GetGPUMemoryAllocator()->free(m_parameterMemory);
+		Application::GetGPUMemoryAllocator()->free(m_fallbackMemory);
+	}
+
+	uint32_t BindlessMaterialTable::allocateMaterial()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_freeMaterialIndices.empty())
+		{
+			uint32_t index = m_freeMaterialIndices.back();
+			m_freeMaterialIndices.pop_back();
+			return index;
+		}
+
+		if (m_nextMaterialIndex >= MaxMaterialCount)
+		{
+			PE_CORE_ERROR("[BindlessMaterialTable] Material count exceed {}", MaxMaterialCount);
+			return InvalidIndex;
+		}
+		return m_nextMaterialIndex++;
+	}
+
+	void BindlessMaterialTable::freeMaterial(uint32_t materialIndex)
+	{
+		if (materialIndex == InvalidIndex)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const ParameterReference& reference : m_materialReferences[materialIndex])
+			releaseSlot(reference.type, reference.slot);
+		m_materialReferences[materialIndex].clear();
+
+		// 前幾個frame的draw可能還在讀這個material的參數
+		m_pendingFrees.push_back({ SlotType::Material, materialIndex, Application::GetFrameNumber() });
+	}
+
+	void BindlessMaterialTable::writeMaterialParameters(uint32_t materialIndex, const void* data, size_t size)
+	{
+		PE_CORE_ASSERT(size <= MaterialParameterStride, "Material parameters exceed bindless stride.");
+		if (materialIndex == InvalidIndex)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		memcpy(m_cpuParameters.data() + static_cast<size_t>(materialIndex) * MaterialParameterStride, data, size);
+		for (const ParameterReference& reference : m_materialReferences[materialIndex])
+			writeReference(materialIndex, reference);
+		markDirty(materialIndex);
+	}
+
+	uint32_t BindlessMaterialTable::registerTexture(uint32_t materialIndex, uint32_t offset, nvrhi::ITexture* texture)
+	{
+		return registerParameter(materialIndex, offset, SlotType::Texture, texture);
+	}
+
+	uint32_t BindlessMaterialTable::registerSampler(uint32_t materialIndex, uint32_t offset, nvrhi::ISampler* sampler)
+	{
+		return registerParameter(materialIndex, offset, SlotType::Sampler, sampler);
+	}
+
+	uint32_t BindlessMaterialTable::registerParameter(uint32_t materialIndex, uint32_t offset, SlotType type, nvrhi::IResource* resource)
+	{
+		if (materialIndex == InvalidIndex || offset + sizeof(uint32_t) > MaterialParameterStride)
+			return InvalidIndex;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const uint32_t slot = acquireSlot(type, resource);
+
+		auto& references = m_materialReferences[materialIndex];
+		auto it = std::find_if(references.begin(), references.end(), [offset](const ParameterReference& reference) {
+			return reference.offset == offset;
+			});
+		if (it != references.end()) {
+			releaseSlot(it->type, it->slot);
+			it->type = type;
+			it->slot = slot;
+		}
+		else {
+			references.push_back({ offset, type, slot });
+			it = std::prev(references.end());
+		}
+
+		writeReference(materialIndex, *it);
+		markDirty(materialIndex);
+		return slot;
+	}
+
+	uint32_t BindlessMaterialTable::acquireSlot(SlotType type, nvrhi::IResource* resource)
+	{
+		DescriptorArray& array = getArray(type);
+
+		auto it = array.indices.find(resource);
+		if (it != array.indices.end()) {
+			array.slots[it->second].refCount++;
+			return it->second;
+		}
+
+		uint32_t slot;
+		if (!array.freeSlots.empty()) {
+			slot = array.freeSlots.back();
+			array.freeSlots.pop_back();
+		}
+		else if (array.slots.size() < MaxDescriptorCount) {
+			slot = static_cast<uint32_t>(array.slots.size());
+			array.slots.emplace_back();
+		}
+		else {
+			PE_CORE_ERROR("[BindlessMaterialTable] {} count exceed {}, using the fallback descriptor.",
+				type == SlotType::Texture ? "Texture" : "Sampler", MaxDescriptorCount);
+			return InvalidIndex;
+		}
+
+		const auto bindingItem = type == SlotType::Texture ?
+			nvrhi::BindingSetItem::Texture_SRV(slot, static_cast<nvrhi::ITexture*>(resource)) :
+			nvrhi::BindingSetItem::Sampler(slot, static_cast<nvrhi::ISampler*>(resource));
+		Application::GetNVRHIDevice()->writeDescriptorTable(m_descriptorTable, bindingItem);
+
+		array.slots[slot] = { resource, 1 };
+		array.indices[resource] = slot;
+		return slot;
+	}
+
+	void BindlessMaterialTable::releaseSlot(SlotType type, uint32_t slot)
+	{
+		if (slot == InvalidIndex)
+			return;
+
+		DescriptorArray& array = getArray(type);
+		DescriptorSlot& descriptor = array.slots[slot];
+		if (--descriptor.refCount > 0)
+			return;
+
+		// resource保持存活，之後重新註冊的話會拿到新的slot
+		array.indices.erase(descriptor.resource.Get());
+		m_pendingFrees.push_back({ type, slot, Application::GetFrameNumber() });
+	}
+
+	void BindlessMaterialTable::writeReference(uint32_t materialIndex, const ParameterReference& reference)
+	{
+		const uint32_t index = reference.slot != InvalidIndex ? reference.slot : FallbackDescriptorIndex;
+		memcpy(m_cpuParameters.data() + static_cast<size_t>(materialIndex) * MaterialParameterStride + reference.offset, &index, sizeof(uint32_t));
+	}
+
+	void BindlessMaterialTable::markDirty(uint32_t materialIndex)
+	{
+		if (m_materialDirty[materialIndex])
+			return;
+		m_materialDirty[materialIndex] = 1;
+		m_dirtyMaterials.push_back(materialIndex);
+	}
+
+	void BindlessMaterialTable::replaceTexture(nvrhi::ITexture* oldTexture, nvrhi::ITexture* newTexture)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_textures.indices.find(oldTexture);
+		if (it == m_textures.indices.end())
+			return;
+
+		// 舊的slot可能還被frame in flight的draw讀取，不能直接改寫
+		const uint32_t oldSlot = it->second;
+		const uint32_t newSlot = acquireSlot(SlotType::Texture, newTexture);
+		if (newSlot == InvalidIndex)
+			return;			// table滿了，繼續用舊的texture
+
+		// 參考數量整個移到新的slot
+		const uint32_t refCount = m_textures.slots[oldSlot].refCount;
+		m_textures.slots[newSlot].refCount += refCount - 1;
+		for (uint32_t materialIndex = 0; materialIndex < m_nextMaterialIndex; materialIndex++) {
+			bool repointed = false;
+			for (ParameterReference& reference : m_materialReferences[materialIndex]) {
+				if (reference.type != SlotType::Texture || reference.slot != oldSlot)
+					continue;
+				reference.slot = newSlot;
+				writeReference(materialIndex, reference);
+				repointed = true;
+			}
+			if (repointed)
+				markDirty(materialIndex);
+		}
+
+		m_textures.slots[oldSlot].refCount = 1;
+		releaseSlot(SlotType::Texture, oldSlot);
+	}
+
+	void BindlessMaterialTable::flush(nvrhi::ICommandList* cmd)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_fallbackUploaded) {
+			const uint32_t magenta = 0xFFFF00FF;
+			cmd->writeTexture(m_fallbackTexture, 0, 0, &magenta, sizeof(uint32_t));
+			m_fallbackUploaded = true;
+		}
+
+		// 這個frame in flight的fence已經等過了，framesInFlight個frame前釋放的GPU不會再使用
+		const uint64_t frameNumber = Application::GetFrameNumber();
+		auto pending = std::remove_if(m_pendingFrees.begin(), m_pendingFrees.end(), [this, frameNumber](const PendingFree& pendingFree) {
+			if (pendingFree.frameNumber + m_framesInFlight > frameNumber)
+				return false;
+
+			if (pendingFree.type == SlotType::Material) {
+				m_freeMaterialIndices.push_back(pendingFree.index);
+			}
+			else {
+				DescriptorArray& array = getArray(pendingFree.type);
+				array.slots[pendingFree.index].resource = nullptr;
+				array.freeSlots.push_back(pendingFree.index);
+			}
+			return true;
+			});
+		m_pendingFrees.erase(pending, m_pendingFrees.end());
+
+		if (m_dirtyMaterials.empty())
+			return;
+
+		// 連續的material index一起傳，中間沒改的不傳
+		std::sort(m_dirtyMaterials.begin(), m_dirtyMaterials.end());
+		size_t runStart = 0;
+		while (runStart < m_dirtyMaterials.size()) {
+			size_t runEnd = runStart + 1;
+			while (runEnd < m_dirtyMaterials.size() && m_dirtyMaterials[runEnd] == m_dirtyMaterials[runEnd - 1] + 1)
+				runEnd++;
+
+			const size_t offset = static_cast<size_t>(m_dirtyMaterials[runStart]) * MaterialParameterStride;
+			const size_t size = (runEnd - runStart) * MaterialParameterStride;
+			cmd->writeBuffer(m_parameterBuffer, m_cpuParameters.data() + offset, size, offset);
+			runStart = runEnd;
+		}
+
+		for (uint32_t materialIndex : m_dirtyMaterials)
+			m_materialDirty[materialIndex] = 0;
+		m_dirtyMaterials.clear();
+	}
+
+	Ref<BindlessMaterialTable> BindlessMaterialTable::Get()
+	{
+		return Application::GetResourceManager()->create<BindlessMaterialTable>("BindlessMaterialTable");
+	}
+
+}
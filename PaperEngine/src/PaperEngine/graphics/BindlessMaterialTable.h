@@ -0,0 +1,211 @@
+﻿#pragma once
+
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/BindingLayout.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// Bindless模式下所有Material共用的資源
+	///
+	/// set = 2: material參數 (ByteAddressBuffer，每個material固定MaterialParameterStride bytes)
+	/// set = 3: bindless descriptor table
+	///		binding 0: Texture2D[]
+	///		binding 1: SamplerState[]
+	///
+	/// Material的texture/sampler會被轉成table中的index並寫進參數中
+	/// 每個instance再透過instance buffer (set = 1, t1) 取得material index
+	/// 這樣不同material的draw就不需要切換binding set
+	///
+	/// texture/sampler的slot依照material參數的參考計數，沒有參考時釋放
+	/// 釋放的material跟slot要等frame in flight個frame (GPU不會再使用) 後才會被重新使用
+	/// </summary>
+	class BindlessMaterialTable {
+	public:
+		/// <summary>
+		/// 每個material參數的大小（bytes）
+		/// bindless的GraphicsPipeline variableBufferSize不能超過這個
+		/// </summary>
+		static constexpr uint32_t MaterialParameterStride = 256;
+
+		static constexpr uint32_t MaxMaterialCount = 16384;
+
+		static constexpr uint32_t MaxDescriptorCount = 4096;
+
+		static constexpr uint32_t InvalidIndex = ~0u;
+
+		/// <summary>
+		/// slot 0的texture (1x1洋紅色) 跟sampler是固定的fallback
+		/// table滿了註冊失敗的參數會指向這裡
+		/// </summary>
+		static constexpr uint32_t FallbackDescriptorIndex = 0;
+
+		/// <summary>
+		/// material 0保留給分配失敗的material，參數全部為0 (texture/sampler都是fallback)
+		/// 不會被allocateMaterial回傳
+		/// </summary>
+		static constexpr uint32_t FallbackMaterialIndex = 0;
+
+	public:
+		BindlessMaterialTable();
+		~BindlessMaterialTable();
+
+		/// <summary>
+		/// 分配一個material的參數位置
+		/// Thread safe
+		/// </summary>
+		/// <returns>material index，滿了回傳InvalidIndex</returns>
+		uint32_t allocateMaterial();
+
+		/// <summary>
+		/// 釋放material跟他參數中參考的texture/sampler
+		/// </summary>
+		void freeMaterial(uint32_t materialIndex);
+
+		/// <summary>
+		/// 更新material參數的CPU資料，要flush才會上傳
+		/// 註冊過的texture/sampler index由table寫回去，不會被data蓋掉
+		/// </summary>
+		void writeMaterialParameters(uint32_t materialIndex, const void* data, size_t size);
+
+		/// <summary>
+		/// 把texture的index寫到material參數的offset (uint)，沒有的話就註冊一個
+		/// 這個offset原本參考的texture會被釋放
+		/// </summary>
+		/// <returns>descriptor table中的index，table滿了回傳InvalidIndex (參數指向FallbackDescriptorIndex)</returns>
+		uint32_t registerTexture(uint32_t materialIndex, uint32_t offset, nvrhi::ITexture* texture);
+
+		uint32_t registerSampler(uint32_t materialIndex, uint32_t offset, nvrhi::ISampler* sampler);
+
+		/// <summary>
+		/// TextureStreamer換掉texture時使用
+		/// newTexture寫到新的slot，參考oldTexture的material參數改成新的index，flush後生效
+		/// 舊的slot還在給frame in flight使用，等釋放後frame in flight個frame才回收
+		/// oldTexture沒有註冊過的話不做事
+		/// </summary>
+		void replaceTexture(nvrhi::ITexture* oldTexture, nvrhi::ITexture* newTexture);
+
+		/// <summary>
+		/// 把修改過的material參數上傳到GPU，回收GPU已經用完的index
+		/// 每個frame由SceneRenderer呼叫
+		/// </summary>
+		void flush(nvrhi::ICommandList* cmd);
+
+		nvrhi::IBindingSet* getParameterSet() const { return m_parameterSet; }
+
+		nvrhi::IDescriptorTable* getDescriptorTable() const { return m_descriptorTable; }
+
+		nvrhi::IBindingLayout* getParameterLayout() const { return m_parameterLayout->handle; }
+
+		nvrhi::IBindingLayout* getBindlessLayout() const { return m_bindlessLayout->handle; }
+
+	public:
+		/// <summary>
+		/// 取得engine的bindless material table
+		///
+		/// binding layout會以
+		/// "BindlessMaterialTable_parameterLayout"
+		/// "BindlessMaterialTable_bindlessLayout"
+		/// 註冊在ResourceManager中
+		/// </summary>
+		PE_API static Ref<BindlessMaterialTable> Get();
+
+	private:
+		enum class SlotType : uint8_t {
+			Material,
+			Texture,
+			Sampler
+		};
+
+		/// <summary>
+		/// material參數中寫了texture/sampler index的位置
+		/// </summary>
+		struct ParameterReference {
+			uint32_t offset;
+			SlotType type;
+			uint32_t slot;				// InvalidIndex為fallback
+		};
+
+		struct DescriptorSlot {
+			nvrhi::ResourceHandle resource;		// 保持存活到slot被重新使用
+			uint32_t refCount = 0;
+		};
+
+		/// <summary>
+		/// descriptor table中的一個binding (Texture2D[] 或 SamplerState[])
+		/// </summary>
+		struct DescriptorArray {
+			std::vector<DescriptorSlot> slots;
+			std::vector<uint32_t> freeSlots;
+			std::unordered_map<nvrhi::IResource*, uint32_t> indices;
+		};
+
+		struct PendingFree {
+			SlotType type;
+			uint32_t index;
+			uint64_t frameNumber;
+		};
+
+	private:
+		/// <summary>
+		/// 參考resource，沒有的話佔一個slot並寫進descriptor table，滿了回傳InvalidIndex
+		/// 要在m_mutex中呼叫
+		/// </summary>
+		uint32_t acquireSlot(SlotType type, nvrhi::IResource* resource);
+
+		/// <summary>
+		/// 參考計數歸零的slot等frame in flight個frame後回收，要在m_mutex中呼叫
+		/// </summary>
+		void releaseSlot(SlotType type, uint32_t slot);
+
+		uint32_t registerParameter(uint32_t materialIndex, uint32_t offset, SlotType type, nvrhi::IResource* resource);
+
+		/// <summary>
+		/// 把material參考的index寫進m_cpuParameters，要在m_mutex中呼叫
+		/// </summary>
+		void writeReference(uint32_t materialIndex, const ParameterReference& reference);
+
+		void markDirty(uint32_t materialIndex);
+
+		DescriptorArray& getArray(SlotType type) { return type == SlotType::Texture ? m_textures : m_samplers; }
+
+	private:
+		std::mutex m_mutex;
+
+		BindingLayoutHandle m_parameterLayout;
+		BindingLayoutHandle m_bindlessLayout;
+
+		nvrhi::BufferHandle m_parameterBuffer;
+		GPUMemoryAllocation m_parameterMemory;
+		nvrhi::BindingSetHandle m_parameterSet;
+		nvrhi::DescriptorTableHandle m_descriptorTable;
+
+		std::vector<uint8_t> m_cpuParameters;
+		// 這個frame修改過的material index，m_materialDirty避免重複加入
+		std::vector<uint32_t> m_dirtyMaterials;
+		std::vector<uint8_t> m_materialDirty;
+
+		std::vector<uint32_t> m_freeMaterialIndices;
+		uint32_t m_nextMaterialIndex = FallbackMaterialIndex + 1;
+		// 每個material參數中的texture/sampler，index為material index
+		std::vector<std::vector<ParameterReference>> m_materialReferences;
+
+		DescriptorArray m_textures;
+		DescriptorArray m_samplers;
+
+		std::vector<PendingFree> m_pendingFrees;
+		uint32_t m_framesInFlight;
+
+		nvrhi::TextureHandle m_fallbackTexture;
+		GPUMemoryAllocation m_fallbackMemory;
+		bool m_fallbackUploaded = false;
+	};
+
+}
@@ -0,0 +1,470 @@
+﻿#include "CascadedShadowPass.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/utils/File.h>
+
+#include <PaperEngine/components/TransformComponent.h>
+#include <PaperEngine/components/MeshComponent.h>
+#include <PaperEngine/components/MeshRendererComponent.h>
+
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	void CascadedShadowPass::init()
+	{
+		// Vulkan的comparison sampler是Less，shadow map外面的border為1 (沒有影子)
+		auto samplerDesc = nvrhi::SamplerDesc()
+			.setAllFilters(true)
+			.setAllAddressModes(nvrhi::SamplerAddressMode::Border)
+			.setBorderColor(nvrhi::Color(1.f))
+			.setReductionType(nvrhi::SamplerReductionType::Comparison);
+		m_sampler = Application::GetNVRHIDevice()->createSampler(samplerDesc);
+
+		// set = 0: cascade的viewProj (b0) 跟instance的transformation (t0)
+		nvrhi::BindingLayoutDesc layoutDesc;
+		layoutDesc
+			.setRegisterSpace(0)
+			.setRegisterSpaceIsDescriptorSet(true)
+			.setVisibility(nvrhi::ShaderType::Vertex)
+			.addItem(nvrhi::BindingLayoutItem::ConstantBuffer(0))
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0));
+		m_bindingLayout = CreateRef<BindingLayout>(Application::GetNVRHIDevice()->createBindingLayout(layoutDesc));
+
+#pragma region Shadow pass graphics Pipeline
+		nvrhi::GraphicsPipelineDesc graphicsPipelineDesc;
+		graphicsPipelineDesc
+			.setPrimType(nvrhi::PrimitiveType::TriangleList)
+			.addBindingLayout(m_bindingLayout->handle);
+		{
+			nvrhi::ShaderDesc shaderDesc;
+			shaderDesc.debugName = "Shadow Pass Vertex Shader";
+			shaderDesc.entryName = "main_vs";
+			shaderDesc.shaderType = nvrhi::ShaderType::Vertex;
+			File file("assets/PaperEngine/shader/shadowPass/shader.vert.spv");
+
+			auto shaderBinary = file.readBinaryFully();
+			if (!shaderBinary) {
+				// 沒有pipeline時render直接跳過，shadow map維持清除後的狀態 (沒有影子)
+				PE_CORE_ERROR("[CascadedShadowPass] Failed to load shadow pass vertex shader.");
+				return;
+			}
+			graphicsPipelineDesc.VS = Application::GetNVRHIDevice()->createShader(
+				shaderDesc,
+				shaderBinary->data,
+				shaderBinary->size);
+		}
+
+		nvrhi::VertexAttributeDesc attributes[] = {
+			nvrhi::VertexAttributeDesc()
+			.setName("POSITION")
+			.setFormat(nvrhi::Format::RGB32_FLOAT)
+			.setOffset(offsetof(StaticVertex, position))
+			.setBufferIndex(0)
+			.setElementStride(sizeof(StaticVertex))
+		};
+
+		graphicsPipelineDesc.inputLayout = Application::GetNVRHIDevice()->createInputLayout(
+			attributes,
+			uint32_t(std::size(attributes)),
+			graphicsPipelineDesc.VS);
+
+		m_pipeline = CreateRef<GraphicsPipeline>(graphicsPipelineDesc, nullptr, 0);
+#pragma endregion
+	}
+
+	void CascadedShadowPass::setSettings(const Settings& settings)
+	{
+		m_settings = settings;
+		m_settings.cascadeCount = std::clamp(m_settings.cascadeCount, 1u, MaxCascades);
+		m_settings.resolution = std::max(m_settings.resolution, 1u);
+
+		for (auto& cascade : m_cascades)
+			cascade.valid = false;
+	}
+
+	nvrhi::TextureDesc CascadedShadowPass::getShadowMapDesc() const
+	{
+		nvrhi::TextureDesc shadowMapDesc;
+		shadowMapDesc
+			.setDebugName("DirectionalShadowMap")
+			.setDimension(nvrhi::TextureDimension::Texture2DArray)
+			.setWidth(m_settings.resolution)
+			.setHeight(m_settings.resolution)
+			.setArraySize(MaxCascades)
+			.setFormat(nvrhi::Format::D32)
+			.setIsRenderTarget(true)
+			.setInitialState(nvrhi::ResourceStates::ShaderResource)
+			.setKeepInitialState(true);
+		return shadowMapDesc;
+	}
+
+	void CascadedShadowPass::setShadowMap(nvrhi::ITexture* shadowMap, bool contentPreserved)
+	{
+		PE_CORE_ASSERT(shadowMap, "Directional shadow map is null");
+
+		if (shadowMap != m_shadowMap.Get()) {
+			m_shadowMap = shadowMap;
+			for (uint32_t i = 0; i < MaxCascades; i++) {
+				nvrhi::FramebufferDesc framebufferDesc;
+				framebufferDesc.setDepthAttachment(nvrhi::FramebufferAttachment()
+					.setTexture(m_shadowMap)
+					.setSubresources(nvrhi::TextureSubresourceSet(0, 1, i, 1)));
+				m_framebuffers[i] = Application::GetNVRHIDevice()->createFramebuffer(framebufferDesc);
+			}
+		}
+
+		// 上次畫的內容不在了 (第一個frame、resolution改變或memory被其他transient用過)
+		if (!contentPreserved) {
+			for (auto& cascade : m_cascades)
+				cascade.valid = false;
+		}
+	}
+
+	void CascadedShadowPass::beginPass()
+	{
+		m_hasLight = false;
+		m_activeCascadeCount = 0;
+	}
+
+	void CascadedShadowPass::setLight(const glm::vec3& direction, uint32_t lightIndex)
+	{
+		const float length = glm::length(direction);
+		if (length <= 0.f)
+			return;
+
+		m_hasLight = true;
+		m_lightDirection = direction / length;
+		m_lightIndex = lightIndex;
+	}
+
+	void CascadedShadowPass::setupCascades(const Camera& camera, const Transform& cameraTransform)
+	{
+		PE_PROFILE_FUNCTION();
+
+		for (auto& cascade : m_cascades) {
+			cascade.drawList.clear();
+			cascade.staticHash.store(0, std::memory_order_relaxed);
+			cascade.render = false;
+		}
+		m_activeCascadeCount = 0;
+
+		const float nearPlane = camera.getNearPlane();
+		const float farPlane = std::min(camera.getFarPlane(), m_settings.shadowDistance);
+		if (!m_hasLight || farPlane <= nearPlane)
+			return;
+
+		const uint32_t cascadeCount = std::clamp(m_settings.cascadeCount, 1u, MaxCascades);
+		const float resolution = static_cast<float>(m_settings.resolution);
+		const float tanHalfFov = std::tan(glm::radians(camera.getFov()) * 0.5f);
+		const float aspect = camera.getWidth() / std::max(camera.getHeight(), 1.f);
+		const glm::mat4& cameraMatrix = cameraTransform.matrix();
+
+		// light space只有旋轉，snap在這個空間做，相機移動時cascade只會整個texel (或grid) 跳
+		const glm::vec3 up = std::abs(m_lightDirection.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+		const glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.f), m_lightDirection, up);
+		const glm::mat4 inverseLightRotation = glm::transpose(lightRotation);
+
+		float splitNear = nearPlane;
+		for (uint32_t i = 0; i < cascadeCount; i++) {
+			Cascade& cascade = m_cascades[i];
+
+			// practical split scheme
+			const float t = static_cast<float>(i + 1) / static_cast<float>(cascadeCount);
+			const float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+			const float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+			const float splitFar = glm::mix(uniformSplit, logSplit, m_settings.splitLambda);
+
+			// slice的8個角 (相機看向-z)，用外接球fit，相機旋轉時大小不變
+			glm::vec3 corners[8];
+			glm::vec3 center(0.f);
+			for (uint32_t j = 0; j < 8; j++) {
+				const float depth = j < 4 ? splitNear : splitFar;
+				const float halfHeight = depth * tanHalfFov;
+				const float halfWidth = halfHeight * aspect;
+				const glm::vec4 viewCorner(
+					(j & 1) ? halfWidth : -halfWidth,
+					(j & 2) ? halfHeight : -halfHeight,
+					-depth,
+					1.f);
+				corners[j] = glm::vec3(cameraMatrix * viewCorner);
+				center += corners[j];
+			}
+			center /= 8.f;
+
+			float radius = 0.f;
+			for (const auto& corner : corners)
+				radius = std::max(radius, glm::length(corner - center));
+			radius = std::ceil(radius * 16.f) / 16.f;
+
+			cascade.cached = i >= m_settings.firstCachedCascade;
+
+			glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.f));
+			if (cascade.cached) {
+				// 粗的grid，相機在格子裡移動時投影完全一樣，內容可以沿用
+				const float step = radius * 2.f / 8.f;
+				lightCenter = glm::floor(lightCenter / step) * step;
+				radius += step * 1.5f;
+			}
+			else {
+				// 以texel為單位移動，避免邊緣閃爍
+				const float texel = radius * 2.f / resolution;
+				lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+				lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+			}
+			const glm::vec3 worldCenter = glm::vec3(inverseLightRotation * glm::vec4(lightCenter, 1.f));
+
+			const glm::vec3 eye = worldCenter - m_lightDirection * (radius + m_settings.casterExtension);
+			const glm::mat4 view = glm::lookAt(eye, worldCenter, up);
+			const glm::mat4 proj = glm::orthoRH_ZO(-radius, radius, -radius, radius, 0.f, radius * 2.f + m_settings.casterExtension);
+
+			cascade.viewProj = proj * view;
+			cascade.frustum = Frustum::Extract(cascade.viewProj);
+
+			m_shadowData.cascadeViewProj[i] = cascade.viewProj;
+			m_shadowData.cascadeSplits[i] = splitFar;
+			m_shadowData.cascadeTexelSize[i] = radius * 2.f / resolution;
+
+			splitNear = splitFar;
+		}
+		m_activeCascadeCount = cascadeCount;
+	}
+
+	void CascadedShadowPass::processScene(Ref<Scene> scene)
+	{
+		if (m_activeCascadeCount == 0)
+			return;
+
+		PE_PROFILE_FUNCTION();
+		PE_FRAME_STAT_SCOPE("CPU Shadow Culling");
+
+		const auto scene_group = scene->getRegistry().group<MeshComponent>(entt::get<TransformComponent, MeshRendererComponent>);
+		const auto group_start = scene_group.begin();
+
+		JobSystem* jobSystem = Application::GetJobSystem();
+		const uint32_t entity_count = static_cast<uint32_t>(scene_group.size());
+
+		jobSystem->parallelFor(entity_count, jobSystem->getGrainSize(entity_count), [&](uint32_t begin, uint32_t end)
+			{
+				PE_PROFILE_SCOPE("Worker thread cull shadow casters");
+				std::array<std::vector<ShadowDrawList::Caster>, MaxCascades> localCasters;
+				uint64_t localStaticHash[MaxCascades] = {};
+
+				auto it = std::next(group_start, begin);
+				for (uint32_t i = begin; i < end; i++, ++it)
+				{
+					auto entity = *it;
+					const auto& meshCom = scene_group.get<MeshComponent>(entity);
+					const auto& meshRendererCom = scene_group.get<MeshRendererComponent>(entity);
+					if (!meshRendererCom.visible || !meshRendererCom.renderStatic || !meshRendererCom.castShadow || !meshCom.mesh)
+						continue;
+
+					const auto& transform = scene_group.get<TransformComponent>(entity).transform;
+					// skin過的mesh每個frame都會變，當作會動的caster
+					const Ref<Mesh>& mesh = m_skinningPass ? m_skinningPass->resolveMesh(&meshCom, meshCom.mesh) : meshCom.mesh;
+					cullCaster(mesh.get(), transform.matrix(), meshCom.worldAABB, meshRendererCom.isStatic && mesh == meshCom.mesh, localCasters, localStaticHash);
+				}
+				mergeCasters(localCasters, localStaticHash);
+			});
+	}
+
+	void CascadedShadowPass::processSnapshot(const SceneSnapshot& snapshot)
+	{
+		if (m_activeCascadeCount == 0)
+			return;
+
+		PE_PROFILE_FUNCTION();
+		PE_FRAME_STAT_SCOPE("CPU Shadow Culling");
+
+		JobSystem* jobSystem = Application::GetJobSystem();
+		const uint32_t instance_count = static_cast<uint32_t>(snapshot.meshInstances.size());
+
+		jobSystem->parallelFor(instance_count, jobSystem->getGrainSize(instance_count), [&](uint32_t begin, uint32_t end)
+			{
+				PE_PROFILE_SCOPE("Worker thread cull shadow casters");
+				std::array<std::vector<ShadowDrawList::Caster>, MaxCascades> localCasters;
+				uint64_t localStaticHash[MaxCascades] = {};
+
+				for (uint32_t i = begin; i < end; i++)
+				{
+					const auto& instance = snapshot.meshInstances[i];
+					if (!instance.castShadow)
+						continue;
+					const Ref<Mesh>& mesh = m_skinningPass ? m_skinningPass->resolveMesh(&instance, instance.mesh) : instance.mesh;
+					cullCaster(mesh.get(), instance.matrix, instance.worldAABB, instance.isStatic && mesh == instance.mesh, localCasters, localStaticHash);
+				}
+				mergeCasters(localCasters, localStaticHash);
+			});
+	}
+
+	void CascadedShadowPass::cullCaster(Mesh* mesh, const glm::mat4& matrix, const AABB& worldAABB, bool isStatic,
+		std::array<std::vector<ShadowDrawList::Caster>, MaxCascades>& localCasters, uint64_t* localStaticHash) const
+	{
+		const uint64_t hash = isStatic ? ShadowDrawList::HashCaster(mesh, worldAABB) : 0;
+		for (uint32_t i = 0; i < m_activeCascadeCount; i++) {
+			const Cascade& cascade = m_cascades[i];
+			// cached cascade只畫static caster，會動的東西只在近的cascade有影子
+			if (cascade.cached && !isStatic)
+				continue;
+			if (!cascade.frustum.isIntersect(worldAABB))
+				continue;
+
+			localCasters[i].push_back({ mesh, matrix });
+			localStaticHash[i] += hash;
+		}
+	}
+
+	void CascadedShadowPass::mergeCasters(const std::array<std::vector<ShadowDrawList::Caster>, MaxCascades>& localCasters, const uint64_t* localStaticHash)
+	{
+		for (uint32_t i = 0; i < m_activeCascadeCount; i++) {
+			if (localCasters[i].empty())
+				continue;
+
+			Cascade& cascade = m_cascades[i];
+			cascade.staticHash.fetch_add(localStaticHash[i], std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock(cascade.mutex);
+			cascade.drawList.append(localCasters[i]);
+		}
+	}
+
+	bool CascadedShadowPass::upload()
+	{
+		PE_PROFILE_FUNCTION();
+
+		m_instanceAllocation = {};
+		m_indirectArgs = {};
+
+		// 決定哪些cascade要畫
+		uint32_t totalInstanceCount = 0;
+		uint32_t totalDrawCount = 0;
+		for (uint32_t i = 0; i < m_activeCascadeCount; i++) {
+			Cascade& cascade = m_cascades[i];
+			cascade.render = !cascade.cached
+				|| !cascade.valid
+				|| cascade.renderedViewProj != cascade.viewProj
+				|| cascade.renderedStaticHash != cascade.staticHash.load(std::memory_order_relaxed);
+			if (!cascade.render)
+				continue;
+
+			totalDrawCount += cascade.drawList.sort();
+			totalInstanceCount += cascade.drawList.getInstanceCount();
+		}
+
+		FrameUploadAllocator* uploadAllocator = Application::GetFrameUploadAllocator();
+		bool uploaded = true;
+		if (totalDrawCount > 0) {
+			m_instanceAllocation = uploadAllocator->allocate(totalInstanceCount * sizeof(glm::mat4));
+			m_indirectArgs = uploadAllocator->allocate(totalDrawCount * sizeof(nvrhi::DrawIndexedIndirectArguments));
+			uploaded = m_instanceAllocation.isValid() && m_indirectArgs.isValid();
+		}
+
+		auto* instanceData = static_cast<glm::mat4*>(m_instanceAllocation.mapPtr);
+		auto* indirectArgs = static_cast<nvrhi::DrawIndexedIndirectArguments*>(m_indirectArgs.mapPtr);
+		uint32_t instanceOffset = 0;
+		uint32_t argsCount = 0;
+		for (uint32_t i = 0; i < m_activeCascadeCount && uploaded; i++) {
+			Cascade& cascade = m_cascades[i];
+			cascade.bindingSet = nullptr;
+			if (!cascade.render || cascade.drawList.empty())
+				continue;		// 沒有caster的話只清除
+
+			cascade.cascadeDataAllocation = uploadAllocator->upload(&cascade.viewProj, 1);
+			if (!cascade.cascadeDataAllocation.isValid()) {
+				uploaded = false;
+				break;
+			}
+
+			nvrhi::BindingSetDesc setDesc;
+			setDesc
+				.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, cascade.cascadeDataAllocation.buffer, cascade.cascadeDataAllocation.getRange()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_instanceAllocation.buffer, nvrhi::Format::UNKNOWN, m_instanceAllocation.getRange()));
+			cascade.bindingSet = Application::GetNVRHIDevice()->createBindingSet(setDesc, m_bindingLayout->handle);
+
+			cascade.drawList.write(instanceData, instanceOffset, indirectArgs, argsCount);
+		}
+
+		// 上傳失敗的話這個frame沒有shadow，cached cascade保留上次的內容
+		if (!uploaded) {
+			for (uint32_t i = 0; i < m_activeCascadeCount; i++)
+				m_cascades[i].render = false;
+		}
+
+		m_shadowData.cascadeCount = uploaded ? m_activeCascadeCount : 0;
+		m_shadowData.lightIndex = m_lightIndex;
+		m_shadowData.normalBias = m_settings.normalBias;
+		m_shadowDataAllocation = uploadAllocator->upload(&m_shadowData, 1);
+
+		PE_FRAME_STAT_COUNT("Shadow Caster Instances", instanceOffset);
+		PE_FRAME_STAT_BYTES("Shadow Instance Upload", instanceOffset * sizeof(glm::mat4));
+		return m_shadowDataAllocation.isValid();
+	}
+
+	bool CascadedShadowPass::needsRender() const
+	{
+		for (uint32_t i = 0; i < m_activeCascadeCount; i++) {
+			if (m_cascades[i].render)
+				return true;
+		}
+		return false;
+	}
+
+	void CascadedShadowPass::render(nvrhi::ICommandList* cmd)
+	{
+		PE_PROFILE_FUNCTION();
+		PE_PROFILE_GPU_SCOPE(cmd, "Directional Shadow");
+
+		PipelineRenderState renderState;
+		renderState.depthBias = m_settings.depthBias;
+		renderState.slopeScaledDepthBias = m_settings.slopeScaledDepthBias;
+		// cascade前面的caster壓到near plane上 (pancaking)，不會被切掉
+		renderState.depthClipEnable = false;
+
+		const float resolution = static_cast<float>(m_settings.resolution);
+		uint32_t renderedCount = 0;
+		uint32_t cachedCount = 0;
+		for (uint32_t i = 0; i < m_activeCascadeCount; i++) {
+			Cascade& cascade = m_cascades[i];
+			if (!cascade.render) {
+				cachedCount++;
+				continue;
+			}
+
+			cmd->clearDepthStencilTexture(m_shadowMap, nvrhi::TextureSubresourceSet(0, 1, i, 1), true, 1.f, false, 0);
+
+			if (cascade.bindingSet && m_pipeline) {
+				nvrhi::IFramebuffer* fb = m_framebuffers[i];
+				nvrhi::GraphicsState graphicsState;
+				graphicsState.setFramebuffer(fb);
+				graphicsState.viewport.addViewportAndScissorRect(nvrhi::Viewport(0, resolution, 0, resolution, 0, 1));
+				graphicsState.bindings.resize(1);
+				graphicsState.bindings[0] = cascade.bindingSet;
+				m_pipeline->bind(graphicsState, fb, renderState);
+				cascade.drawList.record(cmd, graphicsState, m_indirectArgs);
+			}
+
+			cascade.valid = true;
+			cascade.renderedViewProj = cascade.viewProj;
+			cascade.renderedStaticHash = cascade.staticHash.load(std::memory_order_relaxed);
+			renderedCount++;
+		}
+
+		PE_FRAME_STAT_COUNT("Shadow Cascades Rendered", renderedCount);
+		PE_FRAME_STAT_COUNT("Shadow Cascades Cached", cachedCount);
+	}
+
+	void CascadedShadowPass::endFrame()
+	{
+		for (auto& cascade : m_cascades) {
+			cascade.drawList.clear();
+			cascade.bindingSet = nullptr;
+		}
+	}
+
+}
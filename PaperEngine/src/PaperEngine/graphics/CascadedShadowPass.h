@@ -0,0 +1,218 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/scene/Scene.h>
+#include <PaperEngine/graphics/Camera.h>
+#include <PaperEngine/graphics/Mesh.h>
+#include <PaperEngine/graphics/GraphicsPipeline.h>
+#include <PaperEngine/graphics/SceneSnapshot.h>
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
+#include <PaperEngine/utils/BoundingVolume.h>
+#include <PaperEngine/utils/Transform.h>
+
+#include "BindingLayout.h"
+#include "ShadowDrawList.h"
+#include "SkinningPass.h"
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 一個directional light的cascaded shadow map
+	/// 
+	/// 相機的view frustum依照practical split (uniform跟log混合) 切成cascadeCount段，每段用外接球fit一個orthographic投影
+	/// 全部cascade放在一個Texture2DArray中，每個slice一個framebuffer
+	/// shadow map是RenderGraph的transient texture (getShadowMapDesc)，每個frame由setShadowMap給
+	/// memory被其他transient用過 (內容沒有保留) 的話全部cascade重畫
+	/// 
+	/// 近的cascade每個frame都重畫 (所有caster)
+	/// firstCachedCascade之後的遠cascade只畫isStatic的caster，中心snap到粗的grid上
+	/// light方向、cascade位置或cascade中的static caster (mesh + worldAABB) 沒變的話沿用上次的內容
+	/// 
+	/// 使用順序：beginPass -> setLight -> setupCascades -> processScene/processSnapshot -> setShadowMap -> upload -> render -> endFrame
+	/// </summary>
+	class CascadedShadowPass {
+	public:
+		static constexpr uint32_t MaxCascades = 4;
+
+		struct Settings {
+			uint32_t cascadeCount = 4;
+			uint32_t resolution = 2048;
+			/// <summary>
+			/// 超過這個距離 (從相機) 沒有shadow
+			/// </summary>
+			float shadowDistance = 150.f;
+			/// <summary>
+			/// 0為平均分割，1為對數分割
+			/// </summary>
+			float splitLambda = 0.75f;
+			/// <summary>
+			/// 從這個cascade開始只在static caster或light改變時重畫，>= cascadeCount的話全部每個frame重畫
+			/// </summary>
+			uint32_t firstCachedCascade = 2;
+			/// <summary>
+			/// cascade往light的方向延伸多遠，cascade外面的caster也能投影進來
+			/// </summary>
+			float casterExtension = 100.f;
+			int depthBias = 1;
+			float slopeScaledDepthBias = 1.5f;
+			/// <summary>
+			/// shader中沿著normal偏移幾個texel
+			/// </summary>
+			float normalBias = 1.0f;
+		};
+
+		/// <summary>
+		/// 跟shader的ShadowData一樣
+		/// </summary>
+		struct ShadowData {
+			glm::mat4 cascadeViewProj[MaxCascades];
+			glm::vec4 cascadeSplits;
+			glm::vec4 cascadeTexelSize;
+			uint32_t cascadeCount = 0;
+			uint32_t lightIndex = 0;
+			float normalBias = 0.f;
+			float padding = 0.f;
+		};
+
+	public:
+		CascadedShadowPass() = default;
+
+		void init();
+
+		/// <summary>
+		/// process時用skinningPass的skinned output取代skeletal mesh
+		/// </summary>
+		void setSkinningPass(const SkinningPass* skinningPass) { m_skinningPass = skinningPass; }
+
+		/// <summary>
+		/// 所有cache失效，resolution改變的話下一個frame的shadow map desc跟著改變
+		/// </summary>
+		void setSettings(const Settings& settings);
+
+		const Settings& getSettings() const { return m_settings; }
+
+		/// <summary>
+		/// 需要先Call這個才能process，清除上個frame的light
+		/// </summary>
+		void beginPass();
+
+		/// <summary>
+		/// 沒有呼叫的話這個frame沒有directional shadow
+		/// </summary>
+		/// <param name="lightIndex">directional light buffer中的index</param>
+		void setLight(const glm::vec3& direction, uint32_t lightIndex);
+
+		bool hasLight() const { return m_hasLight; }
+
+		/// <summary>
+		/// setLight後呼叫，計算每個cascade的投影跟決定cached cascade是否需要重畫
+		/// </summary>
+		void setupCascades(const Camera& camera, const Transform& cameraTransform);
+
+		/// <summary>
+		/// 對每個cascade的frustum做culling，收集caster
+		/// </summary>
+		void processScene(Ref<Scene> scene);
+
+		void processSnapshot(const SceneSnapshot& snapshot);
+
+		/// <summary>
+		/// process完之後呼叫，ShadowData、instance data跟indirect args上傳到FrameUploadAllocator
+		/// 失敗的話回傳false，這個frame不能render (shadow data也無效)
+		/// 沒有light的時候也要呼叫，上傳cascadeCount為0的ShadowData
+		/// </summary>
+		bool upload();
+
+		/// <summary>
+		/// 畫需要更新的cascade，shadow map的state由NVRHI自動轉換 (clear時CopyDest，畫的時候DepthWrite)
+		/// </summary>
+		void render(nvrhi::ICommandList* cmd);
+
+		void endFrame();
+
+		/// <summary>
+		/// 這個frame有沒有cascade要畫
+		/// </summary>
+		bool needsRender() const;
+
+		/// <summary>
+		/// 用來建立RenderGraph的transient texture，keepInitialState (ShaderResource)，MeshRenderer的worker command list也會讀
+		/// </summary>
+		nvrhi::TextureDesc getShadowMapDesc() const;
+
+		/// <summary>
+		/// RenderGraph compile後呼叫，upload之前
+		/// texture改變的話重新建立framebuffer，contentPreserved為false的話所有cascade失效
+		/// </summary>
+		void setShadowMap(nvrhi::ITexture* shadowMap, bool contentPreserved);
+
+		nvrhi::ITexture* getShadowMap() const { return m_shadowMap; }
+
+		nvrhi::ISampler* getSampler() const { return m_sampler; }
+
+		/// <summary>
+		/// upload後才有效
+		/// </summary>
+		const FrameUploadAllocation& getShadowDataAllocation() const { return m_shadowDataAllocation; }
+
+	private:
+		struct Cascade {
+			glm::mat4 viewProj{ 1.f };
+			Frustum frustum{};
+			bool cached = false;
+			bool render = false;
+
+			std::mutex mutex;
+			ShadowDrawList drawList;
+			// cascade中所有static caster的hash總和 (跟順序無關)
+			std::atomic<uint64_t> staticHash{ 0 };
+
+			// 上次畫的時候的狀態，cached cascade用來判斷要不要重畫
+			bool valid = false;
+			glm::mat4 renderedViewProj{ 1.f };
+			uint64_t renderedStaticHash = 0;
+
+			FrameUploadAllocation cascadeDataAllocation;
+			nvrhi::BindingSetHandle bindingSet;
+		};
+
+	private:
+		/// <summary>
+		/// 一個caster對所有cascade做culling，結果放在chunk local的list
+		/// </summary>
+		void cullCaster(Mesh* mesh, const glm::mat4& matrix, const AABB& worldAABB, bool isStatic,
+			std::array<std::vector<ShadowDrawList::Caster>, MaxCascades>& localCasters, uint64_t* localStaticHash) const;
+
+		void mergeCasters(const std::array<std::vector<ShadowDrawList::Caster>, MaxCascades>& localCasters, const uint64_t* localStaticHash);
+
+	private:
+		Settings m_settings;
+		const SkinningPass* m_skinningPass = nullptr;
+
+		nvrhi::TextureHandle m_shadowMap;
+		std::array<nvrhi::FramebufferHandle, MaxCascades> m_framebuffers;
+		nvrhi::SamplerHandle m_sampler;
+
+		Ref<GraphicsPipeline> m_pipeline;
+		BindingLayoutHandle m_bindingLayout;
+
+		bool m_hasLight = false;
+		glm::vec3 m_lightDirection{ 0.f, -1.f, 0.f };
+		uint32_t m_lightIndex = 0;
+		uint32_t m_activeCascadeCount = 0;
+
+		std::array<Cascade, MaxCascades> m_cascades;
+
+		ShadowData m_shadowData{};
+		FrameUploadAllocation m_shadowDataAllocation;
+		FrameUploadAllocation m_instanceAllocation;
+		FrameUploadAllocation m_indirectArgs;
+	};
+
+}
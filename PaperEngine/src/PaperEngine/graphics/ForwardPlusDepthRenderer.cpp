@@ -146,8 +146,8 @@ namespace PaperEngine {
 			for (auto& subMesh : mesh->getSubMeshes())
 				indicesCount += subMesh.indicesCount;
 			drawArgs.setVertexCount(indicesCount);
-			drawArgs.setStartIndexLocation(0);
-			drawArgs.setStartVertexLocation(0);
+			drawArgs.setStartIndexLocation(mesh->getBaseIndex());
+			drawArgs.setStartVertexLocation(mesh->getBaseVertex());
 			drawArgs.setStartInstanceLocation(instanceOffset);
 			drawArgs.setInstanceCount(static_cast<uint32_t>(instanceCount));
 			m_cmd->setGraphicsState(graphicsState);
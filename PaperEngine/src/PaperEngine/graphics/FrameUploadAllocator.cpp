@@ -0,0 +1,90 @@
+﻿#include "FrameUploadAllocator.h"
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/core/Assert.h>
+#include <PaperEngine/core/Logger.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	namespace {
+
+		uint64_t AlignUp(uint64_t value, uint64_t alignment)
+		{
+			return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+		}
+
+	}
+
+	FrameUploadAllocator::FrameUploadAllocator(uint64_t capacity, uint32_t framesInFlight)
+		: m_capacity(AlignUp(capacity, DefaultAlignment)), m_frameEnds(framesInFlight, 0)
+	{
+		nvrhi::BufferDesc bufferDesc;
+		bufferDesc
+			.setDebugName("FrameUploadAllocator_ring")
+			.setByteSize(m_capacity)
+			.setCpuAccess(nvrhi::CpuAccessMode::Write)
+			.setIsConstantBuffer(true)
+			.setIsDrawIndirectArgs(true)
+			.setCanHaveRawViews(true)
+			.setStructStride(sizeof(uint32_t))		// 讓NVRHI允許當作StructuredBuffer綁定，Vulkan的storage buffer不使用stride
+			.setInitialState(nvrhi::ResourceStates::ConstantBuffer | nvrhi::ResourceStates::ShaderResource | nvrhi::ResourceStates::IndirectArgument)
+			.setKeepInitialState(true);
+		m_buffer = Application::GetGPUMemoryAllocator()->createBuffer(bufferDesc, GPUMemoryCategory::Upload, m_memory);
+		m_mapPtr = static_cast<uint8_t*>(Application::GetNVRHIDevice()->mapBuffer(m_buffer, nvrhi::CpuAccessMode::Write));
+
+		PE_CORE_INFO("[FrameUploadAllocator] Ring buffer {} MB.", m_capacity / (1024 * 1024));
+	}
+
+	FrameUploadAllocator::~FrameUploadAllocator()
+	{
+		if (m_buffer)
+			Application::GetNVRHIDevice()->unmapBuffer(m_buffer);
+		Application::GetGPUMemoryAllocator()->free(m_memory);
+	}
+
+	void FrameUploadAllocator::beginFrame(uint32_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_frameEnds[m_currentFrameIndex] = m_head;
+		m_currentFrameIndex = frameIndex;
+		// frame依序完成，上一次使用這個frame in flight之前的都已經完成了
+		m_tail = std::max(m_tail, m_frameEnds[frameIndex]);
+	}
+
+	FrameUploadAllocation FrameUploadAllocator::allocate(uint64_t size, uint64_t alignment)
+	{
+		PE_CORE_ASSERT(alignment >= DefaultAlignment && alignment % DefaultAlignment == 0,
+			"FrameUploadAllocator alignment must be a multiple of the device offset alignment.");
+
+		FrameUploadAllocation allocation;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			uint64_t position = AlignUp(m_head, alignment);
+			// 放不下buffer尾端的話從頭開始
+			if (position % m_capacity + size > m_capacity)
+				position = AlignUp(position, m_capacity);
+
+			if (size > m_capacity || position + size - m_tail > m_capacity) {
+				PE_FRAME_STAT_COUNT("Frame Upload Overflow", 1);
+				PE_CORE_ERROR("[FrameUploadAllocator] Out of memory ({} bytes requested, {} bytes in flight).", size, m_head - m_tail);
+				return allocation;
+			}
+
+			PE_FRAME_STAT_BYTES("Frame Upload Padding", position - m_head);
+			m_head = position + size;
+
+			allocation.buffer = m_buffer;
+			allocation.offset = position % m_capacity;
+			allocation.size = size;
+			allocation.mapPtr = m_mapPtr + allocation.offset;
+		}
+
+		PE_FRAME_STAT_BYTES("Frame Upload", size);
+		return allocation;
+	}
+
+}
@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// FrameUploadAllocator::allocate拿到的一段，只在這個frame有效
+	/// </summary>
+	struct FrameUploadAllocation {
+		nvrhi::IBuffer* buffer = nullptr;
+		uint64_t offset = 0;		// bytes
+		uint64_t size = 0;			// bytes
+		void* mapPtr = nullptr;
+
+		bool isValid() const { return buffer != nullptr; }
+
+		/// <summary>
+		/// binding set用
+		/// </summary>
+		nvrhi::BufferRange getRange() const { return nvrhi::BufferRange(offset, size); }
+	};
+
+	/// <summary>
+	/// 每個frame CPU上傳到GPU的資料 (global data、instance data、light data、indirect args...) 共用一個persistently mapped的ring buffer
+	/// 
+	/// 每個pass每個frame只allocate實際需要的大小，用offset綁定 (BufferRange或indirect args offset)
+	/// 不需要每個使用的地方各自準備frame in flight份worst case大小的buffer
+	/// 
+	/// beginFrame(frameIndex) 時這個frame in flight上一次使用的範圍已經完成 (fence)，ring的tail往前移到那裡
+	/// 超過capacity的allocate會失敗 (回傳invalid)，由呼叫的地方決定要不要畫
+	/// </summary>
+	class FrameUploadAllocator {
+	public:
+		/// <summary>
+		/// offset的對齊 (Vulkan規定minUniformBufferOffsetAlignment跟minStorageBufferOffsetAlignment最大為256，任何裝置都滿足)
+		/// </summary>
+		static constexpr uint64_t DefaultAlignment = 256;
+
+	public:
+		FrameUploadAllocator(uint64_t capacity, uint32_t framesInFlight);
+		~FrameUploadAllocator();
+
+		/// <summary>
+		/// GraphicsContext::beginFrame成功後呼叫 (這個frame in flight的fence已經等過了)
+		/// </summary>
+		void beginFrame(uint32_t frameIndex);
+
+		/// <summary>
+		/// Thread safe
+		/// 拿到的offset會直接拿去綁定constant/structured buffer，Vulkan要求是minUniformBufferOffsetAlignment
+		/// 跟minStorageBufferOffsetAlignment的倍數，所以alignment必須是DefaultAlignment的倍數 (不能用element大小對齊)
+		/// </summary>
+		PE_API FrameUploadAllocation allocate(uint64_t size, uint64_t alignment = DefaultAlignment);
+
+		/// <summary>
+		/// allocate後複製count個T
+		/// </summary>
+		template<typename T>
+		FrameUploadAllocation upload(const T* data, size_t count, uint64_t alignment = DefaultAlignment)
+		{
+			FrameUploadAllocation allocation = allocate(count * sizeof(T), alignment);
+			if (allocation.isValid() && count > 0)
+				std::memcpy(allocation.mapPtr, data, count * sizeof(T));
+			return allocation;
+		}
+
+		nvrhi::IBuffer* getBuffer() const { return m_buffer; }
+
+		uint64_t getCapacity() const { return m_capacity; }
+
+	private:
+		nvrhi::BufferHandle m_buffer;
+		GPUMemoryAllocation m_memory;
+		uint8_t* m_mapPtr = nullptr;
+		uint64_t m_capacity;
+
+		std::mutex m_mutex;
+
+		// 位置都是一直增加的，% m_capacity才是buffer中的offset
+		uint64_t m_head = 0;
+		uint64_t m_tail = 0;
+
+		/// <summary>
+		/// 每個frame in flight最後一次使用時的head
+		/// </summary>
+		std::vector<uint64_t> m_frameEnds;
+		uint32_t m_currentFrameIndex = 0;
+	};
+
+}
@@ -15,7 +15,7 @@ namespace PaperEngine {
 		{
 			m_storages.resize(1);
 
-			m_storages[0].handle = Application::GetNVRHIDevice()->createBuffer(desc);
+			m_storages[0].handle = Application::GetGPUMemoryAllocator()->createBuffer(desc, GPUMemoryCategory::Buffer, m_storages[0].memory);
 		}
 			break;
 		case FrameStreaming:
@@ -24,7 +24,7 @@ namespace PaperEngine {
 			m_storages.resize(Application::Get()->getGraphicsContext()->getMaxFrameInFlight());
 			for (auto& storage : m_storages)
 			{
-				storage.handle = Application::GetNVRHIDevice()->createBuffer(desc);
+				storage.handle = Application::GetGPUMemoryAllocator()->createBuffer(desc, GPUMemoryCategory::Upload, storage.memory);
 				storage.mapPtr = Application::GetNVRHIDevice()->mapBuffer(storage.handle, nvrhi::CpuAccessMode::Write);
 			}
 		}
@@ -34,7 +34,7 @@ namespace PaperEngine {
 			m_storages.resize(Application::Get()->getGraphicsContext()->getMaxFrameInFlight());
 			for (auto& storage : m_storages)
 			{
-				storage.handle = Application::GetNVRHIDevice()->createBuffer(desc);
+				storage.handle = Application::GetGPUMemoryAllocator()->createBuffer(desc, GPUMemoryCategory::Buffer, storage.memory);
 			}
 		}
 			break;
@@ -43,6 +43,12 @@ namespace PaperEngine {
 		}
 	}
 
+	GPUBuffer::~GPUBuffer()
+	{
+		for (auto& storage : m_storages)
+			Application::GetGPUMemoryAllocator()->free(storage.memory);
+	}
+
 	nvrhi::IBuffer* GPUBuffer::getHandle()
 	{
 		switch (m_usage)
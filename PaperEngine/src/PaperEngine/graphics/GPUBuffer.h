@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
 #include "IResource.h"
 
 #include <nvrhi/nvrhi.h>
@@ -15,6 +16,7 @@ namespace PaperEngine
 		{
 			nvrhi::BufferHandle handle;
 			void* mapPtr;
+			GPUMemoryAllocation memory;
 		};
 	public:
 		/// <summary>
@@ -31,6 +33,7 @@ namespace PaperEngine
 		/// </param>
 		/// <param name="desc"></param>
 		GPUBuffer(ResourceUsage usage, nvrhi::BufferDesc desc);
+		~GPUBuffer();
 
 		nvrhi::IBuffer* getHandle();
 
@@ -0,0 +1,295 @@
+﻿#include "GPUMemoryAllocator.h"
+
+#include <algorithm>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/core/Logger.h>
+
+namespace PaperEngine {
+
+	const char* GPUMemoryCategoryToString(GPUMemoryCategory category)
+	{
+		switch (category)
+		{
+		case GPUMemoryCategory::Mesh:
+			return "Mesh";
+		case GPUMemoryCategory::Texture:
+			return "Texture";
+		case GPUMemoryCategory::Buffer:
+			return "Buffer";
+		case GPUMemoryCategory::Upload:
+			return "Upload";
+		default:
+			return "Unknown";
+		}
+	}
+
+	GPUMemoryAllocator::GPUMemoryAllocator(uint32_t framesInFlight)
+		: m_framesInFlight(framesInFlight)
+	{
+		FrameStats& stats = FrameStats::Get();
+		for (uint32_t i = 0; i < CategoryCount; i++)
+			m_categoryStats[i] = stats.registerStat(std::string("GPU Memory ") + GPUMemoryCategoryToString(static_cast<GPUMemoryCategory>(i)), FrameStatType::Bytes);
+		m_blockStat = stats.registerStat("GPU Memory Blocks", FrameStatType::Bytes);
+		m_blockCountStat = stats.registerStat("GPU Memory Block Count", FrameStatType::Counter);
+		m_deviceBudgetStat = stats.registerStat("GPU Memory Device Budget", FrameStatType::Bytes);
+		m_deviceUsageStat = stats.registerStat("GPU Memory Device Usage", FrameStatType::Bytes);
+	}
+
+	GPUMemoryAllocator::~GPUMemoryAllocator()
+	{
+		// 釋放heap前GPU要用完
+		Application::GetNVRHIDevice()->waitForIdle();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& pending : m_pendingFrees)
+			release(pending.allocation);
+		m_pendingFrees.clear();
+
+		for (uint32_t i = 0; i < CategoryCount; i++) {
+			if (m_categoryUsage[i] > 0)
+				PE_CORE_WARN("[GPUMemoryAllocator] {} bytes of {} memory not freed.", m_categoryUsage[i], GPUMemoryCategoryToString(static_cast<GPUMemoryCategory>(i)));
+		}
+	}
+
+	nvrhi::BufferHandle GPUMemoryAllocator::createBuffer(nvrhi::BufferDesc desc, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation)
+	{
+		auto device = Application::GetNVRHIDevice();
+		outAllocation = {};
+		outAllocation.category = category;
+
+		// map需要buffer自己的記憶體
+		if (desc.cpuAccess != nvrhi::CpuAccessMode::None) {
+			nvrhi::BufferHandle buffer = device->createBuffer(desc);
+			if (buffer) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				outAllocation.size = desc.byteSize;
+				addUsage(category, outAllocation.size);
+			}
+			return buffer;
+		}
+
+		desc.isVirtual = true;
+		nvrhi::BufferHandle buffer = device->createBuffer(desc);
+		if (!buffer)
+			return nullptr;
+
+		const nvrhi::MemoryRequirements requirements = device->getBufferMemoryRequirements(buffer);
+		nvrhi::IHeap* heap = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			heap = allocate(BufferPool, requirements, category, outAllocation);
+		}
+		if (!heap) {
+			PE_CORE_ERROR("[GPUMemoryAllocator] Failed to allocate {} bytes for buffer '{}'.", requirements.size, desc.debugName);
+			outAllocation = {};
+			return nullptr;
+		}
+		if (!device->bindBufferMemory(buffer, heap, outAllocation.offset)) {
+			PE_CORE_ERROR("[GPUMemoryAllocator] Failed to bind memory for buffer '{}'.", desc.debugName);
+			free(outAllocation);
+			return nullptr;
+		}
+		return buffer;
+	}
+
+	nvrhi::TextureHandle GPUMemoryAllocator::createTexture(nvrhi::TextureDesc desc, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation)
+	{
+		auto device = Application::GetNVRHIDevice();
+		outAllocation = {};
+		outAllocation.category = category;
+
+		desc.isVirtual = true;
+		nvrhi::TextureHandle texture = device->createTexture(desc);
+		if (!texture)
+			return nullptr;
+
+		const nvrhi::MemoryRequirements requirements = device->getTextureMemoryRequirements(texture);
+		nvrhi::IHeap* heap = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			heap = allocate(TexturePool, requirements, category, outAllocation);
+		}
+		if (!heap) {
+			PE_CORE_ERROR("[GPUMemoryAllocator] Failed to allocate {} bytes for texture '{}'.", requirements.size, desc.debugName);
+			outAllocation = {};
+			return nullptr;
+		}
+		if (!device->bindTextureMemory(texture, heap, outAllocation.offset)) {
+			PE_CORE_ERROR("[GPUMemoryAllocator] Failed to bind memory for texture '{}'.", desc.debugName);
+			free(outAllocation);
+			return nullptr;
+		}
+		return texture;
+	}
+
+	nvrhi::HeapHandle GPUMemoryAllocator::createHeap(const nvrhi::HeapDesc& desc, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation)
+	{
+		outAllocation = {};
+		outAllocation.category = category;
+
+		nvrhi::HeapHandle heap = Application::GetNVRHIDevice()->createHeap(desc);
+		if (!heap) {
+			PE_CORE_ERROR("[GPUMemoryAllocator] Failed to create heap '{}' ({} bytes).", desc.debugName, desc.capacity);
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		outAllocation.size = desc.capacity;
+		addUsage(category, outAllocation.size);
+		return heap;
+	}
+
+	void GPUMemoryAllocator::free(GPUMemoryAllocation& allocation)
+	{
+		if (!allocation.isValid())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pendingFrees.push_back({ allocation, m_frameNumber });
+		}
+		allocation = {};
+	}
+
+	void GPUMemoryAllocator::setCategoryBudget(GPUMemoryCategory category, uint64_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_categoryBudget[static_cast<uint32_t>(category)] = bytes;
+	}
+
+	uint64_t GPUMemoryAllocator::getCategoryUsage(GPUMemoryCategory category) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_categoryUsage[static_cast<uint32_t>(category)];
+	}
+
+	void GPUMemoryAllocator::beginFrame()
+	{
+		m_deviceBudget = Application::Get()->getGraphicsContext()->getMemoryBudget();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_frameNumber++;
+
+		// 這個frame in flight的fence已經等過了，framesInFlight個frame前free的GPU不會再使用
+		auto it = std::remove_if(m_pendingFrees.begin(), m_pendingFrees.end(), [this](const PendingFree& pending) {
+			if (pending.frameNumber + m_framesInFlight > m_frameNumber)
+				return false;
+			release(pending.allocation);
+			return true;
+			});
+		m_pendingFrees.erase(it, m_pendingFrees.end());
+
+		uint32_t blockCount = 0;
+		for (const auto& blocks : m_pools)
+			for (const Block& block : blocks)
+				blockCount += block.heap ? 1 : 0;
+
+		FrameStats& stats = FrameStats::Get();
+		for (uint32_t i = 0; i < CategoryCount; i++)
+			stats.add(m_categoryStats[i], static_cast<double>(m_categoryUsage[i]));
+		stats.add(m_blockStat, static_cast<double>(m_blockBytes));
+		stats.add(m_blockCountStat, blockCount);
+		stats.add(m_deviceBudgetStat, static_cast<double>(m_deviceBudget.budget));
+		stats.add(m_deviceUsageStat, static_cast<double>(m_deviceBudget.usage));
+
+		const bool overBudget = m_deviceBudget.supported && m_deviceBudget.usage > m_deviceBudget.budget;
+		if (overBudget && !m_deviceOverBudget)
+			PE_CORE_WARN("[GPUMemoryAllocator] Device memory usage {} MB exceeds budget {} MB.", m_deviceBudget.usage / (1024 * 1024), m_deviceBudget.budget / (1024 * 1024));
+		m_deviceOverBudget = overBudget;
+	}
+
+	nvrhi::IHeap* GPUMemoryAllocator::allocate(Pool pool, const nvrhi::MemoryRequirements& requirements, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation)
+	{
+		auto& blocks = m_pools[pool];
+		const uint32_t alignment = static_cast<uint32_t>(std::max<uint64_t>(1, requirements.alignment));
+
+		outAllocation.pool = pool;
+		outAllocation.size = requirements.size;
+
+		// 先找現有的block
+		if (requirements.size <= DedicatedThreshold) {
+			const uint32_t size = static_cast<uint32_t>(requirements.size);
+			for (uint32_t i = 0; i < blocks.size(); i++) {
+				Block& block = blocks[i];
+				if (!block.heap || block.dedicated)
+					continue;
+				if (block.ranges.allocate(size, outAllocation.offset, alignment)) {
+					outAllocation.block = i;
+					block.allocationCount++;
+					addUsage(category, requirements.size);
+					return block.heap;
+				}
+			}
+		}
+
+		// 建立新的block，沒有heap的位置 (釋放過的) 重複使用
+		const bool dedicated = requirements.size > DedicatedThreshold;
+		nvrhi::HeapDesc heapDesc;
+		heapDesc.capacity = dedicated ? requirements.size : BlockSize;
+		heapDesc.type = nvrhi::HeapType::DeviceLocal;
+		heapDesc.debugName = pool == TexturePool ? "GPUMemoryAllocator_textureBlock" : "GPUMemoryAllocator_bufferBlock";
+		nvrhi::HeapHandle heap = Application::GetNVRHIDevice()->createHeap(heapDesc);
+		if (!heap)
+			return nullptr;
+
+		auto slot = std::find_if(blocks.begin(), blocks.end(), [](const Block& block) { return !block.heap; });
+		if (slot == blocks.end())
+			slot = blocks.insert(blocks.end(), Block{});
+
+		Block& block = *slot;
+		block.heap = heap;
+		block.size = heapDesc.capacity;
+		block.dedicated = dedicated;
+		block.allocationCount = 1;
+		m_blockBytes += block.size;
+
+		outAllocation.block = static_cast<uint32_t>(slot - blocks.begin());
+		outAllocation.offset = 0;
+		if (!dedicated) {
+			block.ranges.init(static_cast<uint32_t>(BlockSize));
+			block.ranges.allocate(static_cast<uint32_t>(requirements.size), outAllocation.offset, alignment);
+		}
+
+		addUsage(category, requirements.size);
+		PE_CORE_TRACE("[GPUMemoryAllocator] New {} block {} MB, total {} MB.", dedicated ? "dedicated" : "shared", block.size / (1024 * 1024), m_blockBytes / (1024 * 1024));
+		return block.heap;
+	}
+
+	void GPUMemoryAllocator::release(const GPUMemoryAllocation& allocation)
+	{
+		const uint32_t category = static_cast<uint32_t>(allocation.category);
+		m_categoryUsage[category] -= std::min(m_categoryUsage[category], allocation.size);
+		if (m_categoryUsage[category] <= m_categoryBudget[category])
+			m_categoryOverBudget[category] = false;
+
+		if (allocation.block == GPUMemoryAllocation::NoBlock)
+			return;
+
+		auto& blocks = m_pools[allocation.pool];
+		Block& block = blocks[allocation.block];
+		if (!block.dedicated)
+			block.ranges.free(allocation.offset, static_cast<uint32_t>(allocation.size));
+		block.allocationCount--;
+
+		// 空的block還給driver，但每個pool保留第一個避免反覆建立
+		if (block.allocationCount == 0 && (block.dedicated || allocation.block != 0)) {
+			m_blockBytes -= block.size;
+			block = Block{};
+		}
+	}
+
+	void GPUMemoryAllocator::addUsage(GPUMemoryCategory category, uint64_t bytes)
+	{
+		const uint32_t index = static_cast<uint32_t>(category);
+		m_categoryUsage[index] += bytes;
+
+		const uint64_t budget = m_categoryBudget[index];
+		if (budget > 0 && m_categoryUsage[index] > budget && !m_categoryOverBudget[index]) {
+			m_categoryOverBudget[index] = true;
+			PE_CORE_WARN("[GPUMemoryAllocator] {} memory {} MB exceeds budget {} MB.",
+				GPUMemoryCategoryToString(category), m_categoryUsage[index] / (1024 * 1024), budget / (1024 * 1024));
+		}
+	}
+
+}
@@ -0,0 +1,161 @@
+﻿#pragma once
+
+#include <array>
+#include <mutex>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/GraphicsContext.h>
+#include <PaperEngine/debug/FrameStats.h>
+#include <PaperEngine/utils/RangeAllocator.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// GPU記憶體的用途，各自統計使用量跟budget
+	/// </summary>
+	enum class GPUMemoryCategory : uint32_t {
+		Mesh,			// vertex/index buffer
+		Texture,
+		Buffer,			// GPUBuffer、material參數之類的
+		Upload,			// CPU寫入的buffer (FrameUploadAllocator、FrameStreaming)
+		Count
+	};
+
+	PE_API const char* GPUMemoryCategoryToString(GPUMemoryCategory category);
+
+	/// <summary>
+	/// GPUMemoryAllocator::createBuffer/createTexture/createHeap拿到的記憶體
+	/// resource不用了要呼叫GPUMemoryAllocator::free
+	/// </summary>
+	struct GPUMemoryAllocation {
+		/// <summary>
+		/// 不是放在block中的 (CPU access的buffer由NVRHI自己allocate、createHeap建立的heap)
+		/// </summary>
+		static constexpr uint32_t NoBlock = ~0u;
+
+		GPUMemoryCategory category = GPUMemoryCategory::Buffer;
+		uint32_t pool = 0;
+		uint32_t block = NoBlock;
+		uint32_t offset = 0;		// bytes
+		uint64_t size = 0;			// bytes
+
+		bool isValid() const { return size > 0; }
+	};
+
+	/// <summary>
+	/// 把GPU-only的buffer跟texture放進大的memory block (nvrhi heap)，不用每個resource一個VkDeviceMemory
+	/// 
+	/// resource以virtual建立，依照memory requirement在block中找位置 (RangeAllocator first fit) 後bind
+	/// buffer跟texture使用不同的block，不用處理bufferImageGranularity
+	/// 比DedicatedThreshold大的resource使用自己的heap
+	/// CPU access的buffer要map，不能是virtual，只統計大小
+	/// 
+	/// free的記憶體要等frame in flight個frame後 (GPU不會再使用) 才會被重新使用
+	/// 每個category的使用量跟VK_EXT_memory_budget的數值每個frame寫到FrameStats ("GPU Memory ...")
+	/// </summary>
+	class GPUMemoryAllocator {
+	public:
+		static constexpr uint64_t BlockSize = 256ull * 1024 * 1024;
+
+		static constexpr uint64_t DedicatedThreshold = BlockSize / 4;
+
+	public:
+		GPUMemoryAllocator(uint32_t framesInFlight);
+		~GPUMemoryAllocator();
+
+		/// <summary>
+		/// Thread safe
+		/// 回傳的buffer已經bind好記憶體，outAllocation要在不用時free
+		/// </summary>
+		PE_API nvrhi::BufferHandle createBuffer(nvrhi::BufferDesc desc, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation);
+
+		PE_API nvrhi::TextureHandle createTexture(nvrhi::TextureDesc desc, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation);
+
+		/// <summary>
+		/// 整個heap交給呼叫的人自己放resource (RenderGraph的transient heap)，不放在block中，只統計大小
+		/// </summary>
+		PE_API nvrhi::HeapHandle createHeap(const nvrhi::HeapDesc& desc, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation);
+
+		/// <summary>
+		/// Thread safe，釋放後allocation變成invalid
+		/// 使用這塊記憶體的resource要一起釋放 (NVRHI會等GPU用完才真的destroy)
+		/// </summary>
+		PE_API void free(GPUMemoryAllocation& allocation);
+
+		/// <summary>
+		/// 超過budget時log warning (0代表沒有限制)
+		/// </summary>
+		PE_API void setCategoryBudget(GPUMemoryCategory category, uint64_t bytes);
+
+		PE_API uint64_t getCategoryUsage(GPUMemoryCategory category) const;
+
+		/// <summary>
+		/// GraphicsContext::beginFrame成功後呼叫
+		/// 釋放GPU已經用完的記憶體，更新統計
+		/// </summary>
+		void beginFrame();
+
+		const GPUMemoryBudget& getDeviceBudget() const { return m_deviceBudget; }
+
+	private:
+		enum Pool : uint32_t {
+			BufferPool,
+			TexturePool,
+			PoolCount
+		};
+
+		struct Block {
+			nvrhi::HeapHandle heap;
+			RangeAllocator ranges;
+			uint64_t size = 0;
+			uint32_t allocationCount = 0;
+			bool dedicated = false;			// 只放一個resource，free時一起釋放
+		};
+
+		struct PendingFree {
+			GPUMemoryAllocation allocation;
+			uint64_t frameNumber;
+		};
+
+	private:
+		/// <summary>
+		/// 找位置，沒有的話建立新的block，要在m_mutex中呼叫
+		/// </summary>
+		nvrhi::IHeap* allocate(Pool pool, const nvrhi::MemoryRequirements& requirements, GPUMemoryCategory category, GPUMemoryAllocation& outAllocation);
+
+		/// <summary>
+		/// 真的還給block，要在m_mutex中呼叫
+		/// </summary>
+		void release(const GPUMemoryAllocation& allocation);
+
+		void addUsage(GPUMemoryCategory category, uint64_t bytes);
+
+	private:
+		mutable std::mutex m_mutex;
+
+		std::array<std::vector<Block>, PoolCount> m_pools;
+		uint64_t m_blockBytes = 0;
+
+		std::vector<PendingFree> m_pendingFrees;
+		uint64_t m_frameNumber = 0;
+		uint32_t m_framesInFlight;
+
+		static constexpr uint32_t CategoryCount = static_cast<uint32_t>(GPUMemoryCategory::Count);
+		std::array<uint64_t, CategoryCount> m_categoryUsage{};
+		std::array<uint64_t, CategoryCount> m_categoryBudget{};
+		std::array<bool, CategoryCount> m_categoryOverBudget{};
+
+		GPUMemoryBudget m_deviceBudget;
+		bool m_deviceOverBudget = false;
+
+		std::array<FrameStats::StatHandle, CategoryCount> m_categoryStats{};
+		FrameStats::StatHandle m_blockStat;
+		FrameStats::StatHandle m_blockCountStat;
+		FrameStats::StatHandle m_deviceBudgetStat;
+		FrameStats::StatHandle m_deviceUsageStat;
+	};
+
+}
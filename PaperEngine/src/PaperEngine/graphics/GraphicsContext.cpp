@@ -6,6 +6,17 @@
 
 namespace PaperEngine {
 
+	const char* PresentModeToString(PresentMode mode)
+	{
+		switch (mode)
+		{
+		case PresentMode::Fifo:			return "Fifo";
+		case PresentMode::Mailbox:		return "Mailbox";
+		case PresentMode::Immediate:	return "Immediate";
+		}
+		return "Unknown";
+	}
+
     Ref<GraphicsContext> GraphicsContext::Create(Window* window)
     {
 		switch (Application::Get()->getRenderAPI())
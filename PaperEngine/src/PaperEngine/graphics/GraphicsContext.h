@@ -4,11 +4,56 @@
 
 #include <PaperEngine/core/Window.h>
 
+#include <functional>
+#include <span>
+#include <vector>
+
 #include <nvrhi/nvrhi.h>
 
 namespace PaperEngine {
 
+	/// <summary>
+	/// swapchain的present mode，不支援的話依序fallback (最後一定是Fifo)
+	/// </summary>
+	enum class PresentMode {
+		Fifo,			// vsync，不會tear，latency最高
+		Mailbox,		// vsync，新的frame取代還沒顯示的frame，不支援的話用Fifo
+		Immediate		// 不等vsync，會tear，latency最低，不支援的話用Mailbox再用Fifo
+	};
+
+	PE_API const char* PresentModeToString(PresentMode mode);
+
+	/// <summary>
+	/// requestFrameReadback讀回來的color target
+	/// pixels是緊密排列的 (沒有row padding)，一個pixel bytesPerPixel bytes
+	/// </summary>
+	struct FrameReadback {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		nvrhi::Format format = nvrhi::Format::UNKNOWN;
+		uint32_t bytesPerPixel = 0;
+		std::vector<uint8_t> pixels;
+	};
+
+	typedef std::function<void(const FrameReadback&)> FrameReadbackCallback;
+
+	/// <summary>
+	/// 所有device local heap加起來的budget跟使用量 (bytes)，包含其他process
+	/// 不支援VK_EXT_memory_budget時budget是heap大小，usage是0
+	/// </summary>
+	struct GPUMemoryBudget {
+		uint64_t budget = 0;
+		uint64_t usage = 0;
+		bool supported = false;
+	};
+
 	class GraphicsContext {
+	public:
+		/// <summary>
+		/// ApplicationProps::framesInFlight的上限
+		/// </summary>
+		static constexpr uint32_t MaxFramesInFlight = 4;
+
 	public:
 		virtual ~GraphicsContext() = default;
 
@@ -52,8 +97,46 @@ namespace PaperEngine {
 
 		virtual nvrhi::CommandListHandle getMainCommandList() = 0;
 
+		/// <summary>
+		/// 把main command list目前為止錄的內容送出，接著依序送出followingCommandLists
+		/// 之後main command list會重新open，繼續錄的內容會在這些command list之後執行
+		/// 用在worker thread平行錄製的command list (followingCommandLists要已經close)
+		/// </summary>
+		virtual void executeMainCommandList(std::span<nvrhi::ICommandList* const> followingCommandLists) = 0;
+
+		/// <summary>
+		/// 這個frame畫完後把color target (swapchain image或headless的offscreen texture) 複製到CPU
+		/// 要在beginFrame跟present之間呼叫，GPU完成後 (之後的beginFrame或cleanUp) 在render thread呼叫callback
+		/// 不會等GPU，不影響frame pacing
+		/// </summary>
+		virtual void requestFrameReadback(FrameReadbackCallback callback) = 0;
+
+		/// <summary>
+		/// frame in flight的數量，FrameStreaming的resource都是以這個數量建立
+		/// 跟swapchain image的數量無關
+		/// </summary>
 		virtual uint32_t getMaxFrameInFlight() = 0;
 
+		/// <summary>
+		/// fallback之後實際使用的present mode (headless時為requested的)
+		/// </summary>
+		virtual PresentMode getPresentMode() const = 0;
+
+		virtual GPUMemoryBudget getMemoryBudget() const = 0;
+
+		/// <summary>
+		/// device有BindlessMaterialTable需要的descriptor indexing feature
+		/// 沒有的話bindless的GraphicsPipeline不會被建立
+		/// </summary>
+		virtual bool supportsBindless() const = 0;
+
+		/// <summary>
+		/// 全域的memory barrier，之前所有command的寫入對之後的command都可見
+		/// 同一塊memory換給另一個resource使用 (RenderGraph的transient aliasing) 前呼叫
+		/// 會結束目前的render pass
+		/// </summary>
+		virtual void insertAliasingBarrier(nvrhi::ICommandList* cmd) = 0;
+
 		/// <summary>
 		/// Get the current frame in flight index
 		/// </summary>
@@ -1,12 +1,100 @@
 ﻿#include "GraphicsPipeline.h"
 
+#include <algorithm>
+
 #include <PaperEngine/core/Application.h>
+#include <PaperEngine/graphics/BindlessMaterialTable.h>
 
 namespace PaperEngine {
-    GraphicsPipeline::GraphicsPipeline(nvrhi::GraphicsPipelineDesc desc, nvrhi::BindingLayoutHandle bindingLayout, size_t variableBufferSize) :
-		m_graphicsPipelineDesc(desc), m_bindingLayout(bindingLayout), m_variableBufferSize(variableBufferSize)
+
+	namespace {
+		inline void HashCombine(size_t& seed, size_t value)
+		{
+			seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+	}
+
+	bool PipelineKey::operator==(const PipelineKey& other) const
+	{
+		return framebufferInfo == other.framebufferInfo && renderState == other.renderState;
+	}
+
+	size_t PipelineKeyHash::operator()(const PipelineKey& key) const
 	{
+		size_t seed = 0;
+		for (nvrhi::Format format : key.framebufferInfo.colorFormats)
+			HashCombine(seed, static_cast<size_t>(format));
+		HashCombine(seed, static_cast<size_t>(key.framebufferInfo.depthFormat));
+		HashCombine(seed, key.framebufferInfo.sampleCount);
+		HashCombine(seed, key.framebufferInfo.sampleQuality);
 
+		const PipelineRenderState& state = key.renderState;
+		HashCombine(seed, static_cast<size_t>(state.cullMode));
+		HashCombine(seed, std::hash<int>()(state.depthBias));
+		HashCombine(seed, std::hash<float>()(state.slopeScaledDepthBias));
+		HashCombine(seed, (state.depthClipEnable ? 1 : 0) | (state.depthTestEnable ? 2 : 0) | (state.depthWriteEnable ? 4 : 0));
+		HashCombine(seed, static_cast<size_t>(state.depthFunc));
+		return seed;
+	}
+    GraphicsPipeline::GraphicsPipeline(nvrhi::GraphicsPipelineDesc desc, nvrhi::BindingLayoutHandle bindingLayout, size_t variableBufferSize, bool bindless) :
+		m_graphicsPipelineDesc(desc), m_bindingLayout(bindingLayout), m_variableBufferSize(variableBufferSize), m_bindless(bindless)
+	{
+		const nvrhi::RenderState& renderState = m_graphicsPipelineDesc.renderState;
+		m_defaultRenderState.cullMode = renderState.rasterState.cullMode;
+		m_defaultRenderState.depthBias = renderState.rasterState.depthBias;
+		m_defaultRenderState.slopeScaledDepthBias = renderState.rasterState.slopeScaledDepthBias;
+		m_defaultRenderState.depthClipEnable = renderState.rasterState.depthClipEnable;
+		m_defaultRenderState.depthTestEnable = renderState.depthStencilState.depthTestEnable;
+		m_defaultRenderState.depthWriteEnable = renderState.depthStencilState.depthWriteEnable;
+		m_defaultRenderState.depthFunc = renderState.depthStencilState.depthFunc;
+
+		PE_CORE_ASSERT(!m_bindless || m_variableBufferSize <= BindlessMaterialTable::MaterialParameterStride,
+			"Bindless material variables exceed the parameter stride.");
+
+		// shader是用descriptor table寫的，沒辦法退回一般的binding set
+		if (m_bindless && !Application::Get()->getGraphicsContext()->supportsBindless())
+		{
+			PE_CORE_ERROR("[GraphicsPipeline] Bindless pipeline requested but the device does not support bindless descriptors.");
+			m_bindless = false;
+			m_supported = false;
+		}
+
+		// Material (set = 2) 的參數reflection
+		uint32_t reflectedBufferSize = 0;
+		for (nvrhi::IShader* shader : { m_graphicsPipelineDesc.VS.Get(), m_graphicsPipelineDesc.PS.Get() })
+		{
+			if (!shader)
+				continue;
+
+			const void* bytecode = nullptr;
+			size_t bytecodeSize = 0;
+			shader->getBytecode(&bytecode, &bytecodeSize);
+			ShaderReflection::ReflectSpirv(bytecode, bytecodeSize, 2, m_parameters, reflectedBufferSize);
+			ShaderReflection::ReflectBindings(bytecode, bytecodeSize, 0, m_globalBindings);
+		}
+
+		if (reflectedBufferSize > m_variableBufferSize)
+		{
+			PE_CORE_ERROR("[GraphicsPipeline] Variable buffer size {} is smaller than the shader's constant buffer ({} bytes).",
+				m_variableBufferSize, reflectedBufferSize);
+		}
+
+		for (ParameterHandle handle = 0; handle < m_parameters.size(); handle++)
+			m_parameterHandles[m_parameters[handle].name] = handle;
+	}
+
+	ParameterHandle GraphicsPipeline::getParameterHandle(const std::string& name) const
+	{
+		auto it = m_parameterHandles.find(name);
+		if (it == m_parameterHandles.end())
+			return InvalidParameterHandle;
+		return it->second;
+	}
+
+	bool GraphicsPipeline::usesGlobalShaderResource(uint32_t slot) const
+	{
+		// SRV在NVRHI的Vulkan binding offset為0
+		return std::find(m_globalBindings.begin(), m_globalBindings.end(), slot) != m_globalBindings.end();
 	}
 
     PE_API void GraphicsPipeline::bind(nvrhi::GraphicsState& graphicsState, nvrhi::IFramebuffer* fb) const
@@ -14,20 +102,74 @@ namespace PaperEngine {
         graphicsState.setPipeline(getGraphicsPipeline(fb));
     }
 
+	void GraphicsPipeline::bind(nvrhi::GraphicsState& graphicsState, nvrhi::IFramebuffer* fb, const PipelineRenderState& renderState) const
+	{
+		PipelineKey key;
+		key.framebufferInfo = fb->getFramebufferInfo();
+		key.renderState = renderState;
+		graphicsState.setPipeline(getGraphicsPipeline(key));
+	}
+
     nvrhi::IGraphicsPipeline* GraphicsPipeline::getGraphicsPipeline(nvrhi::IFramebuffer* fb) const
     {
-        if (m_graphicsPipeline)
-            return m_graphicsPipeline;
+		return getGraphicsPipeline(makeKey(fb));
+    }
+
+	nvrhi::IGraphicsPipeline* GraphicsPipeline::getGraphicsPipeline(const PipelineKey& key) const
+	{
+		if (!m_supported)
+			return nullptr;
 
-        auto device = Application::Get()->getGraphicsContext()->getNVRhiDevice();
+		{
+			std::shared_lock readLock(m_pipelineCacheMutex);
+			auto it = m_pipelineCache.find(key);
+			if (it != m_pipelineCache.end())
+				return it->second;
+		}
 
-		m_graphicsPipeline = device->createGraphicsPipeline(
-                m_graphicsPipelineDesc,
-                fb);
-		PE_CORE_ASSERT(m_graphicsPipeline, "Failed to create Graphics Pipeline.");
+		// 在lock外面建立，這樣prewarm的時候不同的key可以同時建立
+		nvrhi::GraphicsPipelineDesc desc = m_graphicsPipelineDesc;
+		const PipelineRenderState& state = key.renderState;
+		desc.renderState.rasterState.cullMode = state.cullMode;
+		desc.renderState.rasterState.depthBias = state.depthBias;
+		desc.renderState.rasterState.slopeScaledDepthBias = state.slopeScaledDepthBias;
+		desc.renderState.rasterState.depthClipEnable = state.depthClipEnable;
+		desc.renderState.depthStencilState.depthTestEnable = state.depthTestEnable;
+		desc.renderState.depthStencilState.depthWriteEnable = state.depthWriteEnable;
+		desc.renderState.depthStencilState.depthFunc = state.depthFunc;
 
-		return m_graphicsPipeline;
-    }
+		nvrhi::GraphicsPipelineHandle pipeline = Application::GetNVRHIDevice()->createGraphicsPipeline(desc, key.framebufferInfo);
+		PE_CORE_ASSERT(pipeline, "Failed to create Graphics Pipeline.");
+
+		std::unique_lock writeLock(m_pipelineCacheMutex);
+		// 其他thread先建立好的話就用他的
+		auto [it, inserted] = m_pipelineCache.emplace(key, pipeline);
+		return it->second;
+	}
+
+	std::vector<std::future<void>> GraphicsPipeline::prewarm(std::span<const PipelineKey> keys)
+	{
+		std::vector<std::future<void>> futures;
+		futures.reserve(keys.size());
+
+		auto self = shared_from_this();
+		for (const PipelineKey& key : keys)
+		{
+			futures.push_back(Application::GetThreadPool()->submit_task([self, key]()
+				{
+					self->getGraphicsPipeline(key);
+				}));
+		}
+		return futures;
+	}
+
+	PipelineKey GraphicsPipeline::makeKey(nvrhi::IFramebuffer* fb) const
+	{
+		PipelineKey key;
+		key.framebufferInfo = fb->getFramebufferInfo();
+		key.renderState = m_defaultRenderState;
+		return key;
+	}
 
     nvrhi::IBindingLayout* GraphicsPipeline::getBindingLayout() const
     {
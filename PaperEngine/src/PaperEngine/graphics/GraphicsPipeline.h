@@ -2,15 +2,59 @@
 
 #include <nvrhi/nvrhi.h>
 
+#include <span>
+#include <vector>
+#include <future>
+#include <unordered_map>
+#include <shared_mutex>
+
 #include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/ShaderReflection.h>
 
 namespace PaperEngine {
 
+	/// <summary>
+	/// 同一個shader在不同pass可能會需要不同的render state
+	/// 例如shadow map需要depth bias或不同的cull mode
+	/// 預設值來自GraphicsPipelineDesc
+	/// </summary>
+	struct PipelineRenderState {
+		nvrhi::RasterCullMode cullMode = nvrhi::RasterCullMode::Back;
+		int depthBias = 0;
+		float slopeScaledDepthBias = 0.f;
+		bool depthClipEnable = true;
+		bool depthTestEnable = true;
+		bool depthWriteEnable = true;
+		nvrhi::ComparisonFunc depthFunc = nvrhi::ComparisonFunc::Less;
+
+		bool operator==(const PipelineRenderState& other) const = default;
+	};
+
+	/// <summary>
+	/// Pipeline cache的key
+	/// </summary>
+	struct PipelineKey {
+		nvrhi::FramebufferInfo framebufferInfo;
+		PipelineRenderState renderState;
+
+		bool operator==(const PipelineKey& other) const;
+	};
+
+	struct PipelineKeyHash {
+		size_t operator()(const PipelineKey& key) const;
+	};
+
 	/// <summary>
 	/// 放Shader的東西
 	/// 只有一個buffer放uniforms (預設放在constant buffer 0)
+	/// 
+	/// 建立時會reflect VS跟PS的SPIR-V，取得material (set = 2) 的參數
+	/// Material用ParameterHandle直接存取，不用每次查字串
+	/// 
+	/// 實際的nvrhi pipeline依照framebuffer格式跟render state快取
+	/// 同一個GraphicsPipeline可以用在不同的render target（pre-depth、shadow map、HDR...）
 	/// </summary>
-	class GraphicsPipeline {
+	class GraphicsPipeline : public std::enable_shared_from_this<GraphicsPipeline> {
 	public:
 		/// <summary>
 		/// 
@@ -20,26 +64,91 @@ namespace PaperEngine {
 		/// 你要自己把Layout放進desc，
 		/// 這個單純是你需要設定shader的值之類的（不是全域）
 		/// </param>
-		PE_API GraphicsPipeline(nvrhi::GraphicsPipelineDesc desc, nvrhi::BindingLayoutHandle bindingLayout, size_t variableBufferSize);
+		/// <param name="bindless">
+		/// 使用BindlessMaterialTable
+		/// desc的bindingLayouts[2], [3]要放BindlessMaterialTable的parameter layout跟bindless layout
+		/// bindingLayout可以是nullptr，variableBufferSize不能超過MaterialParameterStride
+		/// device不支援bindless的話這個pipeline不會被建立 (isSupported為false)
+		/// </param>
+		PE_API GraphicsPipeline(nvrhi::GraphicsPipelineDesc desc, nvrhi::BindingLayoutHandle bindingLayout, size_t variableBufferSize, bool bindless = false);
 
 		PE_API void bind(nvrhi::GraphicsState& graphicsState, nvrhi::IFramebuffer* fb) const;
 
+		PE_API void bind(nvrhi::GraphicsState& graphicsState, nvrhi::IFramebuffer* fb, const PipelineRenderState& renderState) const;
+
 		nvrhi::IGraphicsPipeline* getGraphicsPipeline(nvrhi::IFramebuffer* fb) const;
 
+		/// <summary>
+		/// Thread safe
+		/// 沒有的話會建立（可能會卡，請先prewarm）
+		/// </summary>
+		PE_API nvrhi::IGraphicsPipeline* getGraphicsPipeline(const PipelineKey& key) const;
+
+		/// <summary>
+		/// 在thread pool上先建立這些組合的pipeline
+		/// 載入時呼叫，第一次使用的frame就不會卡
+		/// </summary>
+		/// <returns>每個key一個future，不需要等待的話可以直接丟掉</returns>
+		PE_API std::vector<std::future<void>> prewarm(std::span<const PipelineKey> keys);
+
+		/// <summary>
+		/// desc中的render state
+		/// </summary>
+		PE_API const PipelineRenderState& getDefaultRenderState() const { return m_defaultRenderState; }
+
+		PE_API PipelineKey makeKey(nvrhi::IFramebuffer* fb) const;
+
 		PE_API nvrhi::IBindingLayout* getBindingLayout() const;
 
 		PE_API size_t getVariableBufferSize() const { return m_variableBufferSize; }
 
+		PE_API bool isBindless() const { return m_bindless; }
+
+		/// <summary>
+		/// bindless pipeline在不支援bindless的device上為false
+		/// 這時getGraphicsPipeline回傳nullptr，MeshRenderer跟Material會跳過
+		/// </summary>
+		PE_API bool isSupported() const { return m_supported; }
+
+		/// <summary>
+		/// 沒有這個參數回傳InvalidParameterHandle
+		/// 同一個pipeline的所有Material的handle都一樣，可以先查好存起來
+		/// </summary>
+		PE_API ParameterHandle getParameterHandle(const std::string& name) const;
+
+		PE_API const std::vector<ShaderParameterInfo>& getParameters() const { return m_parameters; }
+
+		/// <summary>
+		/// VS或PS有沒有讀global (set = 0) 的這個SRV slot
+		/// SceneRenderer用來判斷要畫的shader有沒有取樣shadow map
+		/// </summary>
+		PE_API bool usesGlobalShaderResource(uint32_t slot) const;
+
 	private:
 
 		nvrhi::GraphicsPipelineDesc m_graphicsPipelineDesc; // 基本的圖形管線描述，用於創建圖形管線
 
-		mutable nvrhi::GraphicsPipelineHandle m_graphicsPipeline; // 圖形管線，用於渲染圖形
+		PipelineRenderState m_defaultRenderState;
+
+		// 圖形管線，用於渲染圖形
+		mutable std::shared_mutex m_pipelineCacheMutex;
+		mutable std::unordered_map<PipelineKey, nvrhi::GraphicsPipelineHandle, PipelineKeyHash> m_pipelineCache;
 
 		nvrhi::BindingLayoutHandle m_bindingLayout; // 綁定佈局，用於綁定Shader資源
 
 		size_t m_variableBufferSize;
 
+		bool m_bindless;
+
+		bool m_supported = true;
+
+		// reflection出來的material參數，index就是ParameterHandle
+		std::vector<ShaderParameterInfo> m_parameters;
+		std::unordered_map<std::string, ParameterHandle> m_parameterHandles;
+
+		// reflection出來的global (set = 0) binding
+		std::vector<uint32_t> m_globalBindings;
+
 	};
 
 }
@@ -3,6 +3,8 @@
 #include <PaperEngine/utils/File.h>
 
 #include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+#include <PaperEngine/debug/FrameStats.h>
 
 namespace PaperEngine {
 
@@ -10,33 +12,7 @@ namespace PaperEngine {
 		nvrhi::CommandListParameters cmdParams;
 		cmdParams.setQueueType(nvrhi::CommandQueue::Compute);
 
-		const uint32_t max_frame_count = Application::Get()->getGraphicsContext()->getMaxFrameInFlight();
-		{
-			nvrhi::BufferDesc bufferDesc;
-			bufferDesc
-				.setDebugName("Directional Light Buffer")
-				.setByteSize(m_maxDirectionalLight * sizeof(DirectionalLightData))
-				.setCpuAccess(nvrhi::CpuAccessMode::Write)
-				.setIsConstantBuffer(true)
-				.setKeepInitialState(true)
-				.setStructStride(sizeof(DirectionalLightData));
-			m_directionalLightBuffer = CreateRef<GPUBuffer>(ResourceUsage::FrameStreaming, bufferDesc);
-		}
-
-#pragma region Initialize Point buffers
-		{
-			nvrhi::BufferDesc bufferDesc;
-			bufferDesc
-				.setDebugName("Point Light Buffer")
-				.setByteSize(m_maxPointLight * sizeof(PointLightData))
-				.setCpuAccess(nvrhi::CpuAccessMode::Write)
-				.setIsConstantBuffer(true)
-				.setKeepInitialState(true)
-				.setStructStride(sizeof(PointLightData));
-			m_pointLightBuffer = CreateRef<GPUBuffer>(ResourceUsage::FrameStreaming, bufferDesc);
-
-		}
-#pragma endregion
+		m_directionalLights.reserve(m_maxDirectionalLight);
 
 #pragma region Light Cull Binding Layout Creation
 
@@ -55,19 +31,6 @@ namespace PaperEngine {
 		m_lightCullBindingLayout->handle = Application::GetNVRHIDevice()->createBindingLayout(lightCullBindingLayoutDesc);
 #pragma endregion
 
-#pragma region Global data GPU Buffer
-		{
-			nvrhi::BufferDesc bufferDesc;
-			bufferDesc
-				.setDebugName("LightCullGlobalDataBuffer")
-				.setByteSize(sizeof(GlobalData))
-				.setCpuAccess(nvrhi::CpuAccessMode::Write)
-				.setIsConstantBuffer(true)
-				.setKeepInitialState(true);
-			m_pointLightCullData.globalDataBuffer = CreateRef<GPUBuffer>(ResourceUsage::FrameStreaming, bufferDesc);
-		}
-#pragma endregion
-
 #pragma region Global Light Indices Buffer Creation
 		{
 			nvrhi::BufferDesc bufferDesc;
@@ -116,23 +79,6 @@ namespace PaperEngine {
 		}
 #pragma endregion
 
-#pragma region Binding Set Creation
-		{
-			std::vector< nvrhi::BindingSetDesc> bindingSetDescs(max_frame_count);
-			for (uint32_t i = 0; i < max_frame_count; i++)
-			{
-				nvrhi::BindingSetDesc& bindingSetDesc = bindingSetDescs[i];
-				bindingSetDesc
-					.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_pointLightCullData.globalDataBuffer->getStorages()[i].handle))
-					.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_pointLightBuffer->getStorages()[i].handle))
-					.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_pointLightCullData.globalLightIndicesBuffer->getStorages()[i].handle))
-					.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_pointLightCullData.clusterRangesBuffer->getStorages()[i].handle))
-					.addItem(nvrhi::BindingSetItem::RawBuffer_UAV(2, m_pointLightCullData.globalCounterBuffer->getStorages()[i].handle));
-			}
-			m_pointLightCullData.lightCullBindingSet = std::make_shared<BindingSet>(ResourceUsage::FrameStatic, m_lightCullBindingLayout, bindingSetDescs);
-		}
-#pragma endregion
-
 #pragma region Light Culling Compute pipeline Initialization
 		{
 			nvrhi::ComputePipelineDesc pipelineDesc;
@@ -164,7 +110,7 @@ namespace PaperEngine {
 
 	void LightCullingPass::setCamera(const Camera& camera, const glm::mat4& viewMatrix, const Frustum& frustum)
 	{
-		GlobalData* globalData = static_cast<GlobalData*>(m_pointLightCullData.globalDataBuffer->getMapPtr());
+		GlobalData* globalData = &m_globalData;
 
 		globalData->projViewMatrix = camera.getProjectionMatrix() * viewMatrix;
 		globalData->viewMatrix = viewMatrix;
@@ -179,8 +125,11 @@ namespace PaperEngine {
 	void LightCullingPass::beginPass()
 	{
 		// 重置
-		m_currentDirectionalLightCount = 0;
-		m_currentPointLightCount = 0;
+		m_directionalLights.clear();
+		m_shadowDirectionalLightIndex = NoShadowLight;
+		m_pointLights.clear();
+		m_shadowPointLights.clear();
+		m_pointLightCullData.lightCullBindingSet = nullptr;
 	}
 
 	LightCullingPass::LightCullingPass()
@@ -198,32 +147,30 @@ namespace PaperEngine {
 		{
 		case LightType::Directional:
 		{
-			if (m_currentDirectionalLightCount >= m_maxDirectionalLight)
+			if (m_directionalLights.size() >= m_maxDirectionalLight)
 				break;
-			DirectionalLightData* dataPtr =
-				reinterpret_cast<DirectionalLightData*>(
-					(uint8_t*)m_directionalLightBuffer->getMapPtr() + (m_currentDirectionalLightCount * sizeof(DirectionalLightData)));
-			dataPtr->direction = lightCom.light.directionalLight.direction;
-			dataPtr->color = lightCom.light.directionalLight.color;
-			m_currentDirectionalLightCount++;
+			if (lightCom.castShadow && m_shadowDirectionalLightIndex == NoShadowLight)
+				m_shadowDirectionalLightIndex = static_cast<uint32_t>(m_directionalLights.size());
+			DirectionalLightData& data = m_directionalLights.emplace_back();
+			data.direction = lightCom.light.directionalLight.direction;
+			data.color = lightCom.light.directionalLight.color;
 		}
 			break;
 		case LightType::Point:
 		{
-			if (m_currentPointLightCount >= m_maxPointLight)
+			if (m_pointLights.size() >= m_maxPointLight)
 				break;
 			const PointLight& pointLight = lightCom.light.pointLight;
 			if (!BoundingSphere(transform.getPosition(), pointLight.radius)
 				.isIntersect(m_currentCameraFrustum))		// 不在畫面裡
 				break;
 
-			PointLightData* dataPtr =
-				reinterpret_cast<PointLightData*>(
-					(uint8_t*)m_pointLightBuffer->getMapPtr() + (m_currentPointLightCount * sizeof(PointLightData)));
-			dataPtr->position = transform.getPosition();
-			dataPtr->color = lightCom.light.pointLight.color;
-			dataPtr->radius = lightCom.light.pointLight.radius;
-			m_currentPointLightCount++;
+			if (lightCom.castShadow)
+				m_shadowPointLights.push_back(static_cast<uint32_t>(m_pointLights.size()));
+			PointLightData& data = m_pointLights.emplace_back();
+			data.position = transform.getPosition();
+			data.color = lightCom.light.pointLight.color;
+			data.radius = lightCom.light.pointLight.radius;
 		}
 			break;
 		default:
@@ -231,19 +178,50 @@ namespace PaperEngine {
 		}
 	}
 
+	bool LightCullingPass::upload()
+	{
+		PE_PROFILE_FUNCTION();
+
+		m_globalData.numXSlices = m_numberOfXSlices;
+		m_globalData.numYSlices = m_numberOfYSlices;
+		m_globalData.numZSlices = m_numberOfZSlices;
+		m_globalData.pointLightCount = getPointLightCount();
+
+		// 沒有light時也allocate一個element，binding的range不能是0
+		FrameUploadAllocator* uploadAllocator = Application::GetFrameUploadAllocator();
+		m_globalDataAllocation = uploadAllocator->upload(&m_globalData, 1);
+		m_directionalLightAllocation = uploadAllocator->allocate(std::max<size_t>(1, m_directionalLights.size()) * sizeof(DirectionalLightData));
+		m_pointLightAllocation = uploadAllocator->allocate(std::max<size_t>(1, m_pointLights.size()) * sizeof(PointLightData));
+		if (!m_globalDataAllocation.isValid() || !m_directionalLightAllocation.isValid() || !m_pointLightAllocation.isValid())
+			return false;
+
+		memcpy(m_directionalLightAllocation.mapPtr, m_directionalLights.data(), m_directionalLights.size() * sizeof(DirectionalLightData));
+		memcpy(m_pointLightAllocation.mapPtr, m_pointLights.data(), m_pointLights.size() * sizeof(PointLightData));
+
+		auto& pointLightCullData = m_pointLightCullData;
+		nvrhi::BindingSetDesc bindingSetDesc;
+		bindingSetDesc
+			.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_globalDataAllocation.buffer, m_globalDataAllocation.getRange()))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_pointLightAllocation.buffer, nvrhi::Format::UNKNOWN, m_pointLightAllocation.getRange()))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, pointLightCullData.globalLightIndicesBuffer->getHandle()))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(1, pointLightCullData.clusterRangesBuffer->getHandle()))
+			.addItem(nvrhi::BindingSetItem::RawBuffer_UAV(2, pointLightCullData.globalCounterBuffer->getHandle()));
+		pointLightCullData.lightCullBindingSet = Application::GetNVRHIDevice()->createBindingSet(bindingSetDesc, m_lightCullBindingLayout->handle);
+		return true;
+	}
+
 	void LightCullingPass::calculatePass(nvrhi::ICommandList* cmd)
 	{
 		PE_PROFILE_FUNCTION();
-		// 紀錄一下會compute多少個Point Light
-		m_numberOfProcessPointLights = m_currentPointLightCount;
+		PE_PROFILE_GPU_SCOPE(cmd, "Light Culling");
 
 		auto& pointLightCullData = m_pointLightCullData;
+		PE_CORE_ASSERT(pointLightCullData.lightCullBindingSet, "LightCullingPass::upload must succeed before calculatePass.");
 
-		GlobalData* globalData = static_cast<GlobalData*>(pointLightCullData.globalDataBuffer->getMapPtr());
-		globalData->numXSlices = m_numberOfXSlices;
-		globalData->numYSlices = m_numberOfYSlices;
-		globalData->numZSlices = m_numberOfZSlices;
-		globalData->pointLightCount = m_currentPointLightCount;
+		// 紀錄一下會compute多少個Point Light
+		m_numberOfProcessPointLights = getPointLightCount();
+		PE_FRAME_STAT_COUNT("Light Culling Point Lights", m_numberOfProcessPointLights);
+		PE_FRAME_STAT_COUNT("Light Culling Clusters", m_numberOfXSlices * m_numberOfYSlices * m_numberOfZSlices);
 
 		nvrhi::ComputeState computeState;
 
@@ -251,7 +229,7 @@ namespace PaperEngine {
 
 		// Compute Light Clusters
 #pragma region Compute Light Clusters
-		computeState.bindings = { pointLightCullData.lightCullBindingSet->getHandle()};
+		computeState.bindings = { pointLightCullData.lightCullBindingSet };
 		computeState.pipeline = m_lightCullPipeline;
 		cmd->setComputeState(computeState);
 
@@ -261,9 +239,6 @@ namespace PaperEngine {
 
 		cmd->dispatch(m_numberOfXSlices, m_numberOfYSlices, m_numberOfZSlices);
 
-		//cmd->setBufferState(
-		//	pointLightCullData.globalDataBuffer,
-		//	nvrhi::ResourceStates::ShaderResource);
 		//cmd->setBufferState(
 		//	pointLightCullData.globalCounterBuffer,
 		//	nvrhi::ResourceStates::ShaderResource);
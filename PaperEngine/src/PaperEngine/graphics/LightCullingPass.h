@@ -5,6 +5,8 @@
 #include <PaperEngine/utils/BoundingVolume.h>
 #include <PaperEngine/graphics/Camera.h>
 
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
+
 #include <nvrhi/nvrhi.h>
 #include "GPUBuffer.h"
 #include "BindingSet.h"
@@ -32,11 +34,11 @@ namespace PaperEngine {
 	public:
 		struct PointLightCullData
 		{
-			GPUBufferHandle globalDataBuffer;
 			GPUBufferHandle globalLightIndicesBuffer;
 			GPUBufferHandle clusterRangesBuffer;
 			GPUBufferHandle globalCounterBuffer;
-			BindingSetHandle lightCullBindingSet;
+			// global data跟point light是這個frame的upload allocation，upload時重新建立
+			nvrhi::BindingSetHandle lightCullBindingSet;
 		};
 
 		struct GlobalData
@@ -84,13 +86,36 @@ namespace PaperEngine {
 		/// <param name="lightCom"></param>
 		void processLight(const Transform& transform, const LightComponent& lightCom);
 
+		/// <summary>
+		/// process完之後呼叫，把global data跟light上傳到FrameUploadAllocator並建立light cull binding set
+		/// 失敗的話回傳false，這個frame不能calculatePass
+		/// </summary>
+		bool upload();
+
 		void calculatePass(nvrhi::ICommandList* cmd);
 
-		GPUBufferHandle getDirectionalLightBuffer() { return m_directionalLightBuffer; }
-		uint32_t getDirectionalLightCount() const { return m_currentDirectionalLightCount; }
+		/// <summary>
+		/// upload後才有效，沒有light時也至少有一個element的大小
+		/// </summary>
+		const FrameUploadAllocation& getDirectionalLightAllocation() const { return m_directionalLightAllocation; }
+		uint32_t getDirectionalLightCount() const { return static_cast<uint32_t>(m_directionalLights.size()); }
 
-		GPUBufferHandle getPointLightBuffer() { return m_pointLightBuffer; }
-		uint32_t getPointLightCount() const { return m_currentPointLightCount; }
+		/// <summary>
+		/// 第一個castShadow的directional light在directional light buffer中的index，沒有的話回傳NoShadowLight
+		/// </summary>
+		uint32_t getShadowDirectionalLightIndex() const { return m_shadowDirectionalLightIndex; }
+		const DirectionalLightData& getDirectionalLight(uint32_t index) const { return m_directionalLights[index]; }
+
+		static constexpr uint32_t NoShadowLight = ~0u;
+
+		const FrameUploadAllocation& getPointLightAllocation() const { return m_pointLightAllocation; }
+		uint32_t getPointLightCount() const { return static_cast<uint32_t>(m_pointLights.size()); }
+		const PointLightData& getPointLight(uint32_t index) const { return m_pointLights[index]; }
+
+		/// <summary>
+		/// 在camera frustum中且castShadow的point light在point light buffer中的index
+		/// </summary>
+		const std::vector<uint32_t>& getShadowPointLights() const { return m_shadowPointLights; }
 
 		PointLightCullData& getPointLightCullData();
 
@@ -115,17 +140,21 @@ namespace PaperEngine {
 		uint32_t m_numberOfProcessPointLights = 0;
 		// data
 		PointLightCullData m_pointLightCullData;
+		// setCamera跟upload時寫入，upload時才複製到GPU
+		GlobalData m_globalData{};
+		FrameUploadAllocation m_globalDataAllocation;
 
 		// Directional Light Data
 		uint32_t m_maxDirectionalLight = 8;
-		// Current to input (in bytes)
-		uint32_t m_currentDirectionalLightCount = 0;
-		GPUBufferHandle m_directionalLightBuffer;
+		std::vector<DirectionalLightData> m_directionalLights;
+		uint32_t m_shadowDirectionalLightIndex = NoShadowLight;
+		FrameUploadAllocation m_directionalLightAllocation;
 
 		// Point Light Data
 		uint32_t m_maxPointLight = 10000;
-		uint32_t m_currentPointLightCount = 0;
-		GPUBufferHandle m_pointLightBuffer;
+		std::vector<PointLightData> m_pointLights;
+		std::vector<uint32_t> m_shadowPointLights;
+		FrameUploadAllocation m_pointLightAllocation;
 
 		std::mutex m_mutex;
 	};
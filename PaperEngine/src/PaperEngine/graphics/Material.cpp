@@ -7,118 +7,250 @@ namespace PaperEngine {
 	Material::Material(Ref<GraphicsPipeline> graphicsPipeline) :
 		m_graphicsPipeline(graphicsPipeline)
 	{
-		m_cmd = Application::GetNVRHIDevice()->createCommandList();
-
-		if (m_graphicsPipeline->getVariableBufferSize() > 0) {
-			nvrhi::BufferDesc bufferDesc;
-			bufferDesc
-				.setByteSize(m_graphicsPipeline->getVariableBufferSize())
-				.setIsConstantBuffer(true);
-			m_variableBuffer = Application::GetNVRHIDevice()->createBuffer(bufferDesc);
-			m_bindingSetDesc.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_variableBuffer));
+		// reflection出來的參數，handle跟pipeline的一樣
+		const auto& pipelineParameters = m_graphicsPipeline->getParameters();
+		m_parameters.resize(pipelineParameters.size());
+		for (ParameterHandle handle = 0; handle < pipelineParameters.size(); handle++) {
+			const auto& info = pipelineParameters[handle];
+			m_parameters[handle].slot = info.slot;
+			m_parameters[handle].type = info.type;
+			m_parameters[handle].offset = info.offset;
+			m_parameterHandles[info.name] = handle;
+		}
+
+		// 不支援的pipeline不會被畫，不用準備參數的位置
+		if (!m_graphicsPipeline->isSupported())
+			return;
+
+		if (m_graphicsPipeline->isBindless()) {
+			// 參數放在共用的table中，不需要自己的buffer跟binding set
+			m_bindlessTable = BindlessMaterialTable::Get();
+			m_bindlessIndex = m_bindlessTable->allocateMaterial();
+			if (m_bindlessIndex == BindlessMaterialTable::InvalidIndex)
+				PE_CORE_ERROR("Material: bindless material table is full, drawing with the fallback material.");
 			m_cpuVariableBuffer.resize(m_graphicsPipeline->getVariableBufferSize());
+			return;
+		}
+
+		const uint32_t variableBufferSize = static_cast<uint32_t>(m_graphicsPipeline->getVariableBufferSize());
+		if (variableBufferSize > 0) {
+			m_parameterArena = MaterialParameterArena::Get();
+			if (m_parameterArena->allocate(variableBufferSize, m_parameterAllocation)) {
+				m_bindingSetDesc.addItem(nvrhi::BindingSetItem::ConstantBuffer(
+					0,
+					m_parameterArena->getBuffer(),
+					nvrhi::BufferRange(m_parameterAllocation.offset, variableBufferSize)));
+			}
+			else {
+				// layout需要cb0，沒有的話不能建立binding set，這個material不會被畫
+				PE_CORE_ERROR("Material: failed to allocate {} bytes of variable buffer, material will not be drawn.", variableBufferSize);
+				m_missingVariableBuffer = true;
+			}
+			m_cpuVariableBuffer.resize(variableBufferSize);
 		}
 	}
 
+	Material::~Material()
+	{
+		if (m_bindlessTable)
+			m_bindlessTable->freeMaterial(m_bindlessIndex);
+		if (m_parameterArena)
+			m_parameterArena->free(m_parameterAllocation);
+	}
+
+	ParameterHandle Material::getParameterHandle(const std::string& name) const
+	{
+		auto it = m_parameterHandles.find(name);
+		if (it == m_parameterHandles.end())
+			return InvalidParameterHandle;
+		return it->second;
+	}
+
+	ParameterHandle Material::findOrAddParameter(const std::string& name)
+	{
+		auto it = m_parameterHandles.find(name);
+		if (it != m_parameterHandles.end())
+			return it->second;
+
+		ParameterHandle handle = static_cast<ParameterHandle>(m_parameters.size());
+		m_parameters.emplace_back();
+		m_parameterHandles[name] = handle;
+		return handle;
+	}
+
 	PE_API void Material::setOffset(const std::string& name, uint32_t offset)
 	{
-		auto& variable = m_parameterSlots[name];
+		auto& variable = m_parameters[findOrAddParameter(name)];
 
 		variable.offset = offset;
 	}
 
 	PE_API void Material::setSlot(const std::string& name, uint32_t slotIndex)
 	{
-		auto& variable = m_parameterSlots[name];
+		auto& variable = m_parameters[findOrAddParameter(name)];
 
 		variable.slot = slotIndex;
 	}
 
-	void Material::setFloat(const std::string& name, float value)
+	Material::Variable* Material::checkParameter(ParameterHandle handle, VariableType expectedType)
+	{
+		if (handle >= m_parameters.size()) {
+			PE_CORE_ERROR("Material: invalid parameter handle {}.", handle);
+			return nullptr;
+		}
+
+		Variable& variable = m_parameters[handle];
+		if (variable.type == VariableType::Unknown) {
+			variable.type = expectedType;
+		}
+		else if (variable.type != expectedType) {
+			PE_CORE_ERROR("Material: parameter {} type mismatch ({} != {}).",
+				handle, static_cast<int>(variable.type), static_cast<int>(expectedType));
+			return nullptr;
+		}
+		return &variable;
+	}
+
+	template<typename T>
+	void Material::writeValue(ParameterHandle handle, VariableType type, const T& value)
 	{
-		//if (m_parameterSlots.find(name) == m_parameterSlots.end())
-		//{
+		Variable* variable = checkParameter(handle, type);
+		if (!variable)
+			return;
 
-		//	PE_CORE_ERROR("Material: Float parameter '{}' not found.", name);
-		//	return;
-		//}
+		if (variable->offset + sizeof(T) > m_cpuVariableBuffer.size()) {
+			PE_CORE_ERROR("Material: parameter {} offset {} out of variable buffer range.", handle, variable->offset);
+			return;
+		}
 
-		auto& variable = m_parameterSlots[name]; 
-		*reinterpret_cast<float*>(m_cpuVariableBuffer.data() + variable.offset) = value;
+		memcpy(m_cpuVariableBuffer.data() + variable->offset, &value, sizeof(T));
 		m_variableBufferModified = true;
 	}
 
-	void Material::setTexture(const std::string& name, TextureHandle texture)
+	void Material::setFloat(ParameterHandle handle, float value)
 	{
-		//if (m_parameterSlots.find(name) == m_parameterSlots.end())
-		//{
-		//	PE_CORE_ERROR("Material: Texture parameter '{}' not found.", name);
-		//	return;
-		//}
-
-		auto& variable = m_parameterSlots[name];
-		
-		for (auto& bindingItem : m_bindingSetDesc.bindings)
-		{
-			if (bindingItem.type != nvrhi::ResourceType::Texture_SRV)
-				continue;
+		writeValue(handle, VariableType::Float, value);
+	}
 
-			if (bindingItem.slot != variable.slot)
-				continue;
+	void Material::setUint(ParameterHandle handle, uint32_t value)
+	{
+		writeValue(handle, VariableType::Uint, value);
+	}
+
+	void Material::setVec2(ParameterHandle handle, const glm::vec2& value)
+	{
+		writeValue(handle, VariableType::Vec2, value);
+	}
+
+	void Material::setVec3(ParameterHandle handle, const glm::vec3& value)
+	{
+		writeValue(handle, VariableType::Vec3, value);
+	}
+
+	void Material::setVec4(ParameterHandle handle, const glm::vec4& value)
+	{
+		writeValue(handle, VariableType::Vec4, value);
+	}
+
+	void Material::setMat4(ParameterHandle handle, const glm::mat4& value)
+	{
+		writeValue(handle, VariableType::Mat4, value);
+	}
+
+	void Material::setTexture(ParameterHandle handle, TextureHandle texture)
+	{
+		Variable* variable = checkParameter(handle, VariableType::Texture);
+		if (!variable)
+			return;
 
-			// already bind it
-			if (std::get<TextureHandle>(variable.value) == texture)
-				return;
+		// already bind it
+		if (auto current = std::get_if<TextureHandle>(&variable->value); current && *current == texture)
+			return;
+		variable->value = texture;
+		m_hasStreamedTextures |= texture->isStreamed();
 
-			bindingItem = nvrhi::BindingSetItem::Texture_SRV(variable.slot, texture->getTexture());
-			variable.value = texture;
-			variable.type = VariableType::Texture;
-			m_bindingSet = nullptr;
+		if (isBindless()) {
+			// table滿了的話參數指向fallback texture
+			const uint32_t index = m_bindlessTable->registerTexture(m_bindlessIndex, variable->offset, texture->getTexture());
+			writeIndex(*variable, index != BindlessMaterialTable::InvalidIndex ? index : BindlessMaterialTable::FallbackDescriptorIndex);
 			return;
 		}
 
-		// 沒找到，新增他
-		m_bindingSetDesc.addItem(nvrhi::BindingSetItem::Texture_SRV(variable.slot, texture->getTexture()));
-		variable.value = texture;
+		variable->textureVersion = texture->getVersion();
+		auto bindingItem = nvrhi::BindingSetItem::Texture_SRV(variable->slot, texture->getTexture());
+		if (variable->bindingIndex >= 0) {
+			m_bindingSetDesc.bindings[variable->bindingIndex] = bindingItem;
+		}
+		else {
+			// 沒設定過，新增他
+			variable->bindingIndex = static_cast<int32_t>(m_bindingSetDesc.bindings.size());
+			m_bindingSetDesc.addItem(bindingItem);
+		}
 		m_bindingSet = nullptr;
 	}
 
-	void Material::setSampler(const std::string& name, nvrhi::SamplerHandle sampler)
+	void Material::setSampler(ParameterHandle handle, nvrhi::SamplerHandle sampler)
 	{
+		Variable* variable = checkParameter(handle, VariableType::Sampler);
+		if (!variable)
+			return;
 
-		auto& variable = m_parameterSlots[name];
+		// already bind it
+		if (auto current = std::get_if<nvrhi::SamplerHandle>(&variable->value); current && *current == sampler)
+			return;
+		variable->value = sampler;
 
-		for (auto& bindingItem : m_bindingSetDesc.bindings)
-		{
-			if (bindingItem.type != nvrhi::ResourceType::Sampler)
-				continue;
+		if (isBindless()) {
+			const uint32_t index = m_bindlessTable->registerSampler(m_bindlessIndex, variable->offset, sampler);
+			writeIndex(*variable, index != BindlessMaterialTable::InvalidIndex ? index : BindlessMaterialTable::FallbackDescriptorIndex);
+			return;
+		}
 
-			if (bindingItem.slot != variable.slot)
-				continue;
+		auto bindingItem = nvrhi::BindingSetItem::Sampler(variable->slot, sampler);
+		if (variable->bindingIndex >= 0) {
+			m_bindingSetDesc.bindings[variable->bindingIndex] = bindingItem;
+		}
+		else {
+			// 沒設定過，新增他
+			variable->bindingIndex = static_cast<int32_t>(m_bindingSetDesc.bindings.size());
+			m_bindingSetDesc.addItem(bindingItem);
+		}
+		m_bindingSet = nullptr;
+	}
+
+	void Material::setFloat(const std::string& name, float value)
+	{
+		setFloat(findOrAddParameter(name), value);
+	}
 
-			// 同type同slot
+	void Material::setTexture(const std::string& name, TextureHandle texture)
+	{
+		setTexture(findOrAddParameter(name), texture);
+	}
 
-			// already bind it
-			if (std::get<nvrhi::SamplerHandle>(variable.value) == sampler)
-				return;
+	void Material::setSampler(const std::string& name, nvrhi::SamplerHandle sampler)
+	{
+		setSampler(findOrAddParameter(name), sampler);
+	}
 
-			bindingItem = nvrhi::BindingSetItem::Sampler(variable.slot, sampler);
-			variable.value = sampler;
-			variable.type = VariableType::Sampler;
-			m_bindingSet = nullptr;
+	void Material::writeIndex(const Variable& variable, uint32_t index)
+	{
+		if (variable.offset + sizeof(uint32_t) > m_cpuVariableBuffer.size()) {
+			PE_CORE_ERROR("Material: bindless index offset {} out of variable buffer range.", variable.offset);
 			return;
 		}
-		// 沒找到，新增他
-		m_bindingSetDesc.addItem(nvrhi::BindingSetItem::Sampler(variable.slot, sampler));
-		variable.value = sampler;
-		variable.type = VariableType::Sampler;
-		m_bindingSet = nullptr;
+		*reinterpret_cast<uint32_t*>(m_cpuVariableBuffer.data() + variable.offset) = index;
+		m_variableBufferModified = true;
 	}
 
 	nvrhi::IBindingSet* Material::getBindingSet()
 	{
+		// bindless material用的是BindlessMaterialTable的set
+		if (isBindless())
+			return nullptr;
+
 #ifdef PE_DEBUG
-		if (!m_bindingSet) {
+		if (!m_bindingSet && canCreateBindingSet()) {
 			PE_CORE_WARN("Material doesn't update yet!");
 		}
 #endif // PE_DEBUG
@@ -126,16 +258,51 @@ namespace PaperEngine {
 		return m_bindingSet;
 	}
 
+	void Material::requestStreamedMips(float screenPixels) const
+	{
+		if (!m_hasStreamedTextures)
+			return;
+
+		for (const auto& variable : m_parameters)
+			if (auto texture = std::get_if<TextureHandle>(&variable.value))
+				(*texture)->requestScreenSize(screenPixels);
+	}
+
+	void Material::refreshStreamedTextures()
+	{
+		if (!m_hasStreamedTextures || isBindless())
+			return;
+
+		bool changed = false;
+		for (auto& variable : m_parameters) {
+			auto texture = std::get_if<TextureHandle>(&variable.value);
+			if (!texture || variable.bindingIndex < 0 || (*texture)->getVersion() == variable.textureVersion)
+				continue;
+
+			variable.textureVersion = (*texture)->getVersion();
+			m_bindingSetDesc.bindings[variable.bindingIndex] = nvrhi::BindingSetItem::Texture_SRV(variable.slot, (*texture)->getTexture());
+			changed = true;
+		}
+
+		if (changed)
+			generateSet();
+	}
+
 	PE_API void Material::update()
 	{
-		if (m_variableBufferModified && m_cpuVariableBuffer.size() > 0) {
-			m_cmd->open();
-			m_cmd->writeBuffer(m_variableBuffer, m_cpuVariableBuffer.data(), m_cpuVariableBuffer.size());
-			m_cmd->close();
-			Application::GetNVRHIDevice()->executeCommandList(m_cmd);
+		if (isBindless()) {
+			if (m_variableBufferModified && m_cpuVariableBuffer.size() > 0) {
+				m_bindlessTable->writeMaterialParameters(m_bindlessIndex, m_cpuVariableBuffer.data(), m_cpuVariableBuffer.size());
+				m_variableBufferModified = false;
+			}
+			return;
+		}
+
+		if (m_variableBufferModified && m_parameterAllocation.isValid()) {
+			m_parameterArena->write(m_parameterAllocation, m_cpuVariableBuffer.data(), m_cpuVariableBuffer.size());
 			m_variableBufferModified = false;
 		}
-		if (m_bindingSet)
+		if (m_bindingSet || !canCreateBindingSet())
 			return;
 
 		auto device = Application::Get()->getGraphicsContext()->getNVRhiDevice();
@@ -146,13 +313,13 @@ namespace PaperEngine {
 
 	void Material::generateSet()
 	{
-		if (m_variableBufferModified && m_cpuVariableBuffer.size() > 0) {
-			m_cmd->open();
-			m_cmd->writeBuffer(m_variableBuffer, m_cpuVariableBuffer.data(), m_cpuVariableBuffer.size());
-			m_cmd->close();
-			Application::GetNVRHIDevice()->executeCommandList(m_cmd);
+		if (m_variableBufferModified && m_parameterAllocation.isValid()) {
+			m_parameterArena->write(m_parameterAllocation, m_cpuVariableBuffer.data(), m_cpuVariableBuffer.size());
 			m_variableBufferModified = false;
 		}
+		if (!canCreateBindingSet())
+			return;
+
 		auto device = Application::Get()->getGraphicsContext()->getNVRhiDevice();
 		m_bindingSet = device->createBindingSet(
 			m_bindingSetDesc,
@@ -7,6 +7,8 @@
 
 #include <PaperEngine/core/Base.h>
 #include <PaperEngine/graphics/GraphicsPipeline.h>
+#include <PaperEngine/graphics/BindlessMaterialTable.h>
+#include <PaperEngine/graphics/MaterialParameterArena.h>
 
 #include <PaperEngine/graphics/Texture.h>
 
@@ -15,39 +17,52 @@ namespace PaperEngine {
 	class Material {
 	public:
 
-		enum class VariableType {
-			Texture,
-			Sampler,
-			Float,
-			Vec2,
-			Vec3,
-			Vec4,
-			Mat4,
-		};
+		/// <summary>
+		/// 參數類型，由GraphicsPipeline reflection得到
+		/// 手動加入的參數（setOffset/setSlot）在第一次set時決定
+		/// </summary>
+		using VariableType = ShaderParameterType;
 
 		struct Variable {
 			uint32_t slot = 0; // 參數槽
-			VariableType type;
+			VariableType type = VariableType::Unknown;
 
 			/// <summary>
 			/// 如果是float等類型，這個是在其VariableBuffer中的偏移量
 			/// </summary>
 			uint32_t offset = 0;
+
+			/// <summary>
+			/// Texture/Sampler在m_bindingSetDesc.bindings中的index
+			/// 還沒設定過為-1
+			/// </summary>
+			int32_t bindingIndex = -1;
+
+			/// <summary>
+			/// 非bindless時，binding set中的texture是哪個Texture::getVersion()
+			/// </summary>
+			uint32_t textureVersion = 0;
+
 			std::variant<
+				std::monostate,
 				TextureHandle, // 如果是Texture
-				nvrhi::SamplerHandle,
-				float,               // 如果是Float
-				glm::vec2,          // 如果是Vec2
-				glm::vec3,          // 如果是Vec3
-				glm::vec4,           // 如果是Vec4
-				glm::mat4> value;
+				nvrhi::SamplerHandle> value;
 		};
 
 	public:
 		PE_API Material(Ref<GraphicsPipeline> graphicsPipeline);
+		PE_API ~Material();
+
+		/// <summary>
+		/// 取得參數的handle
+		/// reflection出來的參數在同一個pipeline的material中handle都一樣
+		/// 沒有這個參數回傳InvalidParameterHandle
+		/// </summary>
+		PE_API ParameterHandle getParameterHandle(const std::string& name) const;
 
 		/// <summary>
 		/// 設定一個參數在Variable buffer的offset
+		/// shader reflection有的參數不需要設定
 		/// </summary>
 		/// <param name="name"></param>
 		/// <param name="offset"></param>
@@ -56,34 +71,119 @@ namespace PaperEngine {
 
 		PE_API void setSlot(const std::string& name, uint32_t slotIndex);
 
+#pragma region Typed Setters
+		// O(1)，會檢查handle、type跟offset
+
+		PE_API void setFloat(ParameterHandle handle, float value);
+
+		PE_API void setUint(ParameterHandle handle, uint32_t value);
+
+		PE_API void setVec2(ParameterHandle handle, const glm::vec2& value);
+
+		PE_API void setVec3(ParameterHandle handle, const glm::vec3& value);
+
+		PE_API void setVec4(ParameterHandle handle, const glm::vec4& value);
+
+		PE_API void setMat4(ParameterHandle handle, const glm::mat4& value);
+
+		/// <summary>
+		/// Bindless模式下texture不會有binding slot
+		/// 而是把texture在descriptor table的index (uint) 寫在這個參數的offset
+		/// 所以要先setOffset
+		/// </summary>
+		PE_API void setTexture(ParameterHandle handle, TextureHandle texture);
+
+		PE_API void setSampler(ParameterHandle handle, nvrhi::SamplerHandle sampler);
+#pragma endregion
+
+#pragma region Name Setters
+		// 每次都會查字串，每個frame更新的參數請用handle
+
 		PE_API void setFloat(const std::string& name, float value);
 
 		PE_API void setTexture(const std::string& name, TextureHandle texture);
 
 		PE_API void setSampler(const std::string& name, nvrhi::SamplerHandle sampler);
+#pragma endregion
 
 		/// <summary>
 		/// 每次對Material做更改時都要update
 		/// 之所以不內化純粹是不想一直create
+		/// 參數只會寫到arena的CPU端，下一個frame由SceneRenderer一起上傳
 		/// </summary>
 		/// <returns></returns>
 		PE_API void update();
 
 		PE_API nvrhi::IBindingSet* getBindingSet();
 
+		/// <summary>
+		/// 有沒有TextureStreamer載入的texture
+		/// </summary>
+		bool hasStreamedTextures() const { return m_hasStreamedTextures; }
+
+		/// <summary>
+		/// 使用這個material的mesh在畫面上大約佔screenPixels個pixel，轉給streaming的texture
+		/// Thread safe (MeshRenderer的worker同時呼叫)
+		/// </summary>
+		PE_API void requestStreamedMips(float screenPixels) const;
+
+		/// <summary>
+		/// 非bindless的material在streaming texture換掉ITexture後要重建binding set
+		/// 由MeshRenderer在建立draw record時呼叫 (單一thread)
+		/// bindless的material參數由BindlessMaterialTable改成新的slot，不需要
+		/// </summary>
+		PE_API void refreshStreamedTextures();
+
 		PE_API Ref<GraphicsPipeline> getGraphicsPipeline() { return m_graphicsPipeline; }
 
+		PE_API bool isBindless() const { return m_bindlessTable != nullptr; }
+
+		/// <summary>
+		/// 在BindlessMaterialTable中的index，shader用它讀參數
+		/// table滿了沒分配到的話回傳BindlessMaterialTable::FallbackMaterialIndex
+		/// 非bindless的material為BindlessMaterialTable::InvalidIndex
+		/// </summary>
+		PE_API uint32_t getBindlessIndex() const
+		{
+			if (m_bindlessTable && m_bindlessIndex == BindlessMaterialTable::InvalidIndex)
+				return BindlessMaterialTable::FallbackMaterialIndex;
+			return m_bindlessIndex;
+		}
+
 	protected:
 		void generateSet();
 
+		/// <summary>
+		/// pipeline不支援或variable buffer分配失敗的話不建立binding set (不會被畫)
+		/// </summary>
+		bool canCreateBindingSet() const { return m_graphicsPipeline->isSupported() && !m_missingVariableBuffer; }
+
+		/// <summary>
+		/// 把uint寫進variable buffer（bindless的texture/sampler index）
+		/// </summary>
+		void writeIndex(const Variable& variable, uint32_t index);
+
+		/// <summary>
+		/// 檢查handle跟type，type還沒決定的話設為expectedType
+		/// 不合法回傳nullptr
+		/// </summary>
+		Variable* checkParameter(ParameterHandle handle, VariableType expectedType);
+
+		template<typename T>
+		void writeValue(ParameterHandle handle, VariableType type, const T& value);
+
+		ParameterHandle findOrAddParameter(const std::string& name);
+
 	private:
 		Ref<GraphicsPipeline> m_graphicsPipeline; // 用於渲染的圖形管線
 
 		/// <summary>
-		/// 名稱到參數槽的映射，並紀錄當前的值
+		/// ParameterHandle到參數槽的映射，並紀錄當前的值
 		/// 如Texture
+		/// 前面是pipeline reflection的參數，後面是手動加入的
 		/// </summary>
-		std::unordered_map<std::string, Variable> m_parameterSlots;
+		std::vector<Variable> m_parameters;
+		std::unordered_map<std::string, ParameterHandle> m_parameterHandles;
 
 		nvrhi::BindingSetDesc m_bindingSetDesc; // 綁定佈局描述，用於定義Shader資源的綁定方式
 
@@ -93,15 +193,27 @@ namespace PaperEngine {
 		/// </summary>
 		nvrhi::BindingSetHandle m_bindingSet;
 
-		nvrhi::CommandListHandle m_cmd;
-
 		/// <summary>
-		/// 放uniforms的buffer
+		/// 放uniforms的地方
+		/// 在MaterialParameterArena中的一段區塊
 		/// </summary>
-		nvrhi::BufferHandle m_variableBuffer;
+		Ref<MaterialParameterArena> m_parameterArena;
+		MaterialParameterArena::Allocation m_parameterAllocation;
 		
 		std::vector<uint8_t> m_cpuVariableBuffer;
 		bool m_variableBufferModified = true;
+		bool m_missingVariableBuffer = false;	// arena滿了，沒有cb0
+
+		/// <summary>
+		/// Bindless模式才有
+		/// </summary>
+		Ref<BindlessMaterialTable> m_bindlessTable;
+		/// <summary>
+		/// 分配失敗時為InvalidIndex，table的操作都會忽略它 (不會寫到fallback material)
+		/// </summary>
+		uint32_t m_bindlessIndex = BindlessMaterialTable::InvalidIndex;
+
+		bool m_hasStreamedTextures = false;
 	};
 
 }
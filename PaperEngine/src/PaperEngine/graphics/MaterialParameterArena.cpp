@@ -0,0 +1,116 @@
+﻿#include "MaterialParameterArena.h"
+
+#include <algorithm>
+
+#include <PaperEngine/core/Application.h>
+
+namespace PaperEngine {
+
+	MaterialParameterArena::MaterialParameterArena(uint32_t capacity)
+	{
+		nvrhi::BufferDesc bufferDesc;
+		bufferDesc
+			.setByteSize(capacity)
+			.setDebugName("MaterialParameterArena")
+			.setIsConstantBuffer(true)
+			.setInitialState(nvrhi::ResourceStates::ConstantBuffer)
+			.setKeepInitialState(true);
+		m_buffer = Application::GetGPUMemoryAllocator()->createBuffer(bufferDesc, GPUMemoryCategory::Buffer, m_memory);
+
+		m_allocator.init(capacity);
+		m_cpuData.resize(capacity, 0);
+		m_dirtyBlockIndices.resize(capacity / BlockAlignment, ~0u);
+	}
+
+	MaterialParameterArena::~MaterialParameterArena()
+	{
+		Application::GetGPUMemoryAllocator()->free(m_memory);
+	}
+
+	bool MaterialParameterArena::allocate(uint32_t size, Allocation& outAllocation)
+	{
+		if (size == 0)
+			return false;
+
+		const uint32_t alignedSize = (size + BlockAlignment - 1) & ~(BlockAlignment - 1);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_allocator.allocate(alignedSize, outAllocation.offset, BlockAlignment))
+		{
+			PE_CORE_ERROR("[MaterialParameterArena] Out of memory, used {} bytes.", m_allocator.getUsedCount());
+			return false;
+		}
+		outAllocation.size = alignedSize;
+		return true;
+	}
+
+	void MaterialParameterArena::free(const Allocation& allocation)
+	{
+		if (!allocation.isValid())
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_allocator.free(allocation.offset, allocation.size);
+	}
+
+	void MaterialParameterArena::write(const Allocation& allocation, const void* data, size_t size)
+	{
+		PE_CORE_ASSERT(size <= allocation.size, "Material parameters exceed the allocated block.");
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		memcpy(m_cpuData.data() + allocation.offset, data, size);
+
+		// 同一個位置在flush前被free再allocate的話，大小取大的
+		uint32_t& dirtyIndex = m_dirtyBlockIndices[allocation.offset / BlockAlignment];
+		if (dirtyIndex == ~0u) {
+			dirtyIndex = static_cast<uint32_t>(m_dirtyBlocks.size());
+			m_dirtyBlocks.push_back(allocation);
+		}
+		else {
+			m_dirtyBlocks[dirtyIndex].size = std::max(m_dirtyBlocks[dirtyIndex].size, allocation.size);
+		}
+	}
+
+	void MaterialParameterArena::flush(nvrhi::ICommandList* cmd)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_lastUploadSize = 0;
+		if (m_dirtyBlocks.empty())
+			return;
+
+		for (const Allocation& block : m_dirtyBlocks)
+			m_dirtyBlockIndices[block.offset / BlockAlignment] = ~0u;
+
+		std::sort(m_dirtyBlocks.begin(), m_dirtyBlocks.end(), [](const Allocation& a, const Allocation& b) {
+			return a.offset < b.offset;
+			});
+
+		// 剛好接在一起的區塊一起傳，中間沒改的不傳
+		size_t runStart = 0;
+		while (runStart < m_dirtyBlocks.size()) {
+			const uint32_t begin = m_dirtyBlocks[runStart].offset;
+			uint32_t end = begin + m_dirtyBlocks[runStart].size;
+			size_t runEnd = runStart + 1;
+			while (runEnd < m_dirtyBlocks.size() && m_dirtyBlocks[runEnd].offset == end) {
+				end += m_dirtyBlocks[runEnd].size;
+				runEnd++;
+			}
+
+			cmd->writeBuffer(m_buffer, m_cpuData.data() + begin, end - begin, begin);
+			m_lastUploadSize += end - begin;
+			runStart = runEnd;
+		}
+
+		m_dirtyBlocks.clear();
+	}
+
+	Ref<MaterialParameterArena> MaterialParameterArena::Get()
+	{
+		// 4MB, 16384個256 bytes的material
+		return Application::GetResourceManager()->create<MaterialParameterArena>(
+			"MaterialParameterArena",
+			4u * 1024u * 1024u);
+	}
+
+}
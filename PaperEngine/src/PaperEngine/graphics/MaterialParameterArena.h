@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/utils/RangeAllocator.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 所有Material的variable buffer (constant buffer 0) 共用一個大buffer
+	/// 每個Material拿一段對齊過的區塊，binding set用BufferRange綁到自己的區塊
+	/// 
+	/// Material修改時只會寫到CPU端並把他的區塊標記dirty
+	/// 每個frame由SceneRenderer呼叫flush，只上傳dirty的區塊
+	/// </summary>
+	class MaterialParameterArena {
+	public:
+		/// <summary>
+		/// constant buffer offset的對齊（Vulkan minUniformBufferOffsetAlignment最大為256）
+		/// </summary>
+		static constexpr uint32_t BlockAlignment = 256;
+
+		struct Allocation {
+			uint32_t offset = 0;		// bytes
+			uint32_t size = 0;			// bytes，已對齊BlockAlignment
+
+			bool isValid() const { return size > 0; }
+		};
+
+	public:
+		MaterialParameterArena(uint32_t capacity);
+		~MaterialParameterArena();
+
+		/// <summary>
+		/// Thread safe
+		/// </summary>
+		bool allocate(uint32_t size, Allocation& outAllocation);
+
+		void free(const Allocation& allocation);
+
+		/// <summary>
+		/// 寫入CPU端的資料，flush時才會上傳
+		/// </summary>
+		void write(const Allocation& allocation, const void* data, size_t size);
+
+		/// <summary>
+		/// 上傳dirty的區塊，位置相鄰的合併成一次writeBuffer
+		/// 在使用material之前record到command list
+		/// </summary>
+		void flush(nvrhi::ICommandList* cmd);
+
+		nvrhi::IBuffer* getBuffer() const { return m_buffer; }
+
+		uint32_t getUsedSize() const { return m_allocator.getUsedCount(); }
+
+		/// <summary>
+		/// 上一次flush上傳的bytes
+		/// </summary>
+		uint32_t getLastUploadSize() const { return m_lastUploadSize; }
+
+	public:
+		/// <summary>
+		/// 取得engine的material parameter arena
+		/// </summary>
+		PE_API static Ref<MaterialParameterArena> Get();
+
+	private:
+		std::mutex m_mutex;
+
+		nvrhi::BufferHandle m_buffer;
+		GPUMemoryAllocation m_memory;
+		RangeAllocator m_allocator;
+
+		std::vector<uint8_t> m_cpuData;
+
+		// 這個frame寫過的區塊
+		// m_dirtyBlockIndices每BlockAlignment一格，是區塊在m_dirtyBlocks中的index (沒有dirty為~0u)
+		std::vector<Allocation> m_dirtyBlocks;
+		std::vector<uint32_t> m_dirtyBlockIndices;
+		uint32_t m_lastUploadSize = 0;
+	};
+
+}
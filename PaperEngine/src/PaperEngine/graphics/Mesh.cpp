@@ -26,11 +26,64 @@ namespace PaperEngine {
 		return { minPt, maxPt };
 	}
 
-	void Mesh::loadStaticMesh(nvrhi::CommandListHandle cmdList, const std::vector<StaticVertex>& vertices)
+	Mesh::Mesh()
+	{
+		m_bufferPool = MeshBufferPool::GetStaticMeshPool();
+	}
+
+	Mesh::~Mesh()
+	{
+		releasePooledVertices();
+		releasePooledIndices();
+		releaseDedicatedBuffer(m_vertexBuffer, m_vertexMemory);
+		releaseDedicatedBuffer(m_indexBuffer, m_indexMemory);
+		releaseDedicatedBuffer(m_boneBuffer, m_boneMemory);
+	}
+
+	void Mesh::releasePooledVertices()
+	{
+		if (m_vertexAllocation.isValid())
+			m_bufferPool->freeVertices(m_vertexAllocation);
+		m_vertexAllocation = {};
+	}
+
+	void Mesh::releasePooledIndices()
+	{
+		if (m_indexAllocation.isValid())
+			m_bufferPool->freeIndices(m_indexAllocation);
+		m_indexAllocation = {};
+	}
+
+	void Mesh::releaseDedicatedBuffer(nvrhi::BufferHandle& buffer, GPUMemoryAllocation& memory)
 	{
-		auto device = Application::Get()->getGraphicsContext()->getNVRhiDevice();
+		Application::GetGPUMemoryAllocator()->free(memory);
+		buffer = nullptr;
+	}
 
+	void Mesh::loadStaticMesh(nvrhi::CommandListHandle cmdList, const std::vector<StaticVertex>& vertices)
+	{
 		m_type = MeshType::Static;
+		m_vertexCount = static_cast<uint32_t>(vertices.size());
+
+		m_aabb = computeAABB<StaticVertex>(vertices, [](const StaticVertex& v) {
+			return v.position;
+			});
+
+		releasePooledVertices();
+		releaseDedicatedBuffer(m_vertexBuffer, m_vertexMemory);
+
+		// 先嘗試放進shared pool，這樣才能跟其他mesh合併draw call
+		if (m_bufferPool->allocateVertices(static_cast<uint32_t>(vertices.size()), m_vertexAllocation))
+		{
+			cmdList->writeBuffer(
+				m_bufferPool->getVertexBuffer(),
+				vertices.data(),
+				vertices.size() * sizeof(StaticVertex),
+				static_cast<uint64_t>(m_vertexAllocation.offset) * sizeof(StaticVertex));
+			return;
+		}
+
+		PE_CORE_WARN("[Mesh] Static mesh pool is full, fallback to dedicated vertex buffer.");
 
 		nvrhi::BufferDesc vertexBufferDesc;
 		vertexBufferDesc
@@ -39,11 +92,7 @@ namespace PaperEngine {
 			.setInitialState(nvrhi::ResourceStates::CopyDest)
 			.setIsVertexBuffer(true)
 			.setStructStride(sizeof(StaticVertex));
-		m_vertexBuffer = device->createBuffer(vertexBufferDesc);
-
-		m_aabb = computeAABB<StaticVertex>(vertices, [](const StaticVertex& v) {
-			return v.position;
-			});
+		m_vertexBuffer = Application::GetGPUMemoryAllocator()->createBuffer(vertexBufferDesc, GPUMemoryCategory::Mesh, m_vertexMemory);
 
 		cmdList->beginTrackingBufferState(m_vertexBuffer, nvrhi::ResourceStates::CopyDest);
 		cmdList->writeBuffer(m_vertexBuffer, vertices.data(), vertexBufferDesc.byteSize);
@@ -54,9 +103,14 @@ namespace PaperEngine {
 		const std::vector<StaticVertex>& vertices,
 		const std::vector<SkeletalVertexInfo>& boneInfos)
 	{
-		auto device = Application::Get()->getGraphicsContext()->getNVRhiDevice();
-
 		m_type = MeshType::Skeletal;
+		m_vertexCount = static_cast<uint32_t>(vertices.size());
+
+		// skeletal mesh的vertex多了bone資料，不放在static pool裡
+		// SkinningPass的compute shader會讀這兩個buffer (ByteAddressBuffer)
+		releasePooledVertices();
+		releaseDedicatedBuffer(m_vertexBuffer, m_vertexMemory);
+		releaseDedicatedBuffer(m_boneBuffer, m_boneMemory);
 		
 		nvrhi::BufferDesc vertexBufferDesc;
 		vertexBufferDesc
@@ -64,8 +118,9 @@ namespace PaperEngine {
 			.setDebugName("SkeletalMeshVertexBuffer")
 			.setInitialState(nvrhi::ResourceStates::CopyDest)
 			.setIsVertexBuffer(true)
+			.setCanHaveRawViews(true)
 			.setStructStride(sizeof(StaticVertex));
-		m_vertexBuffer = device->createBuffer(vertexBufferDesc);
+		m_vertexBuffer = Application::GetGPUMemoryAllocator()->createBuffer(vertexBufferDesc, GPUMemoryCategory::Mesh, m_vertexMemory);
 
 		m_aabb = computeAABB<StaticVertex>(vertices, [](const StaticVertex& v) {
 			return v.position;
@@ -77,20 +132,63 @@ namespace PaperEngine {
 			.setDebugName("SkeletalBoneVertexBuffer")
 			.setInitialState(nvrhi::ResourceStates::CopyDest)
 			.setIsVertexBuffer(true)
+			.setCanHaveRawViews(true)
 			.setStructStride(sizeof(SkeletalVertexInfo));
-		m_boneBuffer = device->createBuffer(boneBufferDesc);
+		m_boneBuffer = Application::GetGPUMemoryAllocator()->createBuffer(boneBufferDesc, GPUMemoryCategory::Mesh, m_boneMemory);
 
 		cmdList->beginTrackingBufferState(m_vertexBuffer, nvrhi::ResourceStates::CopyDest);
 		cmdList->beginTrackingBufferState(m_boneBuffer, nvrhi::ResourceStates::CopyDest);
 		cmdList->writeBuffer(m_vertexBuffer, vertices.data(), vertexBufferDesc.byteSize);
 		cmdList->writeBuffer(m_boneBuffer, boneInfos.data(), boneBufferDesc.byteSize);
-		cmdList->setPermanentBufferState(m_vertexBuffer, nvrhi::ResourceStates::VertexBuffer);
-		cmdList->setPermanentBufferState(m_boneBuffer, nvrhi::ResourceStates::VertexBuffer);
+		cmdList->setPermanentBufferState(m_vertexBuffer, nvrhi::ResourceStates::VertexBuffer | nvrhi::ResourceStates::ShaderResource);
+		cmdList->setPermanentBufferState(m_boneBuffer, nvrhi::ResourceStates::VertexBuffer | nvrhi::ResourceStates::ShaderResource);
+	}
+
+	void Mesh::setSkinnedOutput(const Ref<Mesh>& source, nvrhi::IBuffer* vertexBuffer, uint32_t baseVertex)
+	{
+		// output buffer是SkinningPass的，這裡只拿reference
+		releasePooledVertices();
+		releasePooledIndices();
+		releaseDedicatedBuffer(m_vertexBuffer, m_vertexMemory);
+
+		m_type = MeshType::Static;
+		m_skinningSource = source;
+		m_vertexBuffer = vertexBuffer;
+		m_skinnedBaseVertex = baseVertex;
+		m_vertexCount = source->m_vertexCount;
+		m_indexFormat = source->m_indexFormat;
+		m_aabb = source->m_aabb;
+		m_subMeshes = source->m_subMeshes;
 	}
 
 	void Mesh::loadIndexBuffer(nvrhi::CommandListHandle cmdList, const void* indicesData, size_t indicesCount, nvrhi::Format type)
 	{
-		auto device = Application::Get()->getGraphicsContext()->getNVRhiDevice();
+		releasePooledIndices();
+		releaseDedicatedBuffer(m_indexBuffer, m_indexMemory);
+
+		// shared pool的index固定是32位元
+		if (m_bufferPool->allocateIndices(static_cast<uint32_t>(indicesCount), m_indexAllocation))
+		{
+			m_indexFormat = nvrhi::Format::R32_UINT;
+
+			std::vector<uint32_t> widenIndices;
+			const void* uploadData = indicesData;
+			if (type == nvrhi::Format::R16_UINT)
+			{
+				const uint16_t* src = static_cast<const uint16_t*>(indicesData);
+				widenIndices.assign(src, src + indicesCount);
+				uploadData = widenIndices.data();
+			}
+
+			cmdList->writeBuffer(
+				m_bufferPool->getIndexBuffer(),
+				uploadData,
+				indicesCount * sizeof(uint32_t),
+				static_cast<uint64_t>(m_indexAllocation.offset) * sizeof(uint32_t));
+			return;
+		}
+
+		PE_CORE_WARN("[Mesh] Index pool is full, fallback to dedicated index buffer.");
 
 		m_indexFormat = type;
 		
@@ -100,21 +198,44 @@ namespace PaperEngine {
 			.setDebugName("MeshIndexBuffer")
 			.setInitialState(nvrhi::ResourceStates::CopyDest)
 			.setIsIndexBuffer(true);
-		m_indexBuffer = device->createBuffer(indexBufferDesc);
+		m_indexBuffer = Application::GetGPUMemoryAllocator()->createBuffer(indexBufferDesc, GPUMemoryCategory::Mesh, m_indexMemory);
 		cmdList->beginTrackingBufferState(m_indexBuffer, nvrhi::ResourceStates::CopyDest);
 		cmdList->writeBuffer(m_indexBuffer, indicesData, indexBufferDesc.byteSize);
 		cmdList->setPermanentBufferState(m_indexBuffer, nvrhi::ResourceStates::IndexBuffer);
 	}
 
+	nvrhi::IBuffer* Mesh::getVertexBuffer() const
+	{
+		return m_vertexAllocation.isValid() ? m_bufferPool->getVertexBuffer() : m_vertexBuffer.Get();
+	}
+
+	nvrhi::IBuffer* Mesh::getIndexBuffer() const
+	{
+		if (m_skinningSource)
+			return m_skinningSource->getIndexBuffer();
+		return m_indexAllocation.isValid() ? m_bufferPool->getIndexBuffer() : m_indexBuffer.Get();
+	}
+
+	bool Mesh::isGeometryBindingCompatible(const Mesh& other) const
+	{
+		return
+			m_type == other.m_type &&
+			m_indexFormat == other.m_indexFormat &&
+			getVertexBuffer() == other.getVertexBuffer() &&
+			getIndexBuffer() == other.getIndexBuffer() &&
+			m_boneBuffer == other.m_boneBuffer;
+	}
+
 	void Mesh::bindMesh(nvrhi::GraphicsState& state) const
 	{
-		state.indexBuffer.buffer = m_indexBuffer;
+		nvrhi::IBuffer* vertexBuffer = getVertexBuffer();
+		state.indexBuffer.buffer = getIndexBuffer();
 		state.indexBuffer.format = m_indexFormat;
 		state.indexBuffer.offset = 0;
 		state.vertexBuffers = {
-			{ m_vertexBuffer, 0, offsetof(StaticVertex, position) },
-			{ m_vertexBuffer, 1, offsetof(StaticVertex, normal) },
-			{ m_vertexBuffer, 2, offsetof(StaticVertex, texcoord) }
+			{ vertexBuffer, 0, offsetof(StaticVertex, position) },
+			{ vertexBuffer, 1, offsetof(StaticVertex, normal) },
+			{ vertexBuffer, 2, offsetof(StaticVertex, texcoord) }
 		};
 		if (m_type == PaperEngine::MeshType::Skeletal) {
 			state.vertexBuffers.push_back(
@@ -133,8 +254,21 @@ namespace PaperEngine {
 		}
 		const SubMeshInfo& subMesh = m_subMeshes[subMeshIndex];
 		drawArgs.vertexCount = subMesh.indicesCount;
-		drawArgs.startIndexLocation = subMesh.indicesOffset;
-		drawArgs.startVertexLocation = 0;
+		drawArgs.startIndexLocation = getBaseIndex() + subMesh.indicesOffset;
+		drawArgs.startVertexLocation = getBaseVertex();
+	}
+
+	void Mesh::getSubMeshDrawArguments(nvrhi::DrawIndexedIndirectArguments& args, uint32_t subMeshIndex) const
+	{
+		if (subMeshIndex >= m_subMeshes.size())
+		{
+			PE_CORE_ERROR("SubMesh index out of range: {}", subMeshIndex);
+			return;
+		}
+		const SubMeshInfo& subMesh = m_subMeshes[subMeshIndex];
+		args.indexCount = subMesh.indicesCount;
+		args.startIndexLocation = getBaseIndex() + subMesh.indicesOffset;
+		args.baseVertexLocation = static_cast<int32_t>(getBaseVertex());
 	}
 
 }
@@ -4,7 +4,8 @@
 
 #include <PaperEngine/core/Base.h>
 #include <PaperEngine/utils/BoundingVolume.h>
-
+#include <PaperEngine/graphics/MeshBufferPool.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
 
 #include <nvrhi/nvrhi.h>
 #include <glm/glm.hpp>
@@ -48,6 +49,9 @@ namespace PaperEngine {
 	/// </summary>
 	class Mesh {
 	public:
+		PE_API Mesh();
+		PE_API ~Mesh();
+
 		struct SubMeshInfo {
 			uint32_t indicesOffset = 0;
 			uint32_t indicesCount = 0;
@@ -68,6 +72,13 @@ namespace PaperEngine {
 
 		PE_API void loadIndexBuffer(nvrhi::CommandListHandle cmdList, const void* indicesData, size_t indicesCount, nvrhi::Format type = nvrhi::Format::R32_UINT);
 
+		/// <summary>
+		/// 把這個Mesh設成skinning的輸出 (SkinningPass使用)
+		/// index buffer跟subMesh沿用source，vertex是vertexBuffer中從baseVertex開始的StaticVertex
+		/// 格式跟static mesh一樣，所以depth、shadow跟main pass不用知道是skinned mesh
+		/// </summary>
+		void setSkinnedOutput(const Ref<Mesh>& source, nvrhi::IBuffer* vertexBuffer, uint32_t baseVertex);
+
 		/// <summary>
 		/// Bind this Mesh
 		/// no submesh information
@@ -84,6 +95,39 @@ namespace PaperEngine {
 
 		void bindSubMesh(nvrhi::DrawArguments& drawArgs, uint32_t subMeshIndex) const;
 
+		/// <summary>
+		/// 填入subMesh的indirect draw參數（instance相關的由caller設定）
+		/// 已經包含在shared buffer裡的base vertex跟base index
+		/// </summary>
+		void getSubMeshDrawArguments(nvrhi::DrawIndexedIndirectArguments& args, uint32_t subMeshIndex) const;
+
+		/// <summary>
+		/// 兩個Mesh bindMesh出來的vertex/index buffer是否一樣
+		/// 一樣的話就可以合併到同一個drawIndexedIndirect
+		/// </summary>
+		bool isGeometryBindingCompatible(const Mesh& other) const;
+
+		/// <summary>
+		/// 這個Mesh在（可能是shared的）vertex buffer中的第一個vertex
+		/// </summary>
+		inline uint32_t getBaseVertex() const { return m_skinningSource ? m_skinnedBaseVertex : m_vertexAllocation.offset; }
+
+		/// <summary>
+		/// 這個Mesh在（可能是shared的）index buffer中的第一個index
+		/// </summary>
+		inline uint32_t getBaseIndex() const { return m_skinningSource ? m_skinningSource->getBaseIndex() : m_indexAllocation.offset; }
+
+		inline uint32_t getVertexCount() const { return m_vertexCount; }
+
+		nvrhi::IBuffer* getVertexBuffer() const;
+
+		nvrhi::IBuffer* getIndexBuffer() const;
+
+		/// <summary>
+		/// Skeletal mesh每個vertex的SkeletalVertexInfo，不是skeletal mesh的話為nullptr
+		/// </summary>
+		nvrhi::IBuffer* getBoneBuffer() const { return m_boneBuffer; }
+
 		/// <summary>
 		/// 設定Mesh Type
 		/// 會依據該Type來決定Mesh的格式處理方式
@@ -93,16 +137,45 @@ namespace PaperEngine {
 
 		inline PE_API const AABB& getAABB() const { return m_aabb; }
 
+	private:
+		void releasePooledVertices();
+		void releasePooledIndices();
+
+		/// <summary>
+		/// 釋放pool滿了 (或skeletal mesh) 時建立的buffer
+		/// </summary>
+		void releaseDedicatedBuffer(nvrhi::BufferHandle& buffer, GPUMemoryAllocation& memory);
+
 	private:
 
 		AABB m_aabb;
 
+		/// <summary>
+		/// Static mesh的vertex跟所有mesh的index會放在shared pool中
+		/// pool滿了才會建立自己的buffer
+		/// </summary>
+		Ref<MeshBufferPool> m_bufferPool;
+		MeshBufferPool::Allocation m_vertexAllocation;
+		MeshBufferPool::Allocation m_indexAllocation;
+
 		nvrhi::BufferHandle m_vertexBuffer;
+		GPUMemoryAllocation m_vertexMemory;
 
 		nvrhi::Format m_indexFormat = nvrhi::Format::R32_UINT; // 預設為32位元整數索引格式
 		nvrhi::BufferHandle m_indexBuffer;
+		GPUMemoryAllocation m_indexMemory;
 
 		nvrhi::BufferHandle m_boneBuffer;
+		GPUMemoryAllocation m_boneMemory;
+
+		uint32_t m_vertexCount = 0;
+
+		/// <summary>
+		/// skinning輸出的話為原本的skeletal mesh，index從這裡拿
+		/// vertex buffer是SkinningPass的output (m_vertexBuffer，沒有m_vertexMemory)
+		/// </summary>
+		Ref<Mesh> m_skinningSource;
+		uint32_t m_skinnedBaseVertex = 0;
 
 		/// <summary>
 		/// 主要是用來區分materials
@@ -0,0 +1,93 @@
+﻿#include "MeshBufferPool.h"
+
+#include <PaperEngine/core/Application.h>
+
+#include "Mesh.h"
+
+namespace PaperEngine {
+
+	MeshBufferPool::MeshBufferPool(uint32_t maxVertexCount, uint32_t maxIndexCount)
+	{
+		auto allocator = Application::GetGPUMemoryAllocator();
+
+		nvrhi::BufferDesc vertexBufferDesc;
+		vertexBufferDesc
+			.setByteSize(static_cast<uint64_t>(maxVertexCount) * sizeof(StaticVertex))
+			.setDebugName("MeshBufferPool_vertexBuffer")
+			.setIsVertexBuffer(true)
+			.setStructStride(sizeof(StaticVertex))
+			.setInitialState(nvrhi::ResourceStates::VertexBuffer)
+			.setKeepInitialState(true);
+		m_vertexBuffer = allocator->createBuffer(vertexBufferDesc, GPUMemoryCategory::Mesh, m_vertexMemory);
+
+		nvrhi::BufferDesc indexBufferDesc;
+		indexBufferDesc
+			.setByteSize(static_cast<uint64_t>(maxIndexCount) * sizeof(uint32_t))
+			.setDebugName("MeshBufferPool_indexBuffer")
+			.setIsIndexBuffer(true)
+			.setInitialState(nvrhi::ResourceStates::IndexBuffer)
+			.setKeepInitialState(true);
+		m_indexBuffer = allocator->createBuffer(indexBufferDesc, GPUMemoryCategory::Mesh, m_indexMemory);
+
+		m_vertexRanges.init(maxVertexCount);
+		m_indexRanges.init(maxIndexCount);
+	}
+
+	MeshBufferPool::~MeshBufferPool()
+	{
+		Application::GetGPUMemoryAllocator()->free(m_vertexMemory);
+		Application::GetGPUMemoryAllocator()->free(m_indexMemory);
+	}
+
+	bool MeshBufferPool::allocateVertices(uint32_t count, Allocation& outAllocation)
+	{
+		if (count == 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_vertexRanges.allocate(count, outAllocation.offset))
+			return false;
+		outAllocation.count = count;
+		return true;
+	}
+
+	bool MeshBufferPool::allocateIndices(uint32_t count, Allocation& outAllocation)
+	{
+		if (count == 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_indexRanges.allocate(count, outAllocation.offset))
+			return false;
+		outAllocation.count = count;
+		return true;
+	}
+
+	void MeshBufferPool::freeVertices(const Allocation& allocation)
+	{
+		if (!allocation.isValid())
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_vertexRanges.free(allocation.offset, allocation.count);
+	}
+
+	void MeshBufferPool::freeIndices(const Allocation& allocation)
+	{
+		if (!allocation.isValid())
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_indexRanges.free(allocation.offset, allocation.count);
+	}
+
+	Ref<MeshBufferPool> MeshBufferPool::GetStaticMeshPool()
+	{
+		// 4M vertices (128MB), 16M indices (64MB)
+		return Application::GetResourceManager()->create<MeshBufferPool>(
+			"MeshBufferPool_static",
+			4u * 1024u * 1024u,
+			16u * 1024u * 1024u);
+	}
+
+}
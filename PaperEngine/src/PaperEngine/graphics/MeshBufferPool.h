@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <mutex>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/utils/RangeAllocator.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 所有Static Mesh共用的一個大vertex buffer跟一個大index buffer
+	/// Mesh只是在裡面拿一段range
+	/// 這樣不同Mesh的draw才可以合併成同一個drawIndexedIndirect
+	///
+	/// vertex格式固定是StaticVertex
+	/// index固定是R32_UINT
+	/// </summary>
+	class MeshBufferPool {
+	public:
+		struct Allocation {
+			uint32_t offset = 0;		// 以element為單位（vertex或index）
+			uint32_t count = 0;
+
+			bool isValid() const { return count > 0; }
+		};
+
+	public:
+		MeshBufferPool(uint32_t maxVertexCount, uint32_t maxIndexCount);
+		~MeshBufferPool();
+
+		/// <summary>
+		/// Thread safe
+		/// 空間不夠時回傳false，Mesh要自己建立獨立的buffer
+		/// </summary>
+		bool allocateVertices(uint32_t count, Allocation& outAllocation);
+
+		bool allocateIndices(uint32_t count, Allocation& outAllocation);
+
+		void freeVertices(const Allocation& allocation);
+
+		void freeIndices(const Allocation& allocation);
+
+		nvrhi::IBuffer* getVertexBuffer() const { return m_vertexBuffer; }
+
+		nvrhi::IBuffer* getIndexBuffer() const { return m_indexBuffer; }
+
+		uint32_t getUsedVertexCount() const { return m_vertexRanges.getUsedCount(); }
+
+		uint32_t getUsedIndexCount() const { return m_indexRanges.getUsedCount(); }
+
+	public:
+		/// <summary>
+		/// 取得engine預設的static mesh pool
+		/// 沒有的話就create一個（由ResourceManager管理，沒人使用時會被釋放）
+		/// </summary>
+		PE_API static Ref<MeshBufferPool> GetStaticMeshPool();
+
+	private:
+		std::mutex m_mutex;
+
+		nvrhi::BufferHandle m_vertexBuffer;
+		nvrhi::BufferHandle m_indexBuffer;
+		GPUMemoryAllocation m_vertexMemory;
+		GPUMemoryAllocation m_indexMemory;
+
+		RangeAllocator m_vertexRanges;
+		RangeAllocator m_indexRanges;
+	};
+
+}
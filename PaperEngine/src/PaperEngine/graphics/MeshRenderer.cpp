@@ -9,38 +9,26 @@
 #include <PaperEngine/utils/BoundingVolume.h>
 
 #include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+#include <PaperEngine/debug/FrameStats.h>
 
 namespace PaperEngine {
 	
 	MeshRenderer::MeshRenderer()
 	{
-		nvrhi::BufferDesc instanceBufferDesc;
-		instanceBufferDesc
-			.setByteSize(sizeof(InstanceData) * 100000)
-			.setIsConstantBuffer(true)
-			.setKeepInitialState(true)
-			.setStructStride(sizeof(InstanceData))
-			.setCpuAccess(nvrhi::CpuAccessMode::Write);
-		m_instanceBuffer = CreateRef<GPUBuffer>(ResourceUsage::FrameStreaming, instanceBufferDesc);
-
 		nvrhi::BindingLayoutDesc instanceBufLayoutDesc;
 		instanceBufLayoutDesc
 			.setRegisterSpace(1)			// set = 1
 			.setRegisterSpaceIsDescriptorSet(true)
 			.setVisibility(nvrhi::ShaderType::Vertex)
-			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0));
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0))
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1));		// bindless material index
 		m_instanceBufBindingLayout = 
 			Application::GetResourceManager()->create<BindingLayout>("MeshRenderer_instanceBufLayout",
 				Application::GetNVRHIDevice()->createBindingLayout(instanceBufLayoutDesc));
 
 		const uint32_t max_frame_count = Application::Get()->getGraphicsContext()->getMaxFrameInFlight();
-		std::vector<nvrhi::BindingSetDesc> instanceBufSetDescs(max_frame_count);
-		for (uint32_t i = 0; i < max_frame_count; i++)
-		{
-			nvrhi::BindingSetDesc& instanceBufSetDesc = instanceBufSetDescs[i];
-			instanceBufSetDesc.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_instanceBuffer->getStorages()[i].handle));
-		}
-		m_instanceBufferSet = std::make_shared<BindingSet>(ResourceUsage::FrameStreaming, m_instanceBufBindingLayout, instanceBufSetDescs);
+		m_recordCommandLists.resize(max_frame_count);
 
 	}
 
@@ -50,86 +38,323 @@ namespace PaperEngine {
 
 	void MeshRenderer::addEntity(Ref<Material> material, Ref<Mesh> mesh, uint32_t subMeshIndex, const Transform& transform)
 	{
+		addEntity(std::move(material), std::move(mesh), subMeshIndex, transform.matrix());
+	}
+
+	void MeshRenderer::addEntity(Ref<Material> material, Ref<Mesh> mesh, uint32_t subMeshIndex, const glm::mat4& matrix)
+	{
+		const bool bindless = material->isBindless();
+		const uint32_t bindlessIndex = bindless ? material->getBindlessIndex() : 0;
+
 		std::lock_guard<std::mutex> lock(m_add_entity_mutex);
-		auto& materialList = m_renderData[material->getGraphicsPipeline()].materialList;
-		auto& meshList = materialList[material].meshList;
+		InsertInstance(m_renderData, material->getGraphicsPipeline(), material, bindless, bindlessIndex, mesh, subMeshIndex, matrix);
+		m_tempInstanceCount++;
+	}
+
+	void MeshRenderer::InsertInstance(
+		RenderData& renderData,
+		const Ref<GraphicsPipeline>& graphicsPipeline,
+		const Ref<Material>& material,
+		bool bindless,
+		uint32_t bindlessIndex,
+		const Ref<Mesh>& mesh,
+		uint32_t subMeshIndex,
+		const glm::mat4& transform)
+	{
+		auto& materialList = renderData[graphicsPipeline].materialList;
+		// bindless的material不需要切換binding set，全部放一起
+		auto& meshList = materialList[bindless ? nullptr : material].meshList;
 		auto& subMeshList = meshList[mesh].subMeshList;
 		auto& subMeshData = subMeshList[subMeshIndex];
 
-		subMeshData.instanceData.emplace_back(transform);
-		m_tempInstanceCount++;
+		subMeshData.instanceData.push_back({ transform });
+		if (bindless)
+			subMeshData.materialIndices.push_back(bindlessIndex);
 	}
 
 	void MeshRenderer::processScene(Ref<Scene> scene, const Frustum& camera_frustum)
 	{
 		const auto scene_group = scene->getRegistry().group<MeshComponent>(entt::get<TransformComponent, MeshRendererComponent>);
 
-		auto group_start = scene_group.begin();
-		auto group_end = scene_group.end();
-
-		size_t thread_count = Application::GetThreadPool()->get_thread_count();
-		size_t chunk_size = (scene_group.size() + thread_count) / thread_count;
+		const auto group_start = scene_group.begin();
 
-		std::vector<std::future<void>> process_futures(thread_count);
+		JobSystem* jobSystem = Application::GetJobSystem();
+		const uint32_t entity_count = static_cast<uint32_t>(scene_group.size());
 
-		for (size_t i = 0; i < thread_count; i++)
-		{
-			PE_PROFILE_SCOPE("static mesh scene dispatch.");
+		// 切成比thread數多的小段，讓比較快做完的worker去偷剩下的
+		jobSystem->parallelFor(entity_count, jobSystem->getGrainSize(entity_count), [&](uint32_t begin, uint32_t end)
+			{
+				PE_PROFILE_SCOPE("Worker thread process mesh renderers");
+				uint32_t culledCount = 0;
+				auto it = std::next(group_start, begin);
+				for (uint32_t i = begin; i < end; i++, ++it)
+				{
+					auto entity = *it;
+					const auto& meshCom = scene_group.get<MeshComponent>(entity);
+					const auto& meshRendererCom = scene_group.get<MeshRendererComponent>(entity);
+					if (!meshRendererCom.visible || !meshCom.mesh)
+						continue;
+					const Ref<Mesh>& mesh = m_skinningPass ? m_skinningPass->resolveMesh(&meshCom, meshCom.mesh) : meshCom.mesh;
+					const auto& transform = scene_group.get<TransformComponent>(entity).transform;
+
+					// Frustum culling for meshes
+					if (!camera_frustum.isIntersect(meshCom.worldAABB)) {
+						culledCount++;
+						continue;
+					}
+					if (!meshRendererCom.renderStatic)		// 不是作為static mesh來render的
+						continue;
+					// meshRenderer的materials跟subMesh是一對一的
+					PE_CORE_ASSERT(mesh->getSubMeshes().size() == meshRendererCom.materials.size(), "Wired mesh renderer materials doesn't match mesh submeshes");
+					// m_forwardPlusDepthRenderer.addEntity(mesh, transform);
+					const float screenSize = estimateScreenSize(meshCom.worldAABB);
+					for (uint32_t subMeshIndex = 0; subMeshIndex < mesh->getSubMeshes().size(); subMeshIndex++) {
+						auto material = meshRendererCom.materials[subMeshIndex];
+						if (!material || (!material->isBindless() && !material->getBindingSet()))
+							continue;			// TODO: 改成null material之類的可以顯示
+						material->requestStreamedMips(screenSize);
+						this->addEntity(
+							material,
+							mesh,
+							subMeshIndex,
+							transform);
+					}
+				}
+				PE_FRAME_STAT_COUNT("MeshRenderer Culled Entities", culledCount);
+			});
+	}
 
-			auto start_it = group_start;
-			std::advance(group_start, chunk_size);
-			process_futures[i] = Application::GetThreadPool()->submit_task([&, group_start, group_end, thread_count, start_it, i]()
+	void MeshRenderer::processSnapshot(const SceneSnapshot& snapshot, const Frustum& camera_frustum)
+	{
+		JobSystem* jobSystem = Application::GetJobSystem();
+		const uint32_t instance_count = static_cast<uint32_t>(snapshot.meshInstances.size());
+
+		jobSystem->parallelFor(instance_count, jobSystem->getGrainSize(instance_count), [&](uint32_t begin, uint32_t end)
+			{
+				PE_PROFILE_SCOPE("Worker thread process mesh snapshot");
+				uint32_t culledCount = 0;
+				for (uint32_t i = begin; i < end; i++)
 				{
-					PE_PROFILE_SCOPE("Worker thread process mesh renderers");
-					auto end_it = (i == thread_count - 1) ? group_end : group_start;
-					for (auto it = start_it; it != end_it; ++it)
-					{
-						auto entity = *it;
-						const auto& meshCom = scene_group.get<MeshComponent>(entity);
-						const auto& meshRendererCom = scene_group.get<MeshRendererComponent>(entity);
-						const auto mesh = meshCom.mesh;
-						const auto& transform = scene_group.get<TransformComponent>(entity).transform;
-
-						if (!meshRendererCom.visible)
-							continue;
-
-						// Frustum culling for meshes
-						if (!camera_frustum.isIntersect(meshCom.worldAABB))
-							continue;
-						if (!meshRendererCom.renderStatic)		// 不是作為static mesh來render的
-							continue;
-						// meshRenderer的materials跟subMesh是一對一的
-						PE_CORE_ASSERT(mesh->getSubMeshes().size() == meshRendererCom.materials.size(), "Wired mesh renderer materials doesn't match mesh submeshes");
-						// m_forwardPlusDepthRenderer.addEntity(mesh, transform);
-						for (uint32_t subMeshIndex = 0; subMeshIndex < mesh->getSubMeshes().size(); subMeshIndex++) {
-							auto material = meshRendererCom.materials[subMeshIndex];
-							if (!material || !material->getBindingSet())
-								continue;			// TODO: 改成null material之類的可以顯示
-							this->addEntity(
-								material,
-								mesh,
-								subMeshIndex,
-								transform);
-						}
+					const auto& instance = snapshot.meshInstances[i];
+
+					// Frustum culling for meshes
+					if (!camera_frustum.isIntersect(instance.worldAABB)) {
+						culledCount++;
+						continue;
 					}
-				});
-		}
+					const Ref<Mesh>& mesh = m_skinningPass ? m_skinningPass->resolveMesh(&instance, instance.mesh) : instance.mesh;
+					const float screenSize = estimateScreenSize(instance.worldAABB);
+					for (uint32_t subMeshIndex = 0; subMeshIndex < mesh->getSubMeshes().size(); subMeshIndex++) {
+						const auto& material = snapshot.materials[instance.materialOffset + subMeshIndex];
+						if (!material || (!material->isBindless() && !material->getBindingSet()))
+							continue;			// TODO: 改成null material之類的可以顯示
+						material->requestStreamedMips(screenSize);
+						this->addEntity(
+							material,
+							mesh,
+							subMeshIndex,
+							instance.matrix);
+					}
+				}
+				PE_FRAME_STAT_COUNT("MeshRenderer Culled Entities", culledCount);
+			});
+	}
 
-		// 等待process mesh完成
-		for (auto& future : process_futures)
-		{
-			future.get();
-		}
+	float MeshRenderer::estimateScreenSize(const AABB& worldAABB) const
+	{
+		const glm::vec3 center = 0.5f * (worldAABB.min + worldAABB.max);
+		const float radius = 0.5f * glm::length(worldAABB.max - worldAABB.min);
+		// 相機在球裡面的話當作很近
+		const float distance = std::max(glm::length(center - m_streamingCameraPosition) - radius, 0.01f);
+		return 2.0f * radius / distance * m_streamingPixelScale;
 	}
 
 	void MeshRenderer::renderScene(nvrhi::ICommandList* cmd, const GlobalSceneData& globalData)
 	{
 		PE_PROFILE_FUNCTION();
 
+		buildDrawRecords(globalData);
+
+		// draw少的時候開command list的成本比較高，直接錄在main command list
+		const uint32_t recordCount = static_cast<uint32_t>(m_drawRecords.size());
+		uint32_t listCount = std::min(recordCount / MinRecordsPerCommandList, Application::GetJobSystem()->getWorkerCount() + 1);
+		if (m_maxRecordCommandLists != 0)
+			listCount = std::min(listCount, m_maxRecordCommandLists);
+
+		PE_FRAME_STAT_SCOPE("MeshRenderer Record Time");
+		if (listCount <= 1) {
+			PE_PROFILE_GPU_SCOPE(cmd, "Mesh Rendering");
+			recordDraws(cmd, globalData, 0, recordCount);
+			PE_FRAME_STAT_COUNT("MeshRenderer Record Lists", 1);
+			return;
+		}
+
+		// 每個frame in flight各自一組，GPU還在執行上一輪的list時不會被重新open
+		auto graphicsContext = Application::Get()->getGraphicsContext();
+		auto& commandLists = m_recordCommandLists[graphicsContext->getCurrentFrameIndex()];
+		while (commandLists.size() < listCount)
+			commandLists.push_back(Application::GetNVRHIDevice()->createCommandList());
+
+		// 依照順序切成連續的區段，submit順序跟單一list時相同
+		const uint32_t recordsPerList = (recordCount + listCount - 1) / listCount;
+		Application::GetJobSystem()->parallelFor(listCount, 1, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t list = begin; list < end; list++) {
+					PE_PROFILE_SCOPE("Worker thread record mesh draws");
+					nvrhi::ICommandList* recordCmd = commandLists[list];
+					const uint32_t first = list * recordsPerList;
+					const uint32_t last = std::min(recordCount, first + recordsPerList);
+
+					recordCmd->open();
+					{
+						// main command list會在中間submit，scope要記在各自的command list裡
+						PE_PROFILE_GPU_SCOPE(recordCmd, "Mesh Rendering");
+						recordDraws(recordCmd, globalData, first, last);
+					}
+					recordCmd->close();
+				}
+			});
 
-		// rendering
+		std::vector<nvrhi::ICommandList*> submitLists(listCount);
+		for (uint32_t i = 0; i < listCount; i++)
+			submitLists[i] = commandLists[i];
+		graphicsContext->executeMainCommandList(submitLists);
+		PE_FRAME_STAT_COUNT("MeshRenderer Record Lists", listCount);
+	}
 
+	void MeshRenderer::buildDrawRecords(const GlobalSceneData& globalData)
+	{
+		PE_PROFILE_FUNCTION();
+
+		m_drawRecords.clear();
+		m_instanceBufferSet = nullptr;
+		m_indirectArgs = {};
+
+		uint32_t totalInstanceCount = 0;
+		uint32_t totalDrawCount = 0;
+		for (const auto& [graphicsPipeline, shaderData] : m_renderData)
+			for (const auto& [material, materialData] : shaderData.materialList)
+				for (const auto& [mesh, meshData] : materialData.meshList) {
+					totalDrawCount += static_cast<uint32_t>(meshData.subMeshList.size());
+					for (const auto& [subMesh, subMeshData] : meshData.subMeshList)
+						totalInstanceCount += static_cast<uint32_t>(subMeshData.instanceData.size());
+				}
+		if (totalDrawCount == 0)
+			return;
+
+		// 失敗的話allocator會log，這個frame就不畫mesh
+		FrameUploadAllocator* uploadAllocator = Application::GetFrameUploadAllocator();
+		const FrameUploadAllocation instanceAllocation = uploadAllocator->allocate(totalInstanceCount * sizeof(InstanceData));
+		const FrameUploadAllocation materialIndexAllocation = uploadAllocator->allocate(totalInstanceCount * sizeof(uint32_t));
+		const FrameUploadAllocation indirectArgsAllocation = uploadAllocator->allocate(totalDrawCount * sizeof(nvrhi::DrawIndexedIndirectArguments));
+		if (!instanceAllocation.isValid() || !materialIndexAllocation.isValid() || !indirectArgsAllocation.isValid())
+			return;
+		m_indirectArgs = indirectArgsAllocation;
+
+		nvrhi::BindingSetDesc instanceBufSetDesc;
+		instanceBufSetDesc
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, instanceAllocation.buffer, nvrhi::Format::UNKNOWN, instanceAllocation.getRange()))
+			.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(1, materialIndexAllocation.buffer, nvrhi::Format::UNKNOWN, materialIndexAllocation.getRange()));
+		m_instanceBufferSet = Application::GetNVRHIDevice()->createBindingSet(instanceBufSetDesc, m_instanceBufBindingLayout->handle);
+
+		auto* instanceData = static_cast<InstanceData*>(instanceAllocation.mapPtr);
+		auto* materialIndices = static_cast<uint32_t*>(materialIndexAllocation.mapPtr);
+		auto* indirectArgs = static_cast<nvrhi::DrawIndexedIndirectArguments*>(m_indirectArgs.mapPtr);
+		uint32_t indirectArgsCount = 0;
+
+		uint32_t instanceOffset = 0;
+		for (auto& [graphicsPipeline, shaderData] : m_renderData) {
+			if (!graphicsPipeline->isSupported())
+				continue;
+
+			DrawRecord record{};
+			record.pipeline = graphicsPipeline->getGraphicsPipeline(globalData.fb);
+			PE_FRAME_STAT_COUNT("MeshRenderer Pipeline Switches", 1);
+
+			if (graphicsPipeline->isBindless()) {
+				if (!m_bindlessTable)
+					m_bindlessTable = BindlessMaterialTable::Get();
+				record.materialSet = m_bindlessTable->getParameterSet();
+				record.descriptorTable = m_bindlessTable->getDescriptorTable();
+			}
+
+			for (auto& [material, materialData] : shaderData.materialList) {
+				if (material) {
+					material->refreshStreamedTextures();
+					record.materialSet = material->getBindingSet();
+					PE_FRAME_STAT_COUNT("MeshRenderer Binding Set Switches", 1);
+				}
+
+				// 收集這個material bucket中所有的draw，順便上傳instance data
+				m_drawItems.clear();
+				for (auto& [mesh, meshData] : materialData.meshList) {
+					for (auto& [subMesh, subMeshData] : meshData.subMeshList) {
+
+						// instance buffer uploading
+						uint32_t instanceCount = static_cast<uint32_t>(subMeshData.instanceData.size());
+						size_t transMatSize = instanceCount * sizeof(InstanceData);
+
+						memcpy(
+							instanceData + instanceOffset,
+							subMeshData.instanceData.data(),
+							transMatSize);
+
+						if (!subMeshData.materialIndices.empty()) {
+							memcpy(
+								materialIndices + instanceOffset,
+								subMeshData.materialIndices.data(),
+								instanceCount * sizeof(uint32_t));
+						}
+
+						m_drawItems.push_back({ mesh.get(), subMesh, instanceOffset, instanceCount });
+						instanceOffset += instanceCount;
+					}
+				}
+
+				// 相同vertex/index buffer的draw排在一起
+				// 大部分static mesh都在shared pool中，所以整個bucket通常只有一個call
+				std::sort(m_drawItems.begin(), m_drawItems.end(), [](const IndirectDrawItem& a, const IndirectDrawItem& b) {
+					if (a.mesh->getVertexBuffer() != b.mesh->getVertexBuffer())
+						return a.mesh->getVertexBuffer() < b.mesh->getVertexBuffer();
+					return a.mesh->getIndexBuffer() < b.mesh->getIndexBuffer();
+					});
+
+				size_t runStart = 0;
+				while (runStart < m_drawItems.size()) {
+					const Mesh* runMesh = m_drawItems[runStart].mesh;
+					size_t runEnd = runStart + 1;
+					while (runEnd < m_drawItems.size() && runMesh->isGeometryBindingCompatible(*m_drawItems[runEnd].mesh))
+						runEnd++;
+
+					const uint32_t runCount = static_cast<uint32_t>(runEnd - runStart);
+					record.mesh = runMesh;
+					record.argsOffset = indirectArgsCount;
+					record.drawCount = runCount;
+					for (size_t i = runStart; i < runEnd; i++) {
+						const IndirectDrawItem& item = m_drawItems[i];
+						nvrhi::DrawIndexedIndirectArguments& args = indirectArgs[indirectArgsCount++];
+						item.mesh->getSubMeshDrawArguments(args, item.subMeshIndex);
+						args.instanceCount = item.instanceCount;
+						args.startInstanceLocation = item.instanceOffset;
+					}
+					m_drawRecords.push_back(record);
+
+					m_tempDrawCallCount += runCount;
+					m_tempIndirectCallCount++;
+
+					runStart = runEnd;
+				}
+			}
+		}
+
+		PE_FRAME_STAT_BYTES("MeshRenderer Instance Upload", instanceOffset * (sizeof(InstanceData) + sizeof(uint32_t)));
+		PE_FRAME_STAT_BYTES("MeshRenderer Indirect Args Upload", indirectArgsCount * sizeof(nvrhi::DrawIndexedIndirectArguments));
+	}
+
+	void MeshRenderer::recordDraws(nvrhi::ICommandList* cmd, const GlobalSceneData& globalData, uint32_t first, uint32_t last) const
+	{
 		// 確保texture state正確
+		// 每個command list的state tracking是分開的，所以每個list都要設定
 		auto color_texture = globalData.fb->getDesc().colorAttachments[0].texture;
 		auto depth_texture = globalData.fb->getDesc().depthAttachment.texture;
 		cmd->setTextureState(color_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::RenderTarget);
@@ -139,7 +364,6 @@ namespace PaperEngine {
 
 		nvrhi::GraphicsState graphicsState;
 		graphicsState.setFramebuffer(globalData.fb);
-		nvrhi::DrawArguments drawArgs;
 		graphicsState.viewport.addViewportAndScissorRect(
 			nvrhi::Viewport(
 				0,
@@ -151,53 +375,56 @@ namespace PaperEngine {
 
 		/// 0: globalSet
 		/// 1: instance buffer
-		/// 2: material
+		/// 2: material (bindless的話為material parameters)
+		/// 3: bindless descriptor table (只有bindless pipeline)
 		graphicsState.bindings.resize(3);
 		graphicsState.bindings[0] = globalData.globalSet;
-		graphicsState.bindings[1] = m_instanceBufferSet->getHandle();
-
-		// Render
-		size_t instanceOffset = 0;
-		for (auto& [graphicsPipeline, shaderData] : m_renderData) {
-			graphicsPipeline->bind(graphicsState, globalData.fb);
-
-			for (auto& [material, materialData] : shaderData.materialList) {
-				graphicsState.bindings[2] = material->getBindingSet();
-				for (auto& [mesh, meshData] : materialData.meshList) {
-					mesh->bindMesh(graphicsState);
-					for (auto& [subMesh, subMeshData] : meshData.subMeshList) {
+		graphicsState.bindings[1] = m_instanceBufferSet;
 
-						// instance buffer uploading
-						size_t instanceCount = subMeshData.instanceData.size();
-						size_t transMatSize = instanceCount * sizeof(InstanceData);
+		graphicsState.setIndirectParams(m_indirectArgs.buffer);
 
-						memcpy(
-							static_cast<uint8_t*>(m_instanceBuffer->getMapPtr()) + instanceOffset * sizeof(InstanceData),
-							subMeshData.instanceData.data(),
-							transMatSize);
-
-
-						mesh->bindSubMesh(drawArgs, subMesh);
-						drawArgs.setStartInstanceLocation(instanceOffset);
-						drawArgs.setInstanceCount(static_cast<uint32_t>(instanceCount));
-						cmd->setGraphicsState(graphicsState);
-						cmd->drawIndexed(drawArgs);
-						m_tempDrawCallCount++;
-						instanceOffset += instanceCount;
-					}
-				}
+		for (uint32_t i = first; i < last; i++) {
+			const DrawRecord& record = m_drawRecords[i];
+			graphicsState.setPipeline(record.pipeline);
+			if (record.descriptorTable) {
+				graphicsState.bindings.resize(4);
+				graphicsState.bindings[3] = record.descriptorTable;
+			}
+			else {
+				graphicsState.bindings.resize(3);
 			}
+			graphicsState.bindings[2] = record.materialSet;
+
+			record.mesh->bindMesh(graphicsState);
+			cmd->setGraphicsState(graphicsState);
+			cmd->drawIndexedIndirect(
+				static_cast<uint32_t>(m_indirectArgs.offset + record.argsOffset * sizeof(nvrhi::DrawIndexedIndirectArguments)),
+				record.drawCount);
 		}
+	}
 
+	bool MeshRenderer::usesGlobalShaderResource(uint32_t slot) const
+	{
+		for (const auto& [graphicsPipeline, shaderData] : m_renderData) {
+			if (graphicsPipeline->isSupported() && graphicsPipeline->usesGlobalShaderResource(slot))
+				return true;
+		}
+		return false;
 	}
 
 	void MeshRenderer::endFrame()
 	{
+		PE_FRAME_STAT_COUNT("MeshRenderer Visible Instances", m_tempInstanceCount);
+		PE_FRAME_STAT_COUNT("MeshRenderer Draws", m_tempDrawCallCount);
+		PE_FRAME_STAT_COUNT("MeshRenderer Indirect Calls", m_tempIndirectCallCount);
+
 		m_renderData.clear();
 		m_totalInstanceCount = m_tempInstanceCount;
 		m_tempInstanceCount = 0;
 		m_totalDrawCallCount = m_tempDrawCallCount;
 		m_tempDrawCallCount = 0;
+		m_totalIndirectCallCount = m_tempIndirectCallCount;
+		m_tempIndirectCallCount = 0;
 	}
 
 	void MeshRenderer::onViewportResized(uint32_t width, uint32_t height)
@@ -4,10 +4,12 @@
 
 #include <span>
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 
 #include <PaperEngine/graphics/GraphicsPipeline.h>
 #include <PaperEngine/graphics/Material.h>
+#include <PaperEngine/graphics/BindlessMaterialTable.h>
 #include <PaperEngine/graphics/Mesh.h>
 
 #include <PaperEngine/scene/Entity.h>
@@ -15,10 +17,11 @@
 #include <PaperEngine/utils/Transform.h>
 
 #include <PaperEngine/graphics/IRenderer.h>
+#include <PaperEngine/graphics/SceneSnapshot.h>
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
 
 #include "BindingLayout.h"
-#include "GPUBuffer.h"
-#include "BindingSet.h"
+#include "SkinningPass.h"
 
 namespace PaperEngine {
 
@@ -34,6 +37,7 @@ namespace PaperEngine {
 
 		struct SubMeshData {
 			std::vector<InstanceData> instanceData;		// instance的transformation
+			std::vector<uint32_t> materialIndices;		// bindless material的index，跟instanceData一對一
 		};
 
 		struct MeshData {
@@ -45,9 +49,15 @@ namespace PaperEngine {
 		};
 
 		struct ShaderData {
+			/// <summary>
+			/// bindless pipeline的material都放在nullptr底下
+			/// 只依mesh分類
+			/// </summary>
 			std::unordered_map<Ref<Material>, MaterialData> materialList;
 		};
 
+		typedef std::unordered_map<Ref<GraphicsPipeline>, ShaderData> RenderData;
+
 	public:
 		MeshRenderer();
 		~MeshRenderer();
@@ -58,8 +68,34 @@ namespace PaperEngine {
 			uint32_t subMeshIndex,
 			const Transform& transform);
 
+		void addEntity(
+			Ref<Material> material,
+			Ref<Mesh> mesh,
+			uint32_t subMeshIndex,
+			const glm::mat4& matrix);
+
+		/// <summary>
+		/// 把一個instance放進 pipeline -> material -> mesh -> subMesh 的bucket
+		/// addEntity實際做的事，不碰GPU資源 (microbenchmark用)
+		/// bindless時material bucket為nullptr，bindlessIndex才有用
+		/// </summary>
+		PE_API static void InsertInstance(
+			RenderData& renderData,
+			const Ref<GraphicsPipeline>& graphicsPipeline,
+			const Ref<Material>& material,
+			bool bindless,
+			uint32_t bindlessIndex,
+			const Ref<Mesh>& mesh,
+			uint32_t subMeshIndex,
+			const glm::mat4& transform);
+
 		void processScene(Ref<Scene> scene, const Frustum& frustum) override;
 
+		/// <summary>
+		/// 跟processScene一樣，但從render snapshot讀取 (threaded rendering)
+		/// </summary>
+		void processSnapshot(const SceneSnapshot& snapshot, const Frustum& frustum);
+
 		// 不對 應該改成process mesh entity之類的
 		// 因為需要先使用scene renderer做 culling，不用畫的不會被process
 		// 由於是整個scene作process，所以mesh renderer保留process mesh entity的function
@@ -72,14 +108,88 @@ namespace PaperEngine {
 		void onViewportResized(uint32_t width, uint32_t height) override;
 
 
+		/// <summary>
+		/// process完之後，這個frame要畫的pipeline中有沒有讀global (set = 0) 的這個SRV slot
+		/// </summary>
+		bool usesGlobalShaderResource(uint32_t slot) const;
+
 		inline uint32_t getTotalInstanceCount() const { return m_totalInstanceCount; }
 
 		inline uint32_t getTotalDrawCallCount() const { return m_totalDrawCallCount; }
 
+		/// <summary>
+		/// 實際送出的drawIndexedIndirect數量
+		/// DrawCallCount個draw會被合併成這麼多個call
+		/// </summary>
+		inline uint32_t getTotalIndirectCallCount() const { return m_totalIndirectCallCount; }
+
+		/// <summary>
+		/// 平行錄製時最多使用幾個command list，0代表JobSystem worker數 + 1
+		/// 設成1就全部錄在main command list (量測scaling用)
+		/// </summary>
+		void setMaxRecordCommandLists(uint32_t count) { m_maxRecordCommandLists = count; }
+
+		/// <summary>
+		/// process時用skinningPass的skinned output取代skeletal mesh
+		/// </summary>
+		void setSkinningPass(const SkinningPass* skinningPass) { m_skinningPass = skinningPass; }
+
+		/// <summary>
+		/// process時用來估計mesh在畫面上的大小 (texture streaming的mip request)
+		/// pixelScale = projection[1][1] * 0.5 * viewport height，距離1的物體一單位大約佔多少pixel
+		/// </summary>
+		void setStreamingView(const glm::vec3& cameraPosition, float pixelScale)
+		{
+			m_streamingCameraPosition = cameraPosition;
+			m_streamingPixelScale = pixelScale;
+		}
+
+	private:
+		/// <summary>
+		/// 一個material bucket中的一個subMesh draw
+		/// </summary>
+		struct IndirectDrawItem {
+			Mesh* mesh;
+			uint32_t subMeshIndex;
+			uint32_t instanceOffset;
+			uint32_t instanceCount;
+		};
+
+		/// <summary>
+		/// 一個drawIndexedIndirect需要的所有state
+		/// 先在呼叫的thread建好，worker只照順序錄製
+		/// </summary>
+		struct DrawRecord {
+			nvrhi::IGraphicsPipeline* pipeline;
+			nvrhi::IBindingSet* materialSet;			// bindless的話為material parameters
+			nvrhi::IBindingSet* descriptorTable;		// 只有bindless pipeline
+			const Mesh* mesh;
+			uint32_t argsOffset;				// m_indirectArgs中第幾個
+			uint32_t drawCount;
+		};
+
+	private:
+		/// <summary>
+		/// 上傳instance data跟indirect args，把m_renderData轉成排好順序的m_drawRecords
+		/// 先數好instance跟draw的數量，從FrameUploadAllocator拿剛好的大小
+		/// </summary>
+		void buildDrawRecords(const GlobalSceneData& globalData);
+
+		/// <summary>
+		/// 錄製 m_drawRecords[first, last)，可以在多個thread對不同的cmd同時呼叫
+		/// </summary>
+		void recordDraws(nvrhi::ICommandList* cmd, const GlobalSceneData& globalData, uint32_t first, uint32_t last) const;
+
+		/// <summary>
+		/// worldAABB的外接球在畫面上的直徑 (pixel)
+		/// 假設texture的UV剛好鋪滿整個mesh
+		/// </summary>
+		float estimateScreenSize(const AABB& worldAABB) const;
+
 	private:
 
 		std::mutex m_add_entity_mutex;
-		std::unordered_map<Ref<GraphicsPipeline>, ShaderData> m_renderData;
+		RenderData m_renderData;
 
 		// 紀錄renderer 的renderer情況
 		uint32_t m_tempInstanceCount{ 0 };
@@ -88,10 +198,31 @@ namespace PaperEngine {
 		uint32_t m_tempDrawCallCount{ 0 };
 		uint32_t m_totalDrawCallCount{ 0 };
 
+		uint32_t m_tempIndirectCallCount{ 0 };
+		uint32_t m_totalIndirectCallCount{ 0 };
+
 		BindingLayoutHandle m_instanceBufBindingLayout;
-		BindingSetHandle m_instanceBufferSet;
-		// 紀錄instance buffer的transformation
-		GPUBufferHandle m_instanceBuffer;
+		// set = 1: instance的transformation (t0) 跟bindless material index (t1)
+		// 兩個都是這個frame的upload allocation，所以每個frame重新建立
+		nvrhi::BindingSetHandle m_instanceBufferSet;
+
+		Ref<BindlessMaterialTable> m_bindlessTable;
+
+		// 每個draw的DrawIndexedIndirectArguments
+		FrameUploadAllocation m_indirectArgs;
+		std::vector<IndirectDrawItem> m_drawItems;
+		std::vector<DrawRecord> m_drawRecords;
+
+		// 每個command list至少要有這麼多個record才會分出去錄
+		static constexpr uint32_t MinRecordsPerCommandList = 64;
+		uint32_t m_maxRecordCommandLists = 0;
+		// [frame in flight][list]
+		std::vector<std::vector<nvrhi::CommandListHandle>> m_recordCommandLists;
+
+		const SkinningPass* m_skinningPass = nullptr;
+
+		glm::vec3 m_streamingCameraPosition{ 0.0f };
+		float m_streamingPixelScale = 0.0f;
 	};
 
 }
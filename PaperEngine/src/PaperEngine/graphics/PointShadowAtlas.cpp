@@ -0,0 +1,742 @@
+﻿#include "PointShadowAtlas.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/utils/File.h>
+
+#include <PaperEngine/components/TransformComponent.h>
+#include <PaperEngine/components/MeshComponent.h>
+#include <PaperEngine/components/MeshRendererComponent.h>
+
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	// cube face的方向跟up，順序跟shader一樣 (+X, -X, +Y, -Y, +Z, -Z)
+	static const glm::vec3 s_faceDirections[PointShadowAtlas::FaceCount] = {
+		{ 1.f, 0.f, 0.f }, { -1.f, 0.f, 0.f },
+		{ 0.f, 1.f, 0.f }, { 0.f, -1.f, 0.f },
+		{ 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f },
+	};
+
+	static const glm::vec3 s_faceUps[PointShadowAtlas::FaceCount] = {
+		{ 0.f, -1.f, 0.f }, { 0.f, -1.f, 0.f },
+		{ 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f },
+		{ 0.f, -1.f, 0.f }, { 0.f, -1.f, 0.f },
+	};
+
+	/// <summary>
+	/// face的四角錐 (light位置到radius的遠平面) 的AABB
+	/// </summary>
+	static AABB GetFaceBounds(const glm::vec3& position, float radius, uint32_t face)
+	{
+		const glm::vec3 forward = s_faceDirections[face] * radius;
+		const glm::vec3 up = s_faceUps[face] * radius;
+		const glm::vec3 right = glm::cross(s_faceDirections[face], s_faceUps[face]) * radius;
+
+		AABB bounds(position, position);
+		for (int i = 0; i < 4; i++) {
+			const glm::vec3 corner = position + forward + ((i & 1) ? right : -right) + ((i & 2) ? up : -up);
+			bounds.min = glm::min(bounds.min, corner);
+			bounds.max = glm::max(bounds.max, corner);
+		}
+		return bounds;
+	}
+
+#pragma region SlotAllocator
+
+	void PointShadowAtlas::SlotAllocator::reset(uint32_t atlasSize, uint32_t minSize)
+	{
+		m_atlasSize = atlasSize;
+		m_maxDepth = 0;
+		while ((atlasSize >> (m_maxDepth + 1)) >= minSize)
+			m_maxDepth++;
+
+		// (4^(maxDepth + 1) - 1) / 3個node
+		const uint32_t nodeCount = ((1u << (2 * (m_maxDepth + 1))) - 1) / 3;
+		m_nodes.assign(nodeCount, NodeState::Free);
+		m_freeArea = static_cast<uint64_t>(atlasSize) * atlasSize;
+	}
+
+	uint32_t PointShadowAtlas::SlotAllocator::allocate(uint32_t size)
+	{
+		if (size == 0 || size > m_atlasSize)
+			return NoShadow;
+
+		uint32_t targetDepth = 0;
+		while ((m_atlasSize >> targetDepth) > size)
+			targetDepth++;
+		if (targetDepth > m_maxDepth)
+			return NoShadow;
+
+		// 先找已經切好的空slot，沒有的話才切大的node，減少碎片
+		uint32_t node = findFree(0, 0, targetDepth, false);
+		if (node == NoShadow)
+			node = findFree(0, 0, targetDepth, true);
+		if (node == NoShadow)
+			return NoShadow;
+
+		m_nodes[node] = NodeState::Used;
+		const uint64_t slotSize = m_atlasSize >> targetDepth;
+		m_freeArea -= slotSize * slotSize;
+		return node;
+	}
+
+	uint32_t PointShadowAtlas::SlotAllocator::findFree(uint32_t node, uint32_t depth, uint32_t targetDepth, bool allowSplit)
+	{
+		const NodeState state = m_nodes[node];
+		if (state == NodeState::Used)
+			return NoShadow;
+
+		if (depth == targetDepth)
+			return state == NodeState::Free ? node : NoShadow;
+
+		if (state == NodeState::Free) {
+			if (!allowSplit)
+				return NoShadow;
+			m_nodes[node] = NodeState::Split;
+			for (uint32_t child = 1; child <= 4; child++)
+				m_nodes[node * 4 + child] = NodeState::Free;
+		}
+
+		for (uint32_t child = 1; child <= 4; child++) {
+			const uint32_t result = findFree(node * 4 + child, depth + 1, targetDepth, allowSplit);
+			if (result != NoShadow)
+				return result;
+		}
+		return NoShadow;
+	}
+
+	void PointShadowAtlas::SlotAllocator::free(uint32_t node)
+	{
+		if (node == NoShadow || m_nodes[node] != NodeState::Used)
+			return;
+
+		const uint64_t slotSize = m_atlasSize >> getDepth(node);
+		m_freeArea += slotSize * slotSize;
+		m_nodes[node] = NodeState::Free;
+
+		// 四個child都空了的話合併回parent
+		while (node != 0) {
+			const uint32_t parent = (node - 1) / 4;
+			for (uint32_t child = 1; child <= 4; child++) {
+				if (m_nodes[parent * 4 + child] != NodeState::Free)
+					return;
+			}
+			m_nodes[parent] = NodeState::Free;
+			node = parent;
+		}
+	}
+
+	uint32_t PointShadowAtlas::SlotAllocator::getDepth(uint32_t node) const
+	{
+		uint32_t depth = 0;
+		while (node != 0) {
+			node = (node - 1) / 4;
+			depth++;
+		}
+		return depth;
+	}
+
+	glm::uvec4 PointShadowAtlas::SlotAllocator::getRect(uint32_t node) const
+	{
+		// 從node往上走，記錄每一層是第幾個child
+		uint32_t path[32];
+		uint32_t depth = 0;
+		while (node != 0) {
+			path[depth++] = (node - 1) % 4;
+			node = (node - 1) / 4;
+		}
+
+		glm::uvec4 rect(0, 0, m_atlasSize, m_atlasSize);
+		while (depth > 0) {
+			const uint32_t child = path[--depth];
+			rect.z /= 2;
+			rect.w /= 2;
+			rect.x += (child & 1) * rect.z;
+			rect.y += (child >> 1) * rect.w;
+		}
+		return rect;
+	}
+
+#pragma endregion
+
+	void PointShadowAtlas::init()
+	{
+		// set = 0: face的viewProj (b0) 跟instance的transformation (t0)，跟CascadedShadowPass一樣
+		nvrhi::BindingLayoutDesc layoutDesc;
+		layoutDesc
+			.setRegisterSpace(0)
+			.setRegisterSpaceIsDescriptorSet(true)
+			.setVisibility(nvrhi::ShaderType::Vertex)
+			.addItem(nvrhi::BindingLayoutItem::ConstantBuffer(0))
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0));
+		m_bindingLayout = CreateRef<BindingLayout>(Application::GetNVRHIDevice()->createBindingLayout(layoutDesc));
+
+		auto loadShader = [](const char* path, const char* entryName, const char* debugName) {
+			nvrhi::ShaderDesc shaderDesc;
+			shaderDesc.debugName = debugName;
+			shaderDesc.entryName = entryName;
+			shaderDesc.shaderType = nvrhi::ShaderType::Vertex;
+			File file(path);
+
+			auto shaderBinary = file.readBinaryFully();
+			if (!shaderBinary) {
+				PE_CORE_ERROR("[PointShadowAtlas] Failed to load shader '{}'.", path);
+				return nvrhi::ShaderHandle();
+			}
+			return Application::GetNVRHIDevice()->createShader(
+				shaderDesc,
+				shaderBinary->data,
+				shaderBinary->size);
+			};
+
+#pragma region Shadow pass graphics Pipeline
+		{
+			nvrhi::GraphicsPipelineDesc graphicsPipelineDesc;
+			graphicsPipelineDesc
+				.setPrimType(nvrhi::PrimitiveType::TriangleList)
+				.addBindingLayout(m_bindingLayout->handle);
+			graphicsPipelineDesc.VS = loadShader("assets/PaperEngine/shader/shadowPass/shader.vert.spv", "main_vs", "Point Shadow Vertex Shader");
+			if (graphicsPipelineDesc.VS) {
+
+				nvrhi::VertexAttributeDesc attributes[] = {
+					nvrhi::VertexAttributeDesc()
+					.setName("POSITION")
+					.setFormat(nvrhi::Format::RGB32_FLOAT)
+					.setOffset(offsetof(StaticVertex, position))
+					.setBufferIndex(0)
+					.setElementStride(sizeof(StaticVertex))
+				};
+
+				graphicsPipelineDesc.inputLayout = Application::GetNVRHIDevice()->createInputLayout(
+					attributes,
+					uint32_t(std::size(attributes)),
+					graphicsPipelineDesc.VS);
+
+				m_pipeline = CreateRef<GraphicsPipeline>(graphicsPipelineDesc, nullptr, 0);
+			}
+		}
+
+		{
+			nvrhi::GraphicsPipelineDesc clearPipelineDesc;
+			clearPipelineDesc.setPrimType(nvrhi::PrimitiveType::TriangleList);
+			clearPipelineDesc.VS = loadShader("assets/PaperEngine/shader/shadowPass/shader.clear.vert.spv", "main_clear_vs", "Point Shadow Clear Vertex Shader");
+			if (clearPipelineDesc.VS)
+				m_clearPipeline = CreateRef<GraphicsPipeline>(clearPipelineDesc, nullptr, 0);
+		}
+#pragma endregion
+
+		m_slots.reset(m_settings.atlasSize, m_settings.minFaceSize);
+	}
+
+	void PointShadowAtlas::setSettings(const Settings& settings)
+	{
+		const bool resized = settings.atlasSize != m_settings.atlasSize || settings.minFaceSize != m_settings.minFaceSize;
+		m_settings = settings;
+		m_settings.atlasSize = std::bit_floor(std::max(m_settings.atlasSize, 1u));
+		m_settings.minFaceSize = std::clamp(std::bit_floor(std::max(m_settings.minFaceSize, 1u)), 1u, m_settings.atlasSize);
+		m_settings.maxFaceSize = std::clamp(std::bit_floor(std::max(m_settings.maxFaceSize, 1u)), m_settings.minFaceSize, m_settings.atlasSize);
+
+		// 全部的slot都失效
+		if (resized) {
+			m_records.clear();
+			m_slots.reset(m_settings.atlasSize, m_settings.minFaceSize);
+		}
+	}
+
+	nvrhi::TextureDesc PointShadowAtlas::getAtlasDesc() const
+	{
+		nvrhi::TextureDesc atlasDesc;
+		atlasDesc
+			.setDebugName("PointShadowAtlas")
+			.setDimension(nvrhi::TextureDimension::Texture2D)
+			.setWidth(m_settings.atlasSize)
+			.setHeight(m_settings.atlasSize)
+			.setFormat(nvrhi::Format::D32)
+			.setIsRenderTarget(true)
+			.setInitialState(nvrhi::ResourceStates::ShaderResource)
+			.setKeepInitialState(true);
+		return atlasDesc;
+	}
+
+	void PointShadowAtlas::setAtlas(nvrhi::ITexture* atlas, bool contentPreserved)
+	{
+		PE_CORE_ASSERT(atlas, "Point shadow atlas is null");
+
+		if (atlas != m_atlas.Get()) {
+			m_atlas = atlas;
+			nvrhi::FramebufferDesc framebufferDesc;
+			framebufferDesc.setDepthAttachment(m_atlas);
+			m_framebuffer = Application::GetNVRHIDevice()->createFramebuffer(framebufferDesc);
+		}
+
+		// slot的位置還是有效的，只有內容要重畫
+		if (!contentPreserved) {
+			for (auto& [key, record] : m_records)
+				record.faceValid.fill(false);
+		}
+	}
+
+	void PointShadowAtlas::beginPass(const glm::vec3& cameraPosition, float pixelScale, const Frustum& cameraFrustum)
+	{
+		m_cameraPosition = cameraPosition;
+		m_pixelScale = pixelScale;
+		m_cameraFrustum = cameraFrustum;
+		m_frameLights.clear();
+		m_faces.clear();
+		m_lightFaces.clear();
+	}
+
+	void PointShadowAtlas::releaseRecord(LightRecord& record)
+	{
+		for (uint32_t face = 0; face < FaceCount; face++) {
+			m_slots.free(record.faceNodes[face]);
+			record.faceNodes[face] = NoShadow;
+			record.faceValid[face] = false;
+		}
+	}
+
+	uint64_t PointShadowAtlas::HashLight(const glm::vec3& position, float radius)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto combine = [&hash](const void* data, size_t size) {
+			const auto* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			};
+		combine(&position, sizeof(position));
+		combine(&radius, sizeof(radius));
+		return hash;
+	}
+
+	void PointShadowAtlas::allocate(const LightCullingPass& lightCullPass)
+	{
+		PE_PROFILE_FUNCTION();
+
+		struct Candidate {
+			uint32_t pointLightIndex;
+			uint64_t key;
+			float importance;
+			float desiredSize;
+			uint32_t faceSize;
+			uint8_t faceMask;
+		};
+
+		// 在camera frustum中的face，importance = 畫面上的直徑 * 亮度
+		std::vector<Candidate> candidates;
+		for (uint32_t pointLightIndex : lightCullPass.getShadowPointLights()) {
+			const PointLightData& light = lightCullPass.getPointLight(pointLightIndex);
+			if (light.radius <= m_settings.nearPlane)
+				continue;
+
+			uint8_t faceMask = 0;
+			for (uint32_t face = 0; face < FaceCount; face++) {
+				if (m_cameraFrustum.isIntersect(GetFaceBounds(light.position, light.radius, face)))
+					faceMask |= 1 << face;
+			}
+			if (faceMask == 0)
+				continue;
+
+			// 相機在light範圍裡面的話當作很近
+			const float distance = std::max(glm::length(light.position - m_cameraPosition) - light.radius, 0.01f);
+			const float screenSize = 2.f * light.radius / distance * m_pixelScale;
+			const float intensity = std::max(light.color.r, std::max(light.color.g, light.color.b));
+			candidates.push_back({ pointLightIndex, HashLight(light.position, light.radius), screenSize * intensity, screenSize * m_settings.faceSizeScale, 0, faceMask });
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+			return a.importance > b.importance;
+			});
+		if (candidates.size() > m_settings.maxShadowedLights)
+			candidates.resize(m_settings.maxShadowedLights);
+
+		// 依importance決定face大小，總面積超過atlas的話降低解析度，還是不夠就沒有shadow
+		const uint64_t atlasArea = static_cast<uint64_t>(m_settings.atlasSize) * m_settings.atlasSize;
+		uint64_t usedArea = 0;
+		for (auto& candidate : candidates) {
+			uint32_t faceSize = 0;
+			auto it = m_records.find(candidate.key);
+			if (it != m_records.end() && it->second.faceSize != 0
+				&& candidate.desiredSize >= it->second.faceSize * 0.5f && candidate.desiredSize < it->second.faceSize * 2.f) {
+				// 差不到兩倍的話保留原本的大小，cache不會因為相機稍微移動就失效
+				faceSize = it->second.faceSize;
+			}
+			else {
+				faceSize = std::bit_floor(static_cast<uint32_t>(std::max(candidate.desiredSize, 1.f)));
+			}
+			faceSize = std::clamp(faceSize, m_settings.minFaceSize, m_settings.maxFaceSize);
+
+			const uint64_t faceCount = std::popcount(candidate.faceMask);
+			while (usedArea + faceCount * faceSize * faceSize > atlasArea && faceSize > m_settings.minFaceSize)
+				faceSize /= 2;
+			if (usedArea + faceCount * faceSize * faceSize > atlasArea)
+				continue;
+
+			candidate.faceSize = faceSize;
+			usedArea += faceCount * faceSize * faceSize;
+		}
+
+		// 這個frame沒有選到的light釋放slot
+		for (auto& [key, record] : m_records)
+			record.used = false;
+		for (const auto& candidate : candidates) {
+			if (candidate.faceSize != 0)
+				m_records[candidate.key].used = true;
+		}
+		for (auto it = m_records.begin(); it != m_records.end();) {
+			if (!it->second.used) {
+				releaseRecord(it->second);
+				it = m_records.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+
+		// 大小改變或看不到的face先釋放，之後分配才有空間
+		for (const auto& candidate : candidates) {
+			if (candidate.faceSize == 0)
+				continue;
+			LightRecord& record = m_records[candidate.key];
+			if (record.faceSize != candidate.faceSize) {
+				releaseRecord(record);
+				record.faceSize = candidate.faceSize;
+			}
+			for (uint32_t face = 0; face < FaceCount; face++) {
+				if (!(candidate.faceMask & (1 << face)) && record.faceNodes[face] != NoShadow) {
+					m_slots.free(record.faceNodes[face]);
+					record.faceNodes[face] = NoShadow;
+					record.faceValid[face] = false;
+				}
+			}
+		}
+
+		for (const auto& candidate : candidates) {
+			if (candidate.faceSize == 0)
+				continue;
+			LightRecord& record = m_records[candidate.key];
+
+			bool allocated = true;
+			for (uint32_t face = 0; face < FaceCount && allocated; face++) {
+				if (!(candidate.faceMask & (1 << face)) || record.faceNodes[face] != NoShadow)
+					continue;
+				record.faceNodes[face] = m_slots.allocate(record.faceSize);
+				record.faceValid[face] = false;
+				allocated = record.faceNodes[face] != NoShadow;
+			}
+			if (!allocated) {
+				// 碎片太多放不下，這個frame沒有shadow
+				releaseRecord(record);
+				m_records.erase(candidate.key);
+				continue;
+			}
+
+			const PointLightData& light = lightCullPass.getPointLight(candidate.pointLightIndex);
+			const uint32_t lightSlot = static_cast<uint32_t>(m_frameLights.size());
+			m_frameLights.push_back({ candidate.pointLightIndex, light.position, light.radius, &record });
+
+			auto& lightFaces = m_lightFaces.emplace_back();
+			lightFaces.fill(NoShadow);
+			const glm::mat4 proj = glm::perspectiveRH_ZO(glm::radians(90.f), 1.f, m_settings.nearPlane, light.radius);
+			for (uint32_t face = 0; face < FaceCount; face++) {
+				if (record.faceNodes[face] == NoShadow)
+					continue;
+
+				lightFaces[face] = static_cast<uint32_t>(m_faces.size());
+				Face& faceData = m_faces.emplace_back();
+				faceData.lightSlot = lightSlot;
+				faceData.faceIndex = face;
+				faceData.viewProj = proj * glm::lookAt(light.position, light.position + s_faceDirections[face], s_faceUps[face]);
+				faceData.frustum = Frustum::Extract(faceData.viewProj);
+			}
+		}
+
+		PE_FRAME_STAT_COUNT("Point Shadow Lights", static_cast<uint32_t>(m_frameLights.size()));
+		PE_FRAME_STAT_COUNT("Point Shadow Faces", static_cast<uint32_t>(m_faces.size()));
+		PE_FRAME_STAT_COUNT("Point Shadow Atlas Used Texels", atlasArea - m_slots.getFreeArea());
+	}
+
+	void PointShadowAtlas::processScene(Ref<Scene> scene)
+	{
+		if (m_faces.empty())
+			return;
+
+		PE_PROFILE_FUNCTION();
+		PE_FRAME_STAT_SCOPE("CPU Shadow Culling");
+
+		const auto scene_group = scene->getRegistry().group<MeshComponent>(entt::get<TransformComponent, MeshRendererComponent>);
+		const auto group_start = scene_group.begin();
+
+		JobSystem* jobSystem = Application::GetJobSystem();
+		const uint32_t entity_count = static_cast<uint32_t>(scene_group.size());
+
+		jobSystem->parallelFor(entity_count, jobSystem->getGrainSize(entity_count), [&](uint32_t begin, uint32_t end)
+			{
+				PE_PROFILE_SCOPE("Worker thread cull point shadow casters");
+				std::vector<std::vector<ShadowDrawList::Caster>> localCasters(m_faces.size());
+				std::vector<uint64_t> localStaticHash(m_faces.size(), 0);
+				std::vector<uint8_t> localDynamic(m_faces.size(), 0);
+
+				auto it = std::next(group_start, begin);
+				for (uint32_t i = begin; i < end; i++, ++it)
+				{
+					auto entity = *it;
+					const auto& meshCom = scene_group.get<MeshComponent>(entity);
+					const auto& meshRendererCom = scene_group.get<MeshRendererComponent>(entity);
+					if (!meshRendererCom.visible || !meshRendererCom.renderStatic || !meshRendererCom.castShadow || !meshCom.mesh)
+						continue;
+
+					const auto& transform = scene_group.get<TransformComponent>(entity).transform;
+					// skin過的mesh每個frame都會變，當作會動的caster
+					const Ref<Mesh>& mesh = m_skinningPass ? m_skinningPass->resolveMesh(&meshCom, meshCom.mesh) : meshCom.mesh;
+					cullCaster(mesh.get(), transform.matrix(), meshCom.worldAABB, meshRendererCom.isStatic && mesh == meshCom.mesh, localCasters, localStaticHash, localDynamic);
+				}
+				mergeCasters(localCasters, localStaticHash, localDynamic);
+			});
+	}
+
+	void PointShadowAtlas::processSnapshot(const SceneSnapshot& snapshot)
+	{
+		if (m_faces.empty())
+			return;
+
+		PE_PROFILE_FUNCTION();
+		PE_FRAME_STAT_SCOPE("CPU Shadow Culling");
+
+		JobSystem* jobSystem = Application::GetJobSystem();
+		const uint32_t instance_count = static_cast<uint32_t>(snapshot.meshInstances.size());
+
+		jobSystem->parallelFor(instance_count, jobSystem->getGrainSize(instance_count), [&](uint32_t begin, uint32_t end)
+			{
+				PE_PROFILE_SCOPE("Worker thread cull point shadow casters");
+				std::vector<std::vector<ShadowDrawList::Caster>> localCasters(m_faces.size());
+				std::vector<uint64_t> localStaticHash(m_faces.size(), 0);
+				std::vector<uint8_t> localDynamic(m_faces.size(), 0);
+
+				for (uint32_t i = begin; i < end; i++)
+				{
+					const auto& instance = snapshot.meshInstances[i];
+					if (!instance.castShadow)
+						continue;
+					const Ref<Mesh>& mesh = m_skinningPass ? m_skinningPass->resolveMesh(&instance, instance.mesh) : instance.mesh;
+					cullCaster(mesh.get(), instance.matrix, instance.worldAABB, instance.isStatic && mesh == instance.mesh, localCasters, localStaticHash, localDynamic);
+				}
+				mergeCasters(localCasters, localStaticHash, localDynamic);
+			});
+	}
+
+	void PointShadowAtlas::cullCaster(Mesh* mesh, const glm::mat4& matrix, const AABB& worldAABB, bool isStatic,
+		std::vector<std::vector<ShadowDrawList::Caster>>& localCasters, std::vector<uint64_t>& localStaticHash, std::vector<uint8_t>& localDynamic) const
+	{
+		uint64_t hash = 0;
+		for (uint32_t lightSlot = 0; lightSlot < m_frameLights.size(); lightSlot++) {
+			const FrameLight& light = m_frameLights[lightSlot];
+			if (!BoundingSphere(light.position, light.radius).isIntersect(worldAABB))
+				continue;
+
+			for (uint32_t faceIndex : m_lightFaces[lightSlot]) {
+				if (faceIndex == NoShadow || !m_faces[faceIndex].frustum.isIntersect(worldAABB))
+					continue;
+
+				localCasters[faceIndex].push_back({ mesh, matrix });
+				if (isStatic) {
+					if (hash == 0)
+						hash = ShadowDrawList::HashCaster(mesh, worldAABB);
+					localStaticHash[faceIndex] += hash;
+				}
+				else {
+					localDynamic[faceIndex] = 1;
+				}
+			}
+		}
+	}
+
+	void PointShadowAtlas::mergeCasters(const std::vector<std::vector<ShadowDrawList::Caster>>& localCasters, const std::vector<uint64_t>& localStaticHash, const std::vector<uint8_t>& localDynamic)
+	{
+		std::lock_guard<std::mutex> lock(m_mergeMutex);
+		for (size_t i = 0; i < m_faces.size(); i++) {
+			if (localCasters[i].empty())
+				continue;
+
+			Face& face = m_faces[i];
+			face.drawList.append(localCasters[i]);
+			face.staticHash += localStaticHash[i];
+			face.hasDynamicCaster |= localDynamic[i] != 0;
+		}
+	}
+
+	bool PointShadowAtlas::upload(uint32_t pointLightCount)
+	{
+		PE_PROFILE_FUNCTION();
+
+		m_instanceAllocation = {};
+		m_indirectArgs = {};
+
+		// 有會動的caster、slot是新的或static caster改變的face才重畫
+		uint32_t totalInstanceCount = 0;
+		uint32_t totalDrawCount = 0;
+		for (auto& face : m_faces) {
+			const LightRecord& record = *m_frameLights[face.lightSlot].record;
+			face.render = face.hasDynamicCaster
+				|| !record.faceValid[face.faceIndex]
+				|| record.renderedStaticHash[face.faceIndex] != face.staticHash;
+			if (!face.render)
+				continue;
+
+			totalDrawCount += face.drawList.sort();
+			totalInstanceCount += face.drawList.getInstanceCount();
+		}
+
+		FrameUploadAllocator* uploadAllocator = Application::GetFrameUploadAllocator();
+		bool uploaded = true;
+		if (totalDrawCount > 0) {
+			m_instanceAllocation = uploadAllocator->allocate(totalInstanceCount * sizeof(glm::mat4));
+			m_indirectArgs = uploadAllocator->allocate(totalDrawCount * sizeof(nvrhi::DrawIndexedIndirectArguments));
+			uploaded = m_instanceAllocation.isValid() && m_indirectArgs.isValid();
+		}
+
+		auto* instanceData = static_cast<glm::mat4*>(m_instanceAllocation.mapPtr);
+		auto* indirectArgs = static_cast<nvrhi::DrawIndexedIndirectArguments*>(m_indirectArgs.mapPtr);
+		uint32_t instanceOffset = 0;
+		uint32_t argsCount = 0;
+		for (auto& face : m_faces) {
+			face.bindingSet = nullptr;
+			if (!uploaded || !face.render || face.drawList.empty())
+				continue;
+
+			face.faceDataAllocation = uploadAllocator->upload(&face.viewProj, 1);
+			if (!face.faceDataAllocation.isValid()) {
+				uploaded = false;
+				continue;
+			}
+
+			nvrhi::BindingSetDesc setDesc;
+			setDesc
+				.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, face.faceDataAllocation.buffer, face.faceDataAllocation.getRange()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_instanceAllocation.buffer, nvrhi::Format::UNKNOWN, m_instanceAllocation.getRange()));
+			face.bindingSet = Application::GetNVRHIDevice()->createBindingSet(setDesc, m_bindingLayout->handle);
+
+			face.drawList.write(instanceData, instanceOffset, indirectArgs, argsCount);
+		}
+
+		// shader用的資料，上傳失敗的話這個frame所有point light都沒有shadow
+		std::vector<uint32_t> shadowIndices(std::max(pointLightCount, 1u), NoShadow);
+		std::vector<PointShadowData> shadowData(std::max<size_t>(m_frameLights.size(), 1));
+		if (uploaded) {
+			const float atlasSize = static_cast<float>(m_settings.atlasSize);
+			for (uint32_t lightSlot = 0; lightSlot < m_frameLights.size(); lightSlot++) {
+				const FrameLight& light = m_frameLights[lightSlot];
+				if (light.pointLightIndex < pointLightCount)
+					shadowIndices[light.pointLightIndex] = lightSlot;
+
+				PointShadowData& data = shadowData[lightSlot];
+				data.normalBias = m_settings.normalBias;
+				for (uint32_t face = 0; face < FaceCount; face++) {
+					const uint32_t faceIndex = m_lightFaces[lightSlot][face];
+					if (faceIndex == NoShadow) {
+						data.faceViewProj[face] = glm::mat4(1.f);
+						data.faceRect[face] = glm::vec4(0.f);
+						continue;
+					}
+					data.faceViewProj[face] = m_faces[faceIndex].viewProj;
+					data.faceRect[face] = glm::vec4(m_slots.getRect(light.record->faceNodes[face])) / atlasSize;
+				}
+			}
+		}
+		else {
+			for (auto& face : m_faces)
+				face.render = false;
+		}
+
+		m_shadowIndexAllocation = uploadAllocator->upload(shadowIndices.data(), shadowIndices.size());
+		m_shadowDataAllocation = uploadAllocator->upload(shadowData.data(), shadowData.size());
+
+		PE_FRAME_STAT_COUNT("Point Shadow Caster Instances", instanceOffset);
+		PE_FRAME_STAT_BYTES("Point Shadow Upload", instanceOffset * sizeof(glm::mat4) + shadowData.size() * sizeof(PointShadowData));
+		return m_shadowIndexAllocation.isValid() && m_shadowDataAllocation.isValid();
+	}
+
+	bool PointShadowAtlas::needsRender() const
+	{
+		for (const auto& face : m_faces) {
+			if (face.render)
+				return true;
+		}
+		return false;
+	}
+
+	void PointShadowAtlas::render(nvrhi::ICommandList* cmd)
+	{
+		PE_PROFILE_FUNCTION();
+		PE_PROFILE_GPU_SCOPE(cmd, "Point Shadow Atlas");
+
+		PipelineRenderState renderState;
+		renderState.depthBias = m_settings.depthBias;
+		renderState.slopeScaledDepthBias = m_settings.slopeScaledDepthBias;
+
+		// clearDepthStencilTexture只能清整張，slot用depth為1的三角形蓋掉
+		PipelineRenderState clearState;
+		clearState.cullMode = nvrhi::RasterCullMode::None;
+		clearState.depthFunc = nvrhi::ComparisonFunc::Always;
+
+		uint32_t renderedCount = 0;
+		uint32_t cachedCount = 0;
+		for (auto& face : m_faces) {
+			LightRecord& record = *m_frameLights[face.lightSlot].record;
+			if (!face.render) {
+				cachedCount++;
+				continue;
+			}
+
+			const glm::uvec4 rect = m_slots.getRect(record.faceNodes[face.faceIndex]);
+			nvrhi::GraphicsState graphicsState;
+			graphicsState.setFramebuffer(m_framebuffer);
+			graphicsState.viewport.addViewportAndScissorRect(nvrhi::Viewport(
+				static_cast<float>(rect.x),
+				static_cast<float>(rect.x + rect.z),
+				static_cast<float>(rect.y),
+				static_cast<float>(rect.y + rect.w),
+				0,
+				1));
+
+			if (m_clearPipeline) {
+				m_clearPipeline->bind(graphicsState, m_framebuffer, clearState);
+				cmd->setGraphicsState(graphicsState);
+				cmd->draw(nvrhi::DrawArguments().setVertexCount(3));
+			}
+
+			if (face.bindingSet && m_pipeline) {
+				graphicsState.bindings.resize(1);
+				graphicsState.bindings[0] = face.bindingSet;
+				m_pipeline->bind(graphicsState, m_framebuffer, renderState);
+				face.drawList.record(cmd, graphicsState, m_indirectArgs);
+			}
+
+			record.faceValid[face.faceIndex] = true;
+			record.renderedStaticHash[face.faceIndex] = face.staticHash;
+			renderedCount++;
+		}
+
+		PE_FRAME_STAT_COUNT("Point Shadow Faces Rendered", renderedCount);
+		PE_FRAME_STAT_COUNT("Point Shadow Faces Cached", cachedCount);
+	}
+
+	void PointShadowAtlas::endFrame()
+	{
+		for (auto& face : m_faces) {
+			face.drawList.clear();
+			face.bindingSet = nullptr;
+		}
+	}
+
+}
@@ -0,0 +1,273 @@
+﻿#pragma once
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/scene/Scene.h>
+#include <PaperEngine/graphics/GraphicsPipeline.h>
+#include <PaperEngine/graphics/SceneSnapshot.h>
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
+#include <PaperEngine/utils/BoundingVolume.h>
+
+#include "BindingLayout.h"
+#include "LightCullingPass.h"
+#include "ShadowDrawList.h"
+#include "SkinningPass.h"
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// Point light的shadow放在一張depth atlas中
+	/// 
+	/// 每個frame從LightCullingPass的visible set (camera frustum中、castShadow的point light) 選light
+	/// importance = 畫面上的大小 * 亮度，依importance排序，face大小依畫面上的大小決定 (2的次方)
+	/// atlas放不下的light降低解析度，還是放不下就沒有shadow，所以成本由atlas大小決定，不是light數量
+	/// 
+	/// 每個light最多6個cube face，跟camera frustum沒有交集的face不分配也不畫
+	/// slot用quadtree (buddy) 分配，light的位置跟半徑沒變的話保留原本的slot
+	/// face中只有static caster，而且static caster (mesh + worldAABB) 沒變的話沿用上次的內容
+	/// atlas是RenderGraph的transient texture (getAtlasDesc)，memory被其他transient用過的話所有face重畫，slot不變
+	/// 
+	/// 使用順序：beginPass -> allocate -> processScene/processSnapshot -> setAtlas -> upload -> render -> endFrame
+	/// </summary>
+	class PointShadowAtlas {
+	public:
+		static constexpr uint32_t FaceCount = 6;
+		static constexpr uint32_t NoShadow = ~0u;
+
+		struct Settings {
+			uint32_t atlasSize = 4096;
+			uint32_t minFaceSize = 64;
+			uint32_t maxFaceSize = 512;
+			uint32_t maxShadowedLights = 32;
+			/// <summary>
+			/// face解析度 = light在畫面上的直徑 (pixel) * faceSizeScale
+			/// </summary>
+			float faceSizeScale = 0.5f;
+			float nearPlane = 0.05f;
+			int depthBias = 1;
+			float slopeScaledDepthBias = 2.0f;
+			/// <summary>
+			/// shader中沿著normal偏移幾個texel
+			/// </summary>
+			float normalBias = 1.0f;
+		};
+
+		/// <summary>
+		/// 跟shader的PointShadowData一樣
+		/// </summary>
+		struct PointShadowData {
+			glm::mat4 faceViewProj[FaceCount];
+			glm::vec4 faceRect[FaceCount];
+			float normalBias;
+			float padding[3];
+		};
+
+	public:
+		PointShadowAtlas() = default;
+
+		void init();
+
+		/// <summary>
+		/// process時用skinningPass的skinned output取代skeletal mesh
+		/// </summary>
+		void setSkinningPass(const SkinningPass* skinningPass) { m_skinningPass = skinningPass; }
+
+		/// <summary>
+		/// atlasSize改變的話所有slot跟cache失效，下一個frame的atlas desc跟著改變
+		/// </summary>
+		void setSettings(const Settings& settings);
+
+		const Settings& getSettings() const { return m_settings; }
+
+		/// <summary>
+		/// 需要先Call這個才能allocate
+		/// pixelScale跟MeshRenderer::setStreamingView一樣
+		/// </summary>
+		void beginPass(const glm::vec3& cameraPosition, float pixelScale, const Frustum& cameraFrustum);
+
+		/// <summary>
+		/// light process完之後呼叫，選出這個frame有shadow的light跟face並分配atlas slot
+		/// </summary>
+		void allocate(const LightCullingPass& lightCullPass);
+
+		/// <summary>
+		/// 對每個分配到的face做culling，收集caster
+		/// </summary>
+		void processScene(Ref<Scene> scene);
+
+		void processSnapshot(const SceneSnapshot& snapshot);
+
+		/// <summary>
+		/// process完之後呼叫，shadow data、instance data跟indirect args上傳到FrameUploadAllocator
+		/// 失敗的話回傳false
+		/// </summary>
+		/// <param name="pointLightCount">point light buffer的大小，每個light一個shadow index</param>
+		bool upload(uint32_t pointLightCount);
+
+		/// <summary>
+		/// 畫需要更新的face，atlas的state由NVRHI自動轉換 (DepthWrite)
+		/// </summary>
+		void render(nvrhi::ICommandList* cmd);
+
+		void endFrame();
+
+		bool needsRender() const;
+
+		/// <summary>
+		/// allocate後有效，這個frame有沒有分配到slot的face
+		/// </summary>
+		bool hasFaces() const { return !m_faces.empty(); }
+
+		/// <summary>
+		/// 用來建立RenderGraph的transient texture，keepInitialState (ShaderResource)，MeshRenderer的worker command list也會讀
+		/// </summary>
+		nvrhi::TextureDesc getAtlasDesc() const;
+
+		/// <summary>
+		/// RenderGraph compile後呼叫，upload之前
+		/// texture改變的話重新建立framebuffer，contentPreserved為false的話所有face的內容失效
+		/// </summary>
+		void setAtlas(nvrhi::ITexture* atlas, bool contentPreserved);
+
+		nvrhi::ITexture* getAtlas() const { return m_atlas; }
+
+		/// <summary>
+		/// upload後才有效
+		/// </summary>
+		const FrameUploadAllocation& getShadowIndexAllocation() const { return m_shadowIndexAllocation; }
+		const FrameUploadAllocation& getShadowDataAllocation() const { return m_shadowDataAllocation; }
+
+	private:
+		/// <summary>
+		/// atlas的quadtree，node 0是整張atlas，node i的child是 4i+1 ~ 4i+4
+		/// </summary>
+		class SlotAllocator {
+		public:
+			void reset(uint32_t atlasSize, uint32_t minSize);
+
+			/// <summary>
+			/// 分配size x size的slot，失敗回傳NoShadow
+			/// </summary>
+			uint32_t allocate(uint32_t size);
+
+			void free(uint32_t node);
+
+			/// <summary>
+			/// slot在atlas中的位置 (pixel)
+			/// </summary>
+			glm::uvec4 getRect(uint32_t node) const;
+
+			/// <summary>
+			/// 還沒分配的面積 (pixel)
+			/// </summary>
+			uint64_t getFreeArea() const { return m_freeArea; }
+
+		private:
+			enum class NodeState : uint8_t {
+				Free,
+				Split,
+				Used
+			};
+
+			uint32_t findFree(uint32_t node, uint32_t depth, uint32_t targetDepth, bool allowSplit);
+
+			uint32_t getDepth(uint32_t node) const;
+
+		private:
+			uint32_t m_atlasSize = 0;
+			uint32_t m_maxDepth = 0;
+			std::vector<NodeState> m_nodes;
+			uint64_t m_freeArea = 0;
+		};
+
+		/// <summary>
+		/// 跨frame保留的light狀態，以位置跟半徑為key
+		/// </summary>
+		struct LightRecord {
+			uint32_t faceSize = 0;
+			std::array<uint32_t, FaceCount> faceNodes;
+			std::array<bool, FaceCount> faceValid;
+			std::array<uint64_t, FaceCount> renderedStaticHash;
+			bool used = false;
+
+			LightRecord() { faceNodes.fill(NoShadow); faceValid.fill(false); renderedStaticHash.fill(0); }
+		};
+
+		/// <summary>
+		/// 這個frame有shadow的light
+		/// </summary>
+		struct FrameLight {
+			uint32_t pointLightIndex;
+			glm::vec3 position;
+			float radius;
+			LightRecord* record;
+		};
+
+		/// <summary>
+		/// 這個frame分配到slot的face
+		/// </summary>
+		struct Face {
+			uint32_t lightSlot;			// m_frameLights中的index
+			uint32_t faceIndex;
+			glm::mat4 viewProj;
+			Frustum frustum;
+			bool render = false;
+
+			ShadowDrawList drawList;
+			uint64_t staticHash = 0;
+			bool hasDynamicCaster = false;
+
+			FrameUploadAllocation faceDataAllocation;
+			nvrhi::BindingSetHandle bindingSet;
+		};
+
+	private:
+		/// <summary>
+		/// 釋放light所有的slot
+		/// </summary>
+		void releaseRecord(LightRecord& record);
+
+		void cullCaster(Mesh* mesh, const glm::mat4& matrix, const AABB& worldAABB, bool isStatic,
+			std::vector<std::vector<ShadowDrawList::Caster>>& localCasters, std::vector<uint64_t>& localStaticHash, std::vector<uint8_t>& localDynamic) const;
+
+		void mergeCasters(const std::vector<std::vector<ShadowDrawList::Caster>>& localCasters, const std::vector<uint64_t>& localStaticHash, const std::vector<uint8_t>& localDynamic);
+
+		static uint64_t HashLight(const glm::vec3& position, float radius);
+
+	private:
+		Settings m_settings;
+		const SkinningPass* m_skinningPass = nullptr;
+
+		nvrhi::TextureHandle m_atlas;
+		nvrhi::FramebufferHandle m_framebuffer;
+
+		Ref<GraphicsPipeline> m_pipeline;
+		// 清除atlas中的一個slot
+		Ref<GraphicsPipeline> m_clearPipeline;
+		BindingLayoutHandle m_bindingLayout;
+
+		SlotAllocator m_slots;
+		std::unordered_map<uint64_t, LightRecord> m_records;
+
+		glm::vec3 m_cameraPosition{ 0.f };
+		float m_pixelScale = 0.f;
+		Frustum m_cameraFrustum{};
+
+		std::vector<FrameLight> m_frameLights;
+		std::vector<Face> m_faces;
+		// [light][face] 在m_faces中的index
+		std::vector<std::array<uint32_t, FaceCount>> m_lightFaces;
+		std::mutex m_mergeMutex;
+
+		FrameUploadAllocation m_shadowIndexAllocation;
+		FrameUploadAllocation m_shadowDataAllocation;
+		FrameUploadAllocation m_instanceAllocation;
+		FrameUploadAllocation m_indirectArgs;
+	};
+
+}
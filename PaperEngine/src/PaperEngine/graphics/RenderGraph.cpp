@@ -0,0 +1,459 @@
+﻿#include "RenderGraph.h"
+
+#include <algorithm>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/core/Assert.h>
+#include <PaperEngine/core/Logger.h>
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	namespace {
+
+		bool IsSameTextureDesc(const nvrhi::TextureDesc& a, const nvrhi::TextureDesc& b)
+		{
+			return a.width == b.width &&
+				a.height == b.height &&
+				a.depth == b.depth &&
+				a.arraySize == b.arraySize &&
+				a.mipLevels == b.mipLevels &&
+				a.sampleCount == b.sampleCount &&
+				a.format == b.format &&
+				a.dimension == b.dimension &&
+				a.isRenderTarget == b.isRenderTarget &&
+				a.isUAV == b.isUAV &&
+				a.isTypeless == b.isTypeless &&
+				a.keepInitialState == b.keepInitialState &&
+				a.initialState == b.initialState;
+		}
+
+		uint64_t AlignUp(uint64_t value, uint64_t alignment)
+		{
+			return alignment == 0 ? value : (value + alignment - 1) / alignment * alignment;
+		}
+
+		// heap以這個大小為單位成長，避免每次多一點就重新建立
+		constexpr uint64_t HeapGranularity = 16ull * 1024 * 1024;
+
+	}
+
+#pragma region RenderGraphBuilder
+
+	RenderGraphTexture RenderGraphBuilder::read(RenderGraphTexture texture, nvrhi::ResourceStates state)
+	{
+		PE_CORE_ASSERT(texture.index < m_graph.m_textures.size(), "Invalid render graph texture.");
+		m_graph.m_passes[m_passIndex].textureAccesses.push_back({ texture.index, state, false });
+		return texture;
+	}
+
+	RenderGraphTexture RenderGraphBuilder::write(RenderGraphTexture texture, nvrhi::ResourceStates state)
+	{
+		PE_CORE_ASSERT(texture.index < m_graph.m_textures.size(), "Invalid render graph texture.");
+		m_graph.m_passes[m_passIndex].textureAccesses.push_back({ texture.index, state, true });
+		return texture;
+	}
+
+	RenderGraphBuffer RenderGraphBuilder::read(RenderGraphBuffer buffer, nvrhi::ResourceStates state)
+	{
+		PE_CORE_ASSERT(buffer.index < m_graph.m_buffers.size(), "Invalid render graph buffer.");
+		m_graph.m_passes[m_passIndex].bufferAccesses.push_back({ buffer.index, state, false });
+		return buffer;
+	}
+
+	RenderGraphBuffer RenderGraphBuilder::write(RenderGraphBuffer buffer, nvrhi::ResourceStates state)
+	{
+		PE_CORE_ASSERT(buffer.index < m_graph.m_buffers.size(), "Invalid render graph buffer.");
+		m_graph.m_passes[m_passIndex].bufferAccesses.push_back({ buffer.index, state, true });
+		return buffer;
+	}
+
+	void RenderGraphBuilder::setSideEffect()
+	{
+		m_graph.m_passes[m_passIndex].sideEffect = true;
+	}
+
+#pragma endregion
+
+#pragma region RenderGraphContext
+
+	nvrhi::ITexture* RenderGraphContext::getTexture(RenderGraphTexture texture) const
+	{
+		return m_graph.getTexture(texture);
+	}
+
+	nvrhi::IBuffer* RenderGraphContext::getBuffer(RenderGraphBuffer buffer) const
+	{
+		PE_CORE_ASSERT(buffer.index < m_graph.m_buffers.size(), "Invalid render graph buffer.");
+		return m_graph.m_buffers[buffer.index].buffer;
+	}
+
+#pragma endregion
+
+	RenderGraph::RenderGraph()
+	{
+	}
+
+	RenderGraph::~RenderGraph()
+	{
+		Application::GetGPUMemoryAllocator()->free(m_heapMemory);
+	}
+
+	void RenderGraph::reset()
+	{
+		m_passes.clear();
+		m_textures.clear();
+		m_buffers.clear();
+		m_transients.clear();
+		m_culledPassCount = 0;
+		m_transientRequestedSize = 0;
+		m_compiled = false;
+	}
+
+	RenderGraphTexture RenderGraph::importTexture(const char* name, nvrhi::ITexture* texture)
+	{
+		TextureResource resource;
+		resource.name = name;
+		resource.desc = texture->getDesc();
+		resource.texture = texture;
+		resource.imported = true;
+		resource.preserved = true;
+		m_textures.push_back(std::move(resource));
+		return { static_cast<uint32_t>(m_textures.size() - 1) };
+	}
+
+	RenderGraphTexture RenderGraph::createTexture(const nvrhi::TextureDesc& desc)
+	{
+		PE_CORE_ASSERT(!m_compiled, "Render graph already compiled, call reset first.");
+
+		TextureResource resource;
+		resource.name = desc.debugName;
+		resource.desc = desc;
+		resource.desc.isVirtual = true;
+		if (!resource.desc.keepInitialState)
+			resource.desc.initialState = nvrhi::ResourceStates::Unknown;
+		m_textures.push_back(std::move(resource));
+		return { static_cast<uint32_t>(m_textures.size() - 1) };
+	}
+
+	RenderGraphBuffer RenderGraph::importBuffer(const char* name, nvrhi::IBuffer* buffer)
+	{
+		m_buffers.push_back({ name, buffer });
+		return { static_cast<uint32_t>(m_buffers.size() - 1) };
+	}
+
+	void RenderGraph::addPass(const char* name, const SetupFunction& setup, ExecuteFunction execute)
+	{
+		PE_CORE_ASSERT(!m_compiled, "Render graph already compiled, call reset first.");
+
+		Pass pass;
+		pass.name = name;
+		pass.execute = std::move(execute);
+		m_passes.push_back(std::move(pass));
+
+		RenderGraphBuilder builder(*this, static_cast<uint32_t>(m_passes.size() - 1));
+		if (setup)
+			setup(builder);
+	}
+
+	void RenderGraph::compile()
+	{
+		PE_PROFILE_FUNCTION();
+
+		cullPasses();
+		allocateTransients();
+		m_compiled = true;
+
+		PE_FRAME_STAT_COUNT("RenderGraph Passes", getPassCount() - m_culledPassCount);
+		PE_FRAME_STAT_COUNT("RenderGraph Culled Passes", m_culledPassCount);
+		PE_FRAME_STAT_BYTES("RenderGraph Transient Requested", m_transientRequestedSize);
+		PE_FRAME_STAT_BYTES("RenderGraph Transient Heap", m_heapSize);
+	}
+
+	void RenderGraph::execute(nvrhi::ICommandList* cmd)
+	{
+		PE_PROFILE_FUNCTION();
+		PE_CORE_ASSERT(m_compiled, "Render graph is not compiled.");
+
+		auto graphicsContext = Application::Get()->getGraphicsContext();
+		const RenderGraphContext context(*this, cmd);
+		for (uint32_t passIndex = 0; passIndex < m_passes.size(); passIndex++) {
+			Pass& pass = m_passes[passIndex];
+			if (pass.culled)
+				continue;
+
+#ifdef PE_PROFILE
+			InstrumentationTimer timer(pass.name);
+#endif // PE_PROFILE
+
+			// 內容沒有保留的transient，memory之前可能被別的resource (這個frame或之前的frame) 寫過
+			// NVRHI從Unknown轉換的barrier不會等之前的寫入，要先插一個全域的barrier
+			const bool aliasing = std::any_of(pass.textureAccesses.begin(), pass.textureAccesses.end(), [this](const ResourceAccess& access) {
+				const TextureResource& resource = m_textures[access.resource];
+				return !resource.imported && resource.firstUse && !resource.preserved;
+				});
+			if (aliasing)
+				graphicsContext->insertAliasingBarrier(cmd);
+
+			// 這個pass需要的state一次設定，只commit一次
+			for (const auto& access : pass.textureAccesses) {
+				TextureResource& resource = m_textures[access.resource];
+				if (!resource.imported && resource.firstUse) {
+					if (!resource.preserved)
+						cmd->beginTrackingTextureState(resource.texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Unknown);
+					resource.firstUse = false;
+				}
+				if (access.state != nvrhi::ResourceStates::Unknown)
+					cmd->setTextureState(resource.texture, nvrhi::AllSubresources, access.state);
+			}
+			for (const auto& access : pass.bufferAccesses) {
+				if (access.state != nvrhi::ResourceStates::Unknown)
+					cmd->setBufferState(m_buffers[access.resource].buffer, access.state);
+			}
+			cmd->commitBarriers();
+
+			if (pass.execute)
+				pass.execute(context);
+
+			// command list close時才轉回initialState的話，這塊memory可能已經給之後的transient使用
+			for (const auto& access : pass.textureAccesses) {
+				const TextureResource& resource = m_textures[access.resource];
+				if (!resource.imported && resource.desc.keepInitialState && resource.lastPass == passIndex)
+					cmd->setTextureState(resource.texture, nvrhi::AllSubresources, resource.desc.initialState);
+			}
+		}
+	}
+
+	nvrhi::ITexture* RenderGraph::getTexture(RenderGraphTexture texture) const
+	{
+		PE_CORE_ASSERT(texture.index < m_textures.size(), "Invalid render graph texture.");
+		return m_textures[texture.index].texture;
+	}
+
+	bool RenderGraph::isContentPreserved(RenderGraphTexture texture) const
+	{
+		PE_CORE_ASSERT(texture.index < m_textures.size(), "Invalid render graph texture.");
+		PE_CORE_ASSERT(m_compiled, "Render graph is not compiled.");
+		return m_textures[texture.index].preserved;
+	}
+
+	void RenderGraph::cullPasses()
+	{
+		// 從後面往前：有side effect、寫入imported resource、或寫入後面的pass需要的resource才保留
+		std::vector<bool> neededTextures(m_textures.size(), false);
+
+		m_culledPassCount = 0;
+		for (size_t i = m_passes.size(); i-- > 0; ) {
+			Pass& pass = m_passes[i];
+
+			bool alive = pass.sideEffect;
+			for (const auto& access : pass.textureAccesses) {
+				if (access.write && (m_textures[access.resource].imported || neededTextures[access.resource]))
+					alive = true;
+			}
+			// buffer都是imported
+			for (const auto& access : pass.bufferAccesses) {
+				if (access.write)
+					alive = true;
+			}
+
+			pass.culled = !alive;
+			if (!alive) {
+				m_culledPassCount++;
+				continue;
+			}
+
+			for (const auto& access : pass.textureAccesses) {
+				if (!access.write)
+					neededTextures[access.resource] = true;
+			}
+		}
+	}
+
+	void RenderGraph::allocateTransients()
+	{
+		auto device = Application::GetNVRHIDevice();
+
+		// 生命週期只算沒被cull的pass
+		for (uint32_t i = 0; i < m_passes.size(); i++) {
+			if (m_passes[i].culled)
+				continue;
+			for (const auto& access : m_passes[i].textureAccesses) {
+				TextureResource& resource = m_textures[access.resource];
+				if (resource.imported)
+					continue;
+				if (resource.firstPass == ~0u) {
+					resource.firstPass = i;
+					m_transients.push_back(access.resource);
+				}
+				resource.lastPass = i;
+			}
+		}
+
+		// 每種desc的memory requirement從cache裡的texture拿，沒有的話建一個還沒bind的virtual texture
+		for (uint32_t index : m_transients) {
+			TextureResource& resource = m_textures[index];
+			auto cached = std::find_if(m_textureCache.begin(), m_textureCache.end(), [&](const CachedTexture& entry) {
+				return IsSameTextureDesc(entry.desc, resource.desc);
+				});
+			if (cached == m_textureCache.end()) {
+				nvrhi::TextureHandle texture = device->createTexture(resource.desc);
+				PE_CORE_ASSERT(texture, "Failed to create render graph texture");
+				const uint64_t size = device->getTextureMemoryRequirements(texture).size;
+				m_textureCache.push_back({ resource.desc, 0, size, texture, false, 0, {}, false });
+				cached = m_textureCache.end() - 1;
+			}
+			resource.memoryRequirements = device->getTextureMemoryRequirements(cached->texture);
+			m_transientRequestedSize += resource.memoryRequirements.size;
+		}
+
+		// 大的先放，每個放在跟它生命週期重疊的allocation都不衝突的最低offset
+		std::vector<uint32_t> order = m_transients;
+		std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+			return m_textures[a].memoryRequirements.size > m_textures[b].memoryRequirements.size;
+			});
+
+		std::vector<uint32_t> placed;
+		uint64_t requiredSize = 0;
+		for (uint32_t index : order) {
+			TextureResource& resource = m_textures[index];
+			const uint64_t size = resource.memoryRequirements.size;
+			const uint64_t alignment = resource.memoryRequirements.alignment;
+
+			std::vector<uint32_t> overlapping;
+			for (uint32_t other : placed) {
+				const TextureResource& o = m_textures[other];
+				if (o.firstPass <= resource.lastPass && resource.firstPass <= o.lastPass)
+					overlapping.push_back(other);
+			}
+
+			std::vector<uint64_t> candidates{ 0 };
+			for (uint32_t other : overlapping) {
+				const TextureResource& o = m_textures[other];
+				candidates.push_back(AlignUp(o.heapOffset + o.memoryRequirements.size, alignment));
+			}
+			std::sort(candidates.begin(), candidates.end());
+
+			for (uint64_t offset : candidates) {
+				const bool fits = std::none_of(overlapping.begin(), overlapping.end(), [&](uint32_t other) {
+					const TextureResource& o = m_textures[other];
+					return offset < o.heapOffset + o.memoryRequirements.size && o.heapOffset < offset + size;
+					});
+				if (fits) {
+					resource.heapOffset = offset;
+					break;
+				}
+			}
+			requiredSize = std::max(requiredSize, resource.heapOffset + size);
+			placed.push_back(index);
+		}
+
+		if (requiredSize > m_heapSize) {
+			// 舊的heap上bind的texture都不能用了，GPU還在用的部分由nvrhi延後釋放
+			m_textureCache.erase(std::remove_if(m_textureCache.begin(), m_textureCache.end(), [](const CachedTexture& entry) {
+				return entry.bound;
+				}), m_textureCache.end());
+
+			GPUMemoryAllocator* allocator = Application::GetGPUMemoryAllocator();
+			allocator->free(m_heapMemory);
+
+			nvrhi::HeapDesc heapDesc;
+			heapDesc.capacity = AlignUp(requiredSize, HeapGranularity);
+			heapDesc.type = nvrhi::HeapType::DeviceLocal;
+			heapDesc.debugName = "RenderGraph_transientHeap";
+			m_heap = allocator->createHeap(heapDesc, GPUMemoryCategory::Texture, m_heapMemory);
+			PE_CORE_ASSERT(m_heap, "Failed to create the render graph transient heap");
+			m_heapSize = heapDesc.capacity;
+			PE_CORE_TRACE("[RenderGraph] Transient heap resized to {} MB.", m_heapSize / (1024 * 1024));
+		}
+
+		for (auto& entry : m_textureCache)
+			entry.unusedFrames++;
+
+		// 內容保留：上次是同一個transient用這個texture，之後memory沒被別人用過，這個frame在它之前也沒有
+		for (uint32_t index : m_transients) {
+			TextureResource& resource = m_textures[index];
+			bool newlyBound = false;
+			const CachedTexture& entry = acquireTexture(resource.desc, resource.heapOffset, resource.memoryRequirements.size, newlyBound);
+			resource.texture = entry.texture;
+			resource.firstUse = true;
+			resource.preserved = resource.desc.keepInitialState &&
+				!newlyBound &&
+				entry.contentValid &&
+				entry.lastUser == resource.name &&
+				!isMemoryUsedByOthers(resource.heapOffset, resource.memoryRequirements.size, index, 0, resource.firstPass);
+		}
+
+		// 給下一個frame判斷，desc一樣的transient可能在同一個frame拿到同一個texture，以最後使用的為準
+		for (auto& entry : m_textureCache) {
+			if (!entry.bound)
+				continue;
+
+			uint32_t user = ~0u;
+			for (uint32_t index : m_transients) {
+				if (m_textures[index].texture == entry.texture && (user == ~0u || m_textures[index].lastPass > m_textures[user].lastPass))
+					user = index;
+			}
+			if (user == ~0u) {
+				entry.contentValid = entry.contentValid && !isMemoryUsedByOthers(entry.heapOffset, entry.size, ~0u, 0, ~0u);
+				continue;
+			}
+
+			const TextureResource& resource = m_textures[user];
+			entry.lastUser = resource.name;
+			entry.contentValid = !isMemoryUsedByOthers(entry.heapOffset, entry.size, user, resource.lastPass + 1, ~0u);
+		}
+
+		m_textureCache.erase(std::remove_if(m_textureCache.begin(), m_textureCache.end(), [](const CachedTexture& entry) {
+			return entry.unusedFrames > MaxUnusedFrames;
+			}), m_textureCache.end());
+	}
+
+	RenderGraph::CachedTexture& RenderGraph::acquireTexture(const nvrhi::TextureDesc& desc, uint64_t heapOffset, uint64_t size, bool& outNewlyBound)
+	{
+		outNewlyBound = false;
+
+		// 已經bind在同一個位置的 (layout沒變的話每個frame都會走這裡)
+		for (auto& entry : m_textureCache) {
+			if (entry.bound && entry.heapOffset == heapOffset && IsSameTextureDesc(entry.desc, desc)) {
+				entry.unusedFrames = 0;
+				return entry;
+			}
+		}
+
+		auto device = Application::GetNVRHIDevice();
+
+		// 還沒bind的 (只用來查memory requirement的)
+		auto unbound = std::find_if(m_textureCache.begin(), m_textureCache.end(), [&](const CachedTexture& entry) {
+			return !entry.bound && IsSameTextureDesc(entry.desc, desc);
+			});
+		if (unbound == m_textureCache.end()) {
+			m_textureCache.push_back({ desc, 0, size, device->createTexture(desc), false, 0, {}, false });
+			unbound = m_textureCache.end() - 1;
+		}
+
+		device->bindTextureMemory(unbound->texture, m_heap, heapOffset);
+		unbound->bound = true;
+		unbound->heapOffset = heapOffset;
+		unbound->size = size;
+		unbound->unusedFrames = 0;
+		unbound->lastUser.clear();
+		unbound->contentValid = false;
+		outNewlyBound = true;
+		return *unbound;
+	}
+
+	bool RenderGraph::isMemoryUsedByOthers(uint64_t offset, uint64_t size, uint32_t self, uint32_t beginPass, uint32_t endPass) const
+	{
+		return std::any_of(m_transients.begin(), m_transients.end(), [&](uint32_t index) {
+			const TextureResource& other = m_textures[index];
+			if (index == self)
+				return false;
+			if (other.lastPass < beginPass || other.firstPass >= endPass)
+				return false;
+			return offset < other.heapOffset + other.memoryRequirements.size && other.heapOffset < offset + size;
+			});
+	}
+
+}
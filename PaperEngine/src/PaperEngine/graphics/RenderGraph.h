@@ -0,0 +1,256 @@
+﻿#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// RenderGraph裡的texture，只在建立它的graph中有效
+	/// </summary>
+	struct RenderGraphTexture {
+		static constexpr uint32_t Invalid = ~0u;
+		uint32_t index = Invalid;
+
+		bool isValid() const { return index != Invalid; }
+	};
+
+	struct RenderGraphBuffer {
+		static constexpr uint32_t Invalid = ~0u;
+		uint32_t index = Invalid;
+
+		bool isValid() const { return index != Invalid; }
+	};
+
+	class RenderGraph;
+
+	/// <summary>
+	/// pass在setup時宣告要讀寫的resource
+	/// state為Unknown的話只記錄相依性，不會幫忙切換state (pass自己處理)
+	/// </summary>
+	class RenderGraphBuilder {
+	public:
+		PE_API RenderGraphTexture read(RenderGraphTexture texture, nvrhi::ResourceStates state);
+
+		PE_API RenderGraphTexture write(RenderGraphTexture texture, nvrhi::ResourceStates state);
+
+		PE_API RenderGraphBuffer read(RenderGraphBuffer buffer, nvrhi::ResourceStates state);
+
+		PE_API RenderGraphBuffer write(RenderGraphBuffer buffer, nvrhi::ResourceStates state);
+
+		/// <summary>
+		/// 沒有人讀它的輸出也不能被cull (例如upload、readback)
+		/// </summary>
+		PE_API void setSideEffect();
+
+	private:
+		friend class RenderGraph;
+		RenderGraphBuilder(RenderGraph& graph, uint32_t passIndex) : m_graph(graph), m_passIndex(passIndex) {}
+
+		RenderGraph& m_graph;
+		uint32_t m_passIndex;
+	};
+
+	/// <summary>
+	/// pass執行時拿到的東西
+	/// </summary>
+	class RenderGraphContext {
+	public:
+		nvrhi::ICommandList* getCommandList() const { return m_cmd; }
+
+		PE_API nvrhi::ITexture* getTexture(RenderGraphTexture texture) const;
+
+		PE_API nvrhi::IBuffer* getBuffer(RenderGraphBuffer buffer) const;
+
+	private:
+		friend class RenderGraph;
+		RenderGraphContext(const RenderGraph& graph, nvrhi::ICommandList* cmd) : m_graph(graph), m_cmd(cmd) {}
+
+		const RenderGraph& m_graph;
+		nvrhi::ICommandList* m_cmd;
+	};
+
+	/// <summary>
+	/// 每個frame重新建立的render graph
+	/// 
+	/// 使用方式：
+	///		graph.reset();
+	///		auto color = graph.importTexture("Color", fb->getDesc().colorAttachments[0].texture);
+	///		graph.addPass("Mesh", [&](RenderGraphBuilder& builder) { builder.write(color, nvrhi::ResourceStates::RenderTarget); },
+	///			[&](const RenderGraphContext& context) { ... });
+	///		graph.compile();
+	///		graph.execute(cmd);
+	/// 
+	/// compile時：
+	///		輸出沒有被使用（也沒有寫入imported resource或side effect）的pass會被cull
+	///		transient texture依照生命週期 (第一個到最後一個使用的pass) 放進同一個heap，生命週期不重疊的共用memory
+	/// execute時：
+	///		每個pass開始前把它宣告的state一次設定好，只commit一次barrier
+	///		內容沒有保留的transient第一次使用前插入aliasing barrier，從Unknown開始
+	/// 
+	/// heap跟transient texture會保留到下一個frame，layout不變的話不會重新建立
+	/// 同一個transient (同名、同desc) 的memory在兩個frame之間沒有被其他transient用過的話內容會保留 (isContentPreserved)
+	/// </summary>
+	class RenderGraph {
+	public:
+		typedef std::function<void(RenderGraphBuilder&)> SetupFunction;
+		typedef std::function<void(const RenderGraphContext&)> ExecuteFunction;
+
+	public:
+		PE_API RenderGraph();
+		PE_API ~RenderGraph();
+
+		/// <summary>
+		/// 清除上一個frame的pass跟resource，保留heap跟transient texture的cache
+		/// </summary>
+		PE_API void reset();
+
+		/// <summary>
+		/// graph外部的texture (framebuffer之類的)，寫入它的pass不會被cull
+		/// </summary>
+		PE_API RenderGraphTexture importTexture(const char* name, nvrhi::ITexture* texture);
+
+		PE_API RenderGraphBuffer importBuffer(const char* name, nvrhi::IBuffer* buffer);
+
+		/// <summary>
+		/// graph管理memory的texture，名字是desc.debugName，compile後才有ITexture
+		/// 要在其他command list使用 (例如MeshRenderer的worker command list、生命週期中有pass會executeMainCommandList) 或要保留內容的話設keepInitialState，
+		/// 最後使用的pass之後graph會把它轉回initialState
+		/// </summary>
+		PE_API RenderGraphTexture createTexture(const nvrhi::TextureDesc& desc);
+
+		/// <summary>
+		/// name需要是string literal (profiler保留pointer)
+		/// setup馬上呼叫，execute在execute()時依照加入的順序呼叫
+		/// </summary>
+		PE_API void addPass(const char* name, const SetupFunction& setup, ExecuteFunction execute);
+
+		PE_API void compile();
+
+		PE_API void execute(nvrhi::ICommandList* cmd);
+
+		/// <summary>
+		/// transient的texture要compile後才有
+		/// </summary>
+		PE_API nvrhi::ITexture* getTexture(RenderGraphTexture texture) const;
+
+		/// <summary>
+		/// compile後有效，transient的內容跟上一個使用它的frame結束時一樣
+		/// false的話第一次使用時內容是undefined，pass要全部重畫
+		/// 只有keepInitialState的transient會保留，imported的一定是true
+		/// </summary>
+		PE_API bool isContentPreserved(RenderGraphTexture texture) const;
+
+		uint32_t getPassCount() const { return static_cast<uint32_t>(m_passes.size()); }
+
+		uint32_t getCulledPassCount() const { return m_culledPassCount; }
+
+		/// <summary>
+		/// 沒有aliasing時需要的memory
+		/// </summary>
+		uint64_t getTransientRequestedSize() const { return m_transientRequestedSize; }
+
+		/// <summary>
+		/// aliasing後實際使用的heap大小
+		/// </summary>
+		uint64_t getTransientHeapSize() const { return m_heapSize; }
+
+	private:
+		friend class RenderGraphBuilder;
+		friend class RenderGraphContext;
+
+		struct ResourceAccess {
+			uint32_t resource;
+			nvrhi::ResourceStates state;
+			bool write;
+		};
+
+		struct Pass {
+			const char* name;			// profiler會保留pointer，需要是string literal
+			ExecuteFunction execute;
+			std::vector<ResourceAccess> textureAccesses;
+			std::vector<ResourceAccess> bufferAccesses;
+			bool sideEffect = false;
+			bool culled = false;
+		};
+
+		struct TextureResource {
+			std::string name;
+			nvrhi::TextureDesc desc;
+			nvrhi::ITexture* texture = nullptr;
+			bool imported = false;
+			// transient用
+			uint32_t firstPass = ~0u;
+			uint32_t lastPass = 0;
+			uint64_t heapOffset = 0;
+			nvrhi::MemoryRequirements memoryRequirements;
+			bool preserved = false;
+			bool firstUse = true;
+		};
+
+		struct BufferResource {
+			std::string name;
+			nvrhi::IBuffer* buffer = nullptr;
+		};
+
+		/// <summary>
+		/// 之前frame建立、可以重複使用的transient texture
+		/// </summary>
+		struct CachedTexture {
+			nvrhi::TextureDesc desc;
+			uint64_t heapOffset;
+			uint64_t size;
+			nvrhi::TextureHandle texture;
+			bool bound;
+			uint32_t unusedFrames;
+			// 最後使用它的transient，跟之後它的memory有沒有被其他transient用過
+			std::string lastUser;
+			bool contentValid;
+		};
+
+	private:
+		void cullPasses();
+
+		/// <summary>
+		/// 計算transient texture的生命週期跟heap offset，heap不夠大的話重新建立
+		/// </summary>
+		void allocateTransients();
+
+		/// <summary>
+		/// 拿已經bind在heapOffset的cached texture，沒有的話把一個還沒bind的bind上去
+		/// </summary>
+		CachedTexture& acquireTexture(const nvrhi::TextureDesc& desc, uint64_t heapOffset, uint64_t size, bool& outNewlyBound);
+
+		/// <summary>
+		/// 這個frame在[beginPass, endPass)之間有沒有self (m_textures的index) 以外的transient用到heap的[offset, offset + size)
+		/// </summary>
+		bool isMemoryUsedByOthers(uint64_t offset, uint64_t size, uint32_t self, uint32_t beginPass, uint32_t endPass) const;
+
+	private:
+		std::vector<Pass> m_passes;
+		std::vector<TextureResource> m_textures;
+		std::vector<BufferResource> m_buffers;
+
+		nvrhi::HeapHandle m_heap;
+		GPUMemoryAllocation m_heapMemory;
+		uint64_t m_heapSize = 0;
+		std::vector<CachedTexture> m_textureCache;
+		std::vector<uint32_t> m_transients;
+
+		uint32_t m_culledPassCount = 0;
+		uint64_t m_transientRequestedSize = 0;
+		bool m_compiled = false;
+
+		/// <summary>
+		/// 超過這麼多frame沒用到的cached texture會被釋放
+		/// </summary>
+		static constexpr uint32_t MaxUnusedFrames = 8;
+	};
+
+}
@@ -7,6 +7,7 @@
 #include <PaperEngine/components/MeshRendererComponent.h>
 #include <PaperEngine/components/LightComponent.h>
 #include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/FrameStats.h>
 
 #include <PaperEngine/utils/BoundingVolume.h>
 
@@ -18,19 +19,17 @@ namespace PaperEngine {
 
 	SceneRenderer::SceneRenderer()
 	{
-		const uint32_t max_frame_count = Application::Get()->getGraphicsContext()->getMaxFrameInFlight();
-
 		m_lightCullPass.init();
+		m_shadowPass.init();
+		m_pointShadowAtlas.init();
+		m_skinningPass.init();
 
-		// 全域data (constantBuffer Slot 0 : set = 0)
-		nvrhi::BufferDesc globalDataBufferDesc;
-		globalDataBufferDesc
-			.setInitialState(nvrhi::ResourceStates::ConstantBuffer)
-			.setKeepInitialState(true)
-			.setByteSize(sizeof(GlobalDataI))
-			.setIsConstantBuffer(true);
-		m_globalDataBuffer = std::make_shared<GPUBuffer>(ResourceUsage::FrameStreaming, globalDataBufferDesc);
+		// skeletal mesh在所有pass都用skinned output畫
+		m_meshRenderer.setSkinningPass(&m_skinningPass);
+		m_shadowPass.setSkinningPass(&m_skinningPass);
+		m_pointShadowAtlas.setSkinningPass(&m_skinningPass);
 
+		// 全域data (constantBuffer Slot 0 : set = 0)
 		nvrhi::BindingLayoutDesc globalLayoutDesc;
 		globalLayoutDesc
 			.setRegisterSpace(0)			// set = 0
@@ -40,59 +39,39 @@ namespace PaperEngine {
 			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0))		// directional Light buffer
 			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1))		// point Light buffer
 			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2))		// light indices buffer
-			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3));	// cluster ranges buffer
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3))		// cluster ranges buffer
+			.addItem(nvrhi::BindingLayoutItem::ConstantBuffer(1))			// directional shadow data
+			.addItem(nvrhi::BindingLayoutItem::Texture_SRV(DirectionalShadowMapSlot))	// directional shadow map (cascade array)
+			.addItem(nvrhi::BindingLayoutItem::Sampler(0))					// shadow comparison sampler
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(5))		// point light -> point shadow index
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(6))		// point shadow data
+			.addItem(nvrhi::BindingLayoutItem::Texture_SRV(PointShadowAtlasSlot));		// point shadow atlas
 		m_globalLayout =
 			Application::GetResourceManager()->create<BindingLayout>("SceneRenderer_globalLayout",
 				Application::GetNVRHIDevice()->createBindingLayout(globalLayoutDesc));
 
-		std::vector<nvrhi::BindingSetDesc> globalSetDescs(max_frame_count);
-		for (uint32_t i = 0; i < max_frame_count; i++)
-		{
-			nvrhi::BindingSetDesc& globalSetDesc = globalSetDescs[i];
-			globalSetDesc.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, m_globalDataBuffer->getStorages()[i].handle));
-			globalSetDesc.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_lightCullPass.getDirectionalLightBuffer()->getStorages()[i].handle));
-			globalSetDesc.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_lightCullPass.getPointLightBuffer()->getStorages()[i].handle));
-			globalSetDesc.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_lightCullPass.getPointLightCullData().globalLightIndicesBuffer->getStorages()[i].handle));
-			globalSetDesc.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_lightCullPass.getPointLightCullData().clusterRangesBuffer->getStorages()[i].handle));
-		}
-		m_globalSet = CreateRef<BindingSet>(ResourceUsage::FrameStatic, m_globalLayout, globalSetDescs);
-
 		m_forwardPlusDepthRenderer.init();
+
+		m_materialParameterArena = MaterialParameterArena::Get();
 	}
 
 	void SceneRenderer::renderScene(std::span<Ref<Scene>> scenes, const Camera* camera, const Transform* transform, nvrhi::IFramebuffer* fb)
 	{
 		PE_PROFILE_FUNCTION();
 
-		// prepare processing
-		m_lightCullPass.beginPass();
-
-		// Global Data in GPU Buffer
-		GlobalDataI* globalData = static_cast<GlobalDataI*>(m_globalDataBuffer->getMapPtr());
-		globalData->projectionMatrix = camera->getProjectionMatrix();
-		globalData->viewMatrix = glm::inverse(transform->matrix());
-		globalData->projViewMatrix = globalData->projectionMatrix * globalData->viewMatrix;
-		globalData->cameraPosition = transform->getPosition();
-		globalData->numXSlices = m_lightCullPass.getNumberOfXSlices();
-		globalData->numYSlices = m_lightCullPass.getNumberOfYSlices();
-		globalData->numZSlices = m_lightCullPass.getNumberOfZSlices();
-		globalData->nearPlane = camera->getNearPlane();
-		globalData->farPlane = camera->getFarPlane();
-
 		GlobalSceneData sceneData;
-		sceneData.camera = camera;
-		sceneData.cameraTransform = transform;
-		sceneData.fb = fb;
-		sceneData.globalSet = m_globalSet->getHandle();
-		sceneData.projViewMatrix = globalData->projViewMatrix;
+		const Frustum cameraFrustum = beginFrame(camera, transform, fb, sceneData);
 
 #pragma region Filter Renderable Meshes
 
-		Frustum cameraFrustum = Frustum::Extract(globalData->projViewMatrix);
-		m_lightCullPass.setCamera(*camera, globalData->viewMatrix, cameraFrustum);
-
 		{
 			PE_PROFILE_SCOPE("Process scene to renderer");
+			PE_FRAME_STAT_SCOPE("CPU Process Scene");
+
+			// skinned output的Mesh要在其他pass process之前準備好
+			for (auto scene : scenes)
+				m_skinningPass.processScene(scene, cameraFrustum);
+			m_skinningPass.upload();
 
 			// Process every scene
 			for (auto scene : scenes) {
@@ -132,46 +111,272 @@ namespace PaperEngine {
 				//	future.get();
 				//}
 
-				for (auto [entity, lightCom, transCom] : light_group.each()) {
-					m_lightCullPass.processLight(transCom.transform, lightCom);
-				}
+				// light跟mesh處理沒有共用資料，light在另一個job做，跟mesh的parallelFor重疊
+				JobCounter light_counter;
+				Application::GetJobSystem()->run([this, &light_group]()
+					{
+						PE_PROFILE_SCOPE("Process lights");
+						for (auto [entity, lightCom, transCom] : light_group.each()) {
+							m_lightCullPass.processLight(transCom.transform, lightCom);
+						}
+					}, &light_counter);
 
 				m_meshRenderer.processScene(scene, cameraFrustum);
-				// TODO process skinned meshes
+
+				Application::GetJobSystem()->wait(light_counter);
+			}
+
+			// cascade的方向跟point shadow的light要等所有scene的light都process完才知道
+			const bool directionalShadow = setupShadows(camera, transform);
+			for (auto scene : scenes) {
+				if (directionalShadow)
+					m_shadowPass.processScene(scene);
+				m_pointShadowAtlas.processScene(scene);
 			}
 		}
 
 #pragma endregion
-		globalData->directionalLightCount = m_lightCullPass.getDirectionalLightCount();
-		// 不代表會全部Process
-		globalData->pointLightCount = m_lightCullPass.getPointLightCount();
 
-		auto swapchain_texture = fb->getDesc().colorAttachments[0].texture;
-		auto depth_texture = fb->getDesc().depthAttachment.texture;
+		submitFrame(sceneData);
+	}
 
-		auto main_cmd = Application::Get()->getGraphicsContext()->getMainCommandList();
+	void SceneRenderer::renderSnapshot(const SceneSnapshot& snapshot, nvrhi::IFramebuffer* fb)
+	{
+		PE_PROFILE_FUNCTION();
+
+		GlobalSceneData sceneData;
+		const Frustum cameraFrustum = beginFrame(&snapshot.camera, &snapshot.cameraTransform, fb, sceneData);
+
+		{
+			PE_PROFILE_SCOPE("Process snapshot to renderer");
+			PE_FRAME_STAT_SCOPE("CPU Process Scene");
 
-		main_cmd->setTextureState(swapchain_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::CopyDest);
-		main_cmd->setTextureState(depth_texture, nvrhi::AllSubresources, nvrhi::ResourceStates::CopyDest);
+			m_skinningPass.processSnapshot(snapshot, cameraFrustum);
+			m_skinningPass.upload();
 
-		main_cmd->commitBarriers();
+			JobCounter light_counter;
+			Application::GetJobSystem()->run([this, &snapshot]()
+				{
+					PE_PROFILE_SCOPE("Process lights");
+					for (const auto& light : snapshot.lights) {
+						m_lightCullPass.processLight(light.transform, light.light);
+					}
+				}, &light_counter);
 
-		main_cmd->clearTextureFloat(swapchain_texture, nvrhi::AllSubresources, nvrhi::Color(0.f, 0.f, 0.f, 0.f));
-		main_cmd->clearDepthStencilTexture(depth_texture, nvrhi::AllSubresources, true, 1.f, false, 0);
+			m_meshRenderer.processSnapshot(snapshot, cameraFrustum);
 
-		//main_cmd->writeBuffer(m_globalDataBuffer->getHandle(), &globalData, sizeof(globalData));
+			Application::GetJobSystem()->wait(light_counter);
+
+			if (setupShadows(&snapshot.camera, &snapshot.cameraTransform))
+				m_shadowPass.processSnapshot(snapshot);
+			m_pointShadowAtlas.processSnapshot(snapshot);
+		}
+
+		submitFrame(sceneData);
+	}
+
+	Frustum SceneRenderer::beginFrame(const Camera* camera, const Transform* transform, nvrhi::IFramebuffer* fb, GlobalSceneData& sceneData)
+	{
+		// prepare processing
+		m_lightCullPass.beginPass();
+		m_shadowPass.beginPass();
+		m_skinningPass.beginPass();
+
+		// Global Data，submitFrame時才上傳
+		GlobalDataI* globalData = &m_globalData;
+		globalData->projectionMatrix = camera->getProjectionMatrix();
+		globalData->viewMatrix = glm::inverse(transform->matrix());
+		globalData->projViewMatrix = globalData->projectionMatrix * globalData->viewMatrix;
+		globalData->cameraPosition = transform->getPosition();
+		globalData->numXSlices = m_lightCullPass.getNumberOfXSlices();
+		globalData->numYSlices = m_lightCullPass.getNumberOfYSlices();
+		globalData->numZSlices = m_lightCullPass.getNumberOfZSlices();
+		globalData->nearPlane = camera->getNearPlane();
+		globalData->farPlane = camera->getFarPlane();
+
+		sceneData.camera = camera;
+		sceneData.cameraTransform = transform;
+		sceneData.fb = fb;
+		sceneData.globalSet = nullptr;
+		sceneData.projViewMatrix = globalData->projViewMatrix;
+
+		const float viewportHeight = static_cast<float>(fb->getFramebufferInfo().height);
+		const float pixelScale = globalData->projectionMatrix[1][1] * 0.5f * viewportHeight;
+		m_meshRenderer.setStreamingView(globalData->cameraPosition, pixelScale);
+
+		Frustum cameraFrustum = Frustum::Extract(globalData->projViewMatrix);
+		m_pointShadowAtlas.beginPass(globalData->cameraPosition, pixelScale, cameraFrustum);
+		m_lightCullPass.setCamera(*camera, globalData->viewMatrix, cameraFrustum);
+		return cameraFrustum;
+	}
+
+	bool SceneRenderer::setupShadows(const Camera* camera, const Transform* transform)
+	{
+		// 沒有shader會取樣的話不畫 (例如assets/shaders/test)，cascade跟shadow data都是空的
+		const uint32_t shadowLightIndex = m_lightCullPass.getShadowDirectionalLightIndex();
+		if (shadowLightIndex != LightCullingPass::NoShadowLight && m_meshRenderer.usesGlobalShaderResource(DirectionalShadowMapSlot))
+			m_shadowPass.setLight(m_lightCullPass.getDirectionalLight(shadowLightIndex).direction, shadowLightIndex);
+
+		m_shadowPass.setupCascades(*camera, *transform);
+		// 沒有分配的話這個frame沒有face，point light的shadow index都是NoShadow
+		if (m_meshRenderer.usesGlobalShaderResource(PointShadowAtlasSlot))
+			m_pointShadowAtlas.allocate(m_lightCullPass);
+		return m_shadowPass.hasLight();
+	}
+
+	void SceneRenderer::submitFrame(GlobalSceneData& sceneData)
+	{
+		m_globalData.directionalLightCount = m_lightCullPass.getDirectionalLightCount();
+		// 不代表會全部Process
+		m_globalData.pointLightCount = m_lightCullPass.getPointLightCount();
+
+		nvrhi::IFramebuffer* fb = sceneData.fb;
+		auto main_cmd = Application::Get()->getGraphicsContext()->getMainCommandList();
+
+		// shadow map跟point shadow atlas是transient，compile後才知道texture跟內容有沒有保留
+		// 要先建graph，決定哪些cascade/face要重畫後才上傳，所以pass在execute時才檢查m_globalSet
+		m_globalSet = nullptr;
+		sceneData.globalSet = nullptr;
+
+		m_renderGraph.reset();
+		const RenderGraphTexture color = m_renderGraph.importTexture("SceneColor", fb->getDesc().colorAttachments[0].texture);
+		const RenderGraphTexture depth = m_renderGraph.importTexture("SceneDepth", fb->getDesc().depthAttachment.texture);
+		const RenderGraphTexture shadowMap = m_renderGraph.createTexture(m_shadowPass.getShadowMapDesc());
+		const RenderGraphTexture pointShadowAtlas = m_renderGraph.createTexture(m_pointShadowAtlas.getAtlasDesc());
+
+		m_renderGraph.addPass("Clear",
+			[&](RenderGraphBuilder& builder) {
+				builder.write(color, nvrhi::ResourceStates::CopyDest);
+				builder.write(depth, nvrhi::ResourceStates::CopyDest);
+			},
+			[color, depth](const RenderGraphContext& context) {
+				context.getCommandList()->clearTextureFloat(context.getTexture(color), nvrhi::AllSubresources, nvrhi::Color(0.f, 0.f, 0.f, 0.f));
+				context.getCommandList()->clearDepthStencilTexture(context.getTexture(depth), nvrhi::AllSubresources, true, 1.f, false, 0);
+			});
+
+		// 上傳這個frame修改過的material參數
+		m_renderGraph.addPass("Upload",
+			[](RenderGraphBuilder& builder) {
+				builder.setSideEffect();
+			},
+			[this](const RenderGraphContext& context) {
+				m_materialParameterArena->flush(context.getCommandList());
+				PE_FRAME_STAT_BYTES("Material Parameter Upload", m_materialParameterArena->getLastUploadSize());
+				if (auto bindlessTable = Application::GetResourceManager()->load<BindlessMaterialTable>("BindlessMaterialTable"))
+					bindlessTable->flush(context.getCommandList());
+			});
 
 		// Render PreDepth Pass
 		//m_forwardPlusDepthRenderer.renderScene(sceneData);
 		// compute light tiles using the filtered lights and (TODO predepth texture)
-		m_lightCullPass.calculatePass(main_cmd);
+		// light data在upload allocation中，cull結果的buffer是每個frame in flight各一份，pass自己處理state
+		m_renderGraph.addPass("Light Culling",
+			[](RenderGraphBuilder& builder) {
+				builder.setSideEffect();
+			},
+			[this](const RenderGraphContext& context) {
+				if (!m_globalSet)
+					return;
+				PE_FRAME_STAT_SCOPE("CPU Light Culling Pass");
+				m_lightCullPass.calculatePass(context.getCommandList());
+			});
+
+		// 每個skeletal instance只skin一次，shadow跟mesh pass都讀output vertex buffer
+		// output buffer的state由nvrhi自動轉換 (UAV -> VertexBuffer)
+		if (m_skinningPass.needsDispatch()) {
+			m_renderGraph.addPass("Skinning",
+				[](RenderGraphBuilder& builder) {
+					builder.setSideEffect();
+				},
+				[this](const RenderGraphContext& context) {
+					if (!m_globalSet)
+						return;
+					PE_FRAME_STAT_SCOPE("CPU Skinning Pass");
+					m_skinningPass.dispatch(context.getCommandList());
+				});
+		}
+
+		// 近的cascade每個frame畫，遠的cascade沒變的話沿用
+		// 全部沿用的話不轉換state，畫的時候state由NVRHI自動轉換
+		if (m_shadowPass.hasLight()) {
+			m_renderGraph.addPass("Directional Shadow",
+				[&](RenderGraphBuilder& builder) {
+					builder.write(shadowMap, nvrhi::ResourceStates::Unknown);
+				},
+				[this](const RenderGraphContext& context) {
+					if (!m_globalSet || !m_shadowPass.needsRender())
+						return;
+					PE_FRAME_STAT_SCOPE("CPU Shadow Pass");
+					m_shadowPass.render(context.getCommandList());
+				});
+		}
 
-		// TODO render shadow maps that are visible in camera viewport
+		// 只畫新分配的slot、內容失效的face跟有會動的caster的face
+		if (m_pointShadowAtlas.hasFaces()) {
+			m_renderGraph.addPass("Point Shadow",
+				[&](RenderGraphBuilder& builder) {
+					builder.write(pointShadowAtlas, nvrhi::ResourceStates::Unknown);
+				},
+				[this](const RenderGraphContext& context) {
+					if (!m_globalSet || !m_pointShadowAtlas.needsRender())
+						return;
+					PE_FRAME_STAT_SCOPE("CPU Point Shadow Pass");
+					m_pointShadowAtlas.render(context.getCommandList());
+				});
+		}
 
-		m_meshRenderer.renderScene(main_cmd, sceneData);
+		m_renderGraph.addPass("Mesh",
+			[&](RenderGraphBuilder& builder) {
+				builder.read(shadowMap, nvrhi::ResourceStates::ShaderResource);
+				builder.read(pointShadowAtlas, nvrhi::ResourceStates::ShaderResource);
+				builder.write(color, nvrhi::ResourceStates::RenderTarget);
+				builder.write(depth, nvrhi::ResourceStates::DepthWrite);
+			},
+			[this, &sceneData](const RenderGraphContext& context) {
+				if (!m_globalSet)
+					return;
+				PE_FRAME_STAT_SCOPE("CPU Mesh Rendering Pass");
+				m_meshRenderer.renderScene(context.getCommandList(), sceneData);
+			});
 
 		// TODO post processing
 
+		m_renderGraph.compile();
+
+		// memory被其他transient用過的話cascade跟face要全部重畫
+		m_shadowPass.setShadowMap(m_renderGraph.getTexture(shadowMap), m_renderGraph.isContentPreserved(shadowMap));
+		m_pointShadowAtlas.setAtlas(m_renderGraph.getTexture(pointShadowAtlas), m_renderGraph.isContentPreserved(pointShadowAtlas));
+
+		// 上傳失敗 (FrameUploadAllocator滿了) 的話這個frame只清除framebuffer
+		const FrameUploadAllocation globalDataAllocation = Application::GetFrameUploadAllocator()->upload(&m_globalData, 1);
+		const bool shadowUploaded = m_shadowPass.upload() && m_pointShadowAtlas.upload(m_globalData.pointLightCount);
+		if (m_lightCullPass.upload() && globalDataAllocation.isValid() && shadowUploaded) {
+			const FrameUploadAllocation& directionalLights = m_lightCullPass.getDirectionalLightAllocation();
+			const FrameUploadAllocation& shadowData = m_shadowPass.getShadowDataAllocation();
+			const FrameUploadAllocation& pointShadowIndices = m_pointShadowAtlas.getShadowIndexAllocation();
+			const FrameUploadAllocation& pointShadowData = m_pointShadowAtlas.getShadowDataAllocation();
+			const FrameUploadAllocation& pointLights = m_lightCullPass.getPointLightAllocation();
+			auto& pointLightCullData = m_lightCullPass.getPointLightCullData();
+
+			nvrhi::BindingSetDesc globalSetDesc;
+			globalSetDesc
+				.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, globalDataAllocation.buffer, globalDataAllocation.getRange()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, directionalLights.buffer, nvrhi::Format::UNKNOWN, directionalLights.getRange()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(1, pointLights.buffer, nvrhi::Format::UNKNOWN, pointLights.getRange()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(2, pointLightCullData.globalLightIndicesBuffer->getHandle()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, pointLightCullData.clusterRangesBuffer->getHandle()))
+				.addItem(nvrhi::BindingSetItem::ConstantBuffer(1, shadowData.buffer, shadowData.getRange()))
+				.addItem(nvrhi::BindingSetItem::Texture_SRV(DirectionalShadowMapSlot, m_shadowPass.getShadowMap()))
+				.addItem(nvrhi::BindingSetItem::Sampler(0, m_shadowPass.getSampler()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, pointShadowIndices.buffer, nvrhi::Format::UNKNOWN, pointShadowIndices.getRange()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(6, pointShadowData.buffer, nvrhi::Format::UNKNOWN, pointShadowData.getRange()))
+				.addItem(nvrhi::BindingSetItem::Texture_SRV(PointShadowAtlasSlot, m_pointShadowAtlas.getAtlas()));
+			m_globalSet = Application::GetNVRHIDevice()->createBindingSet(globalSetDesc, m_globalLayout->handle);
+		}
+		sceneData.globalSet = m_globalSet;
+
+		m_renderGraph.execute(main_cmd);
+
 		// TODO wait for 3d finish rendering (becuase NVRHI doesn't have the command buffer hazal between command buffers
 		// in GPU sides only having the cpu-gpu block api
 		// TODO 2d stuff rendering
@@ -180,6 +385,9 @@ namespace PaperEngine {
 
 		// 清除process data
 		m_meshRenderer.endFrame();
+		m_shadowPass.endFrame();
+		m_pointShadowAtlas.endFrame();
+		m_skinningPass.endFrame();
 	}
 
 	void SceneRenderer::onBackBufferResized() {
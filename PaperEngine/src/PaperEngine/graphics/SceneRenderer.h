@@ -8,11 +8,17 @@
 #include <PaperEngine/utils/Transform.h>
 
 #include <PaperEngine/graphics/MeshRenderer.h>
+#include <PaperEngine/graphics/SceneSnapshot.h>
+#include <PaperEngine/graphics/RenderGraph.h>
 #include "ForwardPlusDepthRenderer.h"
 #include "LightCullingPass.h"
+#include "CascadedShadowPass.h"
+#include "PointShadowAtlas.h"
+#include "SkinningPass.h"
 
 #include "BindingSet.h"
 #include "GPUBuffer.h"
+#include "MaterialParameterArena.h"
 
 namespace PaperEngine {
 
@@ -70,22 +76,68 @@ namespace PaperEngine {
 		/// </param>
 		PE_API void renderScene(std::span<Ref<Scene>> scenes, const Camera* camera, const Transform* transform, nvrhi::IFramebuffer* fb);
 
+		/// <summary>
+		/// 畫SceneSnapshot::Extract抽出來的資料，不讀scene
+		/// threaded rendering時在render thread使用
+		/// </summary>
+		PE_API void renderSnapshot(const SceneSnapshot& snapshot, nvrhi::IFramebuffer* fb);
+
 		PE_API void onBackBufferResized();
 
 		PE_API MeshRenderer* getMeshRenderer() { return &m_meshRenderer; }
 
 		PE_API LightCullingPass* getLightCullPass() { return &m_lightCullPass; }
 
+		PE_API CascadedShadowPass* getShadowPass() { return &m_shadowPass; }
+
+		PE_API PointShadowAtlas* getPointShadowAtlas() { return &m_pointShadowAtlas; }
+
+		PE_API SkinningPass* getSkinningPass() { return &m_skinningPass; }
+
+	private:
+		/// <summary>
+		/// 寫入global data跟設定light culling的camera，回傳camera的frustum
+		/// </summary>
+		Frustum beginFrame(const Camera* camera, const Transform* transform, nvrhi::IFramebuffer* fb, GlobalSceneData& sceneData);
+
+		/// <summary>
+		/// light跟mesh process完之後呼叫，設定directional shadow的light跟cascade，分配point shadow atlas的slot
+		/// 這個frame要畫的shader都沒有取樣point shadow atlas的話不分配slot
+		/// 沒有castShadow的directional light，或是這個frame要畫的shader都沒有取樣shadow map的話
+		/// 回傳false，不用process directional shadow caster
+		/// </summary>
+		bool setupShadows(const Camera* camera, const Transform* transform);
+
+		/// <summary>
+		/// process完之後：清除framebuffer、上傳、light culling、畫shadow、畫mesh
+		/// 每個步驟是m_renderGraph的一個pass，shadow map跟point shadow atlas是graph的transient texture
+		/// graph compile後global data、light跟shadow才上傳到FrameUploadAllocator，設定sceneData.globalSet
+		/// </summary>
+		void submitFrame(GlobalSceneData& sceneData);
+
 	private:
+		// global layout (set = 0) 中shadow的texture，跟shader.hlsl的g_shadowMap、g_pointShadowAtlas一樣
+		static constexpr uint32_t DirectionalShadowMapSlot = 4;
+		static constexpr uint32_t PointShadowAtlasSlot = 7;
 
 		BindingLayoutHandle m_globalLayout;
-		BindingSetHandle m_globalSet;
-		GPUBufferHandle m_globalDataBuffer;
+		// global data跟light是這個frame的upload allocation，每個frame重新建立
+		nvrhi::BindingSetHandle m_globalSet;
+		GlobalDataI m_globalData{};
+
+		// 所有material的參數，每個frame上傳一次
+		Ref<MaterialParameterArena> m_materialParameterArena;
 
 		// 先這樣
+		SkinningPass m_skinningPass;
 		MeshRenderer m_meshRenderer;
 		ForwardPlusDepthRenderer m_forwardPlusDepthRenderer;
 		LightCullingPass m_lightCullPass;
+		CascadedShadowPass m_shadowPass;
+		PointShadowAtlas m_pointShadowAtlas;
+
+		// 每個frame重新建立
+		RenderGraph m_renderGraph;
 	};
 
 }
@@ -0,0 +1,63 @@
+﻿#include "SceneSnapshot.h"
+
+#include <PaperEngine/components/TransformComponent.h>
+#include <PaperEngine/components/MeshComponent.h>
+#include <PaperEngine/components/MeshRendererComponent.h>
+#include <PaperEngine/components/SkinnedMeshComponent.h>
+#include <PaperEngine/core/Assert.h>
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	Ref<const SceneSnapshot> SceneSnapshot::Extract(std::span<Ref<Scene>> scenes, const Camera& camera, const Transform& cameraTransform)
+	{
+		PE_PROFILE_FUNCTION();
+		PE_FRAME_STAT_SCOPE("CPU Extract Scene");
+
+		auto snapshot = CreateRef<SceneSnapshot>();
+
+		// 先算好cache的matrix，render thread讀的時候不會再寫入
+		snapshot->camera = camera;
+		snapshot->camera.getProjectionMatrix();
+		snapshot->cameraTransform = cameraTransform;
+		snapshot->cameraTransform.matrix();
+
+		for (const auto& scene : scenes) {
+			auto& registry = scene->getRegistry();
+
+			const auto mesh_group = registry.group<MeshComponent>(entt::get<TransformComponent, MeshRendererComponent>);
+			snapshot->meshInstances.reserve(snapshot->meshInstances.size() + mesh_group.size());
+			for (auto [entity, meshCom, transformCom, meshRendererCom] : mesh_group.each()) {
+				if (!meshRendererCom.visible || !meshRendererCom.renderStatic || !meshCom.mesh)
+					continue;
+				PE_CORE_ASSERT(meshCom.mesh->getSubMeshes().size() == meshRendererCom.materials.size(), "Wired mesh renderer materials doesn't match mesh submeshes");
+
+				MeshInstance& instance = snapshot->meshInstances.emplace_back();
+				instance.mesh = meshCom.mesh;
+				instance.matrix = transformCom.transform.matrix();
+				instance.worldAABB = meshCom.worldAABB;
+				instance.materialOffset = static_cast<uint32_t>(snapshot->materials.size());
+				instance.castShadow = meshRendererCom.castShadow;
+				instance.isStatic = meshRendererCom.isStatic;
+				instance.bonePaletteOffset = static_cast<uint32_t>(snapshot->bonePalettes.size());
+				instance.boneCount = 0;
+				if (const auto* skinnedCom = registry.try_get<SkinnedMeshComponent>(entity)) {
+					instance.boneCount = static_cast<uint32_t>(skinnedCom->bonePalette.size());
+					snapshot->bonePalettes.insert(snapshot->bonePalettes.end(), skinnedCom->bonePalette.begin(), skinnedCom->bonePalette.end());
+				}
+				snapshot->materials.insert(snapshot->materials.end(), meshRendererCom.materials.begin(), meshRendererCom.materials.end());
+			}
+
+			const auto light_group = registry.group<LightComponent>(entt::get<TransformComponent>);
+			for (auto [entity, lightCom, transformCom] : light_group.each()) {
+				LightInstance& light = snapshot->lights.emplace_back(LightInstance{ transformCom.transform, lightCom });
+				light.transform.matrix();
+			}
+		}
+
+		PE_FRAME_STAT_COUNT("Snapshot Mesh Instances", static_cast<uint32_t>(snapshot->meshInstances.size()));
+		return snapshot;
+	}
+
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include <span>
+#include <vector>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/scene/Scene.h>
+#include <PaperEngine/graphics/Camera.h>
+#include <PaperEngine/graphics/Mesh.h>
+#include <PaperEngine/graphics/Material.h>
+#include <PaperEngine/components/LightComponent.h>
+#include <PaperEngine/utils/BoundingVolume.h>
+#include <PaperEngine/utils/Transform.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// Update thread從scene抽出來的render資料，建立後不會再修改
+	/// Render thread只讀這份資料，不碰scene的registry
+	/// 只包含visible且renderStatic的mesh，culling在render時做
+	/// </summary>
+	struct SceneSnapshot {
+		struct MeshInstance {
+			Ref<Mesh> mesh;
+			glm::mat4 matrix;
+			AABB worldAABB;
+			/// <summary>
+			/// subMesh i 的material是 materials[materialOffset + i]
+			/// </summary>
+			uint32_t materialOffset;
+			bool castShadow;
+			bool isStatic;
+			/// <summary>
+			/// SkinnedMeshComponent的bone palette是 bonePalettes[bonePaletteOffset, bonePaletteOffset + boneCount)
+			/// 不是skinned mesh的話boneCount為0
+			/// </summary>
+			uint32_t bonePaletteOffset;
+			uint32_t boneCount;
+		};
+
+		struct LightInstance {
+			Transform transform;
+			LightComponent light;
+		};
+
+		Camera camera;
+		Transform cameraTransform;
+
+		std::vector<MeshInstance> meshInstances;
+		std::vector<Ref<Material>> materials;
+		std::vector<glm::mat4> bonePalettes;
+		std::vector<LightInstance> lights;
+
+		/// <summary>
+		/// 在update thread呼叫，之後scene可以繼續修改
+		/// </summary>
+		PE_API static Ref<const SceneSnapshot> Extract(std::span<Ref<Scene>> scenes, const Camera& camera, const Transform& cameraTransform);
+	};
+
+}
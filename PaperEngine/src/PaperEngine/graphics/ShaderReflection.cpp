@@ -0,0 +1,371 @@
+﻿#include "ShaderReflection.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+namespace PaperEngine {
+
+	namespace {
+
+		// SPIR-V spec中用到的opcode跟decoration
+		constexpr uint32_t SpirvMagic = 0x07230203;
+
+		constexpr uint32_t OpName = 5;
+		constexpr uint32_t OpMemberName = 6;
+		constexpr uint32_t OpTypeInt = 21;
+		constexpr uint32_t OpTypeFloat = 22;
+		constexpr uint32_t OpTypeVector = 23;
+		constexpr uint32_t OpTypeMatrix = 24;
+		constexpr uint32_t OpTypeImage = 25;
+		constexpr uint32_t OpTypeSampler = 26;
+		constexpr uint32_t OpTypeSampledImage = 27;
+		constexpr uint32_t OpTypeArray = 28;
+		constexpr uint32_t OpTypeRuntimeArray = 29;
+		constexpr uint32_t OpTypeStruct = 30;
+		constexpr uint32_t OpTypePointer = 32;
+		constexpr uint32_t OpVariable = 59;
+		constexpr uint32_t OpDecorate = 71;
+		constexpr uint32_t OpMemberDecorate = 72;
+
+		constexpr uint32_t DecorationBinding = 33;
+		constexpr uint32_t DecorationDescriptorSet = 34;
+		constexpr uint32_t DecorationOffset = 35;
+
+		// NVRHI在Vulkan的binding offset (跟nvrhi_helper.hlsli一樣)
+		constexpr uint32_t SamplerBindingOffset = 128;
+		constexpr uint32_t ConstantBufferBindingOffset = 256;
+		constexpr uint32_t UnorderedAccessBindingOffset = 384;
+
+		struct SpirvType {
+			uint32_t op = 0;
+			uint32_t width = 0;				// int/float
+			uint32_t componentType = 0;		// vector/matrix/array/pointer的element
+			uint32_t componentCount = 0;	// vector/matrix
+			std::vector<uint32_t> members;	// struct
+		};
+
+		struct SpirvVariable {
+			uint32_t id;
+			uint32_t pointerType;
+		};
+
+		uint64_t MemberKey(uint32_t structId, uint32_t member)
+		{
+			return (static_cast<uint64_t>(structId) << 32) | member;
+		}
+
+		std::string ReadString(const uint32_t* words, uint32_t wordCount)
+		{
+			const char* str = reinterpret_cast<const char*>(words);
+			const size_t maxLength = static_cast<size_t>(wordCount) * sizeof(uint32_t);
+			return std::string(str, strnlen(str, maxLength));
+		}
+
+		class SpirvModule {
+		public:
+			bool parse(const uint32_t* code, size_t wordCount)
+			{
+				if (wordCount < 5 || code[0] != SpirvMagic)
+					return false;
+
+				size_t i = 5;
+				while (i < wordCount)
+				{
+					const uint32_t instWordCount = code[i] >> 16;
+					const uint32_t op = code[i] & 0xFFFF;
+					if (instWordCount == 0 || i + instWordCount > wordCount)
+						return false;
+					const uint32_t* operands = code + i + 1;
+					const uint32_t operandCount = instWordCount - 1;
+
+					switch (op)
+					{
+					case OpName:
+						names[operands[0]] = ReadString(operands + 1, operandCount - 1);
+						break;
+					case OpMemberName:
+						memberNames[MemberKey(operands[0], operands[1])] = ReadString(operands + 2, operandCount - 2);
+						break;
+					case OpDecorate:
+						if (operands[1] == DecorationBinding)
+							bindings[operands[0]] = operands[2];
+						else if (operands[1] == DecorationDescriptorSet)
+							descriptorSets[operands[0]] = operands[2];
+						break;
+					case OpMemberDecorate:
+						if (operands[2] == DecorationOffset)
+							memberOffsets[MemberKey(operands[0], operands[1])] = operands[3];
+						break;
+					case OpTypeInt:
+					case OpTypeFloat:
+						types[operands[0]] = { op, operands[1] };
+						break;
+					case OpTypeVector:
+					case OpTypeMatrix:
+						types[operands[0]] = { op, 0, operands[1], operands[2] };
+						break;
+					case OpTypeImage:
+					case OpTypeSampler:
+						types[operands[0]] = { op };
+						break;
+					case OpTypeSampledImage:
+					case OpTypeArray:
+					case OpTypeRuntimeArray:
+						types[operands[0]] = { op, 0, operands[1] };
+						break;
+					case OpTypePointer:
+						types[operands[0]] = { op, 0, operands[2] };
+						break;
+					case OpTypeStruct:
+					{
+						SpirvType type{ op };
+						type.members.assign(operands + 1, operands + operandCount);
+						types[operands[0]] = std::move(type);
+					}
+						break;
+					case OpVariable:
+						variables.push_back({ operands[1], operands[0] });
+						break;
+					default:
+						break;
+					}
+
+					i += instWordCount;
+				}
+				return true;
+			}
+
+			const SpirvType* getType(uint32_t id) const
+			{
+				auto it = types.find(id);
+				return it == types.end() ? nullptr : &it->second;
+			}
+
+			ShaderParameterType classifyValue(uint32_t typeId) const
+			{
+				const SpirvType* type = getType(typeId);
+				if (!type)
+					return ShaderParameterType::Unknown;
+
+				switch (type->op)
+				{
+				case OpTypeFloat:
+					return type->width == 32 ? ShaderParameterType::Float : ShaderParameterType::Unknown;
+				case OpTypeInt:
+					return type->width == 32 ? ShaderParameterType::Uint : ShaderParameterType::Unknown;
+				case OpTypeVector:
+				{
+					if (classifyValue(type->componentType) != ShaderParameterType::Float)
+						return ShaderParameterType::Unknown;
+					switch (type->componentCount)
+					{
+					case 2: return ShaderParameterType::Vec2;
+					case 3: return ShaderParameterType::Vec3;
+					case 4: return ShaderParameterType::Vec4;
+					default: return ShaderParameterType::Unknown;
+					}
+				}
+				case OpTypeMatrix:
+				{
+					if (type->componentCount == 4 && classifyValue(type->componentType) == ShaderParameterType::Vec4)
+						return ShaderParameterType::Mat4;
+					return ShaderParameterType::Unknown;
+				}
+				default:
+					return ShaderParameterType::Unknown;
+				}
+			}
+
+			/// <summary>
+			/// 把struct的member展開成參數
+			/// 巢狀的struct也會展開，名稱為outer.inner
+			/// </summary>
+			void reflectStruct(
+				uint32_t structId,
+				uint32_t baseOffset,
+				const std::string& prefix,
+				std::vector<ShaderParameterInfo>& outParameters,
+				uint32_t& outSize) const
+			{
+				const SpirvType* type = getType(structId);
+				if (!type || type->op != OpTypeStruct)
+					return;
+
+				for (uint32_t member = 0; member < type->members.size(); member++)
+				{
+					const uint32_t memberType = type->members[member];
+					auto offsetIt = memberOffsets.find(MemberKey(structId, member));
+					const uint32_t offset = baseOffset + (offsetIt != memberOffsets.end() ? offsetIt->second : 0);
+
+					auto nameIt = memberNames.find(MemberKey(structId, member));
+					const bool hasName = nameIt != memberNames.end() && !nameIt->second.empty();
+
+					const SpirvType* memberTypeInfo = getType(memberType);
+					if (memberTypeInfo && memberTypeInfo->op == OpTypeStruct)
+					{
+						// 沒有名稱的member沿用外層的prefix
+						reflectStruct(memberType, offset, hasName ? prefix + nameIt->second + "." : prefix, outParameters, outSize);
+						continue;
+					}
+
+					ShaderParameterInfo info;
+					info.type = classifyValue(memberType);
+					if (info.type == ShaderParameterType::Unknown || !hasName)
+						continue;
+
+					info.name = prefix + nameIt->second;
+					info.offset = offset;
+					info.size = ShaderReflection::GetTypeSize(info.type);
+					outSize = std::max(outSize, info.offset + info.size);
+					outParameters.push_back(std::move(info));
+				}
+			}
+
+		public:
+			std::unordered_map<uint32_t, std::string> names;
+			std::unordered_map<uint64_t, std::string> memberNames;
+			std::unordered_map<uint32_t, uint32_t> bindings;
+			std::unordered_map<uint32_t, uint32_t> descriptorSets;
+			std::unordered_map<uint64_t, uint32_t> memberOffsets;
+			std::unordered_map<uint32_t, SpirvType> types;
+			std::vector<SpirvVariable> variables;
+		};
+
+	}
+
+	bool ShaderReflection::ReflectSpirv(
+		const void* spirv,
+		size_t size,
+		uint32_t descriptorSet,
+		std::vector<ShaderParameterInfo>& outParameters,
+		uint32_t& outVariableBufferSize)
+	{
+		SpirvModule spirvModule;
+		if (!spirv || size % sizeof(uint32_t) != 0 ||
+			!spirvModule.parse(static_cast<const uint32_t*>(spirv), size / sizeof(uint32_t)))
+		{
+			PE_CORE_ERROR("[ShaderReflection] Invalid SPIR-V bytecode.");
+			return false;
+		}
+
+		std::vector<ShaderParameterInfo> parameters;
+
+		for (const auto& variable : spirvModule.variables)
+		{
+			auto setIt = spirvModule.descriptorSets.find(variable.id);
+			auto bindingIt = spirvModule.bindings.find(variable.id);
+			if (setIt == spirvModule.descriptorSets.end() || bindingIt == spirvModule.bindings.end())
+				continue;
+			if (setIt->second != descriptorSet)
+				continue;
+
+			const uint32_t binding = bindingIt->second;
+			if (binding >= UnorderedAccessBindingOffset)
+				continue;
+
+			const SpirvType* pointer = spirvModule.getType(variable.pointerType);
+			if (!pointer || pointer->op != OpTypePointer)
+				continue;
+
+			uint32_t typeId = pointer->componentType;
+			const SpirvType* type = spirvModule.getType(typeId);
+			while (type && (type->op == OpTypeArray || type->op == OpTypeRuntimeArray))
+			{
+				typeId = type->componentType;
+				type = spirvModule.getType(typeId);
+			}
+			if (!type)
+				continue;
+
+			// constant buffer 0 -> material的variable buffer
+			if (binding >= ConstantBufferBindingOffset)
+			{
+				if (binding == ConstantBufferBindingOffset && type->op == OpTypeStruct)
+					spirvModule.reflectStruct(typeId, 0, std::string(), parameters, outVariableBufferSize);
+				continue;
+			}
+
+			auto nameIt = spirvModule.names.find(variable.id);
+			if (nameIt == spirvModule.names.end() || nameIt->second.empty())
+				continue;
+
+			ShaderParameterInfo info;
+			info.name = nameIt->second;
+			if (binding >= SamplerBindingOffset && type->op == OpTypeSampler)
+			{
+				info.type = ShaderParameterType::Sampler;
+				info.slot = binding - SamplerBindingOffset;
+			}
+			else if (binding < SamplerBindingOffset && (type->op == OpTypeImage || type->op == OpTypeSampledImage))
+			{
+				info.type = ShaderParameterType::Texture;
+				info.slot = binding;
+			}
+			else
+			{
+				continue;
+			}
+			parameters.push_back(std::move(info));
+		}
+
+		for (auto& parameter : parameters)
+		{
+			auto it = std::find_if(outParameters.begin(), outParameters.end(),
+				[&](const ShaderParameterInfo& p) { return p.name == parameter.name; });
+			if (it != outParameters.end())
+			{
+				// 不同stage宣告同一個參數是正常的，只有內容不同才是衝突
+				if (it->type != parameter.type || it->offset != parameter.offset || it->slot != parameter.slot)
+					PE_CORE_WARN("[ShaderReflection] Parameter '{}' collides with an existing parameter of a different layout, ignored.", parameter.name);
+				continue;
+			}
+			outParameters.push_back(std::move(parameter));
+		}
+		return true;
+	}
+
+	bool ShaderReflection::ReflectBindings(
+		const void* spirv,
+		size_t size,
+		uint32_t descriptorSet,
+		std::vector<uint32_t>& outBindings)
+	{
+		SpirvModule spirvModule;
+		if (!spirv || size % sizeof(uint32_t) != 0 ||
+			!spirvModule.parse(static_cast<const uint32_t*>(spirv), size / sizeof(uint32_t)))
+		{
+			PE_CORE_ERROR("[ShaderReflection] Invalid SPIR-V bytecode.");
+			return false;
+		}
+
+		for (const auto& variable : spirvModule.variables)
+		{
+			auto setIt = spirvModule.descriptorSets.find(variable.id);
+			auto bindingIt = spirvModule.bindings.find(variable.id);
+			if (setIt == spirvModule.descriptorSets.end() || bindingIt == spirvModule.bindings.end())
+				continue;
+			if (setIt->second != descriptorSet)
+				continue;
+
+			if (std::find(outBindings.begin(), outBindings.end(), bindingIt->second) == outBindings.end())
+				outBindings.push_back(bindingIt->second);
+		}
+		return true;
+	}
+
+	uint32_t ShaderReflection::GetTypeSize(ShaderParameterType type)
+	{
+		switch (type)
+		{
+		case ShaderParameterType::Float: return sizeof(float);
+		case ShaderParameterType::Uint: return sizeof(uint32_t);
+		case ShaderParameterType::Vec2: return sizeof(float) * 2;
+		case ShaderParameterType::Vec3: return sizeof(float) * 3;
+		case ShaderParameterType::Vec4: return sizeof(float) * 4;
+		case ShaderParameterType::Mat4: return sizeof(float) * 16;
+		default: return 0;
+		}
+	}
+
+}
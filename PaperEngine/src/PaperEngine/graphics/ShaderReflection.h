@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <PaperEngine/core/Base.h>
+
+namespace PaperEngine {
+
+	enum class ShaderParameterType {
+		Unknown,
+		Texture,
+		Sampler,
+		Float,
+		Vec2,
+		Vec3,
+		Vec4,
+		Mat4,
+		Uint,
+	};
+
+	/// <summary>
+	/// Material參數的handle
+	/// 其實就是GraphicsPipeline reflection出來的參數index
+	/// </summary>
+	typedef uint32_t ParameterHandle;
+	constexpr ParameterHandle InvalidParameterHandle = ~0u;
+
+	struct ShaderParameterInfo {
+		std::string name;
+		ShaderParameterType type = ShaderParameterType::Unknown;
+
+		/// <summary>
+		/// Texture跟Sampler的slot（已經扣掉NVRHI的binding offset）
+		/// </summary>
+		uint32_t slot = 0;
+
+		/// <summary>
+		/// Float等類型在variable buffer (constant buffer 0) 中的offset
+		/// </summary>
+		uint32_t offset = 0;
+		uint32_t size = 0;
+	};
+
+	/// <summary>
+	/// 很小的SPIR-V reflection
+	/// 只讀取Material會用到的東西:
+	///		指定descriptor set的Texture、Sampler
+	///		constant buffer 0的member (name, offset, type)
+	///		指定descriptor set有宣告的binding
+	/// </summary>
+	class ShaderReflection {
+	public:
+		/// <summary>
+		/// </summary>
+		/// <param name="spirv">SPIR-V bytecode</param>
+		/// <param name="size">bytes</param>
+		/// <param name="descriptorSet">要reflect的descriptor set (Material為2)</param>
+		/// <param name="outParameters">結果會加到後面，同名的會略過（layout不同時會警告）</param>
+		/// <param name="outVariableBufferSize">constant buffer 0的大小</param>
+		/// <returns>不是合法的SPIR-V回傳false</returns>
+		PE_API static bool ReflectSpirv(
+			const void* spirv,
+			size_t size,
+			uint32_t descriptorSet,
+			std::vector<ShaderParameterInfo>& outParameters,
+			uint32_t& outVariableBufferSize);
+
+		/// <summary>
+		/// 指定descriptor set中shader有宣告的binding (Vulkan binding，包含NVRHI的offset)
+		/// DXC會把沒用到的resource拿掉，所以可以用來判斷shader有沒有讀某個resource
+		/// </summary>
+		/// <param name="outBindings">結果會加到後面，重複的會略過</param>
+		/// <returns>不是合法的SPIR-V回傳false</returns>
+		PE_API static bool ReflectBindings(
+			const void* spirv,
+			size_t size,
+			uint32_t descriptorSet,
+			std::vector<uint32_t>& outBindings);
+
+		static uint32_t GetTypeSize(ShaderParameterType type);
+	};
+
+}
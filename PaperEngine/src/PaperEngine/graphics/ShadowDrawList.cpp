@@ -0,0 +1,90 @@
+﻿#include "ShadowDrawList.h"
+
+#include <algorithm>
+
+namespace PaperEngine {
+
+	void ShadowDrawList::clear()
+	{
+		m_casters.clear();
+		m_records.clear();
+	}
+
+	uint32_t ShadowDrawList::sort()
+	{
+		std::sort(m_casters.begin(), m_casters.end(), [](const Caster& a, const Caster& b) {
+			if (a.mesh->getVertexBuffer() != b.mesh->getVertexBuffer())
+				return a.mesh->getVertexBuffer() < b.mesh->getVertexBuffer();
+			if (a.mesh->getIndexBuffer() != b.mesh->getIndexBuffer())
+				return a.mesh->getIndexBuffer() < b.mesh->getIndexBuffer();
+			return a.mesh < b.mesh;
+			});
+
+		uint32_t drawCount = 0;
+		for (size_t i = 0; i < m_casters.size(); i++) {
+			if (i == 0 || m_casters[i].mesh != m_casters[i - 1].mesh)
+				drawCount += static_cast<uint32_t>(m_casters[i].mesh->getSubMeshes().size());
+		}
+		return drawCount;
+	}
+
+	void ShadowDrawList::write(glm::mat4* instanceData, uint32_t& instanceOffset, nvrhi::DrawIndexedIndirectArguments* indirectArgs, uint32_t& argsCount)
+	{
+		m_records.clear();
+
+		size_t meshStart = 0;
+		while (meshStart < m_casters.size()) {
+			Mesh* mesh = m_casters[meshStart].mesh;
+			size_t meshEnd = meshStart + 1;
+			while (meshEnd < m_casters.size() && m_casters[meshEnd].mesh == mesh)
+				meshEnd++;
+
+			const uint32_t instanceCount = static_cast<uint32_t>(meshEnd - meshStart);
+			for (size_t i = meshStart; i < meshEnd; i++)
+				instanceData[instanceOffset + i - meshStart] = m_casters[i].matrix;
+
+			if (m_records.empty() || !m_records.back().mesh->isGeometryBindingCompatible(*mesh))
+				m_records.push_back({ mesh, argsCount, 0 });
+			for (uint32_t subMeshIndex = 0; subMeshIndex < mesh->getSubMeshes().size(); subMeshIndex++) {
+				nvrhi::DrawIndexedIndirectArguments& args = indirectArgs[argsCount++];
+				mesh->getSubMeshDrawArguments(args, subMeshIndex);
+				args.instanceCount = instanceCount;
+				args.startInstanceLocation = instanceOffset;
+				m_records.back().drawCount++;
+			}
+
+			instanceOffset += instanceCount;
+			meshStart = meshEnd;
+		}
+	}
+
+	void ShadowDrawList::record(nvrhi::ICommandList* cmd, nvrhi::GraphicsState& graphicsState, const FrameUploadAllocation& indirectArgs) const
+	{
+		graphicsState.setIndirectParams(indirectArgs.buffer);
+		for (const DrawRecord& record : m_records) {
+			record.mesh->bindMesh(graphicsState);
+			cmd->setGraphicsState(graphicsState);
+			cmd->drawIndexedIndirect(
+				static_cast<uint32_t>(indirectArgs.offset + record.argsOffset * sizeof(nvrhi::DrawIndexedIndirectArguments)),
+				record.drawCount);
+		}
+	}
+
+	uint64_t ShadowDrawList::HashCaster(const Mesh* mesh, const AABB& worldAABB)
+	{
+		// FNV-1a，加總後不管順序
+		uint64_t hash = 14695981039346656037ull;
+		auto combine = [&hash](const void* data, size_t size) {
+			const auto* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			};
+		combine(&mesh, sizeof(mesh));
+		combine(&worldAABB.min, sizeof(worldAABB.min));
+		combine(&worldAABB.max, sizeof(worldAABB.max));
+		return hash;
+	}
+
+}
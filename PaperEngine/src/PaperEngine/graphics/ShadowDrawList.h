@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/graphics/Mesh.h>
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
+#include <PaperEngine/utils/BoundingVolume.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 一個shadow view (cascade或cube face) 要畫的caster
+	/// 
+	/// process時收集caster，upload時依geometry排序
+	/// 同一個mesh的instance連續放，每個subMesh一個indirect draw，geometry binding一樣的draw合成一個drawIndexedIndirect
+	/// </summary>
+	class ShadowDrawList {
+	public:
+		struct Caster {
+			Mesh* mesh;
+			glm::mat4 matrix;
+		};
+
+	public:
+		void clear();
+
+		bool empty() const { return m_casters.empty(); }
+
+		/// <summary>
+		/// 不是thread safe，worker先收集在自己的list再一起加入
+		/// </summary>
+		void append(const std::vector<Caster>& casters) { m_casters.insert(m_casters.end(), casters.begin(), casters.end()); }
+
+		/// <summary>
+		/// 依照geometry排序，回傳需要幾個indirect draw
+		/// </summary>
+		uint32_t sort();
+
+		uint32_t getInstanceCount() const { return static_cast<uint32_t>(m_casters.size()); }
+
+		/// <summary>
+		/// sort之後呼叫，寫入instance的matrix跟indirect args，offset跟count會往後移
+		/// </summary>
+		void write(glm::mat4* instanceData, uint32_t& instanceOffset, nvrhi::DrawIndexedIndirectArguments* indirectArgs, uint32_t& argsCount);
+
+		/// <summary>
+		/// graphicsState的pipeline、framebuffer、binding要先設定好
+		/// </summary>
+		void record(nvrhi::ICommandList* cmd, nvrhi::GraphicsState& graphicsState, const FrameUploadAllocation& indirectArgs) const;
+
+		/// <summary>
+		/// static caster的hash，view中所有static caster的hash加總 (跟順序無關) 用來判斷cache是否還有效
+		/// </summary>
+		static uint64_t HashCaster(const Mesh* mesh, const AABB& worldAABB);
+
+	private:
+		struct DrawRecord {
+			const Mesh* mesh;
+			uint32_t argsOffset;
+			uint32_t drawCount;
+		};
+
+	private:
+		std::vector<Caster> m_casters;
+		std::vector<DrawRecord> m_records;
+	};
+
+}
@@ -0,0 +1,222 @@
+﻿#include "SkinningPass.h"
+
+#include <algorithm>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/utils/File.h>
+
+#include <PaperEngine/components/TransformComponent.h>
+#include <PaperEngine/components/MeshComponent.h>
+#include <PaperEngine/components/MeshRendererComponent.h>
+#include <PaperEngine/components/SkinnedMeshComponent.h>
+
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/GPUProfiler.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	void SkinningPass::init()
+	{
+#pragma region Skinning Binding Layout Creation
+
+		nvrhi::BindingLayoutDesc layoutDesc;
+		layoutDesc
+			.setVisibility(nvrhi::ShaderType::Compute)
+			.setRegisterSpace(0)
+			.setRegisterSpaceIsDescriptorSet(true)
+			.addItem(nvrhi::BindingLayoutItem::ConstantBuffer(0))			// instance data
+			.addItem(nvrhi::BindingLayoutItem::RawBuffer_SRV(0))			// source vertices (StaticVertex)
+			.addItem(nvrhi::BindingLayoutItem::RawBuffer_SRV(1))			// source bone infos (SkeletalVertexInfo)
+			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2))	// bone palette
+			.addItem(nvrhi::BindingLayoutItem::RawBuffer_UAV(0));			// output vertices
+		m_bindingLayout = CreateRef<BindingLayout>(Application::GetNVRHIDevice()->createBindingLayout(layoutDesc));
+
+#pragma endregion
+
+#pragma region Skinning Compute pipeline Initialization
+		{
+			nvrhi::ComputePipelineDesc pipelineDesc;
+
+			nvrhi::ShaderDesc shaderDesc;
+			shaderDesc
+				.setDebugName("SkinningComputeShader")
+				.setEntryName("main_cs")
+				.setShaderType(nvrhi::ShaderType::Compute);
+			File file("assets/PaperEngine/shader/skinning/skinning.comp.spv");
+
+			auto shaderBinary = file.readBinaryFully();
+			if (!shaderBinary) {
+				// 沒有pipeline時upload直接跳過，skeletal mesh維持bind pose
+				PE_CORE_ERROR("[SkinningPass] Failed to load skinning compute shader.");
+				return;
+			}
+			pipelineDesc.CS = Application::GetNVRHIDevice()->createShader(
+				shaderDesc,
+				shaderBinary->data,
+				shaderBinary->size);
+
+			pipelineDesc.bindingLayouts = {
+				m_bindingLayout->handle
+			};
+
+			m_pipeline = Application::GetNVRHIDevice()->createComputePipeline(pipelineDesc);
+		}
+#pragma endregion
+	}
+
+	void SkinningPass::beginPass()
+	{
+		m_instances.clear();
+		m_bonePalette.clear();
+		m_vertexCount = 0;
+		m_skinnedMeshIndices.clear();
+		m_bindingSets.clear();
+	}
+
+	void SkinningPass::addInstance(const void* owner, const Ref<Mesh>& source, const glm::mat4* bonePalette, uint32_t boneCount)
+	{
+		Instance& instance = m_instances.emplace_back();
+		instance.owner = owner;
+		instance.source = source;
+		instance.data.vertexCount = source->getVertexCount();
+		instance.data.boneOffset = static_cast<uint32_t>(m_bonePalette.size());
+		instance.data.boneCount = boneCount;
+		instance.data.outputOffset = m_vertexCount;
+
+		m_bonePalette.insert(m_bonePalette.end(), bonePalette, bonePalette + boneCount);
+		m_vertexCount += instance.data.vertexCount;
+	}
+
+	void SkinningPass::processScene(Ref<Scene> scene, const Frustum& cameraFrustum)
+	{
+		PE_PROFILE_FUNCTION();
+
+		// skinned mesh通常不多，不用分到worker
+		const auto skinned_view = scene->getRegistry().view<SkinnedMeshComponent, MeshComponent, MeshRendererComponent>();
+		for (auto [entity, skinnedCom, meshCom, meshRendererCom] : skinned_view.each()) {
+			if (!meshRendererCom.visible || !meshRendererCom.renderStatic || !meshCom.mesh)
+				continue;
+			if (meshCom.mesh->getType() != MeshType::Skeletal || skinnedCom.bonePalette.empty())
+				continue;
+			if (!meshRendererCom.castShadow && !cameraFrustum.isIntersect(meshCom.worldAABB))
+				continue;
+
+			addInstance(&meshCom, meshCom.mesh, skinnedCom.bonePalette.data(), static_cast<uint32_t>(skinnedCom.bonePalette.size()));
+		}
+	}
+
+	void SkinningPass::processSnapshot(const SceneSnapshot& snapshot, const Frustum& cameraFrustum)
+	{
+		PE_PROFILE_FUNCTION();
+
+		for (const auto& instance : snapshot.meshInstances) {
+			if (instance.boneCount == 0 || instance.mesh->getType() != MeshType::Skeletal)
+				continue;
+			if (!instance.castShadow && !cameraFrustum.isIntersect(instance.worldAABB))
+				continue;
+
+			addInstance(&instance, instance.mesh, snapshot.bonePalettes.data() + instance.bonePaletteOffset, instance.boneCount);
+		}
+	}
+
+	void SkinningPass::reserveOutput(uint32_t vertexCount)
+	{
+		if (m_outputBuffer && vertexCount <= m_outputCapacity)
+			return;
+
+		// 多留一些，不要每次多一個instance就重新建立
+		m_outputCapacity = std::max({ vertexCount, m_outputCapacity + m_outputCapacity / 2, 4096u });
+
+		nvrhi::BufferDesc bufferDesc;
+		bufferDesc
+			.setDebugName("Skinned Vertex Buffer")
+			.setByteSize(static_cast<uint64_t>(m_outputCapacity) * sizeof(StaticVertex))
+			.setIsVertexBuffer(true)
+			.setCanHaveUAVs(true)
+			.setCanHaveRawViews(true)
+			.setInitialState(nvrhi::ResourceStates::VertexBuffer)
+			.setKeepInitialState(true);
+		// FrameStatic: 每個frame in flight各一個storage
+		// 舊的buffer由GPUMemoryAllocator等GPU用完才釋放
+		m_outputBuffer = CreateRef<GPUBuffer>(ResourceUsage::FrameStatic, bufferDesc);
+	}
+
+	bool SkinningPass::upload()
+	{
+		PE_PROFILE_FUNCTION();
+
+		if (m_instances.empty() || !m_pipeline)
+			return true;
+
+		FrameUploadAllocator* uploadAllocator = Application::GetFrameUploadAllocator();
+		const FrameUploadAllocation paletteAllocation = uploadAllocator->upload(m_bonePalette.data(), m_bonePalette.size());
+		if (!paletteAllocation.isValid())
+			return false;
+
+		reserveOutput(m_vertexCount);
+		// 只用這個frame in flight的storage，skinned Mesh每個frame重新指向
+		const uint32_t frameIndex = Application::Get()->getGraphicsContext()->getCurrentFrameIndex();
+		nvrhi::IBuffer* outputBuffer = m_outputBuffer->getStorages()[frameIndex].handle;
+
+		while (m_skinnedMeshes.size() < m_instances.size())
+			m_skinnedMeshes.push_back(CreateRef<Mesh>());
+
+		for (uint32_t i = 0; i < m_instances.size(); i++) {
+			const Instance& instance = m_instances[i];
+			const FrameUploadAllocation instanceAllocation = uploadAllocator->upload(&instance.data, 1);
+			if (!instanceAllocation.isValid()) {
+				m_bindingSets.clear();
+				m_skinnedMeshIndices.clear();
+				return false;
+			}
+
+			nvrhi::BindingSetDesc setDesc;
+			setDesc
+				.addItem(nvrhi::BindingSetItem::ConstantBuffer(0, instanceAllocation.buffer, instanceAllocation.getRange()))
+				.addItem(nvrhi::BindingSetItem::RawBuffer_SRV(0, instance.source->getVertexBuffer()))
+				.addItem(nvrhi::BindingSetItem::RawBuffer_SRV(1, instance.source->getBoneBuffer()))
+				.addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(2, paletteAllocation.buffer, nvrhi::Format::UNKNOWN, paletteAllocation.getRange()))
+				.addItem(nvrhi::BindingSetItem::RawBuffer_UAV(0, outputBuffer));
+			m_bindingSets.push_back(Application::GetNVRHIDevice()->createBindingSet(setDesc, m_bindingLayout->handle));
+
+			m_skinnedMeshes[i]->setSkinnedOutput(instance.source, outputBuffer, instance.data.outputOffset);
+			m_skinnedMeshIndices[instance.owner] = i;
+		}
+
+		PE_FRAME_STAT_BYTES("Skinning Bone Palette Upload", m_bonePalette.size() * sizeof(glm::mat4));
+		return true;
+	}
+
+	const Ref<Mesh>& SkinningPass::resolveMesh(const void* owner, const Ref<Mesh>& mesh) const
+	{
+		if (m_skinnedMeshIndices.empty() || mesh->getType() != MeshType::Skeletal)
+			return mesh;
+
+		auto it = m_skinnedMeshIndices.find(owner);
+		return it != m_skinnedMeshIndices.end() ? m_skinnedMeshes[it->second] : mesh;
+	}
+
+	void SkinningPass::dispatch(nvrhi::ICommandList* cmd)
+	{
+		PE_PROFILE_FUNCTION();
+		PE_PROFILE_GPU_SCOPE(cmd, "Skinning");
+
+		nvrhi::ComputeState computeState;
+		computeState.pipeline = m_pipeline;
+		for (uint32_t i = 0; i < m_bindingSets.size(); i++) {
+			computeState.bindings = { m_bindingSets[i] };
+			cmd->setComputeState(computeState);
+			cmd->dispatch((m_instances[i].data.vertexCount + ThreadGroupSize - 1) / ThreadGroupSize);
+		}
+
+		PE_FRAME_STAT_COUNT("Skinned Instances", static_cast<uint32_t>(m_bindingSets.size()));
+		PE_FRAME_STAT_COUNT("Skinned Vertices", m_vertexCount);
+	}
+
+	void SkinningPass::endFrame()
+	{
+		m_bindingSets.clear();
+	}
+
+}
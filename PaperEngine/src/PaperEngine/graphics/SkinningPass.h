@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/scene/Scene.h>
+#include <PaperEngine/graphics/Mesh.h>
+#include <PaperEngine/graphics/SceneSnapshot.h>
+#include <PaperEngine/graphics/FrameUploadAllocator.h>
+#include <PaperEngine/utils/BoundingVolume.h>
+
+#include "BindingLayout.h"
+#include "GPUBuffer.h"
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 每個frame用compute shader把skeletal mesh skin到一個共用的output vertex buffer
+	/// 
+	/// 所有instance的bone palette打包成一個buffer，每個instance一個dispatch
+	/// 輸出的格式跟StaticVertex一樣 (mesh space)，每個instance有一個skinned output的Mesh
+	/// MeshRenderer跟shadow pass用getSkinnedMesh換掉原本的mesh，所以只skin一次就可以給所有pass用
+	/// 
+	/// 在camera frustum中或castShadow的instance才會skin (shadow pass自己cull)
+	/// 
+	/// 使用順序：beginPass -> processScene/processSnapshot -> upload -> (其他pass process) -> dispatch -> endFrame
+	/// </summary>
+	class SkinningPass {
+	public:
+		/// <summary>
+		/// 跟shader的SkinningInstance一樣
+		/// </summary>
+		struct InstanceData {
+			uint32_t vertexCount;
+			uint32_t boneOffset;			// 在bone palette buffer中的第一個matrix
+			uint32_t boneCount;
+			uint32_t outputOffset;			// 在output buffer中的第一個vertex
+		};
+
+		static constexpr uint32_t ThreadGroupSize = 64;
+
+	public:
+		SkinningPass() = default;
+		~SkinningPass() = default;
+
+		void init();
+
+		/// <summary>
+		/// 需要先Call這個才能process
+		/// </summary>
+		void beginPass();
+
+		void processScene(Ref<Scene> scene, const Frustum& cameraFrustum);
+
+		void processSnapshot(const SceneSnapshot& snapshot, const Frustum& cameraFrustum);
+
+		/// <summary>
+		/// 所有scene process完之後、其他pass process之前呼叫
+		/// 上傳bone palette，分配output buffer，設定skinned output的Mesh
+		/// 失敗的話這個frame沒有skinned mesh (照bind pose畫)，回傳false
+		/// </summary>
+		bool upload();
+
+		void dispatch(nvrhi::ICommandList* cmd);
+
+		void endFrame();
+
+		bool needsDispatch() const { return !m_bindingSets.empty(); }
+
+		/// <summary>
+		/// 有skin的話回傳skinned output的Mesh，沒有的話回傳原本的mesh
+		/// owner為scene的MeshComponent或snapshot的MeshInstance，upload後才有效
+		/// </summary>
+		const Ref<Mesh>& resolveMesh(const void* owner, const Ref<Mesh>& mesh) const;
+
+		uint32_t getInstanceCount() const { return static_cast<uint32_t>(m_instances.size()); }
+
+		/// <summary>
+		/// 這個frame skin的vertex數
+		/// </summary>
+		uint32_t getVertexCount() const { return m_vertexCount; }
+
+	private:
+		struct Instance {
+			const void* owner;
+			Ref<Mesh> source;
+			InstanceData data;
+		};
+
+	private:
+		void addInstance(const void* owner, const Ref<Mesh>& source, const glm::mat4* bonePalette, uint32_t boneCount);
+
+		/// <summary>
+		/// output buffer放不下vertexCount個vertex的話重新建立 (每個frame in flight各一個)
+		/// </summary>
+		void reserveOutput(uint32_t vertexCount);
+
+	private:
+		nvrhi::ComputePipelineHandle m_pipeline;
+		BindingLayoutHandle m_bindingLayout;
+
+		/// <summary>
+		/// FrameStatic的GPUBuffer，每個frame in flight各有一個storage
+		/// 這個frame的dispatch只寫getCurrentFrameIndex()的storage，不會蓋掉前面還在畫的frame讀的vertex
+		/// </summary>
+		GPUBufferHandle m_outputBuffer;
+		uint32_t m_outputCapacity = 0;	// 每個storage的vertex數
+
+		std::vector<Instance> m_instances;
+		std::vector<glm::mat4> m_bonePalette;
+		uint32_t m_vertexCount = 0;
+
+		// owner -> m_instances中的index，upload成功後才有
+		std::unordered_map<const void*, uint32_t> m_skinnedMeshIndices;
+		// 跨frame重複使用，m_instances[i]用m_skinnedMeshes[i]
+		std::vector<Ref<Mesh>> m_skinnedMeshes;
+		std::vector<nvrhi::BindingSetHandle> m_bindingSets;
+	};
+
+}
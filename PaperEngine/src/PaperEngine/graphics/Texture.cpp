@@ -1,17 +1,21 @@
 ﻿#include "Texture.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <PaperEngine/core/Application.h>
 
 namespace PaperEngine {
     
     Texture::Texture(nvrhi::TextureDesc desc)
     {
-        m_texture = Application::GetNVRHIDevice()->createTexture(desc);
+        m_texture = Application::GetGPUMemoryAllocator()->createTexture(desc, GPUMemoryCategory::Texture, m_memory);
         PE_CORE_TRACE("Texture created. {}", (void*)m_texture);
     }
 
     Texture::~Texture() {
         PE_CORE_TRACE("Texture destroyed. {}", (void*)m_texture);
+        Application::GetGPUMemoryAllocator()->free(m_memory);
     }
 
     nvrhi::ITexture* Texture::getTexture()
@@ -19,6 +23,35 @@ namespace PaperEngine {
         return m_texture;
     }
 
+    void Texture::requestScreenSize(float screenPixels)
+    {
+        if (!m_streamed)
+            return;
+
+        // 一個texel對應一個pixel的mip
+        uint32_t mip = 0;
+        if (screenPixels < static_cast<float>(m_fullSize)) {
+            const float ratio = static_cast<float>(m_fullSize) / std::max(screenPixels, 1.0f);
+            mip = std::min(static_cast<uint32_t>(std::log2(ratio)), m_mipCount - 1);
+        }
+
+        uint32_t current = m_requestedMip.load(std::memory_order_relaxed);
+        while (mip < current && !m_requestedMip.compare_exchange_weak(current, mip, std::memory_order_relaxed)) {
+        }
+    }
+
+    nvrhi::TextureHandle Texture::replace(nvrhi::TextureHandle texture, GPUMemoryAllocation memory, uint32_t residentMip)
+    {
+        nvrhi::TextureHandle oldTexture = m_texture;
+        Application::GetGPUMemoryAllocator()->free(m_memory);
+
+        m_texture = texture;
+        m_memory = memory;
+        m_residentMip = residentMip;
+        m_version.fetch_add(1, std::memory_order_release);
+        return oldTexture;
+    }
+
     //uint32_t Texture::GetMipLevelsNum(uint32_t width, uint32_t height)
     //{
     //    uint32_t size = std::min(width, height);
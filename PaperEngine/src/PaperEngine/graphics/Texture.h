@@ -1,18 +1,26 @@
 ﻿#pragma once
 
 #include <vector>
+#include <atomic>
 #include <cstdint>
 
 #include <nvrhi/nvrhi.h>
 
 #include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
 
 namespace PaperEngine {
 
 	/// <summary>
 	/// 使用TextureLoader載入Texture
+	/// 
+	/// TextureStreamer載入的texture只有部分mip resident
+	/// getTexture()只包含resident的mip (mip 0是完整mip chain的getResidentMip())，mip變化時會換成新的ITexture
 	/// </summary>
 	class Texture {
+	public:
+		static constexpr uint32_t NoRequest = ~0u;
+
 	public:
 		Texture(nvrhi::TextureDesc desc);
 		~Texture();
@@ -20,10 +28,46 @@ namespace PaperEngine {
 
 		nvrhi::ITexture* getTexture();
 
+		/// <summary>
+		/// getTexture()換成新的ITexture時+1
+		/// 非bindless的Material用這個判斷binding set要不要重建
+		/// </summary>
+		uint32_t getVersion() const { return m_version.load(std::memory_order_acquire); }
+
+		bool isStreamed() const { return m_streamed; }
+
+		/// <summary>
+		/// 完整mip chain中目前resident的最高解析度mip
+		/// </summary>
+		uint32_t getResidentMip() const { return m_residentMip; }
 
+		/// <summary>
+		/// 這個texture在畫面上大約佔screenPixels個pixel (寬高較大的那邊)，換算成需要的mip
+		/// 這個frame所有request中取最高解析度的，由TextureStreamer在下一個frame處理
+		/// Thread safe，不是streaming的texture不做事
+		/// </summary>
+		PE_API void requestScreenSize(float screenPixels);
+
+	private:
+		friend class TextureStreamer;
+
+		/// <summary>
+		/// 換成新的resident mip範圍，舊的記憶體free (frame in flight後才會被重新使用)
+		/// 回傳舊的texture，要等GPU用完才能釋放
+		/// </summary>
+		nvrhi::TextureHandle replace(nvrhi::TextureHandle texture, GPUMemoryAllocation memory, uint32_t residentMip);
 
 	private:
 		nvrhi::TextureHandle m_texture;
+		GPUMemoryAllocation m_memory;
+		std::atomic<uint32_t> m_version{ 0 };
+
+		// streaming
+		bool m_streamed = false;
+		uint32_t m_fullSize = 0;		// mip 0的寬高較大的那邊
+		uint32_t m_mipCount = 1;		// 完整mip chain
+		uint32_t m_residentMip = 0;
+		std::atomic<uint32_t> m_requestedMip{ NoRequest };
 	};
 
 	typedef Ref<Texture> TextureHandle;
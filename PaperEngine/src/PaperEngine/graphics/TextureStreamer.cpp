@@ -0,0 +1,410 @@
+﻿#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <PaperEngine/core/Application.h>
+#include <PaperEngine/graphics/BindlessMaterialTable.h>
+#include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/FrameStats.h>
+
+namespace PaperEngine {
+
+	namespace {
+
+		/// <summary>
+		/// 讀取 [begin, end) 的mip，失敗回傳空的
+		/// 回傳的index是mip - begin
+		/// </summary>
+		std::vector<std::vector<uint8_t>> ReadMips(const std::filesystem::path& path, const std::vector<StreamingTextureMip>& mips, uint32_t begin, uint32_t end)
+		{
+			std::ifstream file(path, std::ios::binary);
+			if (!file.is_open())
+				return {};
+
+			std::vector<std::vector<uint8_t>> data(end - begin);
+			for (uint32_t mip = begin; mip < end; mip++) {
+				auto& mipData = data[mip - begin];
+				mipData.resize(mips[mip].size);
+				file.seekg(static_cast<std::streamoff>(mips[mip].offset));
+				file.read(reinterpret_cast<char*>(mipData.data()), static_cast<std::streamsize>(mipData.size()));
+				if (!file)
+					return {};
+			}
+			return data;
+		}
+
+		nvrhi::TextureDesc MakeDesc(nvrhi::Format format, const StreamingTextureMip& topMip, uint32_t mipLevels, const std::filesystem::path& path)
+		{
+			nvrhi::TextureDesc desc;
+			desc.setDebugName(path.filename().string());
+			desc.format = format;
+			desc.width = topMip.width;
+			desc.height = topMip.height;
+			desc.depth = 1;
+			desc.arraySize = 1;
+			desc.dimension = nvrhi::TextureDimension::Texture2D;
+			desc.mipLevels = mipLevels;
+			return desc;
+		}
+
+	}
+
+	TextureStreamer::TextureStreamer(uint64_t budget, uint32_t framesInFlight) :
+		m_budget(budget), m_framesInFlight(framesInFlight)
+	{
+	}
+
+	TextureStreamer::~TextureStreamer()
+	{
+		for (auto& entry : m_entries)
+			releaseEntry(*entry);
+		m_retiredTextures.clear();
+	}
+
+	TextureHandle TextureStreamer::load(nvrhi::ICommandList* cmd, const std::filesystem::path& path)
+	{
+		PE_PROFILE_FUNCTION();
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			PE_CORE_ERROR("[TextureStreamer] Could not open '{}'.", path.string());
+			return nullptr;
+		}
+
+		StreamingTextureHeader header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || header.magic != StreamingTextureHeader::Magic || header.version != StreamingTextureHeader::CurrentVersion ||
+			header.mipCount == 0 || header.mipCount > MaxMipCount) {
+			PE_CORE_ERROR("[TextureStreamer] '{}' is not a valid streaming texture.", path.string());
+			return nullptr;
+		}
+
+		auto entry = CreateScope<Entry>();
+		entry->path = path;
+		entry->format = static_cast<nvrhi::Format>(header.format);
+		entry->mips.resize(header.mipCount);
+		file.read(reinterpret_cast<char*>(entry->mips.data()), static_cast<std::streamsize>(sizeof(StreamingTextureMip) * header.mipCount));
+		if (!file) {
+			PE_CORE_ERROR("[TextureStreamer] '{}' mip table is truncated.", path.string());
+			return nullptr;
+		}
+		file.close();
+
+		// 第一個寬高都不超過ResidentTailSize的mip
+		const uint32_t mipCount = header.mipCount;
+		uint32_t tailMip = 0;
+		while (tailMip + 1 < mipCount &&
+			(entry->mips[tailMip].width > ResidentTailSize || entry->mips[tailMip].height > ResidentTailSize))
+			tailMip++;
+
+		auto tailData = ReadMips(path, entry->mips, tailMip, mipCount);
+		if (tailData.empty()) {
+			PE_CORE_ERROR("[TextureStreamer] Failed to read tail mips of '{}'.", path.string());
+			return nullptr;
+		}
+
+		nvrhi::TextureDesc desc = MakeDesc(entry->format, entry->mips[tailMip], mipCount - tailMip, path);
+		desc.initialState = nvrhi::ResourceStates::ShaderResource;
+		desc.keepInitialState = true;
+		TextureHandle texture = CreateRef<Texture>(desc);
+		if (!texture->getTexture())
+			return nullptr;
+
+		texture->m_streamed = true;
+		texture->m_fullSize = std::max(header.width, header.height);
+		texture->m_mipCount = mipCount;
+		texture->m_residentMip = tailMip;
+
+		cmd->beginTrackingTextureState(texture->getTexture(), nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
+		for (uint32_t mip = tailMip; mip < mipCount; mip++)
+			cmd->writeTexture(texture->getTexture(), 0, mip - tailMip, tailData[mip - tailMip].data(), entry->mips[mip].rowPitch);
+		cmd->setPermanentTextureState(texture->getTexture(), nvrhi::ResourceStates::ShaderResource);
+		cmd->commitBarriers();
+
+		entry->texture = texture;
+		entry->mipData.resize(mipCount);
+		for (uint32_t mip = tailMip; mip < mipCount; mip++)
+			entry->mipData[mip] = std::move(tailData[mip - tailMip]);
+		entry->tailMip = tailMip;
+		entry->residentMip = tailMip;
+		entry->wantedMip = tailMip;
+
+		std::lock_guard<std::mutex> lock(m_newEntryMutex);
+		m_newEntries.push_back(std::move(entry));
+		return texture;
+	}
+
+	void TextureStreamer::update(nvrhi::ICommandList* cmd)
+	{
+		PE_PROFILE_FUNCTION();
+
+		m_frameNumber++;
+		m_uploadBytes = 0;
+
+		// GPU已經用完的舊texture
+		while (!m_retiredTextures.empty() && m_retiredTextures.front().frameNumber + m_framesInFlight <= m_frameNumber)
+			m_retiredTextures.pop_front();
+
+		{
+			std::lock_guard<std::mutex> lock(m_newEntryMutex);
+			for (auto& entry : m_newEntries)
+				m_entries.push_back(std::move(entry));
+			m_newEntries.clear();
+		}
+
+		nvrhi::IDevice* device = Application::GetNVRHIDevice();
+		uint64_t usage = 0;
+		for (size_t i = 0; i < m_entries.size();) {
+			Entry& entry = *m_entries[i];
+
+			Ref<Texture> texture = entry.texture.lock();
+			if (!texture) {
+				// 讀檔的task還沒結束的話下個frame再移除
+				if (entry.state == EntryState::Loading && entry.io.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+					i++;
+					continue;
+				}
+				releaseEntry(entry);
+				std::swap(m_entries[i], m_entries.back());
+				m_entries.pop_back();
+				continue;
+			}
+
+			const uint32_t requestedMip = texture->m_requestedMip.exchange(Texture::NoRequest, std::memory_order_relaxed);
+			if (requestedMip != Texture::NoRequest) {
+				entry.wantedMip = std::min(requestedMip, entry.tailMip);
+				entry.lastRequestFrame = m_frameNumber;
+			}
+
+			if (entry.state == EntryState::Loading && entry.io.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				auto data = entry.io.get();
+				entry.state = EntryState::Idle;
+				if (data.empty()) {
+					// 不再重試，之後只使用已經resident的mip
+					PE_CORE_ERROR("[TextureStreamer] Failed to read mips of '{}'.", entry.path.string());
+					entry.tailMip = entry.residentMip;
+					entry.wantedMip = entry.residentMip;
+				}
+				else {
+					for (uint32_t mip = entry.targetMip; mip < entry.residentMip; mip++)
+						entry.mipData[mip] = std::move(data[mip - entry.targetMip]);
+					startUpload(entry, entry.targetMip, getCopyCommandList());
+				}
+			}
+			else if (entry.state == EntryState::Uploading && device->pollEventQuery(entry.uploadQuery)) {
+				finishUpload(entry, *texture, cmd);
+			}
+
+			usage += GetMipRangeSize(entry, entry.residentMip, static_cast<uint32_t>(entry.mips.size()));
+			if (entry.state != EntryState::Idle)
+				usage += GetMipRangeSize(entry, entry.targetMip, static_cast<uint32_t>(entry.mips.size()));
+			i++;
+		}
+
+		uint32_t evictionCount = 0;
+		if (usage > m_budget) {
+			// LRU: 最久沒有被request的先降回tail mips，這個frame有request的只降到需要的mip
+			std::vector<Entry*> candidates;
+			for (auto& entry : m_entries)
+				if (entry->state == EntryState::Idle && entry->residentMip < entry->tailMip)
+					candidates.push_back(entry.get());
+			std::sort(candidates.begin(), candidates.end(), [](const Entry* a, const Entry* b) {
+				return a->lastRequestFrame < b->lastRequestFrame;
+				});
+
+			for (Entry* entry : candidates) {
+				if (usage <= m_budget)
+					break;
+				const uint32_t targetMip = entry->lastRequestFrame < m_frameNumber ? entry->tailMip : entry->wantedMip;
+				if (targetMip <= entry->residentMip)
+					continue;
+				if (startUpload(*entry, targetMip, getCopyCommandList())) {
+					usage -= GetMipRangeSize(*entry, entry->residentMip, targetMip);
+					evictionCount++;
+				}
+			}
+		}
+
+		// 這個frame有request且需要更高解析度的，差最多mip的優先
+		std::vector<Entry*> loads;
+		for (auto& entry : m_entries)
+			if (entry->state == EntryState::Idle && entry->lastRequestFrame == m_frameNumber && entry->wantedMip < entry->residentMip)
+				loads.push_back(entry.get());
+		std::sort(loads.begin(), loads.end(), [](const Entry* a, const Entry* b) {
+			return a->residentMip - a->wantedMip > b->residentMip - b->wantedMip;
+			});
+
+		uint32_t loadCount = 0;
+		for (Entry* entry : loads) {
+			if (loadCount >= MaxLoadsPerFrame)
+				break;
+			const uint64_t size = GetMipRangeSize(*entry, entry->wantedMip, entry->residentMip);
+			if (usage + size > m_budget)
+				continue;
+			usage += size;
+			startLoad(*entry, entry->wantedMip);
+			loadCount++;
+		}
+
+		if (m_openCopyCommandList) {
+			m_openCopyCommandList->close();
+			const uint64_t instance = device->executeCommandList(m_openCopyCommandList, nvrhi::CommandQueue::Copy);
+			nvrhi::EventQueryHandle query = device->createEventQuery();
+			device->setEventQuery(query, nvrhi::CommandQueue::Copy);
+			for (Entry* entry : m_recordedUploads) {
+				entry->uploadQuery = query;
+				entry->uploadInstance = instance;
+			}
+			m_recordedUploads.clear();
+			m_openCopyCommandList = nullptr;
+		}
+		cmd->commitBarriers();
+
+		m_residentSize = 0;
+		for (const auto& entry : m_entries)
+			m_residentSize += GetMipRangeSize(*entry, entry->residentMip, static_cast<uint32_t>(entry->mips.size()));
+
+		PE_FRAME_STAT_BYTES("Texture Streaming Resident", m_residentSize);
+		PE_FRAME_STAT_BYTES("Texture Streaming Upload", m_uploadBytes);
+		PE_FRAME_STAT_COUNT("Texture Streaming Loads", loadCount);
+		PE_FRAME_STAT_COUNT("Texture Streaming Evictions", evictionCount);
+		PE_FRAME_STAT_COUNT("Texture Streaming Textures", m_entries.size());
+	}
+
+	uint64_t TextureStreamer::GetMipRangeSize(const Entry& entry, uint32_t begin, uint32_t end)
+	{
+		uint64_t size = 0;
+		for (uint32_t mip = begin; mip < end; mip++)
+			size += entry.mips[mip].size;
+		return size;
+	}
+
+	void TextureStreamer::startLoad(Entry& entry, uint32_t targetMip)
+	{
+		entry.state = EntryState::Loading;
+		entry.targetMip = targetMip;
+		entry.io = Application::GetThreadPool()->submit_task(
+			[path = entry.path, mips = entry.mips, begin = targetMip, end = entry.residentMip]()
+			{
+				PE_PROFILE_SCOPE("TextureStreamer read mips");
+				return ReadMips(path, mips, begin, end);
+			});
+	}
+
+	bool TextureStreamer::startUpload(Entry& entry, uint32_t targetMip, nvrhi::ICommandList* copyCmd)
+	{
+		const uint32_t mipCount = static_cast<uint32_t>(entry.mips.size());
+		nvrhi::TextureDesc desc = MakeDesc(entry.format, entry.mips[targetMip], mipCount - targetMip, entry.path);
+		desc.initialState = nvrhi::ResourceStates::Common;
+		entry.newTexture = Application::GetGPUMemoryAllocator()->createTexture(desc, GPUMemoryCategory::Texture, entry.newMemory);
+		if (!entry.newTexture) {
+			PE_CORE_ERROR("[TextureStreamer] Failed to create mip {} of '{}'.", targetMip, entry.path.string());
+			// 讀進來的mip用不到了
+			for (uint32_t mip = targetMip; mip < entry.residentMip; mip++)
+				entry.mipData[mip] = {};
+			return false;
+		}
+
+		copyCmd->beginTrackingTextureState(entry.newTexture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
+		for (uint32_t mip = targetMip; mip < mipCount; mip++) {
+			copyCmd->writeTexture(entry.newTexture, 0, mip - targetMip, entry.mipData[mip].data(), entry.mips[mip].rowPitch);
+			m_uploadBytes += entry.mips[mip].size;
+		}
+
+		entry.state = EntryState::Uploading;
+		entry.targetMip = targetMip;
+		m_recordedUploads.push_back(&entry);
+		return true;
+	}
+
+	void TextureStreamer::finishUpload(Entry& entry, Texture& texture, nvrhi::ICommandList* cmd)
+	{
+		nvrhi::IDevice* device = Application::GetNVRHIDevice();
+		device->queueWaitForCommandList(nvrhi::CommandQueue::Graphics, nvrhi::CommandQueue::Copy, entry.uploadInstance);
+
+		cmd->beginTrackingTextureState(entry.newTexture, nvrhi::AllSubresources, nvrhi::ResourceStates::CopyDest);
+		cmd->setPermanentTextureState(entry.newTexture, nvrhi::ResourceStates::ShaderResource);
+
+		nvrhi::TextureHandle oldTexture = texture.replace(entry.newTexture, entry.newMemory, entry.targetMip);
+		// bindless的material改指向新的slot，舊的slot跟texture等GPU用完才回收
+		if (auto bindlessTable = Application::GetResourceManager()->load<BindlessMaterialTable>("BindlessMaterialTable"))
+			bindlessTable->replaceTexture(oldTexture, entry.newTexture);
+		m_retiredTextures.push_back({ oldTexture, m_frameNumber });
+
+		// evict的mip不需要CPU資料
+		for (uint32_t mip = entry.residentMip; mip < entry.targetMip; mip++)
+			entry.mipData[mip] = {};
+
+		entry.residentMip = entry.targetMip;
+		entry.state = EntryState::Idle;
+		entry.newTexture = nullptr;
+		entry.newMemory = {};
+		entry.uploadQuery = nullptr;
+	}
+
+	nvrhi::ICommandList* TextureStreamer::getCopyCommandList()
+	{
+		if (m_openCopyCommandList)
+			return m_openCopyCommandList;
+
+		auto& commandList = m_copyCommandLists[Application::Get()->getGraphicsContext()->getCurrentFrameIndex()];
+		if (!commandList)
+			commandList = Application::GetNVRHIDevice()->createCommandList(
+				nvrhi::CommandListParameters().setQueueType(nvrhi::CommandQueue::Copy));
+
+		commandList->open();
+		m_openCopyCommandList = commandList;
+		return m_openCopyCommandList;
+	}
+
+	void TextureStreamer::releaseEntry(Entry& entry)
+	{
+		if (entry.newMemory.isValid())
+			Application::GetGPUMemoryAllocator()->free(entry.newMemory);
+		entry.newTexture = nullptr;
+	}
+
+	bool TextureStreamer::WriteFile(const std::filesystem::path& path, nvrhi::Format format, uint32_t width, uint32_t height, uint32_t bytesPerPixel, const std::vector<std::vector<uint8_t>>& mips)
+	{
+		if (mips.empty() || mips.size() > MaxMipCount) {
+			PE_CORE_ERROR("[TextureStreamer] Invalid mip count {} for '{}'.", mips.size(), path.string());
+			return false;
+		}
+
+		StreamingTextureHeader header;
+		header.format = static_cast<uint32_t>(format);
+		header.width = width;
+		header.height = height;
+		header.mipCount = static_cast<uint32_t>(mips.size());
+
+		// 最小的mip放在前面
+		std::vector<StreamingTextureMip> table(mips.size());
+		uint64_t offset = sizeof(StreamingTextureHeader) + sizeof(StreamingTextureMip) * mips.size();
+		for (size_t i = mips.size(); i-- > 0;) {
+			auto& mip = table[i];
+			mip.width = std::max(1u, width >> i);
+			mip.height = std::max(1u, height >> i);
+			mip.rowPitch = mip.width * bytesPerPixel;
+			mip.size = static_cast<uint64_t>(mip.rowPitch) * mip.height;
+			mip.offset = offset;
+			if (mips[i].size() != mip.size) {
+				PE_CORE_ERROR("[TextureStreamer] Mip {} size mismatch ({} != {}) for '{}'.", i, mips[i].size(), mip.size, path.string());
+				return false;
+			}
+			offset += mip.size;
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			PE_CORE_ERROR("[TextureStreamer] Could not write '{}'.", path.string());
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(sizeof(StreamingTextureMip) * table.size()));
+		for (size_t i = mips.size(); i-- > 0;)
+			file.write(reinterpret_cast<const char*>(mips[i].data()), static_cast<std::streamsize>(mips[i].size()));
+		return static_cast<bool>(file);
+	}
+
+}
@@ -0,0 +1,186 @@
+﻿#pragma once
+
+#include <array>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include <nvrhi/nvrhi.h>
+
+#include <PaperEngine/core/Base.h>
+#include <PaperEngine/graphics/GraphicsContext.h>
+#include <PaperEngine/graphics/GPUMemoryAllocator.h>
+#include <PaperEngine/graphics/Texture.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// Streaming texture檔案 (.ptex)
+	/// [StreamingTextureHeader][StreamingTextureMip * mipCount][mip data]
+	/// mip data從最小的mip開始放，tail mips可以一次讀完
+	/// 只支援沒有壓縮的format
+	/// </summary>
+	struct StreamingTextureHeader {
+		static constexpr uint32_t Magic = 0x58455450;		// "PTEX"
+		static constexpr uint32_t CurrentVersion = 1;
+
+		uint32_t magic = Magic;
+		uint32_t version = CurrentVersion;
+		uint32_t format = 0;		// nvrhi::Format
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipCount = 0;
+	};
+
+	struct StreamingTextureMip {
+		uint64_t offset = 0;		// 從檔案開頭算 (bytes)
+		uint64_t size = 0;			// bytes
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t rowPitch = 0;
+		uint32_t padding = 0;
+	};
+
+	/// <summary>
+	/// Texture streaming
+	/// 
+	/// load時只讀取跟上傳tail mips (寬高都不超過ResidentTailSize)，之後一直resident
+	/// MeshRenderer依照mesh的worldAABB估計在畫面上的大小，透過Texture::requestScreenSize要求需要的mip
+	/// update時:
+	///		比resident還高解析度的request在thread pool讀檔 (一次讀到需要的mip)
+	///		讀完後建立新mip範圍的texture，在copy queue上傳
+	///		上傳完成 (event query) 後換掉Texture的ITexture，bindless descriptor直接改寫同一個index
+	///		使用量超過budget時，從最久沒有被request的texture開始降回tail mips (LRU)
+	/// 
+	/// 不使用sparse texture，mip範圍變化時重建整個texture，resident mip的CPU資料保留在記憶體中用來重建
+	/// 換掉的ITexture等frame in flight個frame後才釋放 (descriptor table不會保持resource存活)
+	/// </summary>
+	class TextureStreamer {
+	public:
+		/// <summary>
+		/// 寬高都不超過這個的mip一直resident
+		/// </summary>
+		static constexpr uint32_t ResidentTailSize = 64;
+
+		/// <summary>
+		/// 每個frame最多開始幾個texture的讀檔
+		/// </summary>
+		static constexpr uint32_t MaxLoadsPerFrame = 8;
+
+		static constexpr uint32_t MaxMipCount = 16;
+
+	public:
+		TextureStreamer(uint64_t budget, uint32_t framesInFlight);
+		~TextureStreamer();
+
+		/// <summary>
+		/// 讀取.ptex，只上傳tail mips
+		/// 跟TextureLoader一樣錄在cmd中，由呼叫的地方execute
+		/// Thread safe
+		/// </summary>
+		PE_API TextureHandle load(nvrhi::ICommandList* cmd, const std::filesystem::path& path);
+
+		/// <summary>
+		/// render thread在main command list open後呼叫
+		/// 上傳完成的texture在cmd轉成ShaderResource後換上去，依照request跟budget開始讀檔/evict
+		/// </summary>
+		void update(nvrhi::ICommandList* cmd);
+
+		/// <summary>
+		/// streaming texture的mip可以使用的記憶體 (bytes)，tail mips也算在內
+		/// </summary>
+		PE_API void setBudget(uint64_t bytes) { m_budget = bytes; }
+
+		uint64_t getBudget() const { return m_budget; }
+
+		/// <summary>
+		/// 上一次update時resident mip的總大小 (bytes)
+		/// </summary>
+		uint64_t getResidentSize() const { return m_residentSize; }
+
+	public:
+		/// <summary>
+		/// 寫出.ptex，mips[0]為最大的mip，每個mip的寬高是上一個的一半 (最小為1)
+		/// </summary>
+		PE_API static bool WriteFile(const std::filesystem::path& path, nvrhi::Format format, uint32_t width, uint32_t height, uint32_t bytesPerPixel, const std::vector<std::vector<uint8_t>>& mips);
+
+	private:
+		enum class EntryState {
+			Idle,
+			Loading,		// thread pool讀檔中
+			Uploading,		// copy queue上傳中
+		};
+
+		struct Entry {
+			std::weak_ptr<Texture> texture;
+			std::filesystem::path path;
+			nvrhi::Format format = nvrhi::Format::UNKNOWN;
+			std::vector<StreamingTextureMip> mips;
+			/// <summary>
+			/// resident mip的CPU資料，index是完整mip chain的mip
+			/// </summary>
+			std::vector<std::vector<uint8_t>> mipData;
+
+			uint32_t tailMip = 0;
+			uint32_t residentMip = 0;
+			uint32_t wantedMip = 0;
+			uint64_t lastRequestFrame = 0;
+
+			EntryState state = EntryState::Idle;
+			uint32_t targetMip = 0;
+			std::future<std::vector<std::vector<uint8_t>>> io;		// [targetMip, residentMip)
+			nvrhi::TextureHandle newTexture;
+			GPUMemoryAllocation newMemory;
+			nvrhi::EventQueryHandle uploadQuery;
+			uint64_t uploadInstance = 0;
+		};
+
+		struct RetiredTexture {
+			nvrhi::TextureHandle texture;
+			uint64_t frameNumber;
+		};
+
+	private:
+		/// <summary>
+		/// [begin, end) mip的大小總和
+		/// </summary>
+		static uint64_t GetMipRangeSize(const Entry& entry, uint32_t begin, uint32_t end);
+
+		void startLoad(Entry& entry, uint32_t targetMip);
+
+		/// <summary>
+		/// 建立 [targetMip, mipCount) 的texture並錄製上傳，mipData要已經有這些mip
+		/// </summary>
+		bool startUpload(Entry& entry, uint32_t targetMip, nvrhi::ICommandList* copyCmd);
+
+		void finishUpload(Entry& entry, Texture& texture, nvrhi::ICommandList* cmd);
+
+		/// <summary>
+		/// 這個frame的copy command list，第一次使用時open
+		/// </summary>
+		nvrhi::ICommandList* getCopyCommandList();
+
+		void releaseEntry(Entry& entry);
+
+	private:
+		uint64_t m_budget;
+		uint32_t m_framesInFlight;
+		uint64_t m_frameNumber = 0;
+		uint64_t m_residentSize = 0;
+
+		std::mutex m_newEntryMutex;
+		std::vector<Scope<Entry>> m_newEntries;		// load完還沒被update收走的
+		std::vector<Scope<Entry>> m_entries;
+
+		std::deque<RetiredTexture> m_retiredTextures;
+
+		// copy queue，每個frame in flight一個
+		std::array<nvrhi::CommandListHandle, GraphicsContext::MaxFramesInFlight> m_copyCommandLists;
+		nvrhi::ICommandList* m_openCopyCommandList = nullptr;
+		std::vector<Entry*> m_recordedUploads;		// 這個frame錄在copy command list中的
+		uint64_t m_uploadBytes = 0;
+	};
+
+}
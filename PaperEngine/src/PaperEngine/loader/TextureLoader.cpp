@@ -2,79 +2,141 @@
 
 #include <PaperEngine/core/Base.h>
 #include <PaperEngine/core/Application.h>
+#include <PaperEngine/graphics/TextureStreamer.h>
 #include "STBInclude.h"
 
+#include <type_traits>
+
 namespace PaperEngine {
     
     TextureLoader::TextureLoader()
     {
     }
 
-    TextureHandle TextureLoader::load2DFromMemory(nvrhi::CommandListHandle cmd, const void* data, size_t size, const TextureConfig& config)
-    {
-        int width = 0, height = 0, originalChannels = 0, channels = 0;
-
-        if (stbi_info_from_memory(
-            static_cast<const stbi_uc*>(data), 
-            static_cast<int>(size), 
-            &width, 
-            &height, 
-            &originalChannels) == 0) {
-            PE_CORE_ERROR("Failed to process image header: {}", stbi_failure_reason());
-            return nullptr;
-        }
+    namespace {
 
-        bool isHdr = stbi_is_hdr_from_memory(
-            static_cast<const stbi_uc*>(data),
-            static_cast<int>(size));
+        /// <summary>
+        /// stb_image解碼後的圖片，3 channel會被轉成4 channel
+        /// </summary>
+        struct DecodedImage {
+            uint8_t* bitmap = nullptr;
+            int width = 0;
+            int height = 0;
+            int channels = 0;
+            bool isHdr = false;
+            nvrhi::Format format = nvrhi::Format::UNKNOWN;
 
-        if (originalChannels == 3) {
-            channels = 4;
-        }
-        else {
-            channels = originalChannels;
-        }
+            ~DecodedImage() {
+                if (bitmap)
+                    stbi_image_free(bitmap);
+            }
 
-        uint8_t* bitmap;
-        int bytesPerPixels = channels * (isHdr ? 4 : 1);
+            uint32_t getBytesPerPixel() const { return channels * (isHdr ? 4 : 1); }
+        };
 
-        if (isHdr) {
-            float* floatmap = stbi_loadf_from_memory(
-                static_cast<const stbi_uc*>(data),
-                static_cast<int>(size),
-                &width, &height, &originalChannels, channels);
+        bool DecodeImage(const void* data, size_t size, const TextureLoader::TextureConfig& config, DecodedImage& image)
+        {
+            int originalChannels = 0;
 
-            bitmap = reinterpret_cast<uint8_t*>(floatmap);
-        }
-        else {
-            bitmap = stbi_load_from_memory(
+            if (stbi_info_from_memory(
                 static_cast<const stbi_uc*>(data),
                 static_cast<int>(size),
-                &width, &height, &originalChannels, channels);
+                &image.width,
+                &image.height,
+                &originalChannels) == 0) {
+                PE_CORE_ERROR("Failed to process image header: {}", stbi_failure_reason());
+                return false;
+            }
+
+            image.isHdr = stbi_is_hdr_from_memory(
+                static_cast<const stbi_uc*>(data),
+                static_cast<int>(size));
+
+            if (originalChannels == 3) {
+                image.channels = 4;
+            }
+            else {
+                image.channels = originalChannels;
+            }
+
+            if (image.isHdr) {
+                float* floatmap = stbi_loadf_from_memory(
+                    static_cast<const stbi_uc*>(data),
+                    static_cast<int>(size),
+                    &image.width, &image.height, &originalChannels, image.channels);
+
+                image.bitmap = reinterpret_cast<uint8_t*>(floatmap);
+            }
+            else {
+                image.bitmap = stbi_load_from_memory(
+                    static_cast<const stbi_uc*>(data),
+                    static_cast<int>(size),
+                    &image.width, &image.height, &originalChannels, image.channels);
+            }
+
+            if (!image.bitmap) {
+                PE_CORE_ERROR("Failed to load texture using stb_image");
+                return false;
+            }
+
+            switch (image.channels) {
+            case 1:
+                image.format = image.isHdr ? nvrhi::Format::R32_FLOAT : nvrhi::Format::R8_UNORM;
+                break;
+            case 2:
+                image.format = image.isHdr ? nvrhi::Format::RG32_FLOAT : nvrhi::Format::RG8_UNORM;
+                break;
+            case 4:
+                image.format = image.isHdr ? nvrhi::Format::RGBA32_FLOAT :
+                    (config.forceSRGB ? nvrhi::Format::SRGBA8_UNORM : nvrhi::Format::RGBA8_UNORM);
+                break;
+            default:
+                PE_CORE_ERROR("Unknown channels for image: {}", image.channels);
+                return false;
+            }
+            return true;
         }
 
-        if (!bitmap) {
-            PE_CORE_ERROR("Failed to load texture using stb_image");
-            return nullptr;
+        /// <summary>
+        /// 2x2 box filter，奇數邊的最後一個pixel重複使用
+        /// </summary>
+        template<typename T>
+        void Downsample(const T* source, uint32_t sourceWidth, uint32_t sourceHeight, T* dest, uint32_t width, uint32_t height, uint32_t channels)
+        {
+            for (uint32_t y = 0; y < height; y++) {
+                const uint32_t y0 = std::min(y * 2, sourceHeight - 1);
+                const uint32_t y1 = std::min(y * 2 + 1, sourceHeight - 1);
+                for (uint32_t x = 0; x < width; x++) {
+                    const uint32_t x0 = std::min(x * 2, sourceWidth - 1);
+                    const uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1);
+                    for (uint32_t c = 0; c < channels; c++) {
+                        const float sum =
+                            static_cast<float>(source[(y0 * sourceWidth + x0) * channels + c]) +
+                            static_cast<float>(source[(y0 * sourceWidth + x1) * channels + c]) +
+                            static_cast<float>(source[(y1 * sourceWidth + x0) * channels + c]) +
+                            static_cast<float>(source[(y1 * sourceWidth + x1) * channels + c]);
+                        if constexpr (std::is_floating_point_v<T>)
+                            dest[(y * width + x) * channels + c] = sum * 0.25f;
+                        else
+                            dest[(y * width + x) * channels + c] = static_cast<T>(sum * 0.25f + 0.5f);
+                    }
+                }
+            }
         }
 
-        nvrhi::Format imageFormat;
-        switch (channels) {
-        case 1:
-            imageFormat = isHdr ? nvrhi::Format::R32_FLOAT : nvrhi::Format::R8_UNORM;
-            break;
-        case 2:
-            imageFormat = isHdr ? nvrhi::Format::RG32_FLOAT : nvrhi::Format::RG8_UNORM;
-            break;
-        case 4:
-            imageFormat = isHdr ? nvrhi::Format::RGBA32_FLOAT :
-                (config.forceSRGB ? nvrhi::Format::SRGBA8_UNORM : nvrhi::Format::RGBA8_UNORM);
-            break;
-        default:
-            stbi_image_free(bitmap);
-            PE_CORE_ERROR("Unknown channels for image: {}", channels);
+    }
+
+    TextureHandle TextureLoader::load2DFromMemory(nvrhi::CommandListHandle cmd, const void* data, size_t size, const TextureConfig& config)
+    {
+        DecodedImage image;
+        if (!DecodeImage(data, size, config, image))
             return nullptr;
-        }
+
+        const int width = image.width;
+        const int height = image.height;
+        const int bytesPerPixels = static_cast<int>(image.getBytesPerPixel());
+        const nvrhi::Format imageFormat = image.format;
+        const uint8_t* bitmap = image.bitmap;
 
         nvrhi::TextureDesc desc;
         desc.setDebugName("TextureLoader_load_shader_resource");
@@ -103,8 +165,6 @@ namespace PaperEngine {
             bitmap,
             static_cast<size_t>(width * bytesPerPixels));
 
-        stbi_image_free(bitmap);
-
         // TODO generate mipmap using compute shader
         for (uint32_t mipLevel = 1; mipLevel < desc.mipLevels; mipLevel++) {
 
@@ -119,6 +179,40 @@ namespace PaperEngine {
         return texture;
     }
 
+    bool TextureLoader::cookStreamingTexture(const void* data, size_t size, const std::filesystem::path& outputPath, const TextureConfig& config)
+    {
+        DecodedImage image;
+        if (!DecodeImage(data, size, config, image))
+            return false;
+
+        const uint32_t width = static_cast<uint32_t>(image.width);
+        const uint32_t height = static_cast<uint32_t>(image.height);
+        const uint32_t bytesPerPixel = image.getBytesPerPixel();
+        const uint32_t channels = static_cast<uint32_t>(image.channels);
+        const uint32_t mipCount = config.generateMipMaps ?
+            std::min(GetMipLevels(width, height), TextureStreamer::MaxMipCount) : 1;
+
+        // CPU產生mip chain
+        std::vector<std::vector<uint8_t>> mips(mipCount);
+        mips[0].assign(image.bitmap, image.bitmap + static_cast<size_t>(width) * height * bytesPerPixel);
+        for (uint32_t mip = 1; mip < mipCount; mip++) {
+            const uint32_t sourceWidth = std::max(1u, width >> (mip - 1));
+            const uint32_t sourceHeight = std::max(1u, height >> (mip - 1));
+            const uint32_t mipWidth = std::max(1u, width >> mip);
+            const uint32_t mipHeight = std::max(1u, height >> mip);
+            mips[mip].resize(static_cast<size_t>(mipWidth) * mipHeight * bytesPerPixel);
+
+            if (image.isHdr)
+                Downsample(reinterpret_cast<const float*>(mips[mip - 1].data()), sourceWidth, sourceHeight,
+                    reinterpret_cast<float*>(mips[mip].data()), mipWidth, mipHeight, channels);
+            else
+                Downsample(mips[mip - 1].data(), sourceWidth, sourceHeight,
+                    mips[mip].data(), mipWidth, mipHeight, channels);
+        }
+
+        return TextureStreamer::WriteFile(outputPath, image.format, width, height, bytesPerPixel, mips);
+    }
+
     uint32_t TextureLoader::GetMipLevels(uint32_t width, uint32_t height)
     {
         uint32_t size = std::min(width, height);
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <filesystem>
+
 #include <PaperEngine/graphics/Texture.h>
 
 namespace PaperEngine {
@@ -27,6 +29,12 @@ namespace PaperEngine {
 		/// <returns></returns>
 		PE_API TextureHandle load2DFromMemory(nvrhi::CommandListHandle cmd, const void* data, size_t size, const TextureLoader::TextureConfig& config = TextureLoader::TextureConfig());
 
+		/// <summary>
+		/// 把原始圖片轉成TextureStreamer用的.ptex (mip在CPU產生，各自分開存放)
+		/// generateMipMaps為false的話只有一個mip
+		/// </summary>
+		PE_API bool cookStreamingTexture(const void* data, size_t size, const std::filesystem::path& outputPath, const TextureLoader::TextureConfig& config = TextureLoader::TextureConfig());
+
 	public:
 		static uint32_t GetMipLevels(uint32_t width, uint32_t height);
 
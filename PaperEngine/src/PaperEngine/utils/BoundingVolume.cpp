@@ -60,6 +60,14 @@ namespace PaperEngine
         return true;
     }
 
+    static bool Intersect(const BoundingSphere& s, const AABB& aabb)
+    {
+        // AABB上離球心最近的點
+        const glm::vec3 closest = glm::clamp(s.position, aabb.min, aabb.max);
+        const glm::vec3 offset = closest - s.position;
+        return glm::dot(offset, offset) <= s.radius * s.radius;
+    }
+
     bool Frustum::isIntersect(const BoundingVolume& other) const
     {
         if (auto o = dynamic_cast<const AABB*>(&other))
@@ -69,8 +77,11 @@ namespace PaperEngine
     }
 
 
-    bool AABB::isIntersect(const BoundingVolume&)  const
+    bool AABB::isIntersect(const BoundingVolume& other)  const
     {
+        if (auto o = dynamic_cast<const BoundingSphere*>(&other))
+            return Intersect(*o, *this);
+
         return false;
     }
 
@@ -78,6 +89,8 @@ namespace PaperEngine
     {
         if (auto o = dynamic_cast<const Frustum*>(&other))
             return Intersect(*o, *this);
+        if (auto o = dynamic_cast<const AABB*>(&other))
+            return Intersect(*this, *o);
 
         return false;
     }
@@ -14,7 +14,7 @@ namespace PaperEngine {
     struct Frustum : public BoundingVolume {
         glm::vec4 planes[6];
 
-        static Frustum Extract(const glm::mat4& viewProj);
+        PE_API static Frustum Extract(const glm::mat4& viewProj);
 
         PE_API bool isIntersect(const BoundingVolume&) const;
     };
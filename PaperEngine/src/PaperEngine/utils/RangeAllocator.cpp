@@ -0,0 +1,66 @@
+﻿#include "RangeAllocator.h"
+
+#include <iterator>
+
+namespace PaperEngine {
+
+	void RangeAllocator::init(uint32_t capacity)
+	{
+		m_freeRanges.clear();
+		m_freeRanges[0] = capacity;
+		m_usedCount = 0;
+		m_capacity = capacity;
+	}
+
+	bool RangeAllocator::allocate(uint32_t count, uint32_t& outOffset, uint32_t alignment)
+	{
+		for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it)
+		{
+			const uint32_t rangeOffset = it->first;
+			const uint32_t rangeCount = it->second;
+			const uint32_t alignedOffset = (rangeOffset + alignment - 1) & ~(alignment - 1);
+			const uint32_t padding = alignedOffset - rangeOffset;
+			if (rangeCount < padding + count)
+				continue;
+
+			const uint32_t remain = rangeCount - padding - count;
+			m_freeRanges.erase(it);
+			// 對齊產生的空隙還給free list
+			if (padding > 0)
+				m_freeRanges[rangeOffset] = padding;
+			if (remain > 0)
+				m_freeRanges[alignedOffset + count] = remain;
+
+			outOffset = alignedOffset;
+			m_usedCount += count;
+			return true;
+		}
+		return false;
+	}
+
+	void RangeAllocator::free(uint32_t offset, uint32_t count)
+	{
+		auto it = m_freeRanges.emplace(offset, count).first;
+		m_usedCount -= count;
+
+		// 跟後面的合併
+		auto next = std::next(it);
+		if (next != m_freeRanges.end() && it->first + it->second == next->first)
+		{
+			it->second += next->second;
+			m_freeRanges.erase(next);
+		}
+
+		// 跟前面的合併
+		if (it != m_freeRanges.begin())
+		{
+			auto prev = std::prev(it);
+			if (prev->first + prev->second == it->first)
+			{
+				prev->second += it->second;
+				m_freeRanges.erase(it);
+			}
+		}
+	}
+
+}
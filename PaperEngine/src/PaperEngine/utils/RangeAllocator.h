@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include <map>
+#include <cstdint>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// First fit的free list
+	/// 只管理[offset, count]，不擁有實際的記憶體
+	/// 單位由使用者決定（vertex、index、bytes...）
+	/// 
+	/// 不是thread safe
+	/// </summary>
+	class RangeAllocator {
+	public:
+		void init(uint32_t capacity);
+
+		/// <summary>
+		/// alignment必須是2的次方，offset會對齊alignment
+		/// </summary>
+		bool allocate(uint32_t count, uint32_t& outOffset, uint32_t alignment = 1);
+
+		void free(uint32_t offset, uint32_t count);
+
+		uint32_t getUsedCount() const { return m_usedCount; }
+
+		uint32_t getCapacity() const { return m_capacity; }
+
+	private:
+		std::map<uint32_t, uint32_t> m_freeRanges;
+		uint32_t m_usedCount = 0;
+		uint32_t m_capacity = 0;
+	};
+
+}
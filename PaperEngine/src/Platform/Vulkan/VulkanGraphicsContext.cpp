@@ -1,12 +1,16 @@
 ﻿
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <iostream>
 #include <exception>
 
 #include <PaperEngine/core/Base.h>
 #include <PaperEngine/core/Assert.h>
+#include <PaperEngine/core/Application.h>
 #include <PaperEngine/core/Logger.h>
 #include <PaperEngine/debug/Instrumentor.h>
+#include <PaperEngine/debug/FrameStats.h>
 
 #include "VulkanGraphicsContext.h"
 
@@ -77,10 +81,11 @@ static VKAPI_ATTR VkBool32 VulkanDebugCallback(
 
 namespace PaperEngine {
 	VulkanGraphicsContext::VulkanGraphicsContext(Window* window) :
-		m_window(static_cast<GLFWWindow*>(window))
+		m_window(window)
 	{
 		PE_CORE_ASSERT(m_window, "VulkanGraphicsContext: Window is null");
-		PE_CORE_ASSERT(m_window->getNativeWindow(), "VulkanGraphicsContext: Native window is null");
+		m_headless = m_window->isHeadless();
+		PE_CORE_ASSERT(m_headless || m_window->getNativeWindow(), "VulkanGraphicsContext: Native window is null");
 
 		m_onBackBufferResizedCallback = []() {
 			};
@@ -92,17 +97,21 @@ namespace PaperEngine {
 	{
 		//PE_CORE_ASSERT(glfwVulkanSupported(), "GLFW is not support vulkan");
 
-		std::vector<const char*> instanceExtensions = {
-			VK_KHR_SURFACE_EXTENSION_NAME,
+		m_framesInFlight = Application::Get()->getFramesInFlight();
+		m_presentMode = Application::Get()->getPresentMode();
+
+		std::vector<const char*> instanceExtensions;
+		if (!m_headless) {
+			instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #if defined (_WIN32)
-			"VK_KHR_win32_surface",
+			instanceExtensions.push_back("VK_KHR_win32_surface");
 #elif defined (__linux__)
-			"VK_KHR_xcb_surface",
+			instanceExtensions.push_back("VK_KHR_xcb_surface");
 #endif
+		}
 #ifdef PE_DEBUG
-			VK_EXT_DEBUG_UTILS_EXTENSION_NAME
+		instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 #endif
-		};
 
 #pragma region Vulkan Instance Creation
 		{
@@ -111,6 +120,7 @@ namespace PaperEngine {
 			auto inst_result = builder
 				.set_app_name("PaperEngine")
 				.set_engine_name("PaperEngine")
+				.set_headless(m_headless)
 				.require_api_version(1, 4, 0)
 #ifdef PE_DEBUG
 				.request_validation_layers()
@@ -129,7 +139,7 @@ namespace PaperEngine {
 #pragma endregion
 
 #pragma region Surface Creation
-		{
+		if (!m_headless) {
 			if (!m_window->createSurface(m_instance.vkbInstance.instance, &m_instance.surface))
 			{
 				// TODO FATAL
@@ -140,10 +150,25 @@ namespace PaperEngine {
 #pragma endregion
 
 		// Features 需要enable
+		VkPhysicalDeviceFeatures vulkan10Features{};
+		vulkan10Features.multiDrawIndirect = VK_TRUE;			// 一個drawIndexedIndirect畫多個draw
+		vulkan10Features.drawIndirectFirstInstance = VK_TRUE;	// indirect args中的startInstanceLocation
+
 		VkPhysicalDeviceVulkan12Features vulkan12Features{};
 		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 		vulkan12Features.timelineSemaphore = VK_TRUE;
 
+		// bindless descriptor table (BindlessMaterialTable)，不是必要的，選好GPU後有支援才開
+		VkPhysicalDeviceVulkan12Features bindlessFeatures{};
+		bindlessFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		bindlessFeatures.descriptorIndexing = VK_TRUE;
+		bindlessFeatures.runtimeDescriptorArray = VK_TRUE;
+		bindlessFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		bindlessFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		// TextureStreamer換texture時寫入沒有被使用中的slot
+		bindlessFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		bindlessFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
 		VkPhysicalDeviceVulkan13Features vulkan13Features{
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
 			.synchronization2 = VK_TRUE, // enable synchronization2
@@ -171,18 +196,44 @@ namespace PaperEngine {
 			// 	PE_CORE_TRACE("GPU: {}", gpu.name);
 			// }
 			
+			// headless的instance不需要present support (lavapipe等沒有display的環境)
+			if (!m_headless)
+				selector.set_surface(m_instance.surface);
+
+			// software ICD (lavapipe/SwiftShader) 是CPU type，也要能選
 			auto phys_result = selector
-				.set_surface(m_instance.surface)
+				.set_required_features(vulkan10Features)
 				.set_required_features_12(vulkan12Features)
 				.set_required_features_13(vulkan13Features)
-				.select();
+				.allow_any_gpu_device_type(true)
+				.select_devices();
 			
-			if (!phys_result) {
+			if (!phys_result || phys_result.value().empty()) {
 				// TODO FATAL
-				PE_CORE_ERROR("[Vulkan] Failed to select physical device: {0}", phys_result.error().message());
+				PE_CORE_ERROR("[Vulkan] Failed to select physical device: {0}", phys_result ? "no suitable device" : phys_result.error().message());
 				throw std::runtime_error("failed to select gpu");
 			}
-			m_instance.physicalDevice = phys_result.value();
+
+			// 依照vk-bootstrap的偏好排序，有指定名稱的話選第一個符合的
+			const auto& devices = phys_result.value();
+			m_instance.physicalDevice = devices.front();
+			const std::string& gpuName = Application::Get()->getGPUName();
+			if (!gpuName.empty()) {
+				auto it = std::find_if(devices.begin(), devices.end(), [&gpuName](const vkb::PhysicalDevice& device) {
+					return device.name.find(gpuName) != std::string::npos;
+					});
+				if (it != devices.end())
+					m_instance.physicalDevice = *it;
+				else
+					PE_CORE_WARN("[Vulkan] No GPU matching '{}', using '{}'.", gpuName, m_instance.physicalDevice.name);
+			}
+
+			// GPUMemoryAllocator的budget統計用，沒有的話只有heap大小
+			m_memoryBudgetSupported = m_instance.physicalDevice.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+			m_bindlessSupported = m_instance.physicalDevice.enable_extension_features_if_present(bindlessFeatures);
+			if (!m_bindlessSupported)
+				PE_CORE_WARN("[Vulkan] Descriptor indexing is not supported, bindless materials are disabled.");
 		}
 		PE_CORE_TRACE("GPU: {}", m_instance.physicalDevice.name);
 #pragma endregion
@@ -258,6 +309,10 @@ namespace PaperEngine {
 			.numInstanceExtensions = instanceExtensions.size(),
 			.vulkanLibraryName = ""
 		};
+
+		// 上次執行存下來的pipeline cache，所有pipeline (GraphicsPipeline、compute pass) 都經過NVRHI建立
+		m_pipelineCache.init(m_instance.vkbDevice.device, m_instance.physicalDevice.physical_device, Application::Get()->getPipelineCacheDirectory());
+		deviceDesc.pipelineCache = m_pipelineCache.getHandle();
 		m_instance.device = nvrhi::vulkan::createDevice(deviceDesc);
 #ifdef PE_DEBUG
 		m_instance.validationDevice = nvrhi::validation::createValidationLayer(m_instance.device);
@@ -288,7 +343,10 @@ namespace PaperEngine {
 
 
 #pragma region Swapchain creation
-		if (!createSwapchain()) {
+		if (m_headless) {
+			this->createOffscreenTargets();
+		}
+		else if (!createSwapchain()) {
 			throw std::runtime_error("failed to create swapchain.");
 		}
 #pragma endregion
@@ -297,29 +355,42 @@ namespace PaperEngine {
 
 		this->createFrameContentObjects();
 
+		PE_CORE_INFO("[Vulkan] {} frames in flight, {} swapchain images, present mode {}.",
+			m_framesInFlight, m_instance.swapchainTextures.size(), m_headless ? "none (headless)" : PresentModeToString(m_presentMode));
 		PE_CORE_TRACE("[Vulkan] Vulkan graphics context initialized successfully!");
 	}
 
 	void VulkanGraphicsContext::cleanUp()
 	{
 		vkDeviceWaitIdle(m_instance.vkbDevice);
+
+		// 還沒交出去的readback，GPU已經idle了
+		for (auto& frame_content : m_frame_contents)
+			this->deliverReadback(frame_content);
 		
 		this->destroyFrameContentObjects();
+		this->destroyRenderFinishedSemaphores();
 
 		m_instance.framebuffers.clear();
 
 		m_instance.swapchainTextures.clear();
+		m_aliasingBarrierBuffer = nullptr;
 
-		vkb::destroy_swapchain(m_instance.vkbSwapchain);
+		if (!m_headless)
+			vkb::destroy_swapchain(m_instance.vkbSwapchain);
 
 #ifdef PE_DEBUG
 		m_instance.validationDevice = nullptr;
 #endif // PE_DEBUG
 		m_instance.device = nullptr;
 
+		// device destroy前存檔，這時所有pipeline都已經建立過了
+		m_pipelineCache.cleanUp();
+
 		vkDestroyDevice(m_instance.vkbDevice, nullptr);
 
-		vkDestroySurfaceKHR(m_instance.vkbInstance.instance, m_instance.surface, nullptr);
+		if (m_instance.surface != VK_NULL_HANDLE)
+			vkDestroySurfaceKHR(m_instance.vkbInstance.instance, m_instance.surface, nullptr);
 		m_instance.surface = VK_NULL_HANDLE;
 		vkb::destroy_instance(m_instance.vkbInstance);
 	}
@@ -342,18 +413,38 @@ namespace PaperEngine {
 
 		VkResult result = VK_SUCCESS;
 
-		const auto& current_frame_content = m_frame_contents[m_current_frame_index];
+		auto& current_frame_content = m_frame_contents[m_current_frame_index];
 
-		m_instance.device->waitEventQuery(current_frame_content.fence);
+		{
+			// CPU領先GPU m_framesInFlight個frame時在這裡等
+			PE_PROFILE_SCOPE("Wait for frame in flight");
+			PE_FRAME_STAT_SCOPE("Frame In Flight Wait");
+			m_instance.device->waitEventQuery(current_frame_content.fence);
+		}
 		m_instance.device->resetEventQuery(current_frame_content.fence);
+		m_imageAvailableWaitQueued = false;
+
+		// 上次使用這個frame in flight時要求的readback，fence完成了可以讀
+		this->deliverReadback(current_frame_content);
 
-		result = vkAcquireNextImageKHR(
-			m_instance.vkbDevice.device,
-			m_instance.vkbSwapchain.swapchain,
-			UINT64_MAX, // use the default timeout
-			current_frame_content.image_available_semaphore,
-			VK_NULL_HANDLE, // Fence for knowing the image can be write
-			&m_instance.swapchainIndex);
+		if (m_headless) {
+			// offscreen texture跟frame in flight一對一
+			m_instance.swapchainIndex = m_current_frame_index;
+			return true;
+		}
+
+		{
+			// Fifo時image都在排隊present的話會在這裡等vsync
+			PE_PROFILE_SCOPE("Acquire swapchain image");
+			PE_FRAME_STAT_SCOPE("Swapchain Acquire Wait");
+			result = vkAcquireNextImageKHR(
+				m_instance.vkbDevice.device,
+				m_instance.vkbSwapchain.swapchain,
+				UINT64_MAX, // use the default timeout
+				current_frame_content.image_available_semaphore,
+				VK_NULL_HANDLE, // Fence for knowing the image can be write
+				&m_instance.swapchainIndex);
+		}
 
 		if ((result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)) {
 			m_resizeRequested = true;
@@ -376,31 +467,46 @@ namespace PaperEngine {
 		// signal render finished semaphore
 		//vk_device->queueSignalSemaphore(nvrhi::CommandQueue::Graphics, [insert render finished semaphore], 0);
 
-		const auto& current_frame_content = m_frame_contents[m_current_frame_index];
+		auto& current_frame_content = m_frame_contents[m_current_frame_index];
 
 		PE_PROFILE_FUNCTION();
+
+		// readback在main command list之後，同一次submit (render finished semaphore在全部完成後signal)
+		std::vector<nvrhi::ICommandList*> commandLists{ current_frame_content.cmd };
+		if (nvrhi::ICommandList* readbackCmd = this->recordReadback(current_frame_content))
+			commandLists.push_back(readbackCmd);
+
+		if (m_headless) {
+			m_instance.device->executeCommandLists(commandLists.data(), commandLists.size());
+			m_instance.device->setEventQuery(current_frame_content.fence, nvrhi::CommandQueue::Graphics);
+			m_current_frame_index = (m_current_frame_index + 1) % static_cast<uint32_t>(m_frame_contents.size());
+			return true;
+		}
 		{
 			// 需要確定device沒有
 			PE_PROFILE_SCOPE("Commit and wait main command buffer");
-			// don't care the value because it is binary semaphore
-			vk_device->queueWaitForSemaphore(nvrhi::CommandQueue::Graphics, current_frame_content.image_available_semaphore, 0);
-			vk_device->queueSignalSemaphore(nvrhi::CommandQueue::Graphics, current_frame_content.render_finished_semaphore, 0);
-			m_instance.device->executeCommandList(current_frame_content.cmd);
+			queueImageAvailableWait();
+			vk_device->queueSignalSemaphore(nvrhi::CommandQueue::Graphics, m_instance.renderFinishedSemaphores[m_instance.swapchainIndex], 0);
+			m_instance.device->executeCommandLists(commandLists.data(), commandLists.size());
 			m_instance.device->setEventQuery(current_frame_content.fence, nvrhi::CommandQueue::Graphics);
 		}
 
 		VkPresentInfoKHR presentInfo = {
 			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &current_frame_content.render_finished_semaphore,
+			.pWaitSemaphores = &m_instance.renderFinishedSemaphores[m_instance.swapchainIndex],
 			.swapchainCount = 1,
 			.pSwapchains = &m_instance.vkbSwapchain.swapchain,
 			.pImageIndices = &m_instance.swapchainIndex,
 		};
 
-		const VkResult result = vkQueuePresentKHR(
-			m_instance.graphicsQueue,
-			&presentInfo);
+		VkResult result;
+		{
+			PE_FRAME_STAT_SCOPE("Present");
+			result = vkQueuePresentKHR(
+				m_instance.graphicsQueue,
+				&presentInfo);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			m_resizeRequested = true;
@@ -413,7 +519,7 @@ namespace PaperEngine {
 
 	uint32_t VulkanGraphicsContext::getSwapchainCount()
 	{
-		return m_instance.vkbSwapchain.image_count;
+		return static_cast<uint32_t>(m_instance.swapchainTextures.size());
 	}
 
 	uint32_t VulkanGraphicsContext::getSwapchainIndex() const
@@ -461,11 +567,176 @@ namespace PaperEngine {
 		return m_frame_contents[m_current_frame_index].cmd;
 	}
 
+	void VulkanGraphicsContext::executeMainCommandList(std::span<nvrhi::ICommandList* const> followingCommandLists)
+	{
+		PE_PROFILE_FUNCTION();
+
+		const auto& current_frame_content = m_frame_contents[m_current_frame_index];
+		current_frame_content.cmd->close();
+
+		std::vector<nvrhi::ICommandList*> commandLists;
+		commandLists.reserve(followingCommandLists.size() + 1);
+		commandLists.push_back(current_frame_content.cmd);
+		commandLists.insert(commandLists.end(), followingCommandLists.begin(), followingCommandLists.end());
+
+		// 會寫到swapchain image，第一次submit要等acquire
+		queueImageAvailableWait();
+		m_instance.device->executeCommandLists(commandLists.data(), commandLists.size());
+
+		current_frame_content.cmd->open();
+	}
+
+	void VulkanGraphicsContext::requestFrameReadback(FrameReadbackCallback callback)
+	{
+		m_readbackRequest = std::move(callback);
+	}
+
+	nvrhi::ICommandList* VulkanGraphicsContext::recordReadback(FrameInFlight& frame)
+	{
+		if (!m_readbackRequest)
+			return nullptr;
+
+		PE_PROFILE_FUNCTION();
+
+		nvrhi::ITexture* colorTexture = m_instance.swapchainTextures[m_instance.swapchainIndex];
+		const nvrhi::TextureDesc& colorDesc = colorTexture->getDesc();
+
+		// resize或format改變的話重新建立
+		if (!frame.readbackTexture ||
+			frame.readbackTexture->getDesc().width != colorDesc.width ||
+			frame.readbackTexture->getDesc().height != colorDesc.height ||
+			frame.readbackTexture->getDesc().format != colorDesc.format) {
+			auto stagingDesc = nvrhi::TextureDesc()
+				.setDebugName("Frame readback")
+				.setDimension(nvrhi::TextureDimension::Texture2D)
+				.setFormat(colorDesc.format)
+				.setWidth(colorDesc.width)
+				.setHeight(colorDesc.height);
+			frame.readbackTexture = m_instance.device->createStagingTexture(stagingDesc, nvrhi::CpuAccessMode::Read);
+		}
+		if (!frame.readbackCmd)
+			frame.readbackCmd = m_instance.device->createCommandList();
+
+		frame.readbackCmd->open();
+		frame.readbackCmd->copyTexture(frame.readbackTexture, nvrhi::TextureSlice(), colorTexture, nvrhi::TextureSlice());
+		frame.readbackCmd->close();
+
+		frame.readbackCallback = std::move(m_readbackRequest);
+		m_readbackRequest = nullptr;
+		return frame.readbackCmd;
+	}
+
+	void VulkanGraphicsContext::deliverReadback(FrameInFlight& frame)
+	{
+		if (!frame.readbackCallback)
+			return;
+
+		PE_PROFILE_FUNCTION();
+
+		const nvrhi::TextureDesc& desc = frame.readbackTexture->getDesc();
+
+		FrameReadback readback;
+		readback.width = desc.width;
+		readback.height = desc.height;
+		readback.format = desc.format;
+		readback.bytesPerPixel = nvrhi::getFormatInfo(desc.format).bytesPerBlock;
+
+		size_t rowPitch = 0;
+		const uint8_t* mapped = static_cast<const uint8_t*>(m_instance.device->mapStagingTexture(frame.readbackTexture, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+		if (mapped) {
+			// 去掉row padding
+			const size_t rowSize = static_cast<size_t>(readback.width) * readback.bytesPerPixel;
+			readback.pixels.resize(rowSize * readback.height);
+			for (uint32_t y = 0; y < readback.height; y++)
+				std::memcpy(readback.pixels.data() + y * rowSize, mapped + y * rowPitch, rowSize);
+			m_instance.device->unmapStagingTexture(frame.readbackTexture);
+		}
+		else {
+			PE_CORE_ERROR("[Vulkan] Failed to map frame readback texture.");
+		}
+
+		FrameReadbackCallback callback = std::move(frame.readbackCallback);
+		frame.readbackCallback = nullptr;
+		callback(readback);
+	}
+
+	void VulkanGraphicsContext::queueImageAvailableWait()
+	{
+		if (m_headless || m_imageAvailableWaitQueued)
+			return;
+
+		auto vk_device = static_cast<nvrhi::vulkan::IDevice*>(m_instance.device.Get());
+		// don't care the value because it is binary semaphore
+		vk_device->queueWaitForSemaphore(nvrhi::CommandQueue::Graphics, m_frame_contents[m_current_frame_index].image_available_semaphore, 0);
+		m_imageAvailableWaitQueued = true;
+	}
+
 	uint32_t VulkanGraphicsContext::getMaxFrameInFlight()
 	{
 		return static_cast<uint32_t>(m_frame_contents.size());
 	}
 
+	PresentMode VulkanGraphicsContext::getPresentMode() const
+	{
+		return m_presentMode;
+	}
+
+	GPUMemoryBudget VulkanGraphicsContext::getMemoryBudget() const
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+		memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		if (m_memoryBudgetSupported)
+			memoryProperties.pNext = &budgetProperties;
+		vkGetPhysicalDeviceMemoryProperties2(m_instance.physicalDevice.physical_device, &memoryProperties);
+
+		GPUMemoryBudget result;
+		result.supported = m_memoryBudgetSupported;
+		const VkPhysicalDeviceMemoryProperties& properties = memoryProperties.memoryProperties;
+		for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+			if (!(properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+				continue;
+			result.budget += m_memoryBudgetSupported ? budgetProperties.heapBudget[i] : properties.memoryHeaps[i].size;
+			result.usage += m_memoryBudgetSupported ? budgetProperties.heapUsage[i] : 0;
+		}
+		return result;
+	}
+
+	void VulkanGraphicsContext::insertAliasingBarrier(nvrhi::ICommandList* cmd)
+	{
+		if (!m_aliasingBarrierBuffer) {
+			nvrhi::BufferDesc bufferDesc;
+			bufferDesc
+				.setByteSize(4)
+				.setDebugName("VulkanGraphicsContext_aliasingBarrier")
+				.setInitialState(nvrhi::ResourceStates::CopyDest)
+				.setKeepInitialState(true);
+			m_aliasingBarrierBuffer = m_instance.device->createBuffer(bufferDesc);
+		}
+
+		// NVRHI沒有公開endRenderPass，這個buffer一定會有state要轉換，commitBarriers時會結束render pass
+		// 同時送出之前pending的barrier，接下來native的barrier才會在它們之後
+		cmd->setBufferState(m_aliasingBarrierBuffer, nvrhi::ResourceStates::CopySource);
+		cmd->setBufferState(m_aliasingBarrierBuffer, nvrhi::ResourceStates::CopyDest);
+		cmd->commitBarriers();
+
+		// 新的resource從UNDEFINED開始的layout transition是TOP_OF_PIPE，不會等之前用同一塊memory的resource
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		VkCommandBuffer commandBuffer = cmd->getNativeObject(nvrhi::ObjectTypes::VK_CommandBuffer);
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+	}
+
 	uint32_t VulkanGraphicsContext::getCurrentFrameIndex()
 	{
 		return m_current_frame_index;
@@ -480,11 +751,16 @@ namespace PaperEngine {
 			VK_FORMAT_R8G8B8A8_SRGB,
 			VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
 		};
+		const VkPresentModeKHR presentMode = selectPresentMode();
+		// 至少要比frame in flight多一張，CPU才不會因為沒有image可以acquire而卡住
+		// mailbox需要三張才有意義 (一張顯示中、一張排隊、一張在畫)
+		const uint32_t minImageCount = std::max(m_framesInFlight + 1, presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3u : 2u);
 		auto swapResult = vkb::SwapchainBuilder(m_instance.vkbDevice)
 			.set_desired_format(surfaceFormat)
 			.set_desired_extent(m_window->getWidth(), m_window->getHeight())
-			.set_desired_present_mode(VK_PRESENT_MODE_MAILBOX_KHR)
-			.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+			.set_desired_present_mode(presentMode)
+			.set_desired_min_image_count(minImageCount)
+			.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
 			.set_old_swapchain(m_instance.vkbSwapchain)
 			.build();
 		if (!swapResult) {
@@ -496,6 +772,14 @@ namespace PaperEngine {
 
 		auto swapchainImages = m_instance.vkbSwapchain.get_images().value();
 
+		this->destroyRenderFinishedSemaphores();
+		for (size_t i = 0; i < swapchainImages.size(); i++) {
+			VkSemaphoreCreateInfo sema_info{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			vkCreateSemaphore(m_instance.vkbDevice.device, &sema_info, nullptr, &semaphore);
+			m_instance.renderFinishedSemaphores.push_back(semaphore);
+		}
+
 		{
 			auto textureDesc = nvrhi::TextureDesc()
 				.setDebugName("Swap chain image")
@@ -519,6 +803,29 @@ namespace PaperEngine {
 		return true;
 	}
 
+	void VulkanGraphicsContext::createOffscreenTargets()
+	{
+		m_instance.swapchainTextures.clear();
+
+		auto textureDesc = nvrhi::TextureDesc()
+			.setDebugName("Offscreen image")
+			.setInitialState(nvrhi::ResourceStates::CopySource)
+			.setKeepInitialState(true)
+			.setClearValue(nvrhi::Color(0.0f, 0.0f, 0.0f, 0.0f))
+			.setUseClearValue(true)
+			.setDimension(nvrhi::TextureDimension::Texture2D)
+			.setFormat(nvrhi::Format::SRGBA8_UNORM)
+			.setWidth(m_window->getWidth())
+			.setHeight(m_window->getHeight())
+			.setIsRenderTarget(true);
+		// offscreen texture跟frame in flight一對一
+		for (uint32_t i = 0; i < m_framesInFlight; i++) {
+			m_instance.swapchainTextures.push_back(m_instance.device->createTexture(textureDesc));
+		}
+
+		PE_CORE_TRACE("[VulkanGraphicsContext] Headless offscreen targets created with size {}x{}", m_window->getWidth(), m_window->getHeight());
+	}
+
 	void VulkanGraphicsContext::createFramebuffers()
 	{
 		m_instance.framebuffers.clear();
@@ -528,8 +835,8 @@ namespace PaperEngine {
 				.setIsRenderTarget(true)
 				.setInitialState(nvrhi::ResourceStates::DepthWrite)
 				.setKeepInitialState(true)
-				.setWidth(m_instance.vkbSwapchain.extent.width)
-				.setHeight(m_instance.vkbSwapchain.extent.height)
+				.setWidth(texture->getDesc().width)
+				.setHeight(texture->getDesc().height)
 				.setFormat(m_instance.depthFormat);
 			auto depthTexture = m_instance.device->createTexture(depthTextureDesc);
 			auto framebufferDesc = nvrhi::FramebufferDesc()
@@ -545,7 +852,7 @@ namespace PaperEngine {
 	void VulkanGraphicsContext::createFrameContentObjects()
 	{
 
-		m_frame_contents.resize(m_instance.vkbSwapchain.image_count);
+		m_frame_contents.resize(m_framesInFlight);
 		for (auto& frame_content : m_frame_contents)
 		{
 			VkFenceCreateInfo fence_info{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
@@ -553,7 +860,6 @@ namespace PaperEngine {
 			frame_content.fence = m_instance.device->createEventQuery();
 			VkSemaphoreCreateInfo sema_info{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 			vkCreateSemaphore(m_instance.vkbDevice.device, &sema_info, nullptr, &frame_content.image_available_semaphore);
-			vkCreateSemaphore(m_instance.vkbDevice.device, &sema_info, nullptr, &frame_content.render_finished_semaphore);
 			frame_content.cmd = m_instance.device->createCommandList();
 		}
 	}
@@ -563,10 +869,65 @@ namespace PaperEngine {
 		for (auto& frame_content : m_frame_contents)
 		{
 			vkDestroySemaphore(m_instance.vkbDevice.device, frame_content.image_available_semaphore, nullptr);
-			vkDestroySemaphore(m_instance.vkbDevice.device, frame_content.render_finished_semaphore, nullptr);
 		}
 		m_frame_contents.clear();
 	}
+
+	void VulkanGraphicsContext::destroyRenderFinishedSemaphores()
+	{
+		for (VkSemaphore semaphore : m_instance.renderFinishedSemaphores)
+			vkDestroySemaphore(m_instance.vkbDevice.device, semaphore, nullptr);
+		m_instance.renderFinishedSemaphores.clear();
+	}
+
+	VkPresentModeKHR VulkanGraphicsContext::selectPresentMode()
+	{
+		uint32_t modeCount = 0;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(m_instance.physicalDevice.physical_device, m_instance.surface, &modeCount, nullptr);
+		std::vector<VkPresentModeKHR> supportedModes(modeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(m_instance.physicalDevice.physical_device, m_instance.surface, &modeCount, supportedModes.data());
+
+		auto isSupported = [&supportedModes](VkPresentModeKHR mode) {
+			return std::find(supportedModes.begin(), supportedModes.end(), mode) != supportedModes.end();
+			};
+
+		const PresentMode requested = Application::Get()->getPresentMode();
+		std::vector<PresentMode> candidates;
+		switch (requested)
+		{
+		case PresentMode::Immediate:
+			candidates = { PresentMode::Immediate, PresentMode::Mailbox, PresentMode::Fifo };
+			break;
+		case PresentMode::Mailbox:
+			candidates = { PresentMode::Mailbox, PresentMode::Fifo };
+			break;
+		default:
+			candidates = { PresentMode::Fifo };
+			break;
+		}
+
+		auto toVkPresentMode = [](PresentMode mode) {
+			switch (mode)
+			{
+			case PresentMode::Immediate:	return VK_PRESENT_MODE_IMMEDIATE_KHR;
+			case PresentMode::Mailbox:		return VK_PRESENT_MODE_MAILBOX_KHR;
+			default:						return VK_PRESENT_MODE_FIFO_KHR;
+			}
+			};
+
+		// Fifo一定支援
+		m_presentMode = PresentMode::Fifo;
+		for (PresentMode candidate : candidates) {
+			if (isSupported(toVkPresentMode(candidate))) {
+				m_presentMode = candidate;
+				break;
+			}
+		}
+		if (m_presentMode != requested)
+			PE_CORE_WARN("[Vulkan] Present mode {} is not supported, using {}.", PresentModeToString(requested), PresentModeToString(m_presentMode));
+
+		return toVkPresentMode(m_presentMode);
+	}
 }
 
 namespace nvrhi
@@ -9,6 +9,8 @@
 
 #include <PaperEngine/core/GLFWWindow.h>
 
+#include "VulkanPipelineCache.h"
+
 #ifdef PE_DEBUG
 #define CHECK_VK_RESULT(x) \
 				do \
@@ -54,9 +56,15 @@ namespace PaperEngine {
 
 	struct FrameInFlight {
 		VkSemaphore image_available_semaphore;
-		VkSemaphore render_finished_semaphore;
 		nvrhi::EventQueryHandle fence;
 		nvrhi::CommandListHandle cmd;		// main command buffer that render specify frame
+
+		/// <summary>
+		/// requestFrameReadback用，第一次使用時建立
+		/// </summary>
+		nvrhi::CommandListHandle readbackCmd;
+		nvrhi::StagingTextureHandle readbackTexture;
+		FrameReadbackCallback readbackCallback;		// 不是nullptr代表這個frame有readback還沒交出去
 	};
 
 	struct VulkanInstance {
@@ -84,6 +92,12 @@ namespace PaperEngine {
 		std::vector<nvrhi::TextureHandle> swapchainTextures;
 		uint32_t swapchainIndex = 0;
 
+		/// <summary>
+		/// 每個swapchain image一個，present等待的semaphore
+		/// present要等到這個image再被acquire才確定用完，所以不能跟frame in flight綁在一起
+		/// </summary>
+		std::vector<VkSemaphore> renderFinishedSemaphores;
+
 		/// <summary>
 		/// swapchain被使用的framebuffer
 		/// </summary>
@@ -131,8 +145,20 @@ namespace PaperEngine {
 		/// <returns></returns>
 		nvrhi::CommandListHandle getMainCommandList() override;
 
+		void executeMainCommandList(std::span<nvrhi::ICommandList* const> followingCommandLists) override;
+
+		void requestFrameReadback(FrameReadbackCallback callback) override;
+
 		uint32_t getMaxFrameInFlight() override;
 
+		PresentMode getPresentMode() const override;
+
+		GPUMemoryBudget getMemoryBudget() const override;
+
+		bool supportsBindless() const override { return m_bindlessSupported; }
+
+		void insertAliasingBarrier(nvrhi::ICommandList* cmd) override;
+
 		/// <summary>
 		/// Get the current frame in flight index
 		/// </summary>
@@ -141,25 +167,86 @@ namespace PaperEngine {
 	private:
 		bool createSwapchain();
 
+		/// <summary>
+		/// headless用，建立frame in flight數量的color texture代替swapchain image
+		/// </summary>
+		void createOffscreenTargets();
+
+		/// <summary>
+		/// 依照fallback順序選surface支援的present mode
+		/// </summary>
+		VkPresentModeKHR selectPresentMode();
+
+		void destroyRenderFinishedSemaphores();
+
+		/// <summary>
+		/// 錄製把目前的color target複製到staging texture的command list，回傳nullptr代表這個frame沒有readback
+		/// </summary>
+		nvrhi::ICommandList* recordReadback(FrameInFlight& frame);
+
+		/// <summary>
+		/// frame的fence已經完成後呼叫，map staging texture交給callback
+		/// </summary>
+		void deliverReadback(FrameInFlight& frame);
+
 		void createFramebuffers();
 
 		void createFrameContentObjects();
 
 		void destroyFrameContentObjects();
 
+		/// <summary>
+		/// 這個frame第一次submit前等待swapchain image acquire
+		/// binary semaphore只能等一次，之後的submit不再等
+		/// </summary>
+		void queueImageAvailableWait();
+
 	private:
 		VulkanInstance m_instance;
 
 		NVMessageCallback m_NVMsgCallback;
 
-		GLFWWindow* m_window;
+		/// <summary>
+		/// NVRHI建立pipeline時使用，cleanUp時存檔
+		/// </summary>
+		VulkanPipelineCache m_pipelineCache;
+
+		Window* m_window;
+
+		/// <summary>
+		/// 沒有surface跟swapchain，present只會submit main command list
+		/// </summary>
+		bool m_headless = false;
 
 		std::function<void()> m_onBackBufferResizingCallback;
 		std::function<void()> m_onBackBufferResizedCallback;
 
 		bool m_resizeRequested = false;
 
+		/// <summary>
+		/// Application::getFramesInFlight，init後不會改變
+		/// </summary>
+		uint32_t m_framesInFlight = 3;
+		PresentMode m_presentMode = PresentMode::Mailbox;
+
+		/// <summary>
+		/// 有VK_EXT_memory_budget的話getMemoryBudget回傳driver的budget跟使用量
+		/// </summary>
+		bool m_memoryBudgetSupported = false;
+
+		/// <summary>
+		/// descriptor indexing的feature是有才開，沒有的話不能用bindless material
+		/// </summary>
+		bool m_bindlessSupported = false;
+
+		/// <summary>
+		/// insertAliasingBarrier用來讓NVRHI結束render pass的buffer，第一次使用時建立
+		/// </summary>
+		nvrhi::BufferHandle m_aliasingBarrierBuffer;
+
 		uint32_t m_current_frame_index = 0;
+		bool m_imageAvailableWaitQueued = false;
+		FrameReadbackCallback m_readbackRequest;
 		std::vector<FrameInFlight> m_frame_contents;
 	};
 }
@@ -7,6 +7,7 @@
 #include <PaperEngine/events/ApplicationEvent.h>
 #include <PaperEngine/events/KeyEvent.h>
 #include <PaperEngine/events/MouseEvent.h>
+#include <PaperEngine/debug/GPUProfiler.h>
 
 #include <vulkan/vulkan.h>
 
@@ -262,6 +263,7 @@ namespace PaperEngine {
 		const auto& io = ImGui::GetIO();
 
 		auto main_cmd = Application::Get()->getGraphicsContext()->getMainCommandList();
+		PE_PROFILE_GPU_SCOPE(main_cmd, "ImGui");
 		
 		main_cmd->beginMarker("ImGui");
 
@@ -0,0 +1,219 @@
+﻿#include "VulkanPipelineCache.h"
+
+#include <cstring>
+#include <fstream>
+
+#include <PaperEngine/core/Logger.h>
+#include <PaperEngine/debug/Instrumentor.h>
+
+namespace PaperEngine {
+
+	namespace {
+
+		constexpr uint32_t CacheFileMagic = 0x43504550;		// "PEPC"
+		constexpr uint32_t CacheFileVersion = 1;
+
+		/// <summary>
+		/// cache檔開頭，後面接dataSize bytes的vkGetPipelineCacheData
+		/// </summary>
+		struct CacheFileHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint8_t deviceUUID[VK_UUID_SIZE];
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+			uint64_t dataSize;
+			uint64_t checksum;
+		};
+
+		uint64_t Checksum(const uint8_t* data, size_t size)
+		{
+			// FNV-1a
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= data[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		std::string ToHex(const uint8_t* data, size_t size)
+		{
+			static constexpr char digits[] = "0123456789abcdef";
+			std::string result;
+			for (size_t i = 0; i < size; i++) {
+				result += digits[data[i] >> 4];
+				result += digits[data[i] & 0xF];
+			}
+			return result;
+		}
+
+	}
+
+	void VulkanPipelineCache::init(VkDevice device, VkPhysicalDevice physicalDevice, const std::filesystem::path& directory)
+	{
+		PE_PROFILE_FUNCTION();
+
+		m_device = device;
+
+		VkPhysicalDeviceIDProperties idProperties{};
+		idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &idProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+		m_properties = properties2.properties;
+		std::memcpy(m_deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+
+		std::vector<uint8_t> initialData;
+		if (!directory.empty()) {
+			m_filepath = directory / ("pipeline_cache_" + ToHex(m_deviceUUID, VK_UUID_SIZE) + "_" + std::to_string(m_properties.driverVersion) + ".bin");
+			initialData = load();
+		}
+
+		VkPipelineCacheCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = initialData.size();
+		createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+		VkResult result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+		if (result != VK_SUCCESS && !initialData.empty()) {
+			// driver不接受的話從空的開始
+			PE_CORE_WARN("[Vulkan] Pipeline cache data rejected by driver ({}), starting empty.", static_cast<int32_t>(result));
+			createInfo.initialDataSize = 0;
+			createInfo.pInitialData = nullptr;
+			result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+		}
+		if (result != VK_SUCCESS) {
+			PE_CORE_ERROR("[Vulkan] Failed to create pipeline cache ({}).", static_cast<int32_t>(result));
+			m_cache = VK_NULL_HANDLE;
+			return;
+		}
+
+		if (!initialData.empty())
+			PE_CORE_INFO("[Vulkan] Loaded pipeline cache '{}' ({} KB).", m_filepath.string(), initialData.size() / 1024);
+	}
+
+	void VulkanPipelineCache::cleanUp()
+	{
+		if (m_cache == VK_NULL_HANDLE)
+			return;
+
+		if (!m_filepath.empty())
+			save();
+
+		vkDestroyPipelineCache(m_device, m_cache, nullptr);
+		m_cache = VK_NULL_HANDLE;
+	}
+
+	std::vector<uint8_t> VulkanPipelineCache::load() const
+	{
+		std::ifstream in(m_filepath, std::ios::binary | std::ios::ate);
+		if (!in.is_open())
+			return {};
+
+		const std::streamoff fileSize = in.tellg();
+		in.seekg(0);
+
+		CacheFileHeader header{};
+		if (fileSize < static_cast<std::streamoff>(sizeof(header)) ||
+			!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+			PE_CORE_WARN("[Vulkan] Pipeline cache '{}' is truncated, ignored.", m_filepath.string());
+			return {};
+		}
+
+		if (header.magic != CacheFileMagic ||
+			header.version != CacheFileVersion ||
+			header.vendorID != m_properties.vendorID ||
+			header.deviceID != m_properties.deviceID ||
+			header.driverVersion != m_properties.driverVersion ||
+			std::memcmp(header.deviceUUID, m_deviceUUID, VK_UUID_SIZE) != 0 ||
+			std::memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+			header.dataSize != static_cast<uint64_t>(fileSize) - sizeof(header)) {
+			PE_CORE_WARN("[Vulkan] Pipeline cache '{}' does not match this device or driver, ignored.", m_filepath.string());
+			return {};
+		}
+
+		std::vector<uint8_t> data(header.dataSize);
+		if (!in.read(reinterpret_cast<char*>(data.data()), data.size()) ||
+			Checksum(data.data(), data.size()) != header.checksum) {
+			PE_CORE_WARN("[Vulkan] Pipeline cache '{}' is corrupted, ignored.", m_filepath.string());
+			return {};
+		}
+
+		// Vulkan自己的header也檢查一次，有些driver對錯誤的data不會回傳錯誤
+		VkPipelineCacheHeaderVersionOne vkHeader{};
+		if (data.size() < sizeof(vkHeader))
+			return {};
+		std::memcpy(&vkHeader, data.data(), sizeof(vkHeader));
+		if (vkHeader.headerSize < sizeof(vkHeader) ||
+			vkHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+			vkHeader.vendorID != m_properties.vendorID ||
+			vkHeader.deviceID != m_properties.deviceID ||
+			std::memcmp(vkHeader.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			PE_CORE_WARN("[Vulkan] Pipeline cache '{}' has an invalid Vulkan header, ignored.", m_filepath.string());
+			return {};
+		}
+
+		return data;
+	}
+
+	void VulkanPipelineCache::save() const
+	{
+		PE_PROFILE_FUNCTION();
+
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+			return;
+		std::vector<uint8_t> data(dataSize);
+		if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, data.data()) != VK_SUCCESS)
+			return;
+		data.resize(dataSize);
+
+		CacheFileHeader header{};
+		header.magic = CacheFileMagic;
+		header.version = CacheFileVersion;
+		header.vendorID = m_properties.vendorID;
+		header.deviceID = m_properties.deviceID;
+		header.driverVersion = m_properties.driverVersion;
+		std::memcpy(header.deviceUUID, m_deviceUUID, VK_UUID_SIZE);
+		std::memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.dataSize = data.size();
+		header.checksum = Checksum(data.data(), data.size());
+
+		std::error_code error;
+		if (m_filepath.has_parent_path())
+			std::filesystem::create_directories(m_filepath.parent_path(), error);
+
+		// 寫完整個暫存檔才取代舊的
+		std::filesystem::path tempPath = m_filepath;
+		tempPath += ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) {
+				PE_CORE_WARN("[Vulkan] Could not write pipeline cache '{}'.", tempPath.string());
+				return;
+			}
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(data.data()), data.size());
+			out.flush();
+			if (!out) {
+				PE_CORE_WARN("[Vulkan] Could not write pipeline cache '{}'.", tempPath.string());
+				out.close();
+				std::filesystem::remove(tempPath, error);
+				return;
+			}
+		}
+
+		std::filesystem::rename(tempPath, m_filepath, error);
+		if (error) {
+			PE_CORE_WARN("[Vulkan] Could not replace pipeline cache '{}': {}", m_filepath.string(), error.message());
+			std::filesystem::remove(tempPath, error);
+			return;
+		}
+
+		PE_CORE_INFO("[Vulkan] Saved pipeline cache '{}' ({} KB).", m_filepath.string(), data.size() / 1024);
+	}
+
+}
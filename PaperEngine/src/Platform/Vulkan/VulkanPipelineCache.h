@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace PaperEngine {
+
+	/// <summary>
+	/// 存在硬碟上的VkPipelineCache，避免每次啟動都要driver重新compile所有pipeline
+	/// 
+	/// 檔名以device UUID跟driver version決定，換GPU或更新driver會用新的檔案
+	/// 讀取時檢查我們的header (大小、checksum) 跟Vulkan的cache header，不符合就從空的cache開始
+	/// 存檔先寫到暫存檔再rename，寫到一半被中斷也不會留下壞掉的cache
+	/// </summary>
+	class VulkanPipelineCache {
+	public:
+		VulkanPipelineCache() = default;
+		VulkanPipelineCache(const VulkanPipelineCache&) = delete;
+		VulkanPipelineCache& operator=(const VulkanPipelineCache&) = delete;
+
+		/// <summary>
+		/// 建立VkPipelineCache，directory裡有可以用的cache檔的話當作initial data
+		/// directory為空的話不讀也不存
+		/// </summary>
+		void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::filesystem::path& directory);
+
+		/// <summary>
+		/// 存檔後destroy，要在所有使用這個cache的pipeline建立完之後、device destroy之前呼叫
+		/// </summary>
+		void cleanUp();
+
+		VkPipelineCache getHandle() const { return m_cache; }
+
+	private:
+		/// <summary>
+		/// 讀取並驗證cache檔，回傳Vulkan的cache data (不含我們的header)
+		/// </summary>
+		std::vector<uint8_t> load() const;
+
+		void save() const;
+
+	private:
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkPipelineCache m_cache = VK_NULL_HANDLE;
+
+		VkPhysicalDeviceProperties m_properties{};
+		uint8_t m_deviceUUID[VK_UUID_SIZE]{};
+
+		/// <summary>
+		/// 空的話不存檔
+		/// </summary>
+		std::filesystem::path m_filepath;
+	};
+
+}
@@ -14,8 +14,10 @@ namespace PaperEngine {
     // convert matrix
     static glm::mat4 ToMatrix(const aiMatrix4x4& from);
     static void ProcessJointRelation(const aiNode* aiJointNode, Ref<ModelData> modelData, Ref<JointData> jointData);
+    static void ProcessJointPalette(const JointData& joint, const glm::mat4& parentTransformation, const glm::mat4& globalInverse,
+        const ModelData& modelData, std::vector<glm::mat4>& outPalette);
 
-    static bool ProcessMesh(const aiScene* aiScene, Ref<ModelData> modelData)
+    bool ModelLoader::BuildMeshData(const aiScene* aiScene, ModelData& modelData, MeshBuildData& outData)
     {
         if (!aiScene->HasMeshes()) {
             PE_CORE_ERROR("[ModelLoader] Scene does not contain mesh!");
@@ -36,26 +38,25 @@ namespace PaperEngine {
 
             for (uint32_t j = 0; j < aiMesh->mNumFaces; j++)
             {
-                const auto& aiFace = aiMesh->mFaces[i];
-                for (uint32_t k = 0; k < aiFace.mNumIndices; k++)
-                {
-                    totalIndices++;
-                }
+                totalIndices += aiMesh->mFaces[j].mNumIndices;
             }
         }
 
-        // create a mesh first
-        MeshHandle mesh = CreateRef<Mesh>();
-
-        std::vector<uint32_t> indices;
+        auto& indices = outData.indices;
+        auto& vertices = outData.vertices;
+        auto& boneInfos = outData.boneInfos;
+        indices.clear();
         indices.reserve(totalIndices);
-        std::vector<StaticVertex> vertices;
+        vertices.clear();
         vertices.reserve(totalVertices);
-        std::vector<SkeletalVertexInfo> boneInfos;
+        boneInfos.clear();
         if (hasBone)
         {
             boneInfos.resize(totalVertices);
         }
+        outData.subMeshes.clear();
+        outData.subMeshes.reserve(aiScene->mNumMeshes);
+        outData.hasBone = hasBone;
 
         uint32_t vertexIndexOffset = 0;
         uint32_t meshIndicesOffset = 0;
@@ -78,7 +79,7 @@ namespace PaperEngine {
             {
                 const auto aiBone = aiMesh->mBones[j];
 
-                auto& boneData = modelData->bones[aiBone->mName.C_Str()];
+                auto& boneData = modelData.bones[aiBone->mName.C_Str()];
 
                 boneData.id = currentBoneIndex;
                 boneData.offsetMatrix = ToMatrix(aiBone->mOffsetMatrix);
@@ -151,7 +152,7 @@ namespace PaperEngine {
             }
 
             // set the submesh info
-            auto& subMeshInfo = mesh->getSubMeshes().emplace_back();
+            auto& subMeshInfo = outData.subMeshes.emplace_back();
             subMeshInfo.indicesCount = subMeshIndicesCount;
             subMeshInfo.indicesOffset = meshIndicesOffset;
             subMeshInfo.materialIndex = aiMesh->mMaterialIndex;
@@ -160,20 +161,33 @@ namespace PaperEngine {
             vertexIndexOffset += aiMesh->mNumVertices;
         }
 
+        return true;
+    }
+
+    static bool ProcessMesh(const aiScene* aiScene, Ref<ModelData> modelData)
+    {
+        MeshBuildData buildData;
+        if (!ModelLoader::BuildMeshData(aiScene, *modelData, buildData))
+            return false;
+
+        // create a mesh first
+        MeshHandle mesh = CreateRef<Mesh>();
+        mesh->getSubMeshes() = std::move(buildData.subMeshes);
+
         // upload to gpu in mesh
         nvrhi::CommandListHandle cmd = Application::Get()->GetNVRHIDevice()->createCommandList();
 
         cmd->open();
-        mesh->loadIndexBuffer(cmd, indices.data(), totalIndices);
-        if (hasBone)
+        mesh->loadIndexBuffer(cmd, buildData.indices.data(), buildData.indices.size());
+        if (buildData.hasBone)
         {
             // Process Joint Relationship
             modelData->rootJoint = CreateRef<JointData>();
             ProcessJointRelation(aiScene->mRootNode, modelData, modelData->rootJoint);
-            mesh->loadSkeletalMesh(cmd, vertices, boneInfos);
+            mesh->loadSkeletalMesh(cmd, buildData.vertices, buildData.boneInfos);
         }
         else {
-            mesh->loadStaticMesh(cmd, vertices);
+            mesh->loadStaticMesh(cmd, buildData.vertices);
         }
         cmd->close();
         Application::Get()->GetNVRHIDevice()->executeCommandList(cmd);
@@ -204,6 +218,31 @@ namespace PaperEngine {
         }
     }
 
+    void ModelLoader::ComputeBonePalette(const ModelData& modelData, std::vector<glm::mat4>& outPalette)
+    {
+        outPalette.assign(modelData.bones.size(), glm::identity<glm::mat4>());
+        if (!modelData.rootJoint)
+            return;
+
+        const glm::mat4 globalInverse = glm::inverse(modelData.rootJoint->transformation);
+        ProcessJointPalette(*modelData.rootJoint, glm::identity<glm::mat4>(), globalInverse, modelData, outPalette);
+    }
+
+    static void ProcessJointPalette(const JointData& joint, const glm::mat4& parentTransformation, const glm::mat4& globalInverse,
+        const ModelData& modelData, std::vector<glm::mat4>& outPalette)
+    {
+        const glm::mat4 globalTransformation = parentTransformation * joint.transformation;
+        if (joint.boneId < outPalette.size())
+        {
+            // 這個joint是bone
+            const auto& boneData = modelData.bones.at(joint.name);
+            outPalette[joint.boneId] = globalInverse * globalTransformation * boneData.offsetMatrix;
+        }
+
+        for (const auto& child : joint.children)
+            ProcessJointPalette(*child, globalTransformation, globalInverse, modelData, outPalette);
+    }
+
     Ref<ModelData> ModelLoader::LoadFromAssimp(const std::filesystem::path& filePath)
     {
         Assimp::Importer importer;
@@ -4,9 +4,24 @@
 #include <PaperLoader/ModelData.h>
 
 #include <filesystem>
+#include <vector>
+
+struct aiScene;
 
 namespace PaperEngine {
 
+	/// <summary>
+	/// 從assimp scene整理出來，還沒上傳到GPU的mesh資料
+	/// </summary>
+	struct MeshBuildData
+	{
+		std::vector<StaticVertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<SkeletalVertexInfo> boneInfos;		// 沒有bone時是空的
+		std::vector<Mesh::SubMeshInfo> subMeshes;
+		bool hasBone = false;
+	};
+
 	/// <summary>
 	/// To use this loader, you need to initialize the engine first
 	/// </summary>
@@ -15,6 +30,19 @@ namespace PaperEngine {
 	public:
 
 		static Ref<ModelData> LoadFromAssimp(const std::filesystem::path& filePath);
+
+		/// <summary>
+		/// 把scene中所有的mesh合併成一個mesh的vertex/index (CPU only，不需要初始化engine)
+		/// bone會寫進modelData.bones
+		/// </summary>
+		static bool BuildMeshData(const aiScene* aiScene, ModelData& modelData, MeshBuildData& outData);
+
+		/// <summary>
+		/// 從joint tree算出bind pose的bone palette (SkinnedMeshComponent::bonePalette)
+		/// outPalette[BoneData::id] = root的inverse * joint的global transformation * offsetMatrix
+		/// 動畫系統可以用同樣的方式把joint的transformation換成這個frame的pose
+		/// </summary>
+		static void ComputeBonePalette(const ModelData& modelData, std::vector<glm::mat4>& outPalette);
 	};
 
 }
@@ -0,0 +1,116 @@
+﻿#include "MicroBench.h"
+
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <PaperEngine/utils/BoundingVolume.h>
+
+namespace {
+
+	using namespace PaperMicroBench;
+
+	/// <summary>
+	/// 跟PaperBench一樣，在 -1000 ~ 1000 的範圍內隨機放box
+	/// </summary>
+	std::vector<PaperEngine::AABB> GenerateAABBs(size_t count, uint32_t seed)
+	{
+		std::mt19937 gen(seed);
+		std::uniform_real_distribution<float> positionDist(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<float> extentDist(1.0f, 10.0f);
+
+		std::vector<PaperEngine::AABB> aabbs(count);
+		for (auto& aabb : aabbs) {
+			const glm::vec3 center(positionDist(gen), positionDist(gen), positionDist(gen));
+			const glm::vec3 extent(extentDist(gen), extentDist(gen), extentDist(gen));
+			aabb = PaperEngine::AABB(center - extent, center + extent);
+		}
+		return aabbs;
+	}
+
+	std::vector<glm::mat4> GenerateTransforms(size_t count, uint32_t seed)
+	{
+		std::mt19937 gen(seed);
+		std::uniform_real_distribution<float> positionDist(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<float> unitDist(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> angleDist(0.0f, 360.0f);
+
+		std::vector<glm::mat4> transforms(count);
+		for (auto& transform : transforms) {
+			glm::vec3 axis(unitDist(gen), unitDist(gen), unitDist(gen));
+			if (glm::length(axis) < 0.01f)
+				axis = glm::vec3(0, 1, 0);
+			transform = glm::translate(glm::mat4(1.0f), glm::vec3(positionDist(gen), positionDist(gen), positionDist(gen)));
+			transform = glm::rotate(transform, glm::radians(angleDist(gen)), glm::normalize(axis));
+		}
+		return transforms;
+	}
+
+	/// <summary>
+	/// SceneRenderer用的camera設定 (70 fov, 0.1 ~ 1000)
+	/// </summary>
+	glm::mat4 MakeViewProjection(float yaw)
+	{
+		const glm::mat4 projection = glm::perspective(glm::radians(70.0f), 1280.0f / 720.0f, 0.1f, 1000.0f);
+		const glm::vec3 forward(std::sin(glm::radians(yaw)), 0.0f, -std::cos(glm::radians(yaw)));
+		const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), forward, glm::vec3(0, 1, 0));
+		return projection * view;
+	}
+
+	void BM_FrustumExtract(State& state)
+	{
+		std::vector<glm::mat4> viewProjections(256);
+		for (size_t i = 0; i < viewProjections.size(); i++)
+			viewProjections[i] = MakeViewProjection(static_cast<float>(i));
+
+		size_t index = 0;
+		for (auto _ : state) {
+			PaperEngine::Frustum frustum = PaperEngine::Frustum::Extract(viewProjections[index]);
+			DoNotOptimize(frustum);
+			index = (index + 1) % viewProjections.size();
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations()));
+	}
+	PAPER_BENCHMARK(BM_FrustumExtract);
+
+	/// <summary>
+	/// MeshRenderer::processScene的culling
+	/// </summary>
+	void BM_FrustumIntersectAABB(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const auto aabbs = GenerateAABBs(count, 1);
+		const PaperEngine::Frustum frustum = PaperEngine::Frustum::Extract(MakeViewProjection(0.0f));
+
+		for (auto _ : state) {
+			uint32_t visible = 0;
+			for (const auto& aabb : aabbs) {
+				if (frustum.isIntersect(aabb))
+					visible++;
+			}
+			DoNotOptimize(visible);
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_FrustumIntersectAABB)->range(1000, 100000);
+
+	/// <summary>
+	/// 移動entity時更新world AABB
+	/// </summary>
+	void BM_AABBTransformed(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const auto aabbs = GenerateAABBs(count, 2);
+		const auto transforms = GenerateTransforms(count, 3);
+		std::vector<PaperEngine::AABB> results(count);
+
+		for (auto _ : state) {
+			for (size_t i = 0; i < count; i++)
+				results[i] = aabbs[i].transformed(transforms[i]);
+			ClobberMemory();
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_AABBTransformed)->range(1000, 100000);
+
+}
@@ -0,0 +1,91 @@
+﻿#include "MicroBench.h"
+
+#include <random>
+
+#include <PaperEngine/graphics/MeshRenderer.h>
+
+namespace {
+
+	using namespace PaperMicroBench;
+
+	/// <summary>
+	/// bucket只用pointer當key，不會dereference
+	/// 用aliasing constructor做出不擁有物件的Ref，不需要建立GPU資源
+	/// </summary>
+	template<typename T>
+	PaperEngine::Ref<T> MakeKey(uintptr_t id)
+	{
+		return PaperEngine::Ref<T>(PaperEngine::Ref<T>(), reinterpret_cast<T*>((id + 1) * alignof(std::max_align_t)));
+	}
+
+	struct DrawInput {
+		PaperEngine::Ref<PaperEngine::GraphicsPipeline> pipeline;
+		PaperEngine::Ref<PaperEngine::Material> material;
+		PaperEngine::Ref<PaperEngine::Mesh> mesh;
+		uint32_t subMeshIndex;
+		uint32_t bindlessIndex;
+		bool bindless;
+		glm::mat4 transform;
+	};
+
+	/// <summary>
+	/// 跟PaperBench default preset差不多的分布：4個pipeline (1個bindless)、32個material、16個mesh
+	/// </summary>
+	std::vector<DrawInput> GenerateDraws(size_t count, uint32_t seed)
+	{
+		constexpr uint32_t PipelineCount = 4;
+		constexpr uint32_t MaterialCount = 32;
+		constexpr uint32_t MeshCount = 16;
+
+		std::mt19937 gen(seed);
+		std::uniform_int_distribution<uint32_t> materialDist(0, MaterialCount - 1);
+		std::uniform_int_distribution<uint32_t> meshDist(0, MeshCount - 1);
+		std::uniform_int_distribution<uint32_t> subMeshDist(0, 1);
+
+		std::vector<DrawInput> draws(count);
+		for (size_t i = 0; i < count; i++) {
+			const uint32_t material = materialDist(gen);
+			const uint32_t pipeline = material % PipelineCount;
+
+			DrawInput& draw = draws[i];
+			draw.pipeline = MakeKey<PaperEngine::GraphicsPipeline>(pipeline);
+			draw.material = MakeKey<PaperEngine::Material>(material);
+			draw.mesh = MakeKey<PaperEngine::Mesh>(meshDist(gen));
+			draw.subMeshIndex = subMeshDist(gen);
+			draw.bindless = pipeline == 0;
+			draw.bindlessIndex = material;
+			draw.transform = glm::mat4(1.0f);
+			draw.transform[3] = glm::vec4(static_cast<float>(i), 0.0f, 0.0f, 1.0f);
+		}
+		return draws;
+	}
+
+	/// <summary>
+	/// MeshRenderer::addEntity的分類 + endFrame的clear，一個iteration是一個frame
+	/// </summary>
+	void BM_MeshRendererBuildDrawList(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const auto draws = GenerateDraws(count, 1);
+
+		PaperEngine::MeshRenderer::RenderData renderData;
+		for (auto _ : state) {
+			for (const auto& draw : draws) {
+				PaperEngine::MeshRenderer::InsertInstance(
+					renderData,
+					draw.pipeline,
+					draw.material,
+					draw.bindless,
+					draw.bindlessIndex,
+					draw.mesh,
+					draw.subMeshIndex,
+					draw.transform);
+			}
+			DoNotOptimize(renderData.size());
+			renderData.clear();
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_MeshRendererBuildDrawList)->range(1000, 100000);
+
+}
@@ -0,0 +1,290 @@
+﻿#include "MicroBench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <thread>
+
+namespace PaperMicroBench {
+
+#pragma region State
+
+	void State::startTiming()
+	{
+		m_running = true;
+		m_start = Clock::now();
+	}
+
+	void State::finishTiming()
+	{
+		if (!m_running)
+			return;
+		m_elapsedNs += std::chrono::duration<double, std::nano>(Clock::now() - m_start).count();
+		m_running = false;
+	}
+
+	void State::pauseTiming()
+	{
+		finishTiming();
+	}
+
+	void State::resumeTiming()
+	{
+		startTiming();
+	}
+
+#pragma endregion
+
+	namespace {
+
+		std::vector<std::unique_ptr<Benchmark>>& GetRegistry()
+		{
+			static std::vector<std::unique_ptr<Benchmark>> registry;
+			return registry;
+		}
+
+		/// <summary>
+		/// 一個benchmark (含arg) 的結果，時間都是每個iteration的ns
+		/// </summary>
+		struct Result {
+			std::string name;
+			uint64_t iterations = 0;
+			uint32_t repetitions = 0;
+			double median = 0.0;
+			double mean = 0.0;
+			double min = 0.0;
+			double max = 0.0;
+			double stddev = 0.0;
+			double itemsPerSecond = 0.0;
+			double bytesPerSecond = 0.0;
+		};
+
+		std::string MakeName(const Benchmark& benchmark, const std::vector<int64_t>& args)
+		{
+			std::string name = benchmark.getName();
+			for (int64_t arg : args)
+				name += "/" + std::to_string(arg);
+			return name;
+		}
+
+		/// <summary>
+		/// 跑一次iterations次
+		/// </summary>
+		State RunOnce(const Benchmark& benchmark, const std::vector<int64_t>& args, uint64_t iterations)
+		{
+			State state(iterations, args);
+			benchmark.getFunction()(state);
+			return state;
+		}
+
+		/// <summary>
+		/// 跟Google Benchmark一樣，iteration從1開始增加到一次run超過minTime
+		/// </summary>
+		uint64_t CalibrateIterations(const Benchmark& benchmark, const std::vector<int64_t>& args, double minTimeSeconds)
+		{
+			constexpr uint64_t MaxIterations = 1000000000;
+			const double minTimeNs = minTimeSeconds * 1e9;
+
+			uint64_t iterations = 1;
+			while (true) {
+				const State state = RunOnce(benchmark, args, iterations);
+				const double elapsed = state.getElapsedNanoseconds();
+				if (elapsed >= minTimeNs || iterations >= MaxIterations)
+					return iterations;
+
+				// 依照目前的速度預測，多估40%，最多一次乘10
+				double multiplier = elapsed > 0.0 ? minTimeNs * 1.4 / elapsed : 10.0;
+				multiplier = std::clamp(multiplier, 2.0, 10.0);
+				iterations = std::min<uint64_t>(MaxIterations, static_cast<uint64_t>(std::ceil(iterations * multiplier)));
+			}
+		}
+
+		Result RunBenchmark(const Benchmark& benchmark, const std::vector<int64_t>& args, const RunOptions& options)
+		{
+			Result result;
+			result.name = MakeName(benchmark, args);
+			result.iterations = CalibrateIterations(benchmark, args, options.minTimeSeconds);
+			result.repetitions = std::max(1u, options.repetitions);
+
+			std::vector<double> perIteration;
+			double itemsPerSecond = 0.0;
+			double bytesPerSecond = 0.0;
+			for (uint32_t i = 0; i < result.repetitions; i++) {
+				const State state = RunOnce(benchmark, args, result.iterations);
+				const double elapsed = state.getElapsedNanoseconds();
+				perIteration.push_back(elapsed / static_cast<double>(result.iterations));
+
+				if (elapsed > 0.0) {
+					itemsPerSecond += state.getItemsProcessed() * 1e9 / elapsed;
+					bytesPerSecond += state.getBytesProcessed() * 1e9 / elapsed;
+				}
+			}
+
+			const double count = static_cast<double>(perIteration.size());
+			double total = 0.0;
+			for (double value : perIteration)
+				total += value;
+			result.mean = total / count;
+
+			double variance = 0.0;
+			for (double value : perIteration)
+				variance += (value - result.mean) * (value - result.mean);
+			result.stddev = perIteration.size() > 1 ? std::sqrt(variance / (count - 1.0)) : 0.0;
+
+			std::sort(perIteration.begin(), perIteration.end());
+			result.min = perIteration.front();
+			result.max = perIteration.back();
+			const size_t middle = perIteration.size() / 2;
+			result.median = perIteration.size() % 2 == 0 ?
+				(perIteration[middle - 1] + perIteration[middle]) * 0.5 :
+				perIteration[middle];
+
+			result.itemsPerSecond = itemsPerSecond / count;
+			result.bytesPerSecond = bytesPerSecond / count;
+			return result;
+		}
+
+		/// <summary>
+		/// 名稱只有 [A-Za-z0-9_/] 所以不用escape
+		/// 欄位名稱跟Google Benchmark的JSON一樣，可以直接用compare.py之類的工具
+		/// </summary>
+		bool WriteJSON(const std::string& filepath, const std::vector<Result>& results, const RunOptions& options)
+		{
+			std::ofstream out(filepath);
+			if (!out.is_open())
+				return false;
+
+			out.precision(6);
+			out << std::fixed;
+			out << "{\n";
+			out << "  \"context\": {\n";
+			out << "    \"library\": \"PaperMicroBench\",\n";
+			out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#if defined(NDEBUG)
+			out << "    \"library_build_type\": \"release\",\n";
+#else
+			out << "    \"library_build_type\": \"debug\",\n";
+#endif
+			out << "    \"min_time\": " << options.minTimeSeconds << ",\n";
+			out << "    \"repetitions\": " << options.repetitions << "\n";
+			out << "  },\n";
+			out << "  \"benchmarks\": [\n";
+			for (size_t i = 0; i < results.size(); i++) {
+				const Result& result = results[i];
+				out << "    {\n";
+				out << "      \"name\": \"" << result.name << "\",\n";
+				out << "      \"run_type\": \"aggregate\",\n";
+				out << "      \"aggregate_name\": \"median\",\n";
+				out << "      \"iterations\": " << result.iterations << ",\n";
+				out << "      \"repetitions\": " << result.repetitions << ",\n";
+				out << "      \"real_time\": " << result.median << ",\n";
+				out << "      \"mean_time\": " << result.mean << ",\n";
+				out << "      \"min_time\": " << result.min << ",\n";
+				out << "      \"max_time\": " << result.max << ",\n";
+				out << "      \"stddev_time\": " << result.stddev << ",\n";
+				out << "      \"time_unit\": \"ns\"";
+				if (result.itemsPerSecond > 0.0)
+					out << ",\n      \"items_per_second\": " << result.itemsPerSecond;
+				if (result.bytesPerSecond > 0.0)
+					out << ",\n      \"bytes_per_second\": " << result.bytesPerSecond;
+				out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+			}
+			out << "  ]\n";
+			out << "}\n";
+			return true;
+		}
+
+		std::string FormatThroughput(double perSecond, const char* unit)
+		{
+			const char* prefixes[] = { "", "k", "M", "G", "T" };
+			size_t prefix = 0;
+			while (perSecond >= 1000.0 && prefix + 1 < std::size(prefixes)) {
+				perSecond /= 1000.0;
+				prefix++;
+			}
+			char buffer[64];
+			std::snprintf(buffer, sizeof(buffer), "%.2f %s%s/s", perSecond, prefixes[prefix], unit);
+			return buffer;
+		}
+
+	}
+
+	Benchmark* RegisterBenchmark(const char* name, BenchmarkFunction function)
+	{
+		auto& registry = GetRegistry();
+		registry.push_back(std::make_unique<Benchmark>(name, function));
+		return registry.back().get();
+	}
+
+	uint32_t RunBenchmarks(const RunOptions& options)
+	{
+		std::regex filter;
+		try {
+			filter = std::regex(options.filter);
+		}
+		catch (const std::regex_error&) {
+			std::fprintf(stderr, "Invalid filter regex '%s'.\n", options.filter.c_str());
+			return 0;
+		}
+
+		// 依名稱排序，輸出的順序固定
+		std::vector<const Benchmark*> benchmarks;
+		for (const auto& benchmark : GetRegistry())
+			benchmarks.push_back(benchmark.get());
+		std::sort(benchmarks.begin(), benchmarks.end(), [](const Benchmark* a, const Benchmark* b) {
+			return a->getName() < b->getName();
+			});
+
+		if (!options.listOnly) {
+			std::printf("%-48s %14s %14s %10s %12s %s\n", "Benchmark", "Median (ns)", "Min (ns)", "CV", "Iterations", "Throughput");
+			std::printf("%s\n", std::string(120, '-').c_str());
+		}
+
+		std::vector<Result> results;
+		for (const Benchmark* benchmark : benchmarks) {
+			std::vector<std::vector<int64_t>> argSets = benchmark->getArgSets();
+			if (argSets.empty())
+				argSets.push_back({});
+
+			for (const auto& args : argSets) {
+				const std::string name = MakeName(*benchmark, args);
+				if (!std::regex_search(name, filter))
+					continue;
+
+				if (options.listOnly) {
+					std::printf("%s\n", name.c_str());
+					continue;
+				}
+
+				const Result result = RunBenchmark(*benchmark, args, options);
+
+				std::string throughput;
+				if (result.itemsPerSecond > 0.0)
+					throughput = FormatThroughput(result.itemsPerSecond, "items");
+				if (result.bytesPerSecond > 0.0)
+					throughput += (throughput.empty() ? "" : ", ") + FormatThroughput(result.bytesPerSecond, "B");
+
+				const double cv = result.mean > 0.0 ? result.stddev / result.mean * 100.0 : 0.0;
+				std::printf("%-48s %14.1f %14.1f %9.2f%% %12llu %s\n",
+					result.name.c_str(), result.median, result.min, cv,
+					static_cast<unsigned long long>(result.iterations), throughput.c_str());
+				std::fflush(stdout);
+
+				results.push_back(result);
+			}
+		}
+
+		if (!options.outputPath.empty() && !options.listOnly) {
+			if (WriteJSON(options.outputPath, results, options))
+				std::printf("Result written to '%s'.\n", options.outputPath.c_str());
+			else
+				std::fprintf(stderr, "Could not open '%s'.\n", options.outputPath.c_str());
+		}
+
+		return static_cast<uint32_t>(results.size());
+	}
+
+}
@@ -0,0 +1,215 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace PaperMicroBench {
+
+	/// <summary>
+	/// 傳給每個benchmark function的狀態
+	/// 用法跟Google Benchmark一樣：
+	///		for (auto _ : state) { ... }
+	/// 迴圈外的準備工作不會被計時
+	/// </summary>
+	class State {
+	public:
+		/// <summary>
+		/// for (auto _ : state) 的 _，標記unused避免-Wunused-variable
+		/// </summary>
+#if defined(_MSC_VER)
+		struct Value {};
+#else
+		struct __attribute__((unused)) Value {};
+#endif
+
+		struct Iterator {
+			uint64_t remaining;
+			State* state;
+
+			bool operator!=(const Iterator&) const
+			{
+				if (remaining != 0)
+					return true;
+				state->finishTiming();
+				return false;
+			}
+
+			void operator++() { remaining--; }
+
+			Value operator*() const { return {}; }
+		};
+
+	public:
+		State(uint64_t iterations, const std::vector<int64_t>& args)
+			: m_iterations(iterations), m_args(args)
+		{
+		}
+
+		Iterator begin()
+		{
+			startTiming();
+			return { m_iterations, this };
+		}
+
+		Iterator end() { return { 0, this }; }
+
+		/// <summary>
+		/// 註冊時用arg(...)設定的參數
+		/// </summary>
+		int64_t range(size_t index = 0) const { return index < m_args.size() ? m_args[index] : 0; }
+
+		uint64_t iterations() const { return m_iterations; }
+
+		/// <summary>
+		/// 暫停計時，迴圈中需要重設資料時使用
+		/// </summary>
+		void pauseTiming();
+
+		void resumeTiming();
+
+		/// <summary>
+		/// 整個run處理了多少item/bytes，用來計算throughput
+		/// </summary>
+		void setItemsProcessed(int64_t items) { m_itemsProcessed = items; }
+
+		void setBytesProcessed(int64_t bytes) { m_bytesProcessed = bytes; }
+
+		int64_t getItemsProcessed() const { return m_itemsProcessed; }
+
+		int64_t getBytesProcessed() const { return m_bytesProcessed; }
+
+		/// <summary>
+		/// 計時的總時間 (ns)
+		/// </summary>
+		double getElapsedNanoseconds() const { return m_elapsedNs; }
+
+	private:
+		void startTiming();
+
+		void finishTiming();
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		uint64_t m_iterations;
+		const std::vector<int64_t>& m_args;
+
+		Clock::time_point m_start;
+		double m_elapsedNs = 0.0;
+		bool m_running = false;
+
+		int64_t m_itemsProcessed = 0;
+		int64_t m_bytesProcessed = 0;
+	};
+
+	typedef void (*BenchmarkFunction)(State&);
+
+	/// <summary>
+	/// 一個註冊的benchmark，每個arg會各自跑一次
+	/// 名稱為 "function/arg"
+	/// </summary>
+	class Benchmark {
+	public:
+		Benchmark(const std::string& name, BenchmarkFunction function)
+			: m_name(name), m_function(function)
+		{
+		}
+
+		/// <summary>
+		/// 加一組參數 (state.range(0))
+		/// </summary>
+		Benchmark* arg(int64_t value)
+		{
+			m_argSets.push_back({ value });
+			return this;
+		}
+
+		/// <summary>
+		/// 從start開始乘multiplier到limit (含) 的參數，例如 range(1000, 100000) => 1000, 10000, 100000
+		/// </summary>
+		Benchmark* range(int64_t start, int64_t limit, int64_t multiplier = 10)
+		{
+			for (int64_t value = start; value <= limit; value *= multiplier)
+				m_argSets.push_back({ value });
+			return this;
+		}
+
+		const std::string& getName() const { return m_name; }
+
+		BenchmarkFunction getFunction() const { return m_function; }
+
+		const std::vector<std::vector<int64_t>>& getArgSets() const { return m_argSets; }
+
+	private:
+		std::string m_name;
+		BenchmarkFunction m_function;
+		std::vector<std::vector<int64_t>> m_argSets;
+	};
+
+	/// <summary>
+	/// 在static initialization時註冊，用PAPER_BENCHMARK
+	/// </summary>
+	Benchmark* RegisterBenchmark(const char* name, BenchmarkFunction function);
+
+	struct RunOptions {
+		/// <summary>
+		/// 只跑名稱符合這個regex的benchmark
+		/// </summary>
+		std::string filter = ".*";
+		/// <summary>
+		/// 每次repetition至少要跑的時間，iteration數依此決定
+		/// </summary>
+		double minTimeSeconds = 0.5;
+		uint32_t repetitions = 5;
+		/// <summary>
+		/// 空的話不輸出JSON
+		/// </summary>
+		std::string outputPath;
+		bool listOnly = false;
+	};
+
+	/// <summary>
+	/// 跑所有符合filter的benchmark，結果印到console，指定outputPath時另外輸出JSON
+	/// 回傳跑了幾個benchmark
+	/// </summary>
+	uint32_t RunBenchmarks(const RunOptions& options);
+
+	/// <summary>
+	/// 避免compiler把沒有使用到的結果最佳化掉
+	/// </summary>
+	template<typename T>
+	inline void DoNotOptimize(T const& value)
+	{
+#if defined(_MSC_VER)
+		const volatile void* volatile sink = &value;
+		(void)sink;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	/// <summary>
+	/// 讓compiler認為所有記憶體都可能被讀寫
+	/// </summary>
+	inline void ClobberMemory()
+	{
+#if defined(_MSC_VER)
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : : "memory");
+#endif
+	}
+
+}
+
+#define PAPER_BENCHMARK_CONCAT2(a, b) a##b
+#define PAPER_BENCHMARK_CONCAT(a, b) PAPER_BENCHMARK_CONCAT2(a, b)
+#define PAPER_BENCHMARK(function) \
+	static ::PaperMicroBench::Benchmark* PAPER_BENCHMARK_CONCAT(s_benchmark_, __LINE__) = ::PaperMicroBench::RegisterBenchmark(#function, function)
@@ -0,0 +1,137 @@
+﻿#include "MicroBench.h"
+
+#include <algorithm>
+#include <memory>
+
+#include <assimp/scene.h>
+
+#include <PaperLoader/ModelLoader.h>
+
+namespace {
+
+	using namespace PaperMicroBench;
+
+	/// <summary>
+	/// 產生一個gridSize x gridSize的grid mesh (triangulated，有normal跟uv)
+	/// boneCount > 0時每個vertex綁4個bone
+	/// </summary>
+	aiMesh* CreateGridMesh(uint32_t gridSize, uint32_t boneCount)
+	{
+		auto* mesh = new aiMesh();
+		mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+
+		const uint32_t vertexCount = gridSize * gridSize;
+		mesh->mNumVertices = vertexCount;
+		mesh->mVertices = new aiVector3D[vertexCount];
+		mesh->mNormals = new aiVector3D[vertexCount];
+		mesh->mTextureCoords[0] = new aiVector3D[vertexCount];
+		mesh->mNumUVComponents[0] = 2;
+		for (uint32_t y = 0; y < gridSize; y++) {
+			for (uint32_t x = 0; x < gridSize; x++) {
+				const uint32_t index = y * gridSize + x;
+				mesh->mVertices[index] = aiVector3D(static_cast<float>(x), 0.0f, static_cast<float>(y));
+				mesh->mNormals[index] = aiVector3D(0.0f, 1.0f, 0.0f);
+				mesh->mTextureCoords[0][index] = aiVector3D(x / float(gridSize - 1), y / float(gridSize - 1), 0.0f);
+			}
+		}
+
+		const uint32_t quadCount = (gridSize - 1) * (gridSize - 1);
+		mesh->mNumFaces = quadCount * 2;
+		mesh->mFaces = new aiFace[mesh->mNumFaces];
+		uint32_t face = 0;
+		for (uint32_t y = 0; y + 1 < gridSize; y++) {
+			for (uint32_t x = 0; x + 1 < gridSize; x++) {
+				const uint32_t i0 = y * gridSize + x;
+				const uint32_t i1 = i0 + 1;
+				const uint32_t i2 = i0 + gridSize;
+				const uint32_t i3 = i2 + 1;
+				const uint32_t triangles[2][3] = { { i0, i2, i1 }, { i1, i2, i3 } };
+				for (const auto& triangle : triangles) {
+					aiFace& aiFace = mesh->mFaces[face++];
+					aiFace.mNumIndices = 3;
+					aiFace.mIndices = new unsigned int[3] { triangle[0], triangle[1], triangle[2] };
+				}
+			}
+		}
+
+		if (boneCount > 0) {
+			// 每個bone影響連續的一段vertex，跟相鄰3個bone重疊 => 每個vertex 4個weight
+			constexpr uint32_t BonesPerVertex = 4;
+			mesh->mNumBones = boneCount;
+			mesh->mBones = new aiBone*[boneCount];
+			for (uint32_t b = 0; b < boneCount; b++) {
+				auto* bone = new aiBone();
+				bone->mName = aiString("bone_" + std::to_string(b));
+
+				std::vector<aiVertexWeight> weights;
+				for (uint32_t v = 0; v < vertexCount; v++) {
+					const uint32_t firstBone = v * boneCount / vertexCount;
+					if (b >= firstBone && b < firstBone + BonesPerVertex)
+						weights.push_back(aiVertexWeight(v, 1.0f / BonesPerVertex));
+				}
+				bone->mNumWeights = static_cast<unsigned int>(weights.size());
+				bone->mWeights = new aiVertexWeight[weights.size()];
+				std::copy(weights.begin(), weights.end(), bone->mWeights);
+				mesh->mBones[b] = bone;
+			}
+		}
+
+		return mesh;
+	}
+
+	std::unique_ptr<aiScene> CreateGridScene(uint32_t meshCount, uint32_t vertexCountPerMesh, uint32_t boneCount)
+	{
+		uint32_t gridSize = 2;
+		while (gridSize * gridSize < vertexCountPerMesh)
+			gridSize++;
+
+		auto scene = std::make_unique<aiScene>();
+		scene->mNumMeshes = meshCount;
+		scene->mMeshes = new aiMesh*[meshCount];
+		for (uint32_t i = 0; i < meshCount; i++) {
+			scene->mMeshes[i] = CreateGridMesh(gridSize, boneCount);
+			scene->mMeshes[i]->mMaterialIndex = i;
+		}
+		return scene;
+	}
+
+	/// <summary>
+	/// ModelLoader::ProcessMesh在上傳GPU之前的部分
+	/// arg是vertex總數，分成4個subMesh
+	/// </summary>
+	void BM_ModelLoaderBuildMeshData(State& state)
+	{
+		constexpr uint32_t MeshCount = 4;
+		const uint32_t vertexCount = static_cast<uint32_t>(state.range(0));
+		const auto scene = CreateGridScene(MeshCount, vertexCount / MeshCount, 0);
+
+		PaperEngine::MeshBuildData buildData;
+		for (auto _ : state) {
+			PaperEngine::ModelData modelData;
+			PaperEngine::ModelLoader::BuildMeshData(scene.get(), modelData, buildData);
+			DoNotOptimize(buildData.vertices.data());
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * buildData.vertices.size()));
+	}
+	PAPER_BENCHMARK(BM_ModelLoaderBuildMeshData)->range(10000, 1000000);
+
+	/// <summary>
+	/// 有bone的mesh，每個vertex 4個weight
+	/// </summary>
+	void BM_ModelLoaderBuildSkinnedMeshData(State& state)
+	{
+		constexpr uint32_t BoneCount = 64;
+		const uint32_t vertexCount = static_cast<uint32_t>(state.range(0));
+		const auto scene = CreateGridScene(1, vertexCount, BoneCount);
+
+		PaperEngine::MeshBuildData buildData;
+		for (auto _ : state) {
+			PaperEngine::ModelData modelData;
+			PaperEngine::ModelLoader::BuildMeshData(scene.get(), modelData, buildData);
+			DoNotOptimize(buildData.boneInfos.data());
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * buildData.vertices.size()));
+	}
+	PAPER_BENCHMARK(BM_ModelLoaderBuildSkinnedMeshData)->range(10000, 100000);
+
+}
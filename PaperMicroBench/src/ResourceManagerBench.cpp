@@ -0,0 +1,83 @@
+﻿#include "MicroBench.h"
+
+#include <PaperEngine/resourceManager/ResourceManager.h>
+
+namespace {
+
+	using namespace PaperMicroBench;
+
+	struct BenchResource {
+		uint32_t value;
+	};
+
+	std::vector<std::string> GenerateNames(size_t count)
+	{
+		std::vector<std::string> names(count);
+		for (size_t i = 0; i < count; i++)
+			names[i] = "assets/bench/resource_" + std::to_string(i) + ".asset";
+		return names;
+	}
+
+	/// <summary>
+	/// 建立新的resource (write lock + 建立物件)
+	/// </summary>
+	void BM_ResourceManagerCreate(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const auto names = GenerateNames(count);
+		std::vector<PaperEngine::Ref<BenchResource>> resources(count);
+
+		for (auto _ : state) {
+			state.pauseTiming();
+			auto manager = std::make_unique<PaperEngine::ResourceManager>();
+			state.resumeTiming();
+
+			for (size_t i = 0; i < count; i++)
+				resources[i] = manager->create<BenchResource>(names[i], static_cast<uint32_t>(i));
+
+			state.pauseTiming();
+			manager.reset();
+			state.resumeTiming();
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_ResourceManagerCreate)->range(100, 10000);
+
+	/// <summary>
+	/// create一個已經存在的resource (只有read lock)
+	/// </summary>
+	void BM_ResourceManagerCreateExisting(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const auto names = GenerateNames(count);
+		PaperEngine::ResourceManager manager;
+		std::vector<PaperEngine::Ref<BenchResource>> resources(count);
+		for (size_t i = 0; i < count; i++)
+			resources[i] = manager.create<BenchResource>(names[i], static_cast<uint32_t>(i));
+
+		for (auto _ : state) {
+			for (size_t i = 0; i < count; i++)
+				DoNotOptimize(manager.create<BenchResource>(names[i], 0u));
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_ResourceManagerCreateExisting)->range(100, 10000);
+
+	void BM_ResourceManagerLoad(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const auto names = GenerateNames(count);
+		PaperEngine::ResourceManager manager;
+		std::vector<PaperEngine::Ref<BenchResource>> resources(count);
+		for (size_t i = 0; i < count; i++)
+			resources[i] = manager.create<BenchResource>(names[i], static_cast<uint32_t>(i));
+
+		for (auto _ : state) {
+			for (size_t i = 0; i < count; i++)
+				DoNotOptimize(manager.load<BenchResource>(names[i]));
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_ResourceManagerLoad)->range(100, 10000);
+
+}
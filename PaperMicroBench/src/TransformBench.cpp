@@ -0,0 +1,62 @@
+﻿#include "MicroBench.h"
+
+#include <random>
+
+#include <PaperEngine/utils/Transform.h>
+
+namespace {
+
+	using namespace PaperMicroBench;
+
+	std::vector<PaperEngine::Transform> GenerateTransforms(size_t count, uint32_t seed)
+	{
+		std::mt19937 gen(seed);
+		std::uniform_real_distribution<float> positionDist(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<float> unitDist(-1.0f, 1.0f);
+
+		std::vector<PaperEngine::Transform> transforms(count);
+		for (auto& transform : transforms) {
+			transform.setPosition(glm::vec3(positionDist(gen), positionDist(gen), positionDist(gen)));
+			transform.setRotation(glm::normalize(glm::quat(unitDist(gen), unitDist(gen), unitDist(gen), unitDist(gen))));
+			transform.setScale(glm::vec3(1.0f + unitDist(gen) * 0.5f));
+		}
+		return transforms;
+	}
+
+	/// <summary>
+	/// 每個frame都在動的entity：dirty之後重新計算matrix
+	/// </summary>
+	void BM_TransformUpdate(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		auto transforms = GenerateTransforms(count, 1);
+
+		for (auto _ : state) {
+			for (auto& transform : transforms) {
+				transform.getPosition().x += 0.01f;		// 設定dirty
+				DoNotOptimize(transform.matrix());
+			}
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_TransformUpdate)->range(1000, 100000);
+
+	/// <summary>
+	/// 靜止的entity：只有dirty檢查跟讀matrix
+	/// </summary>
+	void BM_TransformMatrixCached(State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		auto transforms = GenerateTransforms(count, 1);
+		for (const auto& transform : transforms)
+			DoNotOptimize(transform.matrix());
+
+		for (auto _ : state) {
+			for (const auto& transform : transforms)
+				DoNotOptimize(transform.matrix());
+		}
+		state.setItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+	}
+	PAPER_BENCHMARK(BM_TransformMatrixCached)->range(1000, 100000);
+
+}
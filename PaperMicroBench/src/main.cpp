@@ -0,0 +1,43 @@
+﻿#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <PaperEngine/core/Logger.h>
+
+#include "MicroBench.h"
+
+static void PrintUsage()
+{
+	std::printf("Usage: PaperMicroBench [--filter <regex>] [--min-time <seconds>] [--repetitions <n>] [--output <file.json>] [--list]\n");
+}
+
+int main(int argc, const char** argv)
+{
+	PaperMicroBench::RunOptions options;
+	for (int i = 1; i < argc; i++) {
+		const bool hasValue = i + 1 < argc;
+		if (std::strcmp(argv[i], "--filter") == 0 && hasValue)
+			options.filter = argv[++i];
+		else if (std::strcmp(argv[i], "--min-time") == 0 && hasValue)
+			options.minTimeSeconds = std::strtod(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--repetitions") == 0 && hasValue)
+			options.repetitions = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--output") == 0 && hasValue)
+			options.outputPath = argv[++i];
+		else if (std::strcmp(argv[i], "--list") == 0)
+			options.listOnly = true;
+		else {
+			PrintUsage();
+			return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	// ResourceManager::create會log，只留error避免量到console輸出
+	PaperEngine::Logger::Init();
+	PaperEngine::Logger::GetCoreLogger()->set_level(spdlog::level::err);
+
+	const uint32_t count = PaperMicroBench::RunBenchmarks(options);
+
+	PaperEngine::Logger::Shutdown();
+	return count > 0 || options.listOnly ? 0 : 1;
+}
@@ -11,6 +11,7 @@
 #include <PaperEngine/core/Mouse.h>
 #include <PaperEngine/core/Keyboard.h>
 #include <PaperEngine/events/ApplicationEvent.h>
+#include <PaperEngine/debug/FrameStats.h>
 
 
 #include <PaperLoader/ModelLoader.h>
@@ -357,7 +358,10 @@ public:
 		ImGui::Text("MeshRenderer");
 		ImGui::Text("    instance: %u", m_sceneRenderer->getMeshRenderer()->getTotalInstanceCount());
 		ImGui::Text("    drawcall: %u", m_sceneRenderer->getMeshRenderer()->getTotalDrawCallCount());
+		ImGui::Text("    indirect call: %u", m_sceneRenderer->getMeshRenderer()->getTotalIndirectCallCount());
 		ImGui::End();
+
+		PaperEngine::FrameStats::Get().drawImGui();
 	}
 
 	void onFinalRender(nvrhi::IFramebuffer* framebuffer) override {
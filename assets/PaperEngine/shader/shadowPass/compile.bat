@@ -0,0 +1,2 @@
+dxc -T vs_6_0 -E main_vs -spirv -fspv-target-env=vulkan1.2 -D TARGET_VULKAN shader.hlsl -Fo shader.vert.spv
+dxc -T vs_6_0 -E main_clear_vs -spirv -fspv-target-env=vulkan1.2 -D TARGET_VULKAN shader.hlsl -Fo shader.clear.vert.spv
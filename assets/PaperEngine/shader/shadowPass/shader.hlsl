@@ -0,0 +1,52 @@
+﻿
+
+#include "../../../shaders/utils/nvrhi_helper.hlsli"
+
+
+#pragma pack_matrix(row_major)
+
+// CascadedShadowPass
+// depth only，一個cascade一個binding set
+
+struct CascadeData
+{
+	float4x4 viewProj;
+};
+
+DECLARE_CONSTANT_BUFFER(CascadeData, g_cascadeData, 0, 0);
+
+struct EntityData
+{
+	float4x4 trans;
+};
+
+DECLARE_STRUCTURE_BUFFER_SRV(EntityData, g_entityData, 0, 0);
+
+
+struct VS_INPUT
+{
+	float3 pos : POSITION;
+	uint instanceID : SV_InstanceID;
+};
+
+struct PS_INPUT
+{
+	float4 pos : SV_Position;
+};
+
+PS_INPUT main_vs(VS_INPUT input)
+{
+	PS_INPUT output;
+	EntityData entityData = g_entityData[input.instanceID];
+	float4 worldPosition = mul(float4(input.pos, 1.0f), entityData.trans);
+	output.pos = mul(worldPosition, g_cascadeData.viewProj);
+	return output;
+}
+
+// PointShadowAtlas清除atlas中的一塊用
+// 蓋滿整個viewport的三角形，depth為1 (depth test為Always)
+float4 main_clear_vs(uint vertexID : SV_VertexID) : SV_Position
+{
+	float2 uv = float2((vertexID << 1) & 2, vertexID & 2);
+	return float4(uv * 2.0 - 1.0, 1.0, 1.0);
+}
@@ -0,0 +1 @@
+dxc -T cs_6_0 -E main_cs -spirv -fspv-target-env=vulkan1.2 -D TARGET_VULKAN skinning.hlsl -Fo skinning.comp.spv
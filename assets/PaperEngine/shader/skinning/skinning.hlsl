@@ -0,0 +1,86 @@
+﻿
+#include "../utils/nvrhi_helper.hlsli"
+
+#pragma pack_matrix(row_major)
+
+// SkinningPass
+// 一個instance一個dispatch，一個thread skin一個vertex
+// vertex都用ByteAddressBuffer讀寫，layout跟C++的StaticVertex / SkeletalVertexInfo一樣
+
+#define THREAD_GROUP_SIZE 64
+
+// StaticVertex: float3 position, float3 normal, float2 texcoord
+#define VERTEX_STRIDE 32
+// SkeletalVertexInfo: int4 boneIndices, float4 boneWeights
+#define BONE_INFO_STRIDE 32
+
+struct SkinningInstance
+{
+	uint vertexCount;
+	uint boneOffset;
+	uint boneCount;
+	uint outputOffset;
+};
+DECLARE_CONSTANT_BUFFER(SkinningInstance, g_instance, 0, 0);
+
+struct BoneMatrix
+{
+	float4x4 mat;
+};
+
+DECLARE_BYTE_ADDRESS_BUFFER_SRV(g_sourceVertices, 0, 0);
+DECLARE_BYTE_ADDRESS_BUFFER_SRV(g_sourceBoneInfos, 1, 0);
+DECLARE_STRUCTURE_BUFFER_SRV(BoneMatrix, g_bonePalette, 2, 0);
+
+DECLARE_RW_BYTE_ADDRESS_BUFFER_UAV(g_outputVertices, 0, 0);
+
+float4x4 GetBoneMatrix(int boneIndex)
+{
+	uint index = (uint)clamp(boneIndex, 0, (int)g_instance.boneCount - 1);
+	return g_bonePalette[g_instance.boneOffset + index].mat;
+}
+
+[numthreads(THREAD_GROUP_SIZE, 1, 1)]
+void main_cs(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint vertexIndex = dispatchThreadID.x;
+	if (vertexIndex >= g_instance.vertexCount)
+		return;
+
+	uint sourceAddress = vertexIndex * VERTEX_STRIDE;
+	float3 position = asfloat(g_sourceVertices.Load3(sourceAddress));
+	float3 normal = asfloat(g_sourceVertices.Load3(sourceAddress + 12));
+	uint2 texcoord = g_sourceVertices.Load2(sourceAddress + 24);
+
+	uint boneAddress = vertexIndex * BONE_INFO_STRIDE;
+	int4 boneIndices = asint(g_sourceBoneInfos.Load4(boneAddress));
+	float4 boneWeights = asfloat(g_sourceBoneInfos.Load4(boneAddress + 16));
+
+	// 沒有權重的vertex維持bind pose，權重總和不是1的話正規化
+	float totalWeight = dot(boneWeights, 1.0);
+	float4x4 skinMatrix = float4x4(
+		1, 0, 0, 0,
+		0, 1, 0, 0,
+		0, 0, 1, 0,
+		0, 0, 0, 1);
+	if (totalWeight > 0.0)
+	{
+		boneWeights /= totalWeight;
+		skinMatrix = GetBoneMatrix(boneIndices.x) * boneWeights.x;
+		[unroll]
+		for (uint i = 1; i < 4; i++)
+		{
+			if (boneWeights[i] > 0.0)
+				skinMatrix += GetBoneMatrix(boneIndices[i]) * boneWeights[i];
+		}
+	}
+
+	float3 skinnedPosition = mul(float4(position, 1.0), skinMatrix).xyz;
+	// bone沒有non-uniform scale，不用inverse transpose
+	float3 skinnedNormal = normalize(mul(float4(normal, 0.0), skinMatrix).xyz);
+
+	uint outputAddress = (g_instance.outputOffset + vertexIndex) * VERTEX_STRIDE;
+	g_outputVertices.Store3(outputAddress, asuint(skinnedPosition));
+	g_outputVertices.Store3(outputAddress + 12, asuint(skinnedNormal));
+	g_outputVertices.Store2(outputAddress + 24, texcoord);
+}
@@ -14,6 +14,9 @@
 
 #define VK_BINDING_TEXTURE(reg, dset)				VK_BINDING_SHADER_RESOURCE(reg, dset)
 
+// bindless descriptor table沒有偏移，binding為register space的順序
+#define VK_BINDING_BINDLESS(binding, dset)			[[vk::binding(binding, dset)]]
+
 #else
 #define VK_BINDING_SHADER_RESOURCE(reg, dset)
 #define VK_BINDING_SAMPLER(reg, dset)
@@ -22,6 +25,8 @@
 
 #define VK_BINDING_TEXTURE(reg, dset)
 
+#define VK_BINDING_BINDLESS(binding, dset)
+
 #endif
 
 #ifdef TARGET_D3D11
@@ -52,10 +57,19 @@
 #endif
 
 #define DECLARE_TEXTURE2D_SRV(name, reg, space) VK_BINDING_SHADER_RESOURCE(reg, space) Texture2D name : REGISTER_SRV(reg, space)
+#define DECLARE_TEXTURE2D_ARRAY_SRV(name, reg, space) VK_BINDING_SHADER_RESOURCE(reg, space) Texture2DArray name : REGISTER_SRV(reg, space)
+// shadow map之類的depth比較用
+#define DECLARE_SAMPLER_COMPARISON(name, reg, space) VK_BINDING_SAMPLER(reg, space) SamplerComparisonState name : REGISTER_SAMPLER(reg, space)
 // ty: 結構名稱
 // name: 這個變數名稱
 #define DECLARE_STRUCTURE_BUFFER_SRV(ty, name, reg, space) VK_BINDING_SHADER_RESOURCE(reg, space) StructuredBuffer<ty> name : REGISTER_SRV(reg, space)
 #define DECLARE_RW_STRUCTURE_BUFFER_UAV(ty, name, reg, space) VK_BINDING_UNORDERED_ACCESS(reg, space) RWStructuredBuffer<ty> name : REGISTER_UAV(reg, space)
 #define DECLARE_RW_BYTE_ADDRESS_BUFFER_UAV(name, reg, space) VK_BINDING_UNORDERED_ACCESS(reg, space) RWByteAddressBuffer name : REGISTER_UAV(reg, space)
+#define DECLARE_BYTE_ADDRESS_BUFFER_SRV(name, reg, space) VK_BINDING_SHADER_RESOURCE(reg, space) ByteAddressBuffer name : REGISTER_SRV(reg, space)
+
+// bindless (nvrhi descriptor table)
+// binding: 在BindlessLayoutDesc中register space的順序
+#define DECLARE_BINDLESS_TEXTURE2D_SRV(name, binding, space) VK_BINDING_BINDLESS(binding, space) Texture2D name[] : REGISTER_SRV(0, space)
+#define DECLARE_BINDLESS_SAMPLER(name, binding, space) VK_BINDING_BINDLESS(binding, space) SamplerState name[] : REGISTER_SAMPLER(0, space)
 
 #endif
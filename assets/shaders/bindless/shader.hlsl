@@ -0,0 +1,344 @@
+﻿
+
+#include "../utils/nvrhi_helper.hlsli"
+
+#pragma pack_matrix(row_major)
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Begin Global Data (Scene Renderer prepare)
+////////////////////////////////////////////////////////////////////////////////////////////
+struct GlobalData
+{
+	float4x4 proj;
+	float4x4 view;
+	float4x4 viewProj;
+	float3 cameraPos;
+	float padding0;			// 一定要pad
+	uint directionalLightCount;
+	uint pointLightCount;
+	uint spotLightCount;
+	uint numXSlices;
+	uint numYSlices;
+	uint numZSlices;
+	float nearPlane;
+	float farPlane;
+};
+
+DECLARE_CONSTANT_BUFFER(GlobalData, g_globalData, 0, 0);
+
+struct DirectionalLightData
+{
+	// 不使用float3的原因是因為他會被pad成16bytes
+	float x, y, z;		// direction vector
+	float r, g, b;
+};
+
+DECLARE_STRUCTURE_BUFFER_SRV(DirectionalLightData, g_directionalLightData, 0, 0);
+
+struct PointLightData
+{
+	float x, y, z;		// position vector
+	float r, g, b;
+	float radius;
+};
+
+DECLARE_STRUCTURE_BUFFER_SRV(PointLightData, g_pointLightData, 1, 0);
+DECLARE_STRUCTURE_BUFFER_SRV(uint, g_globalLightIndices, 2, 0);
+
+struct ClusterRange
+{
+	uint offset;
+	uint count;
+};
+DECLARE_STRUCTURE_BUFFER_SRV(ClusterRange, g_clusterRanges, 3, 0);
+
+// 跟CascadedShadowPass::MaxCascades一樣
+#define MAX_SHADOW_CASCADES 4
+
+struct ShadowData
+{
+	float4x4 cascadeViewProj[MAX_SHADOW_CASCADES];
+	float4 cascadeSplits;		// 每個cascade最遠的view space距離
+	float4 cascadeTexelSize;	// 每個cascade一個texel在world space的大小
+	uint cascadeCount;			// 0的話沒有shadow
+	uint lightIndex;			// g_directionalLightData中產生shadow的light
+	float normalBias;			// texel
+	float padding;
+};
+
+DECLARE_CONSTANT_BUFFER(ShadowData, g_shadowData, 1, 0);
+DECLARE_TEXTURE2D_ARRAY_SRV(g_shadowMap, 4, 0);
+DECLARE_SAMPLER_COMPARISON(g_shadowSampler, 0, 0);
+
+/// 回傳0 (在影子中) ~ 1
+float SampleDirectionalShadow(float3 worldPos, float3 normal, float viewDepth)
+{
+	if (g_shadowData.cascadeCount == 0 || viewDepth >= g_shadowData.cascadeSplits[g_shadowData.cascadeCount - 1])
+		return 1.0;
+
+	uint cascade = 0;
+	while (cascade + 1 < g_shadowData.cascadeCount && viewDepth >= g_shadowData.cascadeSplits[cascade])
+		cascade++;
+
+	// normal offset，texel越大偏移越多
+	float3 offsetPos = worldPos + normal * (g_shadowData.normalBias * g_shadowData.cascadeTexelSize[cascade]);
+	float4 shadowPos = mul(float4(offsetPos, 1.0), g_shadowData.cascadeViewProj[cascade]);
+	float3 coord = shadowPos.xyz / shadowPos.w;
+	// NVRHI的viewport跟D3D一樣y朝下
+	float2 uv = float2(coord.x * 0.5 + 0.5, 0.5 - coord.y * 0.5);
+
+	uint width, height, elements;
+	g_shadowMap.GetDimensions(width, height, elements);
+	float2 texelSize = 1.0 / float2(width, height);
+
+	// 3x3 PCF
+	float shadow = 0.0;
+	[unroll]
+	for (int y = -1; y <= 1; y++)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; x++)
+			shadow += g_shadowMap.SampleCmpLevelZero(g_shadowSampler, float3(uv + float2(x, y) * texelSize, cascade), coord.z);
+	}
+	return shadow / 9.0;
+}
+
+struct PointShadowData
+{
+	float4x4 faceViewProj[6];	// +X, -X, +Y, -Y, +Z, -Z
+	float4 faceRect[6];			// atlas中的uv offset (xy) 跟scale (zw)，zw為0代表這個face沒有shadow map
+	float normalBias;			// texel
+	float3 padding;
+};
+
+// 每個point light一個，0xffffffff代表沒有shadow
+DECLARE_STRUCTURE_BUFFER_SRV(uint, g_pointShadowIndices, 5, 0);
+DECLARE_STRUCTURE_BUFFER_SRV(PointShadowData, g_pointShadows, 6, 0);
+DECLARE_TEXTURE2D_SRV(g_pointShadowAtlas, 7, 0);
+
+/// 回傳0 (在影子中) ~ 1
+float SamplePointShadow(uint lightIndex, float3 lightPosition, float3 worldPos, float3 normal)
+{
+	uint shadowIndex = g_pointShadowIndices[lightIndex];
+	if (shadowIndex == 0xffffffff)
+		return 1.0;
+
+	// 用最大的軸選cube face
+	float3 toPixel = worldPos - lightPosition;
+	float3 absDir = abs(toPixel);
+	uint face;
+	if (absDir.x >= absDir.y && absDir.x >= absDir.z)
+		face = toPixel.x > 0 ? 0 : 1;
+	else if (absDir.y >= absDir.z)
+		face = toPixel.y > 0 ? 2 : 3;
+	else
+		face = toPixel.z > 0 ? 4 : 5;
+
+	PointShadowData shadow = g_pointShadows[shadowIndex];
+	float4 rect = shadow.faceRect[face];
+	if (rect.z == 0)
+		return 1.0;
+
+	uint width, height;
+	g_pointShadowAtlas.GetDimensions(width, height);
+	float2 texelSize = 1.0 / float2(width, height);
+
+	// 90度fov，這個距離一個texel在world space的大小
+	float texelWorldSize = 2.0 * max(absDir.x, max(absDir.y, absDir.z)) / (rect.z * width);
+	float3 offsetPos = worldPos + normal * (shadow.normalBias * texelWorldSize);
+	float4 shadowPos = mul(float4(offsetPos, 1.0), shadow.faceViewProj[face]);
+	float3 coord = shadowPos.xyz / shadowPos.w;
+	float2 uv = rect.xy + float2(coord.x * 0.5 + 0.5, 0.5 - coord.y * 0.5) * rect.zw;
+
+	// PCF不能取樣到atlas中旁邊的slot
+	float2 minUV = rect.xy + texelSize * 1.5;
+	float2 maxUV = rect.xy + rect.zw - texelSize * 1.5;
+
+	float result = 0.0;
+	[unroll]
+	for (int y = -1; y <= 1; y++)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; x++)
+			result += g_pointShadowAtlas.SampleCmpLevelZero(g_shadowSampler, clamp(uv + float2(x, y) * texelSize, minUV, maxUV), coord.z);
+	}
+	return result / 9.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// End Global Data
+////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Begin Static Mesh Renderer Data
+////////////////////////////////////////////////////////////////////////////////////////////
+struct EntityData
+{
+	float4x4 trans;
+};
+
+//struct BoneTransformation
+//{
+//	float4x4 trans;
+//};
+
+DECLARE_STRUCTURE_BUFFER_SRV(EntityData, g_entityData, 0, 1);
+// 每個instance的material index (BindlessMaterialTable)
+DECLARE_STRUCTURE_BUFFER_SRV(uint, g_entityMaterialIndex, 1, 1);
+////////////////////////////////////////////////////////////////////////////////////////////
+/// End Static Mesh Renderer Data
+////////////////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Begin Bindless Material Data
+////////////////////////////////////////////////////////////////////////////////////////////
+// 跟BindlessMaterialTable::MaterialParameterStride一樣
+#define MATERIAL_PARAMETER_STRIDE 256
+
+DECLARE_BYTE_ADDRESS_BUFFER_SRV(g_materialParams, 0, 2);
+DECLARE_BINDLESS_TEXTURE2D_SRV(g_bindlessTextures, 0, 3);
+DECLARE_BINDLESS_SAMPLER(g_bindlessSamplers, 1, 3);
+
+/// 你自己Material的data
+/// 對應Material::setOffset
+///		texture0: offset 0
+///		sampler0: offset 4
+struct MaterialParams
+{
+	uint texture0;
+	uint sampler0;
+};
+
+MaterialParams LoadMaterialParams(uint materialIndex)
+{
+	uint2 data = g_materialParams.Load2(materialIndex * MATERIAL_PARAMETER_STRIDE);
+	MaterialParams params;
+	params.texture0 = data.x;
+	params.sampler0 = data.y;
+	return params;
+}
+////////////////////////////////////////////////////////////////////////////////////////////
+/// End Bindless Material Data
+////////////////////////////////////////////////////////////////////////////////////////////
+
+struct VS_INPUT
+{
+	float3 pos : POSITION;
+	float3 normal : NORMAL;
+	float2 uv : TEXCOORD0;
+	uint instanceID : SV_InstanceID;
+};
+
+struct PS_INPUT
+{
+	// Pixel Shader 的 SV_Position input 為 Screen space
+	float4 pos : SV_Position;
+	float2 uv : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 worldPos : WORLD_POSITION;
+	float3 viewPos : VIEW_POSITION;
+	float4 clipPos : CLIP_POSITION;
+	nointerpolation uint materialIndex : MATERIAL_INDEX;
+};
+
+struct PS_OUTPUT
+{
+	float4 col : SV_Target0;
+};
+
+PS_INPUT main_vs(VS_INPUT input)
+{
+	PS_INPUT output;
+	EntityData entityData = g_entityData[input.instanceID];
+	float4 worldPosition = mul(float4(input.pos, 1.0f), entityData.trans);
+	float4 viewPosition = mul(worldPosition, g_globalData.view);
+	output.pos = mul(worldPosition, g_globalData.viewProj);
+	output.uv = input.uv;
+	output.normal = mul(float4(input.normal, 0.0), entityData.trans).xyz;
+	output.worldPos = worldPosition.xyz;
+	output.viewPos = viewPosition.xyz;
+	output.clipPos = output.pos;
+	output.materialIndex = g_entityMaterialIndex[input.instanceID];
+	return output;
+}
+
+PS_OUTPUT main_ps(PS_INPUT input)
+{
+	PS_OUTPUT output;
+	
+
+	/// Light calculation
+	float3 totalDiffuse = float3(0, 0, 0);
+	
+	// direction light
+	for (uint i = 0; i < g_globalData.directionalLightCount; i++)
+	{
+		DirectionalLightData lightData = g_directionalLightData[i];
+		float3 toLightVector = -float3(lightData.x, lightData.y, lightData.z);
+		
+		float3 unitNormal = normalize(input.normal);
+		float3 unitLightVector = normalize(toLightVector);
+		
+		float nDotl = dot(unitNormal, unitLightVector);
+		float brightness = max(0, nDotl);
+		if (i == g_shadowData.lightIndex && brightness > 0)
+			brightness *= SampleDirectionalShadow(input.worldPos, unitNormal, -input.viewPos.z);
+		float3 diffuse = brightness * float3(lightData.r, lightData.g, lightData.b);
+		
+		totalDiffuse += diffuse;
+
+	}
+
+	// --- Clustered point lights ---
+	float4 clipPos = input.clipPos;
+	float3 ndcPos = clipPos.xyz / clipPos.w;	
+	
+	uint clusterX = clamp(uint(floor((ndcPos.x + 1.0) * 0.5 * g_globalData.numXSlices)), 0, g_globalData.numXSlices - 1);
+	uint clusterY = clamp(uint(floor((ndcPos.y + 1.0) * 0.5 * g_globalData.numYSlices)), 0, g_globalData.numYSlices - 1);
+	
+	// NDC z → view space depth (DirectX 0~1)
+	float viewZ = g_globalData.nearPlane * g_globalData.farPlane / (g_globalData.farPlane - ndcPos.z * (g_globalData.farPlane - g_globalData.nearPlane));
+	// 對數分割 z → clusterZ
+	float slice = log(abs(input.viewPos.z) / g_globalData.nearPlane) / log(g_globalData.farPlane / g_globalData.nearPlane);
+	uint clusterZ = min(uint(floor(slice * g_globalData.numZSlices)), g_globalData.numZSlices - 1);
+	clusterZ = clamp(clusterZ, 0, g_globalData.numZSlices - 1);
+	//uint clusterZ = 0;
+	
+	uint clusterIndex = clusterX + clusterY * g_globalData.numXSlices + clusterZ * g_globalData.numXSlices * g_globalData.numYSlices;
+	ClusterRange range = g_clusterRanges[clusterIndex];
+	for (uint clusterLightIndex = 0; clusterLightIndex < range.count; clusterLightIndex++)
+	{
+		uint lightIdx = g_globalLightIndices[range.offset + clusterLightIndex];
+		PointLightData light = g_pointLightData[lightIdx];
+		
+		// -----------------------------------------------------------------------------
+		/// Modify this section for custom point light Lighting calculation
+		float3 toLightVector = float3(light.x, light.y, light.z) - input.worldPos;
+		float dist = max(length(toLightVector), 0.0001f);
+
+		float3 lightDir = toLightVector / dist; // let it unit
+		
+		float NDotL = max(dot(normalize(input.normal), lightDir), 0.0);
+		//float attenuation = (1.0 / max(1, dist * dist)) * (1 - pow(dist / light.radius, 4));
+		float attenuation = saturate(1.0f - (dist / light.radius)); // 線性衰減 0~1
+		attenuation *= attenuation; // 可選二次衰減效果
+		//float attenuation = 1;
+		if (NDotL > 0 && attenuation > 0)
+			attenuation *= SamplePointShadow(lightIdx, float3(light.x, light.y, light.z), input.worldPos, normalize(input.normal));
+		float3 diffuse = NDotL * attenuation * float3(light.r, light.g, light.b);
+		
+		totalDiffuse += diffuse;
+		
+		/// End Lighting calculation
+		// -----------------------------------------------------------------------------
+	}
+	/// End Light calculation
+	MaterialParams params = LoadMaterialParams(input.materialIndex);
+	Texture2D texture0 = g_bindlessTextures[NonUniformResourceIndex(params.texture0)];
+	SamplerState sampler0 = g_bindlessSamplers[NonUniformResourceIndex(params.sampler0)];
+	output.col = float4(totalDiffuse, 1.0) * texture0.Sample(sampler0, input.uv);
+	//output.col = float4(totalDiffuse, 1.0) * float4(1, 1, 0, 1);
+		
+	return output;
+}